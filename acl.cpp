@@ -35,15 +35,11 @@ bool Subnet::match(unsigned long client_ip) const
 	return (client_ip & mask) == (ip & mask);
 }
 
-string Subnet::toString() const
+unsigned int Subnet::getPrefix() const
 {
-	struct in_addr addr;
-	addr.s_addr = ip;
-	string result = inet_ntoa(addr);
-	
 	// Calculate CIDR prefix from mask
 	unsigned long host_mask = ntohl(mask);
-	int prefix = 0;
+	unsigned int prefix = 0;
 	for (int i = 31; i >= 0; i--)
 	{
 		if (host_mask & (1UL << i))
@@ -51,7 +47,16 @@ string Subnet::toString() const
 		else
 			break;
 	}
+	return prefix;
+}
+
+string Subnet::toString() const
+{
+	struct in_addr addr;
+	addr.s_addr = ip;
+	string result = inet_ntoa(addr);
 	
+	unsigned int prefix = getPrefix();
 	if (prefix != 32)
 	{
 		ostringstream ss;
@@ -86,6 +91,28 @@ void Acl::addSubnet(const string& subnet_str, Zone* zone)
 {
 	Subnet subnet(subnet_str);
 	entries.push_back(AclEntry(subnet, zone));
+	
+	// Index the subnet in the trie; of equal subnets the last one wins
+	unsigned int prefix = subnet.getPrefix();
+	unsigned long bits = ntohl(subnet.getIp());
+	if (trie.empty())
+		trie.push_back(TrieNode());
+	size_t node = 0;
+	for (unsigned int depth = 0; ; ++depth)
+	{
+		if (prefix > trie[node].deepest)
+			trie[node].deepest = prefix;
+		if (depth == prefix)
+			break;
+		int bit = (bits >> (31 - depth)) & 1;
+		if (trie[node].child[bit] < 0)
+		{
+			trie[node].child[bit] = (int)trie.size();
+			trie.push_back(TrieNode());
+		}
+		node = trie[node].child[bit];
+	}
+	trie[node].entry = (int)entries.size() - 1;
 }
 
 bool Acl::checkAccess(unsigned long client_ip, Zone** out_zone) const
@@ -102,25 +129,46 @@ bool Acl::checkAccess(unsigned long client_ip, Zone** out_zone) const
 	return false;
 }
 
-Zone* Acl::findMostSpecificMatch(unsigned long client_ip) const
+Zone* Acl::findMostSpecificMatch(unsigned long client_ip, unsigned int source_prefix,
+                                 unsigned int* scope) const
 {
-	Zone* best_match = NULL;
-	unsigned long best_mask = 0;
+	if (scope)
+		*scope = 0;
+	if (trie.empty())
+		return NULL;
+	if (source_prefix > 32)
+		source_prefix = 32;
 	
-	for (vector<AclEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+	// Walk down the client's bits, remembering the last subnet passed
+	unsigned long bits = ntohl(client_ip);
+	int best_match = -1;
+	unsigned int answer_scope;
+	size_t node = 0;
+	for (unsigned int depth = 0; ; ++depth)
 	{
-		if (it->subnet.match(client_ip))
+		const TrieNode& current = trie[node];
+		if (current.entry >= 0)
+			best_match = current.entry;
+		if (depth == source_prefix)
+		{
+			// Longer subnets inside the client's network decide for part of it
+			answer_scope = current.deepest;
+			break;
+		}
+		int next = current.child[(bits >> (31 - depth)) & 1];
+		if (next < 0)
 		{
-			unsigned long current_mask = ntohl(it->subnet.getMask());
-			if (current_mask >= best_mask)
-			{
-				best_mask = current_mask;
-				best_match = it->zone;
-			}
+			// No longer subnet contains the client. One bit more excludes
+			// those branching off here.
+			answer_scope = current.child[0] >= 0 || current.child[1] >= 0 ? depth + 1 : depth;
+			break;
 		}
+		node = next;
 	}
 	
-	return best_match;
+	if (scope)
+		*scope = answer_scope;
+	return best_match >= 0 ? entries[best_match].zone : NULL;
 }
 
 string Acl::toString() const
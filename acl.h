@@ -17,6 +17,7 @@ public:
 	
 	unsigned long getIp() const { return ip; }
 	unsigned long getMask() const { return mask; }
+	unsigned int getPrefix() const;
 	
 private:
 	unsigned long ip;
@@ -31,7 +32,13 @@ public:
 	
 	void addSubnet(const std::string& subnet_str, Zone* zone);
 	bool checkAccess(unsigned long client_ip, Zone** out_zone) const;
-	Zone* findMostSpecificMatch(unsigned long client_ip) const;
+	// The zone of the longest subnet containing `client_ip`, or NULL. When
+	// only the first `source_prefix` bits of the client are known (an EDNS
+	// client subnet), longer subnets are not matched, and `scope` is set to
+	// the prefix length of the client network the answer holds for: longer
+	// than `source_prefix` if longer subnets lie inside the client's.
+	Zone* findMostSpecificMatch(unsigned long client_ip, unsigned int source_prefix = 32,
+	                            unsigned int* scope = NULL) const;
 	size_t size() const { return entries.size(); }
 	std::string toString() const;
 	void propagateTSIGKey(const struct TSIG::Key* key);
@@ -48,7 +55,19 @@ public:
 	const std::vector<AclEntry>& getEntries() const { return entries; }
 	
 private:
+	// Binary trie over the subnets' prefix bits, most significant first: a
+	// lookup walks at most 32 nodes however many subnets there are
+	struct TrieNode
+	{
+		TrieNode() : entry(-1), deepest(0) { child[0] = child[1] = -1; }
+
+		int child[2];          // Indexes into trie, -1 for none
+		int entry;             // The entry whose subnet ends here, -1 for none
+		unsigned int deepest;  // Longest prefix at or below this node
+	};
+
 	std::vector<AclEntry> entries;
+	std::vector<TrieNode> trie;
 };
 
 #endif
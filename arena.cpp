@@ -0,0 +1,141 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <new>
+
+static const size_t ARENA_ALIGN = 16;
+
+// Every ArenaAllocated block starts with a header saying where it came
+// from, so operator delete knows whether to free it.
+static const size_t HEADER_SIZE = ARENA_ALIGN;
+enum BlockOrigin { FROM_HEAP = 0x48454150, FROM_ARENA = 0x4152454e };
+
+static thread_local Arena* t_current_arena = NULL;
+
+static size_t alignUp(size_t n)
+{
+	return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+Arena::Arena(size_t chunk_size)
+	: chunk_size_(alignUp(chunk_size)), chunk_(0), used_(0), allocations_(0), bytes_used_(0)
+{
+}
+
+Arena::~Arena()
+{
+	for (size_t i = 0; i < chunks_.size(); ++i)
+		free(chunks_[i].data);
+}
+
+void* Arena::allocate(size_t size)
+{
+	size = alignUp(size);
+
+	while (chunk_ < chunks_.size() && used_ + size > chunks_[chunk_].size)
+	{
+		chunk_++;
+		used_ = 0;
+	}
+
+	if (chunk_ == chunks_.size())
+	{
+		Chunk chunk;
+		chunk.size = size > chunk_size_ ? size : chunk_size_;
+		chunk.data = (char*)aligned_alloc(ARENA_ALIGN, chunk.size);
+		if (!chunk.data)
+			throw std::bad_alloc();
+		chunks_.push_back(chunk);
+		used_ = 0;
+	}
+
+	void* p = chunks_[chunk_].data + used_;
+	used_ += size;
+	allocations_++;
+	bytes_used_ += size;
+	return p;
+}
+
+void Arena::reset()
+{
+	// Keep the first chunk for the next request; oversized or extra
+	// chunks only come back when a request needed them.
+	for (size_t i = 1; i < chunks_.size(); ++i)
+		free(chunks_[i].data);
+	if (chunks_.size() > 1)
+		chunks_.resize(1);
+	chunk_ = 0;
+	used_ = 0;
+	allocations_ = 0;
+	bytes_used_ = 0;
+}
+
+Arena& Arena::forThread()
+{
+	static thread_local Arena arena;
+	return arena;
+}
+
+Arena* Arena::current()
+{
+	return t_current_arena;
+}
+
+Arena::Scope::Scope(Arena& arena)
+	: arena_(arena), previous_(t_current_arena)
+{
+	t_current_arena = &arena_;
+}
+
+Arena::Scope::~Scope()
+{
+	t_current_arena = previous_;
+	arena_.reset();
+}
+
+Arena::Suspend::Suspend()
+	: previous_(t_current_arena)
+{
+	t_current_arena = NULL;
+}
+
+Arena::Suspend::~Suspend()
+{
+	t_current_arena = previous_;
+}
+
+void* ArenaAllocated::operator new(size_t size)
+{
+	char* block;
+	if (t_current_arena)
+	{
+		block = (char*)t_current_arena->allocate(size + HEADER_SIZE);
+		*(unsigned int*)block = FROM_ARENA;
+	}
+	else
+	{
+		block = (char*)::operator new(size + HEADER_SIZE);
+		*(unsigned int*)block = FROM_HEAP;
+	}
+	return block + HEADER_SIZE;
+}
+
+void ArenaAllocated::operator delete(void* p)
+{
+	if (!p)
+		return;
+	char* block = (char*)p - HEADER_SIZE;
+	// Arena blocks are reclaimed when their arena is reset
+	if (*(unsigned int*)block == FROM_HEAP)
+		::operator delete(block);
+}
+
+void* ArenaAllocated::operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void ArenaAllocated::operator delete[](void* p)
+{
+	operator delete(p);
+}
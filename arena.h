@@ -0,0 +1,126 @@
+#ifndef HAVE_ARENA_H
+#define HAVE_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Per-thread bump allocator for objects that only live while one request
+// is handled (the decoded Message, its RRs, the reply and its answers).
+//
+// An Arena::Scope makes an arena current for the calling thread; every
+// ArenaAllocated object created inside it is carved out of the arena and
+// `delete` only runs its destructor. When the scope ends the whole arena
+// is reset in one step. Outside a scope ArenaAllocated objects come from
+// the heap as usual, so code that creates long-lived objects (zone
+// records, caches) while a scope may be active must use Arena::Suspend.
+class Arena
+{
+public:
+	explicit Arena(size_t chunk_size = 16384);
+	~Arena();
+
+	void* allocate(size_t size);
+	void reset();
+
+	size_t allocations() const { return allocations_; }
+	size_t bytesUsed() const { return bytes_used_; }
+
+	// Arena of the calling thread, created on first use
+	static Arena& forThread();
+	// Arena new ArenaAllocated objects go to on this thread, or NULL
+	static Arena* current();
+
+	class Scope
+	{
+	public:
+		explicit Scope(Arena& arena);
+		~Scope();
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+		Arena& arena_;
+		Arena* previous_;
+	};
+
+	class Suspend
+	{
+	public:
+		Suspend();
+		~Suspend();
+	private:
+		Suspend(const Suspend&);
+		Suspend& operator=(const Suspend&);
+		Arena* previous_;
+	};
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	struct Chunk
+	{
+		char* data;
+		size_t size;
+	};
+
+	size_t chunk_size_;
+	std::vector<Chunk> chunks_;
+	size_t chunk_;       // Index of the chunk being filled
+	size_t used_;        // Bytes used in that chunk
+	size_t allocations_;
+	size_t bytes_used_;
+};
+
+// Base for classes whose instances may live in the current Arena
+class ArenaAllocated
+{
+public:
+	static void* operator new(size_t size);
+	static void operator delete(void* p);
+	static void* operator new[](size_t size);
+	static void operator delete[](void* p);
+};
+
+// Standard allocator for the buffers of containers that live as long as
+// the request, such as the sections of a Message. It binds to the arena
+// current when the container is created (or copied), so a container made
+// outside any scope keeps using the heap even if it grows inside one.
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator() : arena_(Arena::current()) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+	T* allocate(size_t n)
+	{
+		if (arena_)
+			return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		// Arena buffers are reclaimed when their arena is reset
+		if (!arena_)
+			::operator delete(p);
+	}
+
+	// Copies bind to the arena current where they are made, like new objects
+	ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+	Arena* arena() const { return arena_; }
+
+private:
+	Arena* arena_;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
+
+#endif
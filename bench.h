@@ -0,0 +1,56 @@
+#ifndef HAVE_BENCH_H
+#define HAVE_BENCH_H
+
+// Timing harness shared by the bench_* programs. Every result is printed
+// as one line of key=value pairs, so runs can be diffed or fed to scripts:
+//   benchmark=<name> [<param>=<value> ...] ns_per_op=<float> ops=<count>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace bench {
+
+// Minimum wall time spent on each benchmark
+inline std::chrono::milliseconds& minTime()
+{
+	static std::chrono::milliseconds t(300);
+	return t;
+}
+
+// Results are added here so the compiler cannot drop the work
+inline volatile size_t& sink()
+{
+	static volatile size_t s;
+	return s;
+}
+
+// Calls `body` (which returns a value derived from its work) until
+// minTime() has passed; each call counts as `ops_per_call` operations.
+// `params` is printed between the name and the timing, e.g. "records=1000".
+template <typename F>
+void run(const std::string& name, const std::string& params, size_t ops_per_call, F body)
+{
+	typedef std::chrono::steady_clock clock;
+	size_t calls = 0;
+	size_t total = 0;
+	clock::time_point start = clock::now();
+	clock::time_point end;
+	do
+	{
+		for (int i = 0; i < 16; ++i, ++calls)
+			total += body();
+		end = clock::now();
+	} while (end - start < minTime());
+	sink() = total;
+
+	double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	size_t ops = calls * ops_per_call;
+	printf("benchmark=%s%s%s ns_per_op=%.2f ops=%zu\n", name.c_str(),
+	       params.empty() ? "" : " ", params.c_str(), ns / ops, ops);
+	fflush(stdout);
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,464 @@
+// Microbenchmarks for the request hot paths: message decoding and encoding,
+// name decompression, record lookup, zone selection, ACL view selection,
+// TSIG verification and response rate limiting, over synthetic zones, zone sets and ACLs of the sizes
+// given on the command line. Build and run with `make bench`.
+//
+// Usage: bench_hotpaths [--records=N,...] [--zones=N,...] [--subnets=N,...]
+//                       [--filter=SUBSTRING] [--min-time-ms=MS]
+//
+// Output is one line per benchmark (see bench.h), e.g.
+//   benchmark=find_matches_hit records=1000 ns_per_op=812.40 ops=368640
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "acl.h"
+#include "arena.h"
+#include "cookie.h"
+#include "message.h"
+#include "name_table.h"
+#include "query_processor.h"
+#include "rate_limit.h"
+#include "rr.h"
+#include "rropt.h"
+#include "tsig.h"
+#include "zone.h"
+#include "zone_authority.h"
+
+using namespace std;
+using bench::run;
+
+namespace {
+
+struct Options
+{
+	vector<unsigned long> records;
+	vector<unsigned long> zones;
+	vector<unsigned long> subnets;
+	string filter;
+};
+
+bool selected(const Options& options, const char* name)
+{
+	return options.filter.empty() || strstr(name, options.filter.c_str()) != NULL;
+}
+
+string param(const char* key, unsigned long value)
+{
+	ostringstream ss;
+	ss << key << "=" << value;
+	return ss.str();
+}
+
+// Parses "1,1000,100000" into `out`; every value must lie in [low, high]
+bool parseSizes(const char* arg, const char* key, unsigned long low, unsigned long high,
+                vector<unsigned long>& out)
+{
+	out.clear();
+	stringstream ss(arg);
+	string item;
+	while (getline(ss, item, ','))
+	{
+		char* end = NULL;
+		unsigned long value = strtoul(item.c_str(), &end, 10);
+		if (item.empty() || *end != '\0' || value < low || value > high)
+		{
+			cerr << "--" << key << ": sizes must be between " << low << " and " << high << endl;
+			return false;
+		}
+		out.push_back(value);
+	}
+	return !out.empty();
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		const char* value = strchr(arg, '=');
+		if (value == NULL)
+		{
+			cerr << "Unknown argument: " << arg << endl;
+			return false;
+		}
+		string key(arg, value - arg);
+		++value;
+
+		if (key == "--records")
+		{
+			if (!parseSizes(value, "records", 1, 1000000, options.records))
+				return false;
+		}
+		else if (key == "--zones")
+		{
+			if (!parseSizes(value, "zones", 1, 10000, options.zones))
+				return false;
+		}
+		else if (key == "--subnets")
+		{
+			if (!parseSizes(value, "subnets", 1, 1000, options.subnets))
+				return false;
+		}
+		else if (key == "--filter")
+			options.filter = value;
+		else if (key == "--min-time-ms")
+			bench::minTime() = chrono::milliseconds(strtoul(value, NULL, 10));
+		else
+		{
+			cerr << "Unknown argument: " << arg << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// --- Synthetic data ----------------------------------------------------------
+
+void initMessage(Message& msg, bool query)
+{
+	msg.id = 0x1234;
+	msg.query = query;
+	msg.opcode = Message::QUERY;
+	msg.authoritative = !query;
+	msg.truncation = false;
+	msg.recursiondesired = true;
+	msg.recursionavailable = false;
+	msg.rcode = Message::CODENOERROR;
+}
+
+RR* makeQuestion(const string& name, RR::RRType type)
+{
+	RR* q = RR::createByType(type);
+	q->name = name;
+	q->type = type;
+	q->rrclass = RR::CLASSIN;
+	q->query = true;
+	return q;
+}
+
+// A query as a resolver sends it: one question and an EDNS OPT record
+unsigned int packQuery(const string& name, RR::RRType type, char* packet, unsigned int len)
+{
+	Message query;
+	initMessage(query, true);
+	query.qd.push_back(makeQuestion(name, type));
+	query.ar.push_back(new RROPT());
+
+	unsigned int size = 0;
+	query.pack(packet, len, size);
+	return size;
+}
+
+// "bench.test." with `count` A records. Every hundredth host lives one
+// label deeper, under "sub.bench.test.", for the wildcard lookup.
+Zone* makeZone(unsigned long count)
+{
+	Zone* zone = new Zone();
+	zone->name = "bench.test.";
+	NameTable& names = NameTable::global();
+	for (unsigned long i = 0; i < count; ++i)
+	{
+		ostringstream name;
+		name << "host" << i << (i % 100 == 0 ? ".sub" : "") << ".bench.test.";
+		unsigned char address[4] = {10, (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i};
+		zone->addRecord(names.intern(name.str()), RR::A, RR::CLASSIN, 300, (const char*)address, 4);
+	}
+	zone->shrinkToFit();
+	return zone;
+}
+
+// --- Benchmarks --------------------------------------------------------------
+
+void benchMessages(const Options& options)
+{
+	Arena arena;
+
+	if (selected(options, "message_unpack"))
+	{
+		char packet[512];
+		unsigned int size = packQuery("www.example.com.", RR::A, packet, sizeof(packet));
+		run("message_unpack", "", 1, [&]() {
+			Arena::Scope scope(arena);
+			Message msg;
+			unsigned int offset = 0;
+			msg.unpack(packet, size, offset);
+			return (size_t)msg.qd.size();
+		});
+	}
+
+	if (selected(options, "message_pack"))
+	{
+		// A reply with the question, four answers and EDNS
+		Message reply;
+		initMessage(reply, false);
+		reply.qd.push_back(makeQuestion("www.example.com.", RR::A));
+		for (int i = 0; i < 4; ++i)
+		{
+			RR* rr = RR::createByType(RR::A);
+			rr->name = "www.example.com.";
+			rr->type = RR::A;
+			rr->rrclass = RR::CLASSIN;
+			rr->ttl = 300;
+			rr->query = false;
+			unsigned char address[4] = {192, 0, 2, (unsigned char)i};
+			rr->rdata.assign((const char*)address, 4);
+			reply.an.push_back(rr);
+		}
+		reply.ar.push_back(new RROPT());
+
+		char packet[4096];
+		run("message_pack", "", 1, [&]() {
+			unsigned int offset = 0;
+			reply.pack(packet, sizeof(packet), offset);
+			return (size_t)offset;
+		});
+	}
+
+	if (selected(options, "rr_unpack_name"))
+	{
+		// "www.example.com." at offset 12, then "mail" plus a pointer to
+		// "example.com." inside it, as answer sections usually look
+		static const char wire[] =
+			"\0\0\0\0\0\0\0\0\0\0\0\0"
+			"\3www\7example\3com\0"
+			"\4mail\xC0\x10";
+		char packet[sizeof(wire)];
+		memcpy(packet, wire, sizeof(wire));
+		unsigned int plain = 12;
+		unsigned int compressed = 12 + 17;
+
+		run("rr_unpack_name", "compression=none", 1, [&]() {
+			unsigned int offset = plain;
+			return RR::unpackName(packet, sizeof(packet) - 1, offset).length();
+		});
+		run("rr_unpack_name", "compression=pointer", 1, [&]() {
+			unsigned int offset = compressed;
+			return RR::unpackName(packet, sizeof(packet) - 1, offset).length();
+		});
+	}
+
+	if (selected(options, "tsig_verify"))
+	{
+		TSIG::Key key;
+		key.name = "bench-key.example.com.";
+		key.algorithm = TSIG::HMAC_SHA256;
+		key.secret = "K2tf3TRrmE7TJd+m2NPBuw==";
+		key.decoded_secret = TSIG::base64Decode(key.secret);
+
+		// sign() repacks the message into a 64 KiB buffer
+		vector<char> packet(65536);
+		Message signed_query;
+		initMessage(signed_query, true);
+		signed_query.qd.push_back(makeQuestion("www.example.com.", RR::A));
+		unsigned int size = 0;
+		signed_query.pack(&packet[0], packet.size(), size);
+		string error;
+		TSIG::sign(&signed_query, &packet[0], size, &key, signed_query.id, error);
+
+		Message msg;
+		unsigned int offset = 0;
+		if (!msg.unpack(&packet[0], size, offset) || !TSIG::verify(&msg, &packet[0], size, &key, error))
+		{
+			cerr << "tsig_verify: signed message does not verify: " << error << endl;
+			return;
+		}
+		run("tsig_verify", "algorithm=hmac-sha256", 1, [&]() {
+			string err;
+			return (size_t)TSIG::verify(&msg, &packet[0], size, &key, err);
+		});
+	}
+}
+
+void benchFindMatches(const Options& options)
+{
+	if (!selected(options, "find_matches"))
+		return;
+
+	Arena arena;
+	for (size_t s = 0; s < options.records.size(); ++s)
+	{
+		unsigned long count = options.records[s];
+		Zone* zone = makeZone(count);
+		string params = param("records", count);
+
+		ostringstream hit_name;
+		unsigned long last = count - 1;
+		hit_name << "host" << last << (last % 100 == 0 ? ".sub" : "") << ".bench.test.";
+
+		// Questions are resolved against the name table, as Message::unpack does
+		RR* hit = makeQuestion(hit_name.str(), RR::A);
+		hit->name_id = NameTable::global().find(hit->name);
+		RR* miss = makeQuestion("missing.bench.test.", RR::A);
+		miss->name_id = NameTable::global().find(miss->name);
+		RR* wildcard = makeQuestion("*.sub.bench.test.", RR::A);
+		wildcard->name_id = NameTable::global().find(wildcard->name);
+
+		struct { const char* name; RR* query; } cases[] = {
+			{"find_matches_hit", hit},
+			{"find_matches_miss", miss},
+			{"find_matches_wildcard", wildcard},
+		};
+		for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+		{
+			if (!selected(options, cases[c].name))
+				continue;
+			RR* query = cases[c].query;
+			run(cases[c].name, params, 1, [&]() {
+				Arena::Scope scope(arena);
+				vector<RR*> matches;
+				QueryProcessor::findMatches(query, *zone, matches);
+				for (size_t i = 0; i < matches.size(); ++i)
+					delete matches[i];
+				return matches.size();
+			});
+		}
+
+		delete hit;
+		delete miss;
+		delete wildcard;
+		delete zone;
+	}
+}
+
+void benchFindZone(const Options& options)
+{
+	if (!selected(options, "find_zone_for_name"))
+		return;
+
+	for (size_t s = 0; s < options.zones.size(); ++s)
+	{
+		unsigned long count = options.zones[s];
+		vector<Zone*> zones;
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			ostringstream name;
+			name << "zone" << i << ".bench.test.";
+			zones.push_back(new Zone());
+			zones.back()->name = name.str();
+		}
+		ZoneAuthority authority(zones);
+
+		// The zone added last, with a name one label below its apex
+		ostringstream query;
+		query << "www.zone" << (count - 1) << ".bench.test.";
+		string qname = query.str();
+		unsigned long client = htonl(0x7F000001);
+
+		run("find_zone_for_name", param("zones", count), 1, [&]() {
+			return (size_t)authority.findZoneForName(qname, client).found;
+		});
+
+		for (size_t i = 0; i < zones.size(); ++i)
+			delete zones[i];
+	}
+}
+
+void benchAcl(const Options& options)
+{
+	if (!selected(options, "acl_find_most_specific"))
+		return;
+
+	for (size_t s = 0; s < options.subnets.size(); ++s)
+	{
+		unsigned long count = options.subnets[s];
+
+		// A /8 covering everything, then /24s inside it; the client sits in
+		// the last /24, so the lookup has to weigh two matches
+		Acl acl;
+		Zone* view = new Zone();
+		view->name = "bench.test.";
+		acl.addSubnet("10.0.0.0/8", view);
+		for (unsigned long i = 1; i < count; ++i)
+		{
+			ostringstream subnet;
+			subnet << "10." << ((i >> 8) & 0xFF) << "." << (i & 0xFF) << ".0/24";
+			acl.addSubnet(subnet.str(), view);
+		}
+		unsigned long last = count - 1;
+		unsigned long client = htonl(0x0A000000 | ((last & 0xFFFF) << 8) | 7);
+
+		run("acl_find_most_specific", param("subnets", count), 1, [&]() {
+			return (size_t)(acl.findMostSpecificMatch(client) != NULL);
+		});
+	}
+}
+
+void benchRateLimit(const Options& options)
+{
+	if (!selected(options, "rate_limit_check"))
+		return;
+
+	// Under the rate, as most clients are, and over it, as a flood is
+	RateLimiter::Config config;
+	config.rate[RateLimiter::RESPONSE] = RateLimiter::MAX_RATE;
+	RateLimiter limiter;
+	limiter.configure(config);
+	IpAddress client = IpAddress::fromIpv4(htonl(0xC0000201));
+	string name = "www.example.com.";
+	unsigned long i = 0;
+	run("rate_limit_check", "clients=many", 1, [&]() {
+		++i;
+		return (size_t)limiter.check(IpAddress::fromIpv4(htonl(0x0A000000 | (i << 8))), RateLimiter::RESPONSE, name,
+		                             RR::A, 100);
+	});
+	run("rate_limit_check", "clients=one", 1, [&]() {
+		return (size_t)limiter.check(client, RateLimiter::RESPONSE, name, RR::A, 100);
+	});
+}
+
+void benchCookies(const Options& options)
+{
+	if (!selected(options, "cookie_check"))
+		return;
+
+	// A returning client's cookie, and a forged one that is checked against
+	// both secrets
+	DnsCookies cookies;
+	IpAddress client;
+	client.parse("192.0.2.1");
+	string valid = cookies.reply(string(8, 'c'), client, 100);
+	string forged = valid;
+	forged[23] ^= 1;
+	run("cookie_check", "cookie=valid", 1, [&]() {
+		return (size_t)cookies.check(valid, client, 100);
+	});
+	run("cookie_check", "cookie=forged", 1, [&]() {
+		return (size_t)cookies.check(forged, client, 100);
+	});
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	Options options;
+	options.records.push_back(1);
+	options.records.push_back(1000);
+	options.records.push_back(100000);
+	options.zones.push_back(1);
+	options.zones.push_back(100);
+	options.zones.push_back(10000);
+	options.subnets.push_back(1);
+	options.subnets.push_back(100);
+	options.subnets.push_back(1000);
+
+	if (!parseOptions(argc, argv, options))
+	{
+		cerr << "Usage: " << argv[0] << " [--records=N,...] [--zones=N,...] [--subnets=N,...]"
+		     << " [--filter=SUBSTRING] [--min-time-ms=MS]" << endl;
+		return 1;
+	}
+
+	benchMessages(options);
+	benchFindMatches(options);
+	benchFindZone(options);
+	benchAcl(options);
+	benchRateLimit(options);
+	benchCookies(options);
+	return 0;
+}
@@ -0,0 +1,178 @@
+// Microbenchmarks for the name case kernels (dns_name.h) against the
+// helpers they replaced. Build and run with `make bench-names`.
+//
+// Output is one line per benchmark:
+//   benchmark=<name> kernel=<avx2|sse2|scalar> ns_per_op=<float> ops=<count>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "dns_name.h"
+
+using namespace std;
+using bench::run;
+
+namespace {
+
+// --- Helpers as they were before the kernels ------------------------------
+
+string legacy_tolower(const string& name)
+{
+	string result = name;
+	transform(result.begin(), result.end(), result.begin(),
+	          [](unsigned char c){ return tolower(c); });
+	return result;
+}
+
+bool legacy_equal_nocase(const string& a, const string& b)
+{
+	return legacy_tolower(a) == legacy_tolower(b);
+}
+
+// Dotted suffix match on lowercased copies, as zone selection did
+bool legacy_is_subdomain(const string& name, const string& zone)
+{
+	string query = legacy_tolower(name);
+	string suffix = legacy_tolower(zone);
+	if (query == suffix)
+		return true;
+	if (query.length() < suffix.length())
+		return false;
+	size_t pos = query.length() - suffix.length();
+	return query.compare(pos, string::npos, suffix) == 0 && (pos == 0 || query[pos - 1] == '.');
+}
+
+vector<string> makeNames(size_t count)
+{
+	static const char* const words[] = {
+		"www", "Mail", "API", "cdn-edge", "Static", "login", "us-east-1", "Backend",
+		"x", "service-discovery", "INTERNAL", "a1b2c3",
+	};
+	static const size_t nwords = sizeof(words) / sizeof(words[0]);
+
+	vector<string> names;
+	unsigned int seed = 12345;
+	for (size_t i = 0; i < count; ++i)
+	{
+		string name;
+		unsigned int labels = 1 + (seed >> 16) % 4;
+		for (unsigned int l = 0; l < labels; ++l)
+		{
+			seed = seed * 1103515245 + 12345;
+			name += words[(seed >> 16) % nwords];
+			name += '.';
+		}
+		name += "Example.COM.";
+		names.push_back(name);
+	}
+	return names;
+}
+
+} // namespace
+
+int main()
+{
+	const string kernel = string("kernel=") + dns_name_kernel();
+	vector<string> names = makeNames(1024);
+
+	// Lowercasing
+	run("tolower_legacy", "kernel=locale", names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += legacy_tolower(names[i])[0];
+		return n;
+	});
+	run("tolower_copy", kernel, names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			string lower = names[i];
+			dns_ascii_tolower(&lower[0], lower.data(), lower.length());
+			n += lower[0];
+		}
+		return n;
+	});
+	char buffer[DNS_WIRE_NAME_MAX];
+	run("tolower_buffer_scalar", "kernel=scalar", names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			dns_ascii_tolower_scalar(buffer, names[i].data(), names[i].length());
+			n += buffer[0];
+		}
+		return n;
+	});
+	run("tolower_buffer", kernel, names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			dns_ascii_tolower(buffer, names[i].data(), names[i].length());
+			n += buffer[0];
+		}
+		return n;
+	});
+
+	// Case-insensitive equality: each name against its lowercased form
+	vector<string> lowered;
+	for (size_t i = 0; i < names.size(); ++i)
+		lowered.push_back(legacy_tolower(names[i]));
+
+	run("equal_nocase_legacy", "kernel=locale", names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += legacy_equal_nocase(names[i], lowered[i]);
+		return n;
+	});
+	run("equal_nocase_scalar", "kernel=scalar", names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += names[i].length() == lowered[i].length() &&
+			     dns_ascii_equal_nocase_scalar(names[i].data(), lowered[i].data(), names[i].length());
+		return n;
+	});
+	run("equal_nocase", kernel, names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += names[i].length() == lowered[i].length() &&
+			     dns_ascii_equal_nocase(names[i].data(), lowered[i].data(), names[i].length());
+		return n;
+	});
+
+	// Zone suffix test: every name against "example.com."
+	const string zone = "Example.COM.";
+	vector<string> wires;
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		size_t len = dns_name_to_wire(names[i].data(), names[i].length(), buffer, false);
+		wires.push_back(string(buffer, len));
+	}
+	string zone_wire = dns_name_to_wire(zone);
+
+	run("subdomain_legacy", "kernel=locale", names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += legacy_is_subdomain(names[i], zone);
+		return n;
+	});
+	run("subdomain_wire_nocase", kernel, names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < wires.size(); ++i)
+			n += dns_wire_is_subdomain_nocase(wires[i].data(), wires[i].length(),
+			                                  zone_wire.data(), zone_wire.length());
+		return n;
+	});
+
+	// Text to canonical wire, as the name table and zone lookups do it
+	run("name_to_wire", kernel, names.size(), [&]() {
+		size_t n = 0;
+		for (size_t i = 0; i < names.size(); ++i)
+			n += dns_name_to_wire(names[i].data(), names[i].length(), buffer);
+		return n;
+	});
+
+	return 0;
+}
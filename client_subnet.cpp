@@ -0,0 +1,131 @@
+#include "client_subnet.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "wire.h"
+
+using namespace std;
+
+const uint16_t ClientSubnet::OPTION_CODE;
+
+// FAMILY, SOURCE PREFIX-LENGTH and SCOPE PREFIX-LENGTH
+static const size_t HEADER_SIZE = 4;
+
+static unsigned int addressBits(uint16_t family)
+{
+	return family == ClientSubnet::IPV4 ? 32 : 128;
+}
+
+ClientSubnet::ClientSubnet() : family(IPV4), source_prefix(0)
+{
+	memset(address, 0, sizeof(address));
+}
+
+bool ClientSubnet::parse(const string& option)
+{
+	if (option.length() < HEADER_SIZE)
+		return false;
+	family = wire_read_u16(option.data(), 0);
+	source_prefix = (unsigned char)option[2];
+	unsigned int scope_prefix = (unsigned char)option[3];
+	if (family != IPV4 && family != IPV6)
+		return false;
+	if (source_prefix > addressBits(family) || scope_prefix != 0)
+		return false;
+
+	// Exactly the bytes the prefix needs, with the bits past it zero
+	size_t length = (source_prefix + 7) / 8;
+	if (option.length() != HEADER_SIZE + length)
+		return false;
+	memset(address, 0, sizeof(address));
+	memcpy(address, option.data() + HEADER_SIZE, length);
+	if (source_prefix % 8 && (address[length - 1] & (0xFF >> (source_prefix % 8))))
+		return false;
+	return true;
+}
+
+unsigned long ClientSubnet::ipv4() const
+{
+	uint32_t ip;
+	memcpy(&ip, address, sizeof(ip));
+	return ip;
+}
+
+string ClientSubnet::reply(unsigned int scope_prefix) const
+{
+	if (scope_prefix > addressBits(family))
+		scope_prefix = addressBits(family);
+	char header[HEADER_SIZE];
+	wire_write_u16(header, 0, family);
+	header[2] = (char)source_prefix;
+	header[3] = (char)scope_prefix;
+	string data(header, sizeof(header));
+	data.append((const char*)address, (source_prefix + 7) / 8);
+	return data;
+}
+
+namespace {
+
+struct TrustedNetwork
+{
+	IpAddress network;
+	unsigned int prefix;
+};
+
+std::vector<TrustedNetwork>& trustedNetworks()
+{
+	static std::vector<TrustedNetwork> networks;
+	return networks;
+}
+
+} // namespace
+
+bool ClientSubnet::addTrusted(const string& networks)
+{
+	vector<TrustedNetwork> parsed;
+	size_t start = 0;
+	while (start <= networks.length())
+	{
+		size_t end = networks.find(',', start);
+		if (end == string::npos)
+			end = networks.length();
+		string cidr = networks.substr(start, end - start);
+		start = end + 1;
+
+		TrustedNetwork trusted;
+		string::size_type slash = cidr.find('/');
+		if (!trusted.network.parse(cidr.substr(0, slash).c_str()))
+			return false;
+		trusted.prefix = (unsigned int)(8 * trusted.network.length());
+		if (slash != string::npos)
+		{
+			string bits = cidr.substr(slash + 1);
+			if (bits.empty() || bits.length() > 3 || bits.find_first_not_of("0123456789") != string::npos)
+				return false;
+			unsigned int prefix = (unsigned int)atoi(bits.c_str());
+			if (prefix > trusted.prefix)
+				return false;
+			trusted.prefix = prefix;
+		}
+		parsed.push_back(trusted);
+	}
+	trustedNetworks().insert(trustedNetworks().end(), parsed.begin(), parsed.end());
+	return true;
+}
+
+void ClientSubnet::clearTrusted()
+{
+	trustedNetworks().clear();
+}
+
+bool ClientSubnet::trusted(const IpAddress& source)
+{
+	const vector<TrustedNetwork>& networks = trustedNetworks();
+	for (size_t i = 0; i < networks.size(); ++i)
+	{
+		if (source.inNetwork(networks[i].network, networks[i].prefix))
+			return true;
+	}
+	return false;
+}
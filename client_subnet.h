@@ -0,0 +1,54 @@
+#ifndef HAVE_CLIENT_SUBNET_H
+#define HAVE_CLIENT_SUBNET_H
+
+#include <string>
+#include <stdint.h>
+#include "ip_address.h"
+
+// EDNS Client Subnet (RFC 7871). A resolver puts the network of the client
+// it resolves for in the ECS option of its queries, so that ACL views can
+// be selected by the end user's address instead of the resolver's. The
+// reply echoes the option with the scope prefix length: how many leading
+// bits of the client address the answer depends on, which is how widely
+// the resolver may share it from its cache.
+//
+// Nothing authenticates the option, so it is only honored from resolvers
+// in the trusted list, and only once the resolver's own address may see
+// the zone; anyone else would read every view by naming its subnet.
+class ClientSubnet
+{
+public:
+	enum Family { IPV4 = 1, IPV6 = 2 };
+
+	static const uint16_t OPTION_CODE = 8;
+
+	ClientSubnet();
+
+	// Reads the data of an ECS option. False if it is malformed, which is
+	// FORMERR (RFC 7871 section 7.1.1): an unknown family, a source prefix
+	// longer than the address, a scope prefix in a query, an address not
+	// cut to the source prefix.
+	bool parse(const std::string& option);
+
+	// The client network as IPv4 in network byte order, for ACLs. Only
+	// IPv4 subnets with a source prefix select views: a prefix of 0 means
+	// the client must not be told apart, and ACLs hold no IPv6 subnets.
+	bool selectsView() const { return family == IPV4 && source_prefix > 0; }
+	unsigned long ipv4() const;
+
+	// The option data for the reply
+	std::string reply(unsigned int scope_prefix) const;
+
+	// Resolvers whose options select views, as comma-separated networks
+	// such as "192.0.2.0/24,2001:db8::53". False, adding none, if one is
+	// malformed. Not safe against concurrent queries: set before serving.
+	static bool addTrusted(const std::string& networks);
+	static void clearTrusted();
+	static bool trusted(const IpAddress& source);
+
+	uint16_t family;
+	unsigned int source_prefix;
+	unsigned char address[16];  // Zero past source_prefix
+};
+
+#endif
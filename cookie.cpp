@@ -0,0 +1,204 @@
+#include "cookie.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include "wire.h"
+
+using namespace std;
+
+const uint16_t DnsCookies::OPTION_CODE;
+const size_t DnsCookies::CLIENT_COOKIE_SIZE;
+const size_t DnsCookies::SERVER_COOKIE_SIZE;
+const size_t DnsCookies::SECRET_SIZE;
+const time_t DnsCookies::LIFETIME;
+const time_t DnsCookies::ROTATE_INTERVAL;
+const unsigned int DnsCookies::DEFAULT_MAX_UDP_WITHOUT_COOKIE;
+
+unsigned int DnsCookies::max_udp_without_cookie = DnsCookies::DEFAULT_MAX_UDP_WITHOUT_COOKIE;
+
+// RFC 9018 section 4.3: a server cookie may come from a clock up to five
+// minutes ahead
+static const time_t CLOCK_SKEW = 300;
+static const unsigned char VERSION = 1;
+
+static inline uint64_t rotl(uint64_t x, int b)
+{
+	return (x << b) | (x >> (64 - b));
+}
+
+static inline uint64_t readLE64(const unsigned char* p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32); \
+		v2 += v3; v3 = rotl(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = rotl(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32); \
+	} while (0)
+
+uint64_t DnsCookies::siphash24(const unsigned char* key, const unsigned char* data, size_t len)
+{
+	uint64_t k0 = readLE64(key);
+	uint64_t k1 = readLE64(key + 8);
+	uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+	uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+	size_t blocks = len & ~(size_t)7;
+	for (size_t i = 0; i < blocks; i += 8)
+	{
+		uint64_t m = readLE64(data + i);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	// The last 0-7 bytes, with the length in the top byte
+	uint64_t b = (uint64_t)len << 56;
+	for (size_t i = len - blocks; i-- > 0; )
+		b |= (uint64_t)data[blocks + i] << (8 * i);
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPROUND
+
+static void randomSecret(unsigned char* secret)
+{
+	if (RAND_bytes(secret, (int)DnsCookies::SECRET_SIZE) != 1)
+		throw runtime_error("Cannot generate a DNS cookie secret");
+}
+
+DnsCookies::DnsCookies() : current_(0), rotated_(time(NULL)), fixed_(false)
+{
+	for (size_t i = 0; i < 3; ++i)
+		randomSecret(secrets_[i]);
+}
+
+DnsCookies& DnsCookies::global()
+{
+	static DnsCookies cookies;
+	return cookies;
+}
+
+static int hexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool DnsCookies::setSecret(const string& hex)
+{
+	unsigned char secret[SECRET_SIZE];
+	if (hex.length() != 2 * SECRET_SIZE)
+		return false;
+	for (size_t i = 0; i < SECRET_SIZE; ++i)
+	{
+		int high = hexDigit(hex[2 * i]);
+		int low = hexDigit(hex[2 * i + 1]);
+		if (high < 0 || low < 0)
+			return false;
+		secret[i] = (unsigned char)(high << 4 | low);
+	}
+
+	// The same secret in every slot: nothing else is accepted
+	for (size_t i = 0; i < 3; ++i)
+		memcpy(secrets_[i], secret, SECRET_SIZE);
+	fixed_ = true;
+	return true;
+}
+
+void DnsCookies::rotate(time_t now)
+{
+	// Readers use the current and the previous slot; the third is free
+	unsigned int next = (current_.load(memory_order_relaxed) + 1) % 3;
+	randomSecret(secrets_[next]);
+	current_.store(next, memory_order_release);
+	rotated_ = now;
+	fixed_ = false;
+}
+
+void DnsCookies::rotateIfDue(time_t now)
+{
+	if (!fixed_ && now - rotated_ >= ROTATE_INTERVAL)
+		rotate(now);
+}
+
+uint64_t DnsCookies::hash(const unsigned char* secret, const char* head, const IpAddress& client)
+{
+	// RFC 9018 section 4.4: 4 address bytes for IPv4, 16 for IPv6
+	unsigned char input[CLIENT_COOKIE_SIZE + 8 + 16];
+	memcpy(input, head, CLIENT_COOKIE_SIZE + 8);
+	memcpy(input + CLIENT_COOKIE_SIZE + 8, client.bytes, client.length());
+	return siphash24(secret, input, CLIENT_COOKIE_SIZE + 8 + client.length());
+}
+
+DnsCookies::Status DnsCookies::check(const string& option, const IpAddress& client, time_t now) const
+{
+	// A client cookie alone, or followed by a server cookie of 8 to 32 bytes
+	size_t len = option.length();
+	if (len < CLIENT_COOKIE_SIZE || (len > CLIENT_COOKIE_SIZE && len < CLIENT_COOKIE_SIZE + 8) ||
+	    len > CLIENT_COOKIE_SIZE + 32)
+		return MALFORMED;
+	if (len != CLIENT_COOKIE_SIZE + SERVER_COOKIE_SIZE)
+		return CLIENT;
+
+	const char* server = option.data() + CLIENT_COOKIE_SIZE;
+	if ((unsigned char)server[0] != VERSION)
+		return CLIENT;
+	time_t timestamp = (time_t)wire_read_u32(server, 4);
+	if (timestamp + LIFETIME < now || timestamp > now + CLOCK_SKEW)
+		return CLIENT;
+
+	unsigned int current = current_.load(memory_order_acquire);
+	const unsigned int slots[2] = { current, (current + 2) % 3 };
+	for (size_t i = 0; i < 2; ++i)
+	{
+		uint64_t h = hash(secrets_[slots[i]], option.data(), client);
+		unsigned char expected[8];
+		for (int b = 0; b < 8; ++b)
+			expected[b] = (unsigned char)(h >> (8 * b));
+		if (CRYPTO_memcmp(expected, server + 8, 8) == 0)
+			return VALID;
+	}
+	return CLIENT;
+}
+
+string DnsCookies::reply(const string& option, const IpAddress& client, time_t now) const
+{
+	char cookie[CLIENT_COOKIE_SIZE + SERVER_COOKIE_SIZE];
+	memcpy(cookie, option.data(), CLIENT_COOKIE_SIZE);
+	char* server = cookie + CLIENT_COOKIE_SIZE;
+	server[0] = (char)VERSION;
+	server[1] = server[2] = server[3] = 0;
+	wire_write_u32(server, 4, (uint32_t)now);
+
+	uint64_t h = hash(secrets_[current_.load(memory_order_acquire)], cookie, client);
+	for (int b = 0; b < 8; ++b)
+		server[8 + b] = (char)(h >> (8 * b));
+	return string(cookie, sizeof(cookie));
+}
@@ -0,0 +1,86 @@
+#ifndef HAVE_COOKIE_H
+#define HAVE_COOKIE_H
+
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <stdint.h>
+#include "ip_address.h"
+
+// DNS Cookies (RFC 7873). A client puts a random client cookie in the
+// COOKIE option of its queries; the server answers with the client cookie
+// and a server cookie, which the client sends back from then on. A valid
+// server cookie shows that the client really is at its source address,
+// which a spoofed query cannot do: such clients skip rate limiting and get
+// UDP replies of the size they ask for (see RATE_LIMITING.md).
+//
+// Server cookies are in the format of RFC 9018, so servers sharing an
+// address can share a secret: a version byte, three reserved bytes, a
+// timestamp and a SipHash-2-4 of the client cookie, those eight bytes and
+// the full client address, keyed by the server secret. Checking one costs
+// a hash over 20 bytes (32 for IPv6) and keeps no state per client. The secret is random
+// and replaced every hour unless set with setSecret(); cookies made with
+// the previous secret stay valid.
+class DnsCookies
+{
+public:
+	enum Status
+	{
+		NONE,       // No COOKIE option
+		MALFORMED,  // An option of the wrong length: FORMERR (RFC 7873 section 5.2.2)
+		CLIENT,     // A client cookie, without a server cookie or with one that is not valid here
+		VALID       // A server cookie this server made for the client's address within LIFETIME
+	};
+
+	static const uint16_t OPTION_CODE = 10;
+	static const size_t CLIENT_COOKIE_SIZE = 8;
+	static const size_t SERVER_COOKIE_SIZE = 16;
+	static const size_t SECRET_SIZE = 16;
+	static const time_t LIFETIME = 3600;         // Server cookies are accepted for an hour
+	static const time_t ROTATE_INTERVAL = 3600;
+	static const unsigned int DEFAULT_MAX_UDP_WITHOUT_COOKIE = 1232;
+
+	// Largest UDP reply for clients without a valid server cookie, however
+	// large a payload they advertise; 0 for no cap
+	static unsigned int max_udp_without_cookie;
+
+	// Starts with a random secret
+	DnsCookies();
+
+	// The cookies of the server's request engine
+	static DnsCookies& global();
+
+	// A fixed secret of 32 hex digits, e.g. shared by the servers of an
+	// anycast address; turns rotation off. False if `hex` is not valid.
+	bool setSecret(const std::string& hex);
+	// Replaces the secret with a random one. Safe against concurrent
+	// check() and reply() calls, but not against another rotate().
+	void rotate(time_t now);
+	void rotateIfDue(time_t now);
+
+	// Checks the data of a COOKIE option from `client`
+	Status check(const std::string& option, const IpAddress& client, time_t now) const;
+	// The COOKIE option data for the reply to a CLIENT or VALID option: the
+	// client cookie and a new server cookie
+	std::string reply(const std::string& option, const IpAddress& client, time_t now) const;
+
+	// SipHash-2-4 with a 16-byte key
+	static uint64_t siphash24(const unsigned char* key, const unsigned char* data, size_t len);
+
+private:
+	DnsCookies(const DnsCookies&);
+	DnsCookies& operator=(const DnsCookies&);
+
+	// The hash of a server cookie: `head` is the client cookie followed by
+	// the version, reserved and timestamp bytes
+	static uint64_t hash(const unsigned char* secret, const char* head, const IpAddress& client);
+
+	// The current secret, the previous one and the next to be filled
+	unsigned char secrets_[3][SECRET_SIZE];
+	std::atomic<unsigned int> current_;
+	time_t rotated_;
+	bool fixed_;
+};
+
+#endif
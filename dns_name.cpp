@@ -0,0 +1,247 @@
+#include "dns_name.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Folding works on signed bytes: adding 0x3F moves 'A'..'Z' to the 26
+// smallest values (-128..-103), so one compare finds the upper-case letters
+// and their 0x20 bit is set. Bytes above 0x7F are never touched.
+
+#if defined(__AVX2__)
+static inline __m256i fold32(__m256i v)
+{
+	const __m256i shift = _mm256_set1_epi8(0x3F);
+	const __m256i limit = _mm256_set1_epi8(-128 + 26);
+	const __m256i bit = _mm256_set1_epi8(0x20);
+	__m256i upper = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, shift));
+	return _mm256_or_si256(v, _mm256_and_si256(upper, bit));
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i fold16(__m128i v)
+{
+	const __m128i shift = _mm_set1_epi8(0x3F);
+	const __m128i limit = _mm_set1_epi8(-128 + 26);
+	const __m128i bit = _mm_set1_epi8(0x20);
+	__m128i upper = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+	return _mm_or_si128(v, _mm_and_si128(upper, bit));
+}
+#endif
+
+static inline char lowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+void dns_ascii_tolower_scalar(char* dst, const char* src, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+		dst[i] = lowerAscii(src[i]);
+}
+
+bool dns_ascii_equal_nocase_scalar(const char* a, const char* b, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+		if (lowerAscii(a[i]) != lowerAscii(b[i]))
+			return false;
+	return true;
+}
+
+void dns_ascii_tolower(char* dst, const char* src, size_t len)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= len; i += 32)
+		_mm256_storeu_si256((__m256i*)(dst + i), fold32(_mm256_loadu_si256((const __m256i*)(src + i))));
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= len; i += 16)
+		_mm_storeu_si128((__m128i*)(dst + i), fold16(_mm_loadu_si128((const __m128i*)(src + i))));
+	// Redo the last 16 bytes rather than finishing byte by byte. Folding is
+	// idempotent, so bytes already written come out the same.
+	if (i < len && len >= 16)
+	{
+		i = len - 16;
+		_mm_storeu_si128((__m128i*)(dst + i), fold16(_mm_loadu_si128((const __m128i*)(src + i))));
+		return;
+	}
+#endif
+	dns_ascii_tolower_scalar(dst + i, src + i, len - i);
+}
+
+bool dns_ascii_equal_nocase(const char* a, const char* b, size_t len)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i x = fold32(_mm256_loadu_si256((const __m256i*)(a + i)));
+		__m256i y = fold32(_mm256_loadu_si256((const __m256i*)(b + i)));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1)
+			return false;
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i x = fold16(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m128i y = fold16(_mm_loadu_si128((const __m128i*)(b + i)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF)
+			return false;
+	}
+	if (i < len && len >= 16)
+	{
+		i = len - 16;
+		__m128i x = fold16(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m128i y = fold16(_mm_loadu_si128((const __m128i*)(b + i)));
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+	}
+#endif
+	return dns_ascii_equal_nocase_scalar(a + i, b + i, len - i);
+}
+
+const char* dns_name_kernel()
+{
+#if defined(__AVX2__)
+	return "avx2";
+#elif defined(__SSE2__)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+size_t dns_name_to_wire(const char* name, size_t len, char* out, bool fold)
+{
+	size_t w = 0;
+	size_t start = 0;
+	while (start < len)
+	{
+		const char* dot = (const char*)memchr(name + start, '.', len - start);
+		size_t end = dot ? (size_t)(dot - name) : len;
+		size_t label = end - start;
+		if (label == 0)
+			break;  // Trailing dot (or an empty label, which ends the name)
+		if (label > 63 || w + 1 + label + 1 > DNS_WIRE_NAME_MAX)
+			return 0;
+
+		out[w++] = (char)label;
+		memcpy(out + w, name + start, label);
+		w += label;
+		start = end + 1;
+	}
+	out[w++] = '\0';
+
+	// Length bytes are at most 63, below 'A', so one pass folds the labels
+	if (fold)
+		dns_ascii_tolower(out, out, w);
+	return w;
+}
+
+string dns_name_to_wire(const string& name)
+{
+	char wire[DNS_WIRE_NAME_MAX];
+	size_t len = dns_name_to_wire(name.data(), name.length(), wire);
+	return string(wire, len);
+}
+
+void dns_wire_to_name(const char* wire, string& out)
+{
+	out.clear();
+	for (size_t i = 0; wire[i] != 0; )
+	{
+		unsigned char label = (unsigned char)wire[i];
+		out.append(wire + i + 1, label);
+		out += '.';
+		i += 1 + label;
+	}
+}
+
+size_t dns_wire_length(const char* wire)
+{
+	size_t i = 0;
+	while (wire[i] != 0)
+		i += 1 + (unsigned char)wire[i];
+	return i + 1;
+}
+
+unsigned int dns_wire_label_count(const char* wire)
+{
+	unsigned int count = 0;
+	for (size_t i = 0; wire[i] != 0; i += 1 + (unsigned char)wire[i])
+		++count;
+	return count;
+}
+
+// Offset in `name` where a suffix of `suffix_len` bytes starts, if that is
+// a label boundary; otherwise `name_len` + 1
+static size_t suffixStart(const char* name, size_t name_len, size_t suffix_len)
+{
+	if (suffix_len > name_len)
+		return name_len + 1;
+
+	size_t skip = name_len - suffix_len;
+	size_t i = 0;
+	while (i < skip)
+		i += 1 + (unsigned char)name[i];
+	return i == skip ? i : name_len + 1;
+}
+
+bool dns_wire_is_subdomain(const char* name, size_t name_len,
+                           const char* parent, size_t parent_len)
+{
+	size_t i = suffixStart(name, name_len, parent_len);
+	return i <= name_len && memcmp(name + i, parent, parent_len) == 0;
+}
+
+// Offsets of the labels of wire name `wire`, leftmost first; returns their
+// number (at most 127 in a valid name)
+static int labelOffsets(const char* wire, size_t len, unsigned char* offsets)
+{
+	int count = 0;
+	for (size_t i = 0; i < len && wire[i] != 0 && count < 128; i += 1 + (unsigned char)wire[i])
+		offsets[count++] = (unsigned char)i;
+	return count;
+}
+
+int dns_wire_canonical_compare(const char* a, size_t a_len, const char* b, size_t b_len)
+{
+	unsigned char a_labels[128], b_labels[128];
+	int a_count = labelOffsets(a, a_len, a_labels);
+	int b_count = labelOffsets(b, b_len, b_labels);
+
+	while (a_count > 0 && b_count > 0)
+	{
+		const char* a_label = a + a_labels[--a_count];
+		const char* b_label = b + b_labels[--b_count];
+		size_t a_label_len = (unsigned char)a_label[0];
+		size_t b_label_len = (unsigned char)b_label[0];
+		int diff = memcmp(a_label + 1, b_label + 1, std::min(a_label_len, b_label_len));
+		if (diff)
+			return diff;
+		if (a_label_len != b_label_len)
+			return a_label_len < b_label_len ? -1 : 1;
+	}
+	// The name with labels left is below the other
+	return a_count - b_count;
+}
+
+bool dns_wire_equal_nocase(const char* a, size_t a_len, const char* b, size_t b_len)
+{
+	// Length bytes never change under folding, so they compare exactly too
+	return a_len == b_len && dns_ascii_equal_nocase(a, b, a_len);
+}
+
+bool dns_wire_is_subdomain_nocase(const char* name, size_t name_len,
+                                  const char* parent, size_t parent_len)
+{
+	size_t i = suffixStart(name, name_len, parent_len);
+	return i <= name_len && dns_ascii_equal_nocase(name + i, parent, parent_len);
+}
@@ -0,0 +1,66 @@
+#ifndef HAVE_DNS_NAME_H
+#define HAVE_DNS_NAME_H
+
+#include <string>
+#include <cstddef>
+
+// Canonical wire form of a domain name: length-prefixed, lowercased
+// labels ending with the zero-length root label, e.g. "\3www\7example\3com\0".
+// No compression pointers. Two names are equal exactly when their canonical
+// wire forms are byte-identical, and a name is at or below another when the
+// other is one of its label suffixes.
+
+// Longest name the parser accepts: 255 characters of dotted text
+static const size_t DNS_WIRE_NAME_MAX = 257;
+
+// Writes the canonical wire form of dotted `name` (trailing dot optional)
+// to `out`, which holds DNS_WIRE_NAME_MAX bytes. Returns its length, or 0
+// if a label is longer than 63 bytes or the name longer than 255. With
+// `fold` false the case is kept, for the *_nocase comparisons below.
+size_t dns_name_to_wire(const char* name, size_t len, char* out, bool fold = true);
+std::string dns_name_to_wire(const std::string& name);  // Empty if invalid
+
+// Dotted text of wire name `wire`, with a trailing dot ("" for the root)
+void dns_wire_to_name(const char* wire, std::string& out);
+
+// Length of wire name `wire` including the root label
+size_t dns_wire_length(const char* wire);
+
+// Number of labels, not counting the root
+unsigned int dns_wire_label_count(const char* wire);
+
+// True if canonical `name` equals `parent` or lies below it. Walks the
+// labels of `name` instead of comparing string suffixes, so "fooexample.com."
+// is not below "example.com.".
+bool dns_wire_is_subdomain(const char* name, size_t name_len,
+                           const char* parent, size_t parent_len);
+
+// Canonical DNS name order (RFC 4034 section 6.1) of canonical wire names:
+// labels compared from the rightmost, each as an unsigned octet string.
+// Returns <0, 0 or >0. A name sorts directly before the names below it, so
+// every subtree is one contiguous range of a sorted list.
+int dns_wire_canonical_compare(const char* a, size_t a_len, const char* b, size_t b_len);
+
+// ASCII case kernels. Only 'A'-'Z' are folded, whatever the locale. They use
+// AVX2 or SSE2 when the build targets them (`-march=native` in release
+// builds, SSE2 on any x86-64) and plain loops otherwise.
+
+// Lowercases `len` bytes of `src` into `dst`; they are the same or disjoint
+void dns_ascii_tolower(char* dst, const char* src, size_t len);
+// True if `a` and `b` are equal ignoring ASCII case
+bool dns_ascii_equal_nocase(const char* a, const char* b, size_t len);
+
+// Wire-name comparisons ignoring ASCII case, for names that are not
+// canonical yet. Labels must be at most 63 bytes long.
+bool dns_wire_equal_nocase(const char* a, size_t a_len, const char* b, size_t b_len);
+bool dns_wire_is_subdomain_nocase(const char* name, size_t name_len,
+                                  const char* parent, size_t parent_len);
+
+// Byte-at-a-time versions of the kernels, for tests and benchmarks
+void dns_ascii_tolower_scalar(char* dst, const char* src, size_t len);
+bool dns_ascii_equal_nocase_scalar(const char* a, const char* b, size_t len);
+
+// "avx2", "sse2" or "scalar": the variant this build uses
+const char* dns_name_kernel();
+
+#endif
@@ -0,0 +1,578 @@
+// dnsbench - open-loop load generator for a DNS server on this machine
+//
+//   dnsbench -z zonefile [-s server] [-p port] [-t udp|tcp] [-r qps] [-c senders]
+//            [-d seconds] [-m A:80,AAAA:15,MX:5] [-a zipf_exponent] [-e edns_size]
+//            [-w timeout_ms] [--seed N] [-o result.json]
+//
+// Query names are the owner names of the zone file, drawn with a Zipf
+// distribution (a few names get most of the traffic), and the query types
+// follow the given mix. Every sender sends on a fixed schedule of rate /
+// senders queries per second whatever the server does (open loop), and
+// latency is measured from the scheduled send time, so a stalled server
+// shows up in the tail instead of slowing the load down.
+//
+// Results (QPS, loss, truncation, rcodes and latency percentiles) are
+// printed as JSON on stdout and, with -o, written to a file.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include "socket.h"
+#include "message.h"
+#include "name_table.h"
+#include "rr.h"
+#include "wire.h"
+#include "zone.h"
+#include "zoneFileLoader.h"
+
+using namespace std;
+
+namespace {
+
+struct Options
+{
+	string server = "127.0.0.1";
+	int port = 53;
+	bool tcp = false;
+	double rate = 10000;          // Queries per second, all senders together
+	int senders = 4;
+	double duration = 10;         // Seconds
+	double zipf = 1.0;            // Exponent; 0 picks names uniformly
+	unsigned int edns = 1232;     // Advertised UDP payload size; 0 sends no OPT
+	int timeout_ms = 1000;        // A query unanswered after this is lost
+	unsigned long seed = 1;
+	string qtypes = "A:80,AAAA:15,MX:5";
+	string output;
+	vector<string> zonefiles;
+};
+
+// Wire-format query names and the cumulative weights they are drawn with
+struct Workload
+{
+	vector<string> names;
+	vector<double> name_cdf;
+	vector<RR::RRType> types;
+	vector<double> type_cdf;
+};
+
+// What one sender measured
+struct Result
+{
+	unsigned long long sent = 0;
+	unsigned long long received = 0;
+	unsigned long long lost = 0;
+	unsigned long long truncated = 0;
+	unsigned long long errors = 0;      // Sockets that failed (TCP)
+	unsigned long long rcodes[16] = {};
+	vector<unsigned long long> latencies;  // Nanoseconds
+};
+
+unsigned long long now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sleep_until_ns(unsigned long long t)
+{
+	timespec ts;
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+size_t draw(const vector<double>& cdf, mt19937_64& rng)
+{
+	double u = uniform_real_distribution<double>(0.0, cdf.back())(rng);
+	return min((size_t)(upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()), cdf.size() - 1);
+}
+
+// --- Workload ------------------------------------------------------------------
+
+bool parseTypeMix(const string& spec, Workload& workload)
+{
+	stringstream ss(spec);
+	string item;
+	double total = 0;
+	while (getline(ss, item, ','))
+	{
+		size_t colon = item.find(':');
+		string type_name = item.substr(0, colon);
+		double weight = colon == string::npos ? 1 : atof(item.c_str() + colon + 1);
+		RR::RRType type = RR::RRTypeFromString(type_name);
+		if (type == RR::RRUNDEF || weight <= 0)
+		{
+			cerr << "Error: bad query type in mix: " << item << endl;
+			return false;
+		}
+		total += weight;
+		workload.types.push_back(type);
+		workload.type_cdf.push_back(total);
+	}
+	return !workload.types.empty();
+}
+
+bool loadNames(const Options& options, Workload& workload)
+{
+	set<t_name_id> seen;
+	for (size_t f = 0; f < options.zonefiles.size(); ++f)
+	{
+		t_zones zones;
+		if (!ZoneFileLoader::loadFile(options.zonefiles[f], zones))
+			return false;
+
+		for (size_t z = 0; z < zones.size(); ++z)
+		{
+			const RecordStore& records = zones[z]->records();
+			for (size_t i = 0; i < records.size(); ++i)
+			{
+				t_name_id id = records.nameId(i);
+				const string& wire = NameTable::global().wire(id);
+				// Wildcard owners ("*" label) are not names anyone asks for
+				if (wire.empty() || (wire[0] == 1 && wire[1] == '*') || !seen.insert(id).second)
+					continue;
+				workload.names.push_back(wire);
+			}
+			delete zones[z];
+		}
+	}
+	if (workload.names.empty())
+	{
+		cerr << "Error: no names in the zone file(s)" << endl;
+		return false;
+	}
+
+	// Popularity must not follow zone file order
+	mt19937_64 rng(options.seed);
+	shuffle(workload.names.begin(), workload.names.end(), rng);
+
+	double total = 0;
+	for (size_t rank = 1; rank <= workload.names.size(); ++rank)
+	{
+		total += 1.0 / pow((double)rank, options.zipf);
+		workload.name_cdf.push_back(total);
+	}
+	return true;
+}
+
+// Header, question and optional OPT record; returns the length
+unsigned int buildQuery(char* packet, unsigned short id, const string& wire, RR::RRType type, unsigned int edns)
+{
+	unsigned int n = 0;
+	wire_write_u16(packet, 0, id);
+	wire_write_u16(packet, 2, 0x0100);        // RD
+	wire_write_u16(packet, 4, 1);             // QDCOUNT
+	wire_write_u16(packet, 6, 0);
+	wire_write_u16(packet, 8, 0);
+	wire_write_u16(packet, 10, edns ? 1 : 0); // ARCOUNT
+	n = 12;
+	memcpy(packet + n, wire.data(), wire.length());
+	n += (unsigned int)wire.length();
+	wire_write_u16(packet, n, type);
+	wire_write_u16(packet, n + 2, RR::CLASSIN);
+	n += 4;
+	if (edns)
+	{
+		packet[n++] = 0;                          // Root owner
+		wire_write_u16(packet, n, RR::OPT);
+		wire_write_u16(packet, n + 2, (unsigned short)edns);
+		wire_write_u32(packet, n + 4, 0);
+		wire_write_u16(packet, n + 8, 0);
+		n += 10;
+	}
+	return n;
+}
+
+void countResponse(const char* packet, int len, unsigned long long sent_at, Result& result)
+{
+	unsigned long long latency = now_ns() - sent_at;
+	result.received++;
+	result.latencies.push_back(latency);
+	if (len >= 4)
+	{
+		unsigned short flags = wire_read_u16(packet, 2);
+		if (flags & 0x0200)
+			result.truncated++;
+		result.rcodes[flags & 0x000F]++;
+	}
+}
+
+// --- Senders -------------------------------------------------------------------
+
+struct Sender
+{
+	const Options* options;
+	const Workload* workload;
+	sockaddr_in server;
+	unsigned int index;
+	unsigned long long start;
+	unsigned long long interval;       // Nanoseconds between scheduled sends
+	unsigned long long count;          // Queries to send
+	unsigned long long finished;       // When the last query was sent (UDP) or answered (TCP)
+	Result result;
+
+	// UDP: the receiver thread matches responses by ID. A slot holds the
+	// scheduled send time of the query in flight with that ID, or 0.
+	SOCKET udp;
+	atomic<unsigned long long>* slots;
+	atomic<bool> sending_done;
+	Result received;                   // Filled by the receiver thread
+};
+
+void* udpReceiver(void* arg)
+{
+	Sender* sender = (Sender*)arg;
+	char packet[0x10000];
+	unsigned long long drain_until = 0;
+	for (;;)
+	{
+		if (sender->sending_done.load())
+		{
+			unsigned long long now = now_ns();
+			if (!drain_until)
+				drain_until = now + (unsigned long long)sender->options->timeout_ms * 1000000ULL;
+			if (now >= drain_until)
+				break;
+		}
+
+		pollfd pfd;
+		pfd.fd = sender->udp;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 50) <= 0)
+			continue;
+
+		int len = recv(sender->udp, packet, sizeof(packet), 0);
+		if (len < 12)
+			continue;
+		unsigned short id = wire_read_u16(packet, 0);
+		unsigned long long sent_at = sender->slots[id].exchange(0);
+		if (sent_at)
+			countResponse(packet, len, sent_at, sender->received);
+	}
+	return NULL;
+}
+
+void* udpSender(void* arg)
+{
+	Sender* sender = (Sender*)arg;
+	const Workload& workload = *sender->workload;
+	mt19937_64 rng(sender->options->seed * 7919 + sender->index);
+	char packet[512];
+
+	for (unsigned long long k = 0; k < sender->count; ++k)
+	{
+		unsigned long long scheduled = sender->start + k * sender->interval;
+		sleep_until_ns(scheduled);
+
+		unsigned short id = (unsigned short)k;
+		const string& name = workload.names[draw(workload.name_cdf, rng)];
+		RR::RRType type = workload.types[draw(workload.type_cdf, rng)];
+		unsigned int len = buildQuery(packet, id, name, type, sender->options->edns);
+
+		// An ID still in flight after 65536 queries is given up on
+		if (sender->slots[id].exchange(scheduled))
+			sender->result.lost++;
+		if (send(sender->udp, packet, len, 0) == (int)len)
+			sender->result.sent++;
+		else
+		{
+			sender->slots[id].store(0);
+			sender->result.errors++;
+		}
+	}
+	sender->finished = now_ns();
+	sender->sending_done.store(true);
+	return NULL;
+}
+
+// TCP: one connection per query, as the server handles them. A sender
+// that falls behind sends late, and the wait counts in the latency.
+void* tcpSender(void* arg)
+{
+	Sender* sender = (Sender*)arg;
+	const Workload& workload = *sender->workload;
+	mt19937_64 rng(sender->options->seed * 7919 + sender->index);
+	char packet[514];
+	char response[0x10000];
+
+	for (unsigned long long k = 0; k < sender->count; ++k)
+	{
+		unsigned long long scheduled = sender->start + k * sender->interval;
+		sleep_until_ns(scheduled);
+
+		const string& name = workload.names[draw(workload.name_cdf, rng)];
+		RR::RRType type = workload.types[draw(workload.type_cdf, rng)];
+		unsigned int len = buildQuery(packet + 2, (unsigned short)k, name, type, sender->options->edns);
+		wire_write_u16(packet, 0, (unsigned short)len);
+
+		SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+		if (s == INVALID_SOCKET)
+		{
+			sender->result.errors++;
+			continue;
+		}
+		set_recv_timeout(s, (sender->options->timeout_ms + 999) / 1000);
+		sender->result.sent++;
+
+		bool ok = connect(s, (sockaddr*)&sender->server, sizeof(sender->server)) == 0 &&
+		          send(s, packet, len + 2, 0) == (int)(len + 2);
+		unsigned short response_len = 0;
+		if (ok)
+		{
+			char prefix[2];
+			ok = recv(s, prefix, 2, MSG_WAITALL) == 2;
+			response_len = ok ? wire_read_u16(prefix, 0) : 0;
+		}
+		if (ok)
+			ok = recv(s, response, response_len, MSG_WAITALL) == (int)response_len;
+		closesocket_compat(s);
+
+		if (ok)
+			countResponse(response, response_len, scheduled, sender->result);
+		else
+			sender->result.lost++;
+	}
+	sender->finished = now_ns();
+	return NULL;
+}
+
+// --- Report --------------------------------------------------------------------
+
+double percentile(const vector<unsigned long long>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = (size_t)ceil(p / 100.0 * sorted.size());
+	return sorted[min(max(i, (size_t)1), sorted.size()) - 1] / 1000.0;
+}
+
+string report(const Options& options, const Workload& workload, Result& total, double elapsed)
+{
+	sort(total.latencies.begin(), total.latencies.end());
+	double answered = total.received ? (double)total.received : 1;
+
+	ostringstream json;
+	json.setf(ios::fixed);
+	json.precision(3);
+	json << "{\n"
+	     << "  \"transport\": \"" << (options.tcp ? "tcp" : "udp") << "\",\n"
+	     << "  \"server\": \"" << options.server << ":" << options.port << "\",\n"
+	     << "  \"names\": " << workload.names.size() << ",\n"
+	     << "  \"zipf\": " << options.zipf << ",\n"
+	     << "  \"qtypes\": \"" << options.qtypes << "\",\n"
+	     << "  \"senders\": " << options.senders << ",\n"
+	     << "  \"target_qps\": " << options.rate << ",\n"
+	     << "  \"duration_s\": " << elapsed << ",\n"
+	     << "  \"sent\": " << total.sent << ",\n"
+	     << "  \"received\": " << total.received << ",\n"
+	     << "  \"lost\": " << total.lost << ",\n"
+	     << "  \"errors\": " << total.errors << ",\n"
+	     << "  \"achieved_qps\": " << total.received / elapsed << ",\n"
+	     << "  \"loss_rate\": " << (total.sent ? (double)total.lost / total.sent : 0.0) << ",\n"
+	     << "  \"truncation_rate\": " << total.truncated / answered << ",\n"
+	     << "  \"rcodes\": {";
+	bool first = true;
+	for (int rc = 0; rc < 16; ++rc)
+	{
+		if (!total.rcodes[rc])
+			continue;
+		json << (first ? "" : ", ") << "\"" << Message::RCodeToString((Message::RCode)rc) << "\": " << total.rcodes[rc];
+		first = false;
+	}
+	json << "},\n"
+	     << "  \"latency_us\": {"
+	     << "\"p50\": " << percentile(total.latencies, 50) << ", "
+	     << "\"p99\": " << percentile(total.latencies, 99) << ", "
+	     << "\"p99.9\": " << percentile(total.latencies, 99.9) << ", "
+	     << "\"max\": " << percentile(total.latencies, 100) << "}\n"
+	     << "}\n";
+	return json.str();
+}
+
+int usage(const char* argv0)
+{
+	cerr << "Usage: " << argv0 << " -z zonefile [-z zonefile2 ...] [-s server] [-p port] [-t udp|tcp]" << endl
+	     << "       [-r qps] [-c senders] [-d seconds] [-m A:80,AAAA:15,MX:5] [-a zipf_exponent]" << endl
+	     << "       [-e edns_size] [-w timeout_ms] [--seed N] [-o result.json]" << endl;
+	return 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	for (int arg = 1; arg < argc; arg += 2)
+	{
+		string opt = argv[arg];
+		if (arg + 1 >= argc)
+			return usage(argv[0]);
+		const char* value = argv[arg + 1];
+
+		if (opt == "-z" || opt == "--zone")
+			options.zonefiles.push_back(value);
+		else if (opt == "-s" || opt == "--server")
+			options.server = value;
+		else if (opt == "-p" || opt == "--port")
+			options.port = atoi(value);
+		else if (opt == "-t" || opt == "--transport")
+		{
+			if (value != string("udp") && value != string("tcp"))
+				return usage(argv[0]);
+			options.tcp = value == string("tcp");
+		}
+		else if (opt == "-r" || opt == "--rate")
+			options.rate = atof(value);
+		else if (opt == "-c" || opt == "--senders")
+			options.senders = atoi(value);
+		else if (opt == "-d" || opt == "--duration")
+			options.duration = atof(value);
+		else if (opt == "-m" || opt == "--qtypes")
+			options.qtypes = value;
+		else if (opt == "-a" || opt == "--zipf")
+			options.zipf = atof(value);
+		else if (opt == "-e" || opt == "--edns")
+			options.edns = (unsigned int)atoi(value);
+		else if (opt == "-w" || opt == "--timeout")
+			options.timeout_ms = atoi(value);
+		else if (opt == "--seed")
+			options.seed = strtoul(value, NULL, 10);
+		else if (opt == "-o" || opt == "--output")
+			options.output = value;
+		else
+			return usage(argv[0]);
+	}
+	if (options.zonefiles.empty() || options.rate <= 0 || options.senders < 1 ||
+	    options.duration <= 0 || options.edns > 65535 || options.timeout_ms < 1)
+		return usage(argv[0]);
+
+	ZoneFileLoader::verbosity = ZoneFileLoader::QUIET;
+	Workload workload;
+	if (!parseTypeMix(options.qtypes, workload) || !loadNames(options, workload))
+		return 1;
+
+	sockaddr_in server;
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(options.port);
+	if (inet_pton(AF_INET, options.server.c_str(), &server.sin_addr) != 1)
+	{
+		cerr << "Error: server must be an IPv4 address: " << options.server << endl;
+		return 1;
+	}
+
+	cerr << "dnsbench: " << workload.names.size() << " names, " << options.rate << " qps over "
+	     << options.senders << " " << (options.tcp ? "TCP" : "UDP") << " sender(s) for "
+	     << options.duration << " s" << endl;
+
+	vector<Sender*> senders;
+	unsigned long long interval = (unsigned long long)(1e9 * options.senders / options.rate);
+	unsigned long long start = now_ns() + 50000000ULL;  // Let every thread get going
+	for (int i = 0; i < options.senders; ++i)
+	{
+		Sender* sender = new Sender();
+		sender->options = &options;
+		sender->workload = &workload;
+		sender->server = server;
+		sender->index = i;
+		sender->interval = max(interval, 1ULL);
+		// Stagger the senders evenly over one interval
+		sender->start = start + sender->interval * i / options.senders;
+		sender->count = (unsigned long long)(options.duration * options.rate / options.senders);
+		sender->udp = INVALID_SOCKET;
+		sender->slots = NULL;
+		sender->sending_done.store(false);
+		if (!options.tcp)
+		{
+			sender->udp = socket(AF_INET, SOCK_DGRAM, 0);
+			if (sender->udp == INVALID_SOCKET ||
+			    connect(sender->udp, (sockaddr*)&server, sizeof(server)) != 0)
+			{
+				cerr << "Error: cannot open UDP socket to " << options.server << endl;
+				return 1;
+			}
+			int size = 4 << 20;
+			setsockopt(sender->udp, SOL_SOCKET, SO_RCVBUF, (char*)&size, sizeof(size));
+			sender->slots = new atomic<unsigned long long>[65536];
+			for (int id = 0; id < 65536; ++id)
+				sender->slots[id].store(0);
+		}
+		senders.push_back(sender);
+	}
+
+	vector<pthread_t> threads;
+	for (size_t i = 0; i < senders.size(); ++i)
+	{
+		pthread_t thread;
+		if (!options.tcp)
+		{
+			pthread_create(&thread, NULL, udpReceiver, senders[i]);
+			threads.push_back(thread);
+		}
+		pthread_create(&thread, NULL, options.tcp ? tcpSender : udpSender, senders[i]);
+		threads.push_back(thread);
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+		pthread_join(threads[i], NULL);
+
+	// QPS is taken over the sending period, without the final wait for
+	// late UDP responses
+	unsigned long long finished = start;
+	for (size_t i = 0; i < senders.size(); ++i)
+		finished = max(finished, senders[i]->finished);
+	double elapsed = max((finished - start) / 1e9, 1e-9);
+
+	Result total;
+	for (size_t i = 0; i < senders.size(); ++i)
+	{
+		Sender* sender = senders[i];
+		Result& sent = sender->result;
+		Result& got = options.tcp ? sender->result : sender->received;
+		total.sent += sent.sent;
+		total.errors += sent.errors;
+		total.lost += sent.lost;
+		total.received += got.received;
+		total.truncated += got.truncated;
+		for (int rc = 0; rc < 16; ++rc)
+			total.rcodes[rc] += got.rcodes[rc];
+		total.latencies.insert(total.latencies.end(), got.latencies.begin(), got.latencies.end());
+		if (!options.tcp)
+		{
+			// Still in flight after the final wait
+			for (int id = 0; id < 65536; ++id)
+				if (sender->slots[id].load())
+					total.lost++;
+			closesocket_compat(sender->udp);
+			delete[] sender->slots;
+		}
+		delete sender;
+	}
+
+	string json = report(options, workload, total, elapsed);
+	cout << json;
+	if (!options.output.empty())
+	{
+		ofstream out(options.output.c_str());
+		out << json;
+		if (!out)
+		{
+			cerr << "Error: cannot write " << options.output << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,391 @@
+// dnsreplay - replay captured DNS queries through the request engine
+//
+//   dnsreplay -z zonefile [-z zonefile2 ...] [-j threads] [-n passes] [-p port]
+//             [--compare] [--slow-ms ms] [-o result.json] capture.pcap
+//
+// Reads the queries (QR clear, opcode QUERY) sent to `port` (default 53)
+// from a pcap or pcapng capture and hands them to RequestEngine in
+// process, spread over the threads, as fast as it takes them. No sockets
+// are involved, so this measures the engine alone on a real query mix.
+//
+// Reports throughput, rcode counts and the response size distribution as
+// JSON. With --compare, each response of the first pass is also compared
+// with the response recorded in the capture for the same client, port,
+// transport and ID. With --slow-ms, queries slower than that are printed
+// from the slow log to stderr at the end.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include "pcap.h"
+#include "request_engine.h"
+#include "stage_trace.h"
+#include "slow_log.h"
+#include "wire.h"
+#include "zoneFileLoader.h"
+
+using namespace std;
+
+namespace {
+
+// Upper bounds of the response size buckets, in bytes
+const unsigned int SIZE_BUCKETS[] = {64, 128, 256, 512, 1232, 4096, 65535};
+const int NUM_SIZE_BUCKETS = sizeof(SIZE_BUCKETS) / sizeof(SIZE_BUCKETS[0]);
+
+struct Query
+{
+	string payload;
+	RequestEngine::Client client;
+	RequestEngine::Transport transport;
+	const string* recorded;  // Response in the capture, or NULL
+};
+
+struct Counts
+{
+	unsigned long long handled = 0;
+	unsigned long long no_response = 0;
+	unsigned long long rcodes[16] = {};
+	unsigned long long sizes[NUM_SIZE_BUCKETS] = {};
+	unsigned long long bytes = 0;
+	unsigned int max_size = 0;
+
+	// --compare
+	unsigned long long compared = 0;
+	unsigned long long identical = 0;
+	unsigned long long same_rcode = 0;
+	unsigned long long rcode_differs = 0;
+	unsigned long long missing = 0;     // Recorded a response, produced none
+};
+
+struct Worker
+{
+	RequestEngine* engine;
+	const vector<Query>* queries;
+	unsigned int index;
+	unsigned int threads;
+	unsigned int passes;
+	bool compare;
+	atomic<bool>* go;
+	Counts counts;
+};
+
+unsigned long long now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void compareResponse(const RequestEngine::Response& response, bool answered, const string& recorded, Counts& counts)
+{
+	counts.compared++;
+	if (!answered)
+	{
+		counts.missing++;
+		return;
+	}
+	if (response.length == recorded.length() && memcmp(response.data, recorded.data(), recorded.length()) == 0)
+		counts.identical++;
+	else if (recorded.length() >= 4 && response.length >= 4 &&
+	         (wire_read_u16(recorded.data(), 2) & 0x000F) == (wire_read_u16(response.data, 2) & 0x000F))
+		counts.same_rcode++;
+	else
+		counts.rcode_differs++;
+}
+
+void* replayWorker(void* arg)
+{
+	Worker* worker = (Worker*)arg;
+	const vector<Query>& queries = *worker->queries;
+	RequestEngine::Response* response = new RequestEngine::Response();
+	char packet[0x10000];
+
+	while (!worker->go->load())
+		;
+
+	for (unsigned int pass = 0; pass < worker->passes; ++pass)
+	{
+		for (size_t i = worker->index; i < queries.size(); i += worker->threads)
+		{
+			const Query& query = queries[i];
+			// The engine may write to the request, so it gets a copy
+			memcpy(packet, query.payload.data(), query.payload.length());
+			bool answered = worker->engine->handle(packet, (unsigned int)query.payload.length(),
+			                                       query.client, query.transport, *response);
+
+			Counts& counts = worker->counts;
+			counts.handled++;
+			if (answered)
+			{
+				counts.rcodes[wire_read_u16(response->data, 2) & 0x000F]++;
+				int bucket = 0;
+				while (bucket < NUM_SIZE_BUCKETS - 1 && response->length > SIZE_BUCKETS[bucket])
+					++bucket;
+				counts.sizes[bucket]++;
+				counts.bytes += response->length;
+				counts.max_size = max(counts.max_size, response->length);
+			}
+			else
+				counts.no_response++;
+
+			if (worker->compare && pass == 0 && query.recorded)
+				compareResponse(*response, answered, *query.recorded, counts);
+		}
+	}
+
+	delete response;
+	return NULL;
+}
+
+string flowKey(const string& client, unsigned short port, bool tcp, unsigned short id)
+{
+	ostringstream key;
+	key << client << '|' << port << '|' << (tcp ? 't' : 'u') << '|' << id;
+	return key.str();
+}
+
+int usage(const char* argv0)
+{
+	cerr << "Usage: " << argv0 << " -z zonefile [-z zonefile2 ...] [-j threads] [-n passes] [-p port]" << endl
+	     << "       [--compare] [--slow-ms ms] [-o result.json] capture.pcap" << endl;
+	return 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	vector<string> zonefiles;
+	string capture, output;
+	unsigned int threads = 1, passes = 1;
+	unsigned short port = 53;
+	bool compare = false;
+	SlowLog::setThreshold(0);
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		string opt = argv[arg];
+		if (opt == "--compare")
+		{
+			compare = true;
+			continue;
+		}
+		if (opt[0] != '-')
+		{
+			if (!capture.empty())
+				return usage(argv[0]);
+			capture = opt;
+			continue;
+		}
+		if (arg + 1 >= argc)
+			return usage(argv[0]);
+		const char* value = argv[++arg];
+
+		if (opt == "-z" || opt == "--zone")
+			zonefiles.push_back(value);
+		else if (opt == "-j" || opt == "--threads")
+			threads = (unsigned int)atoi(value);
+		else if (opt == "-n" || opt == "--passes")
+			passes = (unsigned int)atoi(value);
+		else if (opt == "-p" || opt == "--port")
+			port = (unsigned short)atoi(value);
+		else if (opt == "--slow-ms")
+			SlowLog::setThreshold((unsigned long long)(atof(value) * 1000000.0));
+		else if (opt == "-o" || opt == "--output")
+			output = value;
+		else
+			return usage(argv[0]);
+	}
+	if (zonefiles.empty() || capture.empty() || threads < 1 || passes < 1)
+		return usage(argv[0]);
+
+	ZoneFileLoader::verbosity = ZoneFileLoader::QUIET;
+	vector<Zone*> zones;
+	for (size_t i = 0; i < zonefiles.size(); ++i)
+		if (!ZoneFileLoader::loadFile(zonefiles[i], zones))
+			return 1;
+	for (size_t i = 0; i < zones.size(); ++i)
+		zones[i]->shrinkToFit();
+
+	vector<Pcap::Packet> packets;
+	string error;
+	if (!Pcap::readFile(capture, port, packets, error))
+	{
+		cerr << "Error: " << capture << ": " << error << endl;
+		return 1;
+	}
+
+	// Queries to the server, and its responses keyed by the flow they answer.
+	// `packets` stays alive and unchanged, so queries point into it.
+	map<string, const string*> responses;
+	vector<Query> queries;
+	vector<string> keys;
+	unsigned long long skipped = 0;
+	for (size_t i = 0; i < packets.size(); ++i)
+	{
+		const Pcap::Packet& packet = packets[i];
+		unsigned short id = wire_read_u16(packet.payload.data(), 0);
+		unsigned short flags = wire_read_u16(packet.payload.data(), 2);
+		bool response = (flags & 0x8000) != 0;
+		int opcode = (flags >> 11) & 0x0F;
+
+		if (response && packet.src_port == port)
+			responses.insert(make_pair(flowKey(packet.dst, packet.dst_port, packet.tcp, id), &packet.payload));
+		else if (!response && packet.dst_port == port && opcode == Message::QUERY)
+		{
+			Query query;
+			query.payload = packet.payload;
+			query.client.setAddress(packet.src.c_str());
+			query.transport = packet.tcp ? RequestEngine::TCP : RequestEngine::UDP;
+			query.recorded = NULL;
+			queries.push_back(query);
+			keys.push_back(flowKey(packet.src, packet.src_port, packet.tcp, id));
+		}
+		else
+			skipped++;  // UPDATEs and other opcodes change zones; not replayed
+	}
+	for (size_t i = 0; i < queries.size(); ++i)
+	{
+		map<string, const string*>::const_iterator recorded = responses.find(keys[i]);
+		if (recorded != responses.end())
+			queries[i].recorded = recorded->second;
+	}
+
+	if (queries.empty())
+	{
+		cerr << "Error: no DNS queries to port " << port << " in " << capture << endl;
+		return 1;
+	}
+	cerr << "dnsreplay: " << queries.size() << " queries (" << skipped << " other packets skipped), "
+	     << threads << " thread(s), " << passes << " pass(es)" << endl;
+
+	RequestEngine engine(zones, false);
+	atomic<bool> go(false);
+	vector<Worker*> workers;
+	vector<pthread_t> handles;
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		Worker* worker = new Worker();
+		worker->engine = &engine;
+		worker->queries = &queries;
+		worker->index = i;
+		worker->threads = threads;
+		worker->passes = passes;
+		worker->compare = compare;
+		worker->go = &go;
+		workers.push_back(worker);
+
+		pthread_t handle;
+		if (pthread_create(&handle, NULL, replayWorker, worker) != 0)
+		{
+			cerr << "Error: cannot start thread" << endl;
+			return 1;
+		}
+		handles.push_back(handle);
+	}
+
+	unsigned long long start = now_ns();
+	go.store(true);
+	for (size_t i = 0; i < handles.size(); ++i)
+		pthread_join(handles[i], NULL);
+	double elapsed = max((now_ns() - start) / 1e9, 1e-9);
+
+	Counts total;
+	for (size_t i = 0; i < workers.size(); ++i)
+	{
+		const Counts& c = workers[i]->counts;
+		total.handled += c.handled;
+		total.no_response += c.no_response;
+		for (int rc = 0; rc < 16; ++rc)
+			total.rcodes[rc] += c.rcodes[rc];
+		for (int b = 0; b < NUM_SIZE_BUCKETS; ++b)
+			total.sizes[b] += c.sizes[b];
+		total.bytes += c.bytes;
+		total.max_size = max(total.max_size, c.max_size);
+		total.compared += c.compared;
+		total.identical += c.identical;
+		total.same_rcode += c.same_rcode;
+		total.rcode_differs += c.rcode_differs;
+		total.missing += c.missing;
+		delete workers[i];
+	}
+	unsigned long long answered = total.handled - total.no_response;
+
+	ostringstream json;
+	json.setf(ios::fixed);
+	json.precision(3);
+	json << "{\n"
+	     << "  \"capture\": \"" << capture << "\",\n"
+	     << "  \"queries\": " << queries.size() << ",\n"
+	     << "  \"threads\": " << threads << ",\n"
+	     << "  \"passes\": " << passes << ",\n"
+	     << "  \"handled\": " << total.handled << ",\n"
+	     << "  \"elapsed_s\": " << elapsed << ",\n"
+	     << "  \"qps\": " << total.handled / elapsed << ",\n"
+	     << "  \"no_response\": " << total.no_response << ",\n"
+	     << "  \"rcodes\": {";
+	bool first = true;
+	for (int rc = 0; rc < 16; ++rc)
+	{
+		if (!total.rcodes[rc])
+			continue;
+		json << (first ? "" : ", ") << "\"" << Message::RCodeToString((Message::RCode)rc) << "\": " << total.rcodes[rc];
+		first = false;
+	}
+	json << "},\n"
+	     << "  \"response_size\": {\"mean\": " << (answered ? (double)total.bytes / answered : 0.0)
+	     << ", \"max\": " << total.max_size << ", \"buckets\": {";
+	for (int b = 0; b < NUM_SIZE_BUCKETS; ++b)
+		json << (b ? ", " : "") << "\"<=" << SIZE_BUCKETS[b] << "\": " << total.sizes[b];
+	json << "}}";
+	if (compare)
+	{
+		json << ",\n  \"compare\": {\"compared\": " << total.compared
+		     << ", \"identical\": " << total.identical
+		     << ", \"same_rcode\": " << total.same_rcode
+		     << ", \"rcode_differs\": " << total.rcode_differs
+		     << ", \"no_response\": " << total.missing << "}";
+	}
+#if STAGE_TRACE
+	json << ",\n  \"stages_ns\": {";
+	first = true;
+	for (int stage = 0; stage < StageTrace::NUM_STAGES; ++stage)
+	{
+		StageTrace::Histogram h = StageTrace::merged((StageTrace::Stage)stage);
+		if (!h.count())
+			continue;
+		json << (first ? "" : ",") << "\n    \"" << StageTrace::stageName((StageTrace::Stage)stage) << "\": {"
+		     << "\"count\": " << h.count() << ", \"p50\": " << h.percentile(50) << ", \"p99\": " << h.percentile(99)
+		     << ", \"p99.9\": " << h.percentile(99.9) << ", \"max\": " << h.max() << "}";
+		first = false;
+	}
+	json << "\n  }";
+#endif
+	json << "\n}\n";
+
+	cout << json.str();
+	SlowLog::dump(cerr);
+	if (!output.empty())
+	{
+		ofstream out(output.c_str());
+		out << json.str();
+		if (!out)
+		{
+			cerr << "Error: cannot write " << output << endl;
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < zones.size(); ++i)
+		delete zones[i];
+	return 0;
+}
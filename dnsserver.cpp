@@ -21,21 +21,24 @@ using namespace std;
 #include "message.h"
 #include "rr.h"
 #include "rrsoa.h"
-#include "rrtxt.h"
 #include "zoneFileLoader.h"
 #include "zoneFileSaver.h"
-#include "zone_authority.h"
-#include "update_processor.h"
+#include "zoneImage.h"
+#include "zoneLoadPool.h"
+#include "request_engine.h"
 #include "query_processor.h"
-#include "tsig.h"
+#include "stats.h"
+#include "stage_trace.h"
+#include "slow_log.h"
+#include "rate_limit.h"
+#include "cookie.h"
+#include "client_subnet.h"
 #include "version.h"
 
-// Global mutex for zone modifications
-pthread_mutex_t g_zone_mutex = PTHREAD_MUTEX_INITIALIZER; 
-
 // Global flags for signal handlers
 volatile sig_atomic_t g_reload_zones = 0; 
 volatile sig_atomic_t g_shutdown = 0; 
+volatile sig_atomic_t g_dump_stats = 0;
 
 
 
@@ -53,439 +56,18 @@ void dump(char *buf, int len)
 	cout << flush;
 }
 
-void dumpPacketHex(const char* label, char *buf, int len)
-{
-	cerr << "[" << label << "] Packet dump (" << len << " bytes):" << endl;
-	for (int i = 0; i < len; i++)
-	{
-		cerr << hex << setfill('0') << setw(2) << (int)(unsigned char)buf[i];
-		if (i % 16 == 15)
-			cerr << endl;
-		else if (i % 2 == 1)
-			cerr << " ";
-	}
-	if ((len - 1) % 16 != 15)
-		cerr << endl;
-	cerr << dec << flush;
-}
-
-void handleVersionBind(SOCKET s, SOCKADDR_STORAGE* addr, int addrlen, Message* request, vector<Zone*>& zones, bool is_tcp)
-{
-	try {
-		const RR *qrr = request->qd[0];
-		Message *reply = new Message();
-		reply->id = request->id;
-		reply->opcode = Message::QUERY;
-		reply->qd.push_back(qrr->clone());
-		reply->truncation = false;
-		reply->query = false;
-		reply->authoritative = true;
-		reply->rcode = Message::CODENOERROR;
-		reply->recursionavailable = reply->recursiondesired = request->recursiondesired;
-		
-		// Check if there's a version.bind record in the zone file
-		string version_text = VERSION;
-		for (vector<Zone*>::iterator zone_iter = zones.begin(); zone_iter != zones.end(); ++zone_iter)
-		{
-			Zone* zone = *zone_iter;
-			const vector<RR*>& rrs = zone->getAllRecords();
-			for (vector<RR*>::const_iterator rr_iter = rrs.begin(); rr_iter != rrs.end(); ++rr_iter)
-			{
-				const RR* rr = *rr_iter;
-				if (rr->name == qrr->name && rr->type == RR::TXT && rr->rrclass == RR::CH)
-				{
-					// Found zone file entry - prepend it to version
-					version_text = rr->rdata + " " + VERSION;
-					break;
-				}
-			}
-		}
-		
-		// Create TXT record with version
-		RR *arr = new RRTXT();
-		arr->name = qrr->name;
-		arr->rrclass = RR::CH;
-		arr->type = RR::TXT;
-		arr->ttl = 0;
-		arr->query = false;
-		arr->rdata = version_text;
-		reply->an.push_back(arr);
-		
-		// Add EDNS(0) support to response if client supports it
-		reply->copyEDNS(request);
-		
-		cout << *reply << flush;
-		
-		char response[0x10000];
-		unsigned int response_len = 0;
-		reply->pack(response, sizeof(response), response_len);
-		
-		send_dns_response(s, response, response_len, addr, addrlen, is_tcp);
-		delete reply;
-	}
-	catch (const std::exception& e)
-	{
-		cerr << "\n[EXCEPTION] In handleVersionBind(): " << e.what() << endl;
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-	catch (...)
-	{
-		cerr << "\n[EXCEPTION] Unknown exception in handleVersionBind()" << endl;
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-}
-
-void handleQuery(SOCKET s, char *buf, int len, char *from, SOCKADDR_STORAGE *addr, int addrlen,
-                 Message *request, vector<Zone *>& zones, unsigned long fromaddr, bool is_tcp = false)
-{
-	try {
-		if (request->qd.size() != 1 || !request->qd[0])
-		{
-			return;
-		}
-		
-		const RR *qrr = request->qd[0];
-		
-		// Handle CHAOS class version.bind queries
-		if (qrr->rrclass == RR::CH && qrr->type == RR::TXT && 
-		    (qrr->name == "version.bind." || qrr->name == "version."))
-		{
-			handleVersionBind(s, addr, addrlen, request, zones, is_tcp);
-			return;
-		}
-		
-		// Find zone using ZoneAuthority
-		ZoneAuthority authority(zones);
-		ZoneLookupResult lookup = authority.findZoneForName(qrr->name, fromaddr);
-		
-		if (!lookup.found)
-		{
-			// Zone not found - return SERVFAIL instead of no response
-			Message *reply = new Message();
-			reply->id = request->id;
-			reply->opcode = Message::QUERY;
-			reply->qd.push_back(qrr->clone());
-			reply->truncation = false;
-			reply->query = false;
-			reply->authoritative = true;
-			reply->rcode = Message::CODESERVERFAILURE;
-			reply->recursionavailable = reply->recursiondesired = request->recursiondesired;
-			reply->copyEDNS(request);
-			
-			char response[0x10000];
-			unsigned int response_len = 0;
-			reply->pack(response, sizeof(response), response_len);
-			
-			send_dns_response(s, response, response_len, addr, addrlen, is_tcp);
-			delete reply;
-			return;
-		}
-		
-		if (!lookup.authorized)
-		{
-			// Return REFUSED per RFC 1035 - client gets explicit error instead of silent drop
-			Message *reply = new Message();
-			reply->id = request->id;
-			reply->opcode = Message::QUERY;
-			reply->qd.push_back(qrr->clone());
-			reply->truncation = false;
-			reply->query = false;
-			reply->authoritative = true;
-			reply->rcode = Message::CODEREFUSED;
-			reply->recursionavailable = reply->recursiondesired = request->recursiondesired;
-			reply->copyEDNS(request);
-			
-			char response[0x10000];
-			unsigned int response_len = 0;
-			reply->pack(response, sizeof(response), response_len);
-			
-			send_dns_response(s, response, response_len, addr, addrlen, is_tcp);
-			delete reply;
-			return;
-		}
-		
-		Message *reply = new Message();
-		reply->id = request->id;
-		reply->opcode = Message::QUERY;
-		reply->qd.push_back(qrr->clone());
-		reply->truncation = false;
-		reply->query = false;
-		reply->authoritative = true;
-		reply->rcode = Message::CODENOERROR;
-		reply->recursionavailable = reply->recursiondesired = request->recursiondesired;
-		
-		vector<RR*> matches;
-		vector<RR*> dynamic_records;  // Track dynamically-created records for cleanup
-		RR *rrNs = nullptr;
-		
-		// Search the zone (ACL longest-match already applied in zone_authority)
-		QueryProcessor::findMatches(qrr, *lookup.zone, matches, &rrNs, &dynamic_records);
-		
-		// Clone matches and add to answer section
-		for (vector<RR*>::const_iterator match_iter = matches.begin(); 
-		     match_iter != matches.end(); ++match_iter)
-		{
-			RR *arr = (*match_iter)->clone();
-			arr->query = false;
-			arr->ttl = 10 * 60; // 10 minutes
-			reply->an.push_back(arr);
-		}
-		
-		// Clean up dynamically-created records (from DYNAMIC RR expansion)
-		for (vector<RR*>::iterator it = dynamic_records.begin(); 
-		     it != dynamic_records.end(); ++it)
-		{
-			delete *it;
-		}
-
-		// If no answers found, return NXDOMAIN instead of NOERROR with empty answers
-		// This is critical for proper DNS resolution - RFC 2308 requires NXDOMAIN for non-existent names
-		if (reply->an.size() == 0) {
-			if (rrNs != nullptr) {
-				// There's a delegation (NS record), so return NOERROR with authority section
-				RR *arr = rrNs->clone();
-				arr->query = false;
-				arr->ttl = 10 * 60; // 10 minutes
-				reply->ns.push_back(arr);
-				reply->authoritative = false;
-			} else {
-				// No records found - return NXDOMAIN
-				// Per RFC 2308, include SOA record for negative caching
-				vector<RR*> soa_rrs = lookup.zone->findRecordsByName(lookup.zone->name, RR::SOA);
-				if (!soa_rrs.empty()) {
-					RR* soa = soa_rrs[0]->clone();
-					soa->query = false;
-					reply->ns.push_back(soa);
-				}
-				reply->rcode = Message::CODENAMEERROR;
-			}
-		}
-		
-		// Add EDNS(0) support to response if client supports it
-		reply->copyEDNS(request);
-		
-		cout << *reply << flush;
-		
-		char response[0x10000];
-		unsigned int response_len = 0;
-		reply->pack(response, sizeof(response), response_len);
-		
-		send_dns_response(s, response, response_len, addr, addrlen, is_tcp);
-		
-		delete reply;
-	}
-	catch (const std::exception& e)
-	{
-		cerr << "\n[EXCEPTION] In handleQuery(): " << e.what() << endl;
-		cerr << "[EXCEPTION] Query: " << (request->qd[0] ? request->qd[0]->name : "NULL") 
-		     << " from " << from << endl;
-		dumpPacketHex("QUERY_EXCEPTION", buf, len);
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-	catch (...)
-	{
-		cerr << "\n[EXCEPTION] Unknown exception in handleQuery()" << endl;
-		cerr << "[EXCEPTION] Query: " << (request->qd[0] ? request->qd[0]->name : "NULL") 
-		     << " from " << from << endl;
-		dumpPacketHex("QUERY_EXCEPTION", buf, len);
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-}
-
-void handleUpdate(SOCKET s, char *buf, int len, char *from, SOCKADDR_STORAGE *addr, int addrlen, 
-                  Message *request, vector<Zone *>& zones, unsigned long fromaddr, bool is_tcp = false)
-{
-	try {
-		const RR *zone_rr = NULL;
-		Message *reply = new Message();
-		reply->id = request->id;
-		reply->opcode = Message::UPDATE;
-		reply->query = false;
-		reply->authoritative = true;
-		reply->truncation = false;
-		reply->recursiondesired = false;
-		reply->recursionavailable = false;
-		reply->rcode = Message::CODENOERROR;
-		
-		if (request->qd.size() != 1 || !request->qd[0])
-		{
-			cout << "UPDATE: Invalid zone section" << endl << flush;
-			reply->rcode = Message::CODEFORMATERROR;
-			goto send_response;
-		}
-		
-		zone_rr = request->qd[0];
-		if (zone_rr->type != RR::SOA)
-		{
-			cout << "UPDATE: Zone section must be SOA" << endl << flush;
-			reply->rcode = Message::CODEFORMATERROR;
-			goto send_response;
-		}
-		
-		cout << "UPDATE: Processing zone " << zone_rr->name << endl << flush;
-		
-		{
-			// Find zone using ZoneAuthority
-			ZoneAuthority authority(zones);
-			ZoneLookupResult lookup = authority.findZoneForName(zone_rr->name, fromaddr);
-			
-			if (!lookup.found || !lookup.authorized)
-			{
-				cout << "UPDATE: " << lookup.error_message << endl << flush;
-				reply->rcode = Message::CODEREFUSED;
-				goto send_response;
-			}
-			
-			Zone *target_zone = lookup.zone;
-			cout << "UPDATE: Target zone found: " << target_zone->name << endl << flush;
-			
-			// TSIG Authentication Check
-			if (target_zone->tsig_key)
-			{
-				string tsig_error;
-				if (!TSIG::verify(request, buf, len, target_zone->tsig_key, tsig_error))
-				{
-					cout << "UPDATE: TSIG verification failed: " << tsig_error << endl << flush;
-					reply->rcode = Message::CODEREFUSED;
-					goto send_response;
-				}
-				cout << "UPDATE: TSIG verification successful" << endl << flush;
-			}
-			
-			cout << "UPDATE: Prerequisites: " << request->an.size() << ", Updates: " << request->ns.size() << endl << flush;
-			
-			// Check prerequisites using UpdateProcessor
-			string prereq_error;
-			Message::RCode prereq_result = UpdateProcessor::checkPrerequisites(request, *target_zone, prereq_error);
-			if (prereq_result != Message::CODENOERROR)
-			{
-			 cout << "UPDATE: " << prereq_error << endl << flush;
-				reply->rcode = prereq_result;
-				goto send_response;
-			}
-			
-			cout << "UPDATE: All prerequisites passed" << endl << flush;
-			
-			// CRITICAL SECTION START: Protect all zone modifications
-			MutexGuard<pthread_mutex_t> lock(&g_zone_mutex);
-			
-			// Apply updates using UpdateProcessor
-			string update_error;
-			UpdateProcessor::applyUpdates(request, *target_zone, update_error);
-			
-			// MutexGuard auto-unlocks on destruction
-			// CRITICAL SECTION END
-			
-			cout << "UPDATE: Success" << endl << flush;
-		}
-		
-send_response:
-		if (zone_rr)
-			reply->qd.push_back(zone_rr->clone());
-		
-		// Add EDNS(0) support to response if client supports it
-		reply->copyEDNS(request);
-		
-		char packet[0x10000] = {};
-		unsigned int packetsize = 0;
-		
-		cout << *reply << endl << flush;
-		
-		reply->pack(packet, (unsigned int)sizeof(packet), packetsize);
-		send_dns_response(s, packet, packetsize, addr, addrlen, is_tcp);
-		
-		delete reply;
-	}
-	catch (const std::exception& e)
-	{
-		cerr << "\n[EXCEPTION] In handleUpdate(): " << e.what() << endl;
-		cerr << "[EXCEPTION] Zone: " << (request->qd[0] ? request->qd[0]->name : "NULL") 
-		     << " from " << from << endl;
-		dumpPacketHex("UPDATE_EXCEPTION", buf, len);
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-	catch (...)
-	{
-		cerr << "\n[EXCEPTION] Unknown exception in handleUpdate()" << endl;
-		cerr << "[EXCEPTION] Zone: " << (request->qd[0] ? request->qd[0]->name : "NULL") 
-		     << " from " << from << endl;
-		dumpPacketHex("UPDATE_EXCEPTION", buf, len);
-		cerr << flush;
-		throw; // Re-throw to be caught by handle()
-	}
-}
-
-
-void handle(SOCKET s, char *buf, int len, char *from, SOCKADDR_STORAGE *addr, int addrlen, vector<Zone *>& zones, bool is_tcp = false)
+void handle(SOCKET s, char *buf, int len, char *from, SOCKADDR_STORAGE *addr, int addrlen, RequestEngine& engine, bool is_tcp = false)
 {
-	time_t t = time(NULL);
-	tm *tmt = localtime(&t);
-	char tmp[200];
-
-	
-	HOSTENT *he = NULL;
-	/*
-	char *ipBytes = (char *)&((sockaddr_in *)addr)->sin_addr.s_addr;
-	
-	he = gethostbyaddr(ipBytes, addrlen, AF_INET);
-	*/
+	// The server loop is single-threaded, so one buffer serves every request
+	static RequestEngine::Response response;
 
-	strftime(tmp, sizeof(tmp), "%Y.%m.%d %H:%M:%S", tmt);
-	cout << "\n" << tmp << " [" << from << "] {" << (he ? he->h_name : "-") << "} : " << len << endl << flush;
-	unsigned long fromaddr = inet_addr(from);
+	RequestEngine::Client client;
+	client.setAddress(from);
 
-	//dump(buf, len);
-
-	try {
-		Message *msgtest = new Message();
-		unsigned int offset = 0;
-		if (!msgtest->unpack(buf, len, offset))
-		{
-			delete msgtest;
-			cerr << "[UNPACK_FAILED] Message unpacking failed" << endl;
-			cerr << "[UNPACK_FAILED] Client: " << from << ", Packet length: " << len << " bytes" << endl;
-			dumpPacketHex("UNPACK_FAILED", buf, len);
-			cerr << flush;
-			cout << "faulty" << endl << flush;
-			return;
-		}
-
-		cout << *msgtest << flush;
-		
-		if (msgtest->query && msgtest->opcode == Message::UPDATE)
-		{
-			handleUpdate(s, buf, len, from, addr, addrlen, msgtest, zones, fromaddr, is_tcp);
-			delete msgtest;
-			return;
-		}
-		
-		if (msgtest->query && msgtest->opcode == Message::QUERY)
-		{
-			handleQuery(s, buf, len, from, addr, addrlen, msgtest, zones, fromaddr, is_tcp);
-			delete msgtest;
-			return;
-		}
-
-		delete msgtest;
-	}
-	catch (const std::exception& e)
-	{
-		cerr << "\n[EXCEPTION] Caught exception in handle(): " << e.what() << endl;
-		cerr << "[EXCEPTION] Client: " << from << ", Packet length: " << len << " bytes" << endl;
-		dumpPacketHex("EXCEPTION", buf, len);
-		cerr << flush;
-	}
-	catch (...)
+	if (engine.handle(buf, len, client, is_tcp ? RequestEngine::TCP : RequestEngine::UDP, response))
 	{
-		cerr << "\n[EXCEPTION] Caught unknown exception in handle()" << endl;
-		cerr << "[EXCEPTION] Client: " << from << ", Packet length: " << len << " bytes" << endl;
-		dumpPacketHex("EXCEPTION", buf, len);
-		cerr << flush;
+		StageTrace::Timer timer(StageTrace::SEND);
+		send_dns_response(s, response.data, response.length, addr, addrlen, is_tcp);
 	}
 }
 
@@ -565,6 +147,23 @@ void sigtermHandler(int /*signum*/)
 	g_shutdown = 1;
 }
 
+void sigusr1Handler(int /*signum*/)
+{
+	g_dump_stats = 1;
+}
+
+void handleStatsRequest()
+{
+	if (!g_dump_stats)
+		return;
+
+	g_dump_stats = 0;
+	Stats::dump(cerr);
+	SlowLog::dump(cerr);
+	if (RateLimiter::global().enabled())
+		RateLimiter::global().dump(cerr);
+}
+
 void saveModifiedZonesLocked(vector<Zone*>& zones, const char* prefix)
 {
 	for (vector<Zone*>::iterator it = zones.begin(); it != zones.end(); ++it)
@@ -603,38 +202,53 @@ void clearExistingZones(vector<Zone*>& zones)
 	zones.clear();
 }
 
-bool loadZoneFile(const string& zonefile_path, vector<Zone*>& zones)
+bool loadZoneFile(const string& zonefile_path, vector<Zone*>& zones, ostream& log)
 {
-	vector<string> zonedata;
-	
-	ifstream zonefile;
-	zonefile.open(zonefile_path.c_str());
-	
-	if (!zonefile.good())
+	// Prefer a compiled image when one exists and is still fresh
+	string image_path = ZoneImage::pathFor(zonefile_path);
+	if (access(image_path.c_str(), R_OK) == 0)
 	{
-		cerr << "Error: Cannot open zone file: " << zonefile_path << endl;
-		return false;
+		string image_error;
+		if (ZoneImage::load(image_path, zonefile_path, zones, image_error))
+		{
+			log << "Zone " << zonefile_path << " loaded from image " << image_path << endl;
+			return true;
+		}
+		log << "Zone image " << image_path << " not used (" << image_error 
+		    << "), loading text zone file" << endl;
 	}
 	
-	do
+	if (!ZoneFileLoader::loadFile(zonefile_path, zones, log))
+		return false;
+	log << "Zone " << zonefile_path << " loaded" << endl;
+	
+	return true;
+}
+
+// Parse all zone files concurrently, then report and merge them in
+// command line order. Returns the number of files that failed to load.
+int loadZoneFiles(vector<string>& zonefiles, vector<Zone*>& zones, const char* prefix = "")
+{
+	vector<ZoneLoadPool::Result> results;
+	ZoneLoadPool::loadAll(zonefiles, loadZoneFile, results);
+	
+	int failed = 0;
+	for (size_t i = 0; i < results.size(); ++i)
 	{
-		char line[4096];
-		if (zonefile.getline(line, sizeof(line)))
+		cerr << results[i].log;
+		if (!results[i].ok)
 		{
-			zonedata.push_back(line);
+			cerr << prefix << "[-] error loading zones from " << zonefiles[i] << ", skipping..." << endl;
+			failed++;
+			continue;
 		}
-		else
-			break;
-	} while (true);
-	
-	if (!ZoneFileLoader::load(zonedata, zones, zonefile_path))
-	{
-		cerr << "Error loading zones from " << zonefile_path << endl;
-		return false;
+		zones.insert(zones.end(), results[i].zones.begin(), results[i].zones.end());
+		if (*prefix)
+			cerr << prefix << "Reloaded zone file: " << zonefiles[i] << endl;
 	}
-	cerr << "Zone " << zonefile_path << " loaded" << endl << flush;
+	cerr << flush;
 	
-	return true;
+	return failed;
 }
 
 void reloadZonesLocked(vector<Zone*>& zones, vector<string>& zonefiles)
@@ -643,13 +257,7 @@ void reloadZonesLocked(vector<Zone*>& zones, vector<string>& zonefiles)
 	clearExistingZones(zones);
 	
 	cerr << "[SIGHUP] Reloading zones from disk..." << endl;
-	for (vector<string>::iterator zf_it = zonefiles.begin(); zf_it != zonefiles.end(); ++zf_it)
-	{
-		if (loadZoneFile(*zf_it, zones))
-		{
-			cerr << "[SIGHUP] Reloaded zone file: " << *zf_it << endl;
-		}
-	}
+	loadZoneFiles(zonefiles, zones, "[SIGHUP] ");
 	
 	cerr << "[SIGHUP] Zone reload complete. Total zones: " << zones.size() << endl;
 }
@@ -790,10 +398,14 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 	
 	// Signal handlers are installed in main()
 	
+	RequestEngine engine(zones);
+	
 	while (!g_shutdown)
 	{
 		// Check for reload request
 		handleReloadRequest(zones, zonefiles);
+		handleStatsRequest();
+		DnsCookies::global().rotateIfDue(time(NULL));
 		
 		char buf[0xFFFF] = {0};
 		char hostname[NI_MAXHOST] = {0x41};
@@ -826,7 +438,9 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 
 			fromlen = sizeof(from);
 			memset(&from, 0, fromlen);
+			unsigned long long recv_start = StageTrace::now();
 			int numrecv = recvfrom(udp_s[i], (char *)&buf, sizeof(buf), 0, (sockaddr *)&from, &fromlen);
+			StageTrace::record(StageTrace::RECV, StageTrace::now() - recv_start);
 			if (numrecv == SOCKET_ERROR || numrecv == 0)
 			{
 				if (!wouldblock())
@@ -837,7 +451,7 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 			if (getnameinfo((sockaddr *)&from, fromlen, hostname, sizeof(hostname), NULL, 0, NI_NUMERICHOST))
 				strcpy(hostname, "unknown");
 
-			handle(udp_s[i], buf, numrecv, hostname, reinterpret_cast<SOCKADDR_STORAGE*>(&from), fromlen, zones, false);
+			handle(udp_s[i], buf, numrecv, hostname, reinterpret_cast<SOCKADDR_STORAGE*>(&from), fromlen, engine, false);
 		}
 
 		// Handle TCP
@@ -859,6 +473,7 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 			}
 
 			// Read length prefix
+			unsigned long long recv_start = StageTrace::now();
 			unsigned short msglen;
 			int recv_result = recv(client, (char*)&msglen, 2, 0);
 			if (recv_result != 2)
@@ -889,10 +504,12 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 				continue;
 			}
 
+			StageTrace::record(StageTrace::RECV, StageTrace::now() - recv_start);
+
 			if (getnameinfo((sockaddr *)&from, fromlen, hostname, sizeof(hostname), NULL, 0, NI_NUMERICHOST))
 				strcpy(hostname, "unknown");
 
-			handle(client, buf, msglen, hostname, reinterpret_cast<SOCKADDR_STORAGE*>(&from), fromlen, zones, true);
+			handle(client, buf, msglen, hostname, reinterpret_cast<SOCKADDR_STORAGE*>(&from), fromlen, engine, true);
 			
 			closesocket_compat(client);
 		}
@@ -901,6 +518,10 @@ void serverloop(char **vaddr, vector<Zone *>& zones, vector<string>& zonefiles,
 	// Server is shutting down - save all modified zones
 	cerr << "[SHUTDOWN] Saving modified zones before exit..." << endl;
 	saveModifiedZones(zones);
+	Stats::dump(cerr);
+	SlowLog::dump(cerr);
+	if (RateLimiter::global().enabled())
+		RateLimiter::global().dump(cerr);
 	cerr << "[SHUTDOWN] Shutdown complete" << endl;
 }
 
@@ -915,13 +536,14 @@ int main(int argc, char* argv[])
 
 	if (argc < 3)
 	{
-		cerr << "Usage: " << argv[0] << " [-p port] [-u uid] [-g gid] [-d] -z zonefile [-z zonefile2 ...] IP1 [IP2 ...]" << endl;
+		cerr << "Usage: " << argv[0] << " [-p port] [-u uid] [-g gid] [-d] [-v|-q] [--slow-ms ms] [--slow-log-size n] [--max-wildcard-answers n] [--max-cname-chain n] [--rrl-responses n] [--rrl-nxdomains n] [--rrl-errors n] [--rrl-slip n] [--rrl-ipv4-prefix n] [--rrl-ipv6-prefix n] [--cookie-secret hex] [--max-udp-without-cookie n] [--ecs-trusted networks] -z zonefile [-z zonefile2 ...] IP1 [IP2 ...]" << endl;
 		return 1;
 	}
 
 	// Parse options first
 	int uid = -1, gid = -1, port = 53;
 	bool should_daemonize = false;
+	RateLimiter::Config rrl;
 	int arg = 1;
 	for (; arg < argc; ) {
 		if (argv[arg] == std::string("-p") || argv[arg] == std::string("--port")) {
@@ -940,6 +562,81 @@ int main(int argc, char* argv[])
 			should_daemonize = true;
 			arg += 1;
 		} else
+		if (argv[arg] == std::string("-v") || argv[arg] == std::string("--verbose")) {
+			ZoneFileLoader::verbosity = ZoneFileLoader::VERBOSE;  // Echo every loaded record
+			arg += 1;
+		} else
+		if (argv[arg] == std::string("-q") || argv[arg] == std::string("--quiet")) {
+			ZoneFileLoader::verbosity = ZoneFileLoader::QUIET;
+			arg += 1;
+		} else
+		if (argv[arg] == std::string("--slow-ms") && arg + 1 < argc) {
+			// Requests slower than this are kept in the slow log; 0 turns it off
+			SlowLog::setThreshold((unsigned long long)(atof(argv[arg + 1]) * 1000000.0));
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--slow-log-size") && arg + 1 < argc) {
+			SlowLog::setCapacity((size_t)atoi(argv[arg + 1]));
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--max-wildcard-answers") && arg + 1 < argc) {
+			// Limits on *.suffix and **.suffix answers; 0 means no limit
+			QueryProcessor::max_wildcard_answers = (size_t)atol(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--max-cname-chain") && arg + 1 < argc) {
+			// In-zone CNAME targets followed per query (QUERY_RESOLUTION.md)
+			QueryProcessor::max_cname_chain = (size_t)atol(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-responses") && arg + 1 < argc) {
+			// Response rate limiting per client network (RATE_LIMITING.md); 0 is off
+			rrl.rate[RateLimiter::RESPONSE] = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-nxdomains") && arg + 1 < argc) {
+			rrl.rate[RateLimiter::NXDOMAIN] = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-errors") && arg + 1 < argc) {
+			rrl.rate[RateLimiter::ERROR] = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-slip") && arg + 1 < argc) {
+			rrl.slip = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-ipv4-prefix") && arg + 1 < argc) {
+			rrl.ipv4_prefix = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--rrl-ipv6-prefix") && arg + 1 < argc) {
+			rrl.ipv6_prefix = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--cookie-secret") && arg + 1 < argc) {
+			// Server cookie secret shared by the servers of an address (COOKIES.md)
+			if (!DnsCookies::global().setSecret(argv[arg + 1]))
+			{
+				cerr << "Error: --cookie-secret requires 32 hex digits" << endl;
+				return 1;
+			}
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--ecs-trusted") && arg + 1 < argc) {
+			// Resolvers whose EDNS Client Subnet options select views (ACL_LONGEST_MATCH.md)
+			if (!ClientSubnet::addTrusted(argv[arg + 1]))
+			{
+				cerr << "Error: --ecs-trusted requires networks such as 192.0.2.0/24,2001:db8::/32" << endl;
+				return 1;
+			}
+			arg += 2;
+		} else
+		if (argv[arg] == std::string("--max-udp-without-cookie") && arg + 1 < argc) {
+			// UDP reply size for clients without a server cookie; 0 is no cap
+			DnsCookies::max_udp_without_cookie = (unsigned int)atoi(argv[arg + 1]);
+			arg += 2;
+		} else
 		if (argv[arg] == std::string("-z") || argv[arg] == std::string("--zone")) {
 			if (arg + 1 >= argc)
 			{
@@ -951,6 +648,7 @@ int main(int argc, char* argv[])
 		} else
 			break;  // First non-option is IP address
 	}
+	RateLimiter::global().configure(rrl);
 
 	// Check if we have at least one zone file
 	if (zonefiles.empty())
@@ -960,15 +658,7 @@ int main(int argc, char* argv[])
 	}
 	
 	// Load all zone files - continue on error to allow graceful degradation
-	int failed_zones = 0;
-	for (vector<string>::iterator zf_it = zonefiles.begin(); zf_it != zonefiles.end(); ++zf_it)
-	{
-		if (!loadZoneFile(*zf_it, zones))
-		{
-			cerr << "[-] error loading zones from " << *zf_it << ", skipping..." << endl;
-			failed_zones++;
-		}
-	}
+	int failed_zones = loadZoneFiles(zonefiles, zones);
 	
 	if (zones.empty())
 	{
@@ -1005,7 +695,13 @@ int main(int argc, char* argv[])
 	sigaction(SIGTERM, &sa, NULL);
 	sigaction(SIGINT, &sa, NULL);
 	
-	cerr << "Signal handlers installed (SIGHUP=reload, SIGTERM/SIGINT=shutdown)" << endl;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigusr1Handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, NULL);
+	
+	cerr << "Signal handlers installed (SIGHUP=reload, SIGUSR1=stats, SIGTERM/SIGINT=shutdown)" << endl;
 #else
 	signal(SIGHUP, sighupHandler);
 	signal(SIGTERM, sigtermHandler);
@@ -0,0 +1,122 @@
+// dnszonec - compile text zone files into binary zone images
+//
+//   dnszonec [-o image] zonefile     compile (default output: zonefile.zimg)
+//   dnszonec -q image name type      look a name up through the image index
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "zone.h"
+#include "rr.h"
+#include "zoneFileLoader.h"
+#include "zoneImage.h"
+
+using namespace std;
+
+static int usage(const char* argv0)
+{
+	cerr << "Usage: " << argv0 << " [-o image] zonefile" << endl;
+	cerr << "       " << argv0 << " -q image name type" << endl;
+	return 1;
+}
+
+static int query(const string& image_path, const string& name, const string& type_name)
+{
+	ZoneImage::Mapping image;
+	string error;
+	if (!image.open(image_path, error))
+	{
+		cerr << "Error: " << image_path << ": " << error << endl;
+		return 1;
+	}
+
+	RR::RRType type = RR::RRTypeFromString(type_name);
+	uint32_t name_index;
+	if (type == RR::RRUNDEF || !image.findName(name, name_index))
+	{
+		cout << name << " " << type_name << ": not found" << endl;
+		return 2;
+	}
+
+	int found = 0;
+	for (uint32_t zi = 0; zi < image.header().zone_count; ++zi)
+	{
+		uint32_t rrset_index;
+		if (!image.findRRset(zi, name_index, type, RR::CLASSIN, rrset_index))
+			continue;
+
+		const ZoneImage::ZoneEntry& zone = image.zone(zi);
+		const ZoneImage::RRsetEntry& set = image.rrset(rrset_index);
+		cout << "; zone " << image.text(zone.name)
+		     << (zone.parent >= 0 ? " (ACL " + image.text(zone.acl_subnets) + ")" : "") << endl;
+
+		for (uint32_t ri = set.first_rdata; ri < set.first_rdata + set.rdata_count; ++ri)
+		{
+			const ZoneImage::RdataEntry& rdata = image.rdata(ri);
+			RR* rr = RR::createByType(type);
+			rr->name = image.nameText(name_index);
+			rr->type = type;
+			rr->rrclass = RR::CLASSIN;
+			rr->ttl = rdata.ttl;
+			rr->query = false;
+			if (rr->unpackRdata(image.bytes(rdata.rdata), rdata.rdata.length))
+				cout << rr->toString() << endl;
+			delete rr;
+			found++;
+		}
+	}
+
+	if (!found)
+	{
+		cout << name << " " << type_name << ": not found" << endl;
+		return 2;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc >= 2 && argv[1] == string("-q"))
+	{
+		if (argc != 5)
+			return usage(argv[0]);
+		return query(argv[2], argv[3], argv[4]);
+	}
+
+	string output;
+	int arg = 1;
+	if (arg < argc && argv[arg] == string("-o"))
+	{
+		if (arg + 1 >= argc)
+			return usage(argv[0]);
+		output = argv[arg + 1];
+		arg += 2;
+	}
+	if (arg + 1 != argc)
+		return usage(argv[0]);
+
+	string source = argv[arg];
+	if (output.empty())
+		output = ZoneImage::pathFor(source);
+
+	t_zones zones;
+	if (!ZoneFileLoader::loadFile(source, zones))
+		return 1;
+
+	string error;
+	if (!ZoneImage::compile(zones, source, output, error))
+	{
+		cerr << "Error: cannot compile " << source << ": " << error << endl;
+		return 1;
+	}
+
+	size_t records = 0;
+	for (t_zones::const_iterator it = zones.begin(); it != zones.end(); ++it)
+		records += (*it)->records().size();
+	cerr << "Compiled " << zones.size() << " zone(s), " << records << " record(s) from "
+	     << source << " into " << output << endl;
+
+	for (t_zones::iterator it = zones.begin(); it != zones.end(); ++it)
+		delete *it;
+	return 0;
+}
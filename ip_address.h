@@ -0,0 +1,85 @@
+#ifndef HAVE_IP_ADDRESS_H
+#define HAVE_IP_ADDRESS_H
+
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+// A client address of either family, as the raw bytes in network order.
+// IPv4 clients seen on a dual-stack socket as ::ffff:a.b.c.d are IPv4, so
+// the same client always has the same address.
+struct IpAddress
+{
+	enum Family { NONE = 0, IPV4 = 4, IPV6 = 6 };
+
+	IpAddress() : family(NONE) { memset(bytes, 0, sizeof(bytes)); }
+
+	// An IPv4 address in network byte order
+	static IpAddress fromIpv4(unsigned long ip)
+	{
+		IpAddress address;
+		uint32_t v4 = (uint32_t)ip;
+		memcpy(address.bytes, &v4, sizeof(v4));
+		address.family = IPV4;
+		return address;
+	}
+
+	// Reads numeric text. False, and NONE, if it is neither family.
+	bool parse(const char* text)
+	{
+		memset(bytes, 0, sizeof(bytes));
+		family = NONE;
+		if (!text)
+			return false;
+		if (inet_pton(AF_INET, text, bytes) == 1)
+		{
+			family = IPV4;
+			return true;
+		}
+		if (inet_pton(AF_INET6, text, bytes) != 1)
+			return false;
+		static const unsigned char mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+		if (memcmp(bytes, mapped, sizeof(mapped)) == 0)
+		{
+			memmove(bytes, bytes + 12, 4);
+			memset(bytes + 4, 0, 12);
+			family = IPV4;
+		}
+		else
+			family = IPV6;
+		return true;
+	}
+
+	// Bytes of `bytes` in use: 4, 16, or 0 for NONE
+	size_t length() const { return family == IPV4 ? 4 : family == IPV6 ? 16 : 0; }
+
+	// Whether the first `prefix` bits are those of `network`, of the same
+	// family
+	bool inNetwork(const IpAddress& network, unsigned int prefix) const
+	{
+		if (family == NONE || family != network.family || prefix > 8 * length())
+			return false;
+		size_t whole = prefix / 8;
+		if (memcmp(bytes, network.bytes, whole) != 0)
+			return false;
+		unsigned char mask = (unsigned char)(0xFF << (8 - prefix % 8));
+		return prefix % 8 == 0 || ((bytes[whole] ^ network.bytes[whole]) & mask) == 0;
+	}
+
+	// IPv4 in network byte order, INADDR_NONE for other families
+	unsigned long ipv4() const
+	{
+		if (family != IPV4)
+			return INADDR_NONE;
+		uint32_t ip;
+		memcpy(&ip, bytes, sizeof(ip));
+		return ip;
+	}
+
+	int family;
+	unsigned char bytes[16];
+};
+
+#endif
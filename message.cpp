@@ -3,6 +3,8 @@
 #include "rropt.h"
 #include "wire.h"
 
+const unsigned int Message::MAX_SIZE;
+
 std::ostream& operator <<(std::ostream& os, const Message& m)
 {
 	os << std::hex << m.id << " " << (m.query ? "Q" : "q") << " " << m.opcode << " " << (m.authoritative ? "A" : "a") <<
@@ -11,18 +13,18 @@ std::ostream& operator <<(std::ostream& os, const Message& m)
 
 	for (int rrtype = 0; rrtype < 4; rrtype++)
 	{
-		std::vector<RR *> rrs[4] = {(m.qd), (m.an), (m.ns), (m.ar)};
+		const Message::t_section* rrs[4] = {&m.qd, &m.an, &m.ns, &m.ar};
 
 		bool first = true;
-		for (unsigned short i = 0; i < rrs[rrtype].size(); i++)
+		for (unsigned short i = 0; i < rrs[rrtype]->size(); i++)
 		{
 			if (first)
 			{
 				os << "[ ";
 				first = false;
 			}
-			os << *(rrs[rrtype][i]);
-			if (i == rrs[rrtype].size() - 1)
+			os << *(*rrs[rrtype])[i];
+			if (i == rrs[rrtype]->size() - 1)
 				os << " ]";
 			os << "\n";
 		}
@@ -75,13 +77,15 @@ bool Message::unpack(char *data, unsigned int len, unsigned int& offset)
 	for (int rrtype = 0; rrtype < 4; rrtype++)
 	{
 		
-		std::vector<RR *>* rrs[] = {&qd, &an, &ns, &ar};
+		t_section* rrs[] = {&qd, &an, &ns, &ar};
 
 		for (unsigned short i = 0; i < counts[rrtype]; i++)
 		{
 			// First, peek at the RR to determine its type
+			unsigned int rr_offset = iter;
 			unsigned int peek_offset = iter;
-			std::string rr_name = RR::unpackName(data, len, peek_offset);
+			if (!RR::skipName(data, len, peek_offset))
+				return false;
 			
 			if (peek_offset + 1 >= len)
 				return false;
@@ -107,6 +111,15 @@ bool Message::unpack(char *data, unsigned int len, unsigned int& offset)
 				const char* section_names[] = {"QUESTION/ZONE", "ANSWER/PREREQ", "AUTHORITY/UPDATE", "ADDITIONAL"};
 				std::cerr << "[UNPACK_ERROR] Failed to unpack RR in section " << section_names[rrtype] 
 				          << " (index " << i << "/" << counts[rrtype] << ")" << std::endl;
+				std::string rr_name;
+				try
+				{
+					unsigned int name_offset = rr_offset;
+					rr_name = RR::unpackName(data, len, name_offset);
+				} catch (std::exception&)
+				{
+					rr_name = "(malformed)";
+				}
 				std::cerr << "[UNPACK_ERROR] RR name: " << rr_name << ", type: " << rr_type 
 				          << ", offset: " << peek_offset << "/" << len << std::endl;
 				std::cerr << "[UNPACK_ERROR] Exception: " << ex.what() << std::endl;
@@ -121,9 +134,11 @@ bool Message::unpack(char *data, unsigned int len, unsigned int& offset)
 	return true;
 }
 
-void Message::pack(char *data, unsigned int len, unsigned int& offset) const
+bool Message::pack(char *data, unsigned int len, unsigned int& offset) const
 {
 	offset = 0;
+	if (len < 12)
+		return false;
 
 	wire_write_u16(data, offset, id);
 	offset += 2;
@@ -154,20 +169,24 @@ void Message::pack(char *data, unsigned int len, unsigned int& offset) const
 
 	for (int rrtype = 0; rrtype < 4; rrtype++)
 	{
-		const std::vector<RR *>* rrs[] = {&qd, &an, &ns, &ar};
+		const t_section* rrs[] = {&qd, &an, &ns, &ar};
 
 		for (unsigned short i = 0; i < rrs[rrtype]->size(); i++)
-			rrs[rrtype]->at(i)->pack(data, len, offset);			
+		{
+			if (!rrs[rrtype]->at(i)->pack(data, len, offset))
+				return false;
+		}
 	}
+	return true;
 }
 
 Message::~Message()
 {
 	for (int rrtype = 0; rrtype < 4; ++rrtype)
 	{
-		std::vector<RR *>* rrs[] = {&qd, &an, &ns, &ar};
+		t_section* rrs[] = {&qd, &an, &ns, &ar};
 
-		for (std::vector<RR *>::iterator it = rrs[rrtype]->begin();
+		for (t_section::iterator it = rrs[rrtype]->begin();
 			it != rrs[rrtype]->end();
 			++it)
 		{
@@ -190,7 +209,7 @@ std::ostream& operator <<(std::ostream& os, const Message::RCode rc)
 RR* Message::getOPT() const
 {
 	// OPT record should be in additional section
-	for (std::vector<RR*>::const_iterator it = ar.begin(); it != ar.end(); ++it)
+	for (t_section::const_iterator it = ar.begin(); it != ar.end(); ++it)
 	{
 		if ((*it)->type == RR::OPT)
 			return *it;
@@ -198,6 +217,15 @@ RR* Message::getOPT() const
 	return NULL;
 }
 
+unsigned int Message::maxUdpPayload() const
+{
+	const RROPT* opt = dynamic_cast<const RROPT*>(getOPT());
+	if (!opt)
+		return 512;
+	unsigned int size = opt->udp_payload_size;
+	return size < 512 ? 512 : size > 4096 ? 4096 : size;
+}
+
 void Message::copyEDNS(const Message* request)
 {
 	// Check if request has EDNS(0)
@@ -4,10 +4,11 @@
 #include <vector>
 #include <iostream>
 #include "rr.h"
+#include "arena.h"
 
 #define SCC(x) case CODE##x: return #x;
 
-class Message
+class Message : public ArenaAllocated
 {
 public:
 	enum Opcode {QUERY = 0, IQUERY = 1, STATUS = 2, UPDATE = 5};
@@ -24,6 +25,9 @@ public:
 		CODENOTZONE = 10     // RFC 2136: name not in zone
 	};
 
+	// The largest message: what the length prefix of DNS over TCP frames
+	static const unsigned int MAX_SIZE = 0xFFFF;
+
 	unsigned short id;
 	bool query;
 	Opcode opcode;
@@ -32,14 +36,20 @@ public:
 	bool recursiondesired;
 	bool recursionavailable;
 	RCode rcode;
-	std::vector<RR *> qd, an, ns, ar;
+	// The sections, with their buffers in the request arena like the RRs
+	typedef std::vector<RR *, ArenaAllocator<RR *> > t_section;
+	t_section qd, an, ns, ar;
 
 	bool unpack(char *data, unsigned int len, unsigned int& offset);
-	void pack(char *data, unsigned int len, unsigned int& offset) const;
+	// False if the message does not fit in the `len` bytes at `data`
+	bool pack(char *data, unsigned int len, unsigned int& offset) const;
 	
 	// EDNS(0) helper methods
 	RR* getOPT() const;  // Get OPT record from additional section (if any)
 	void copyEDNS(const Message* request);  // Copy EDNS from request to response
+	// Largest UDP response the requester accepts: 512 bytes without EDNS,
+	// else its advertised size up to our 4096 (RFC 6891 section 6.2.5)
+	unsigned int maxUdpPayload() const;
 	
 	Message() 
 	{
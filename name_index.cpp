@@ -0,0 +1,169 @@
+#include "name_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "dns_name.h"
+#include "name_table.h"
+#include "record_store.h"
+
+using namespace std;
+
+static inline int compareWire(const string& a, const char* b, size_t b_len)
+{
+	return dns_wire_canonical_compare(a.data(), a.length(), b, b_len);
+}
+
+NameIndex::NameIndex() : valid_(false)
+{
+}
+
+// Appends a sort key for wire name `wire` to `keys`: its labels from the
+// right, each followed by a zero byte, so that comparing keys bytewise
+// gives canonical order. Zero and one bytes in labels are escaped as
+// 1 1 and 1 2, which keeps them in order and above the separator.
+static void appendKey(const string& wire, string& keys)
+{
+	size_t offsets[DNS_WIRE_NAME_MAX];
+	size_t count = 0;
+	for (size_t pos = 0; pos < wire.length() && wire[pos]; pos += 1 + (unsigned char)wire[pos])
+		offsets[count++] = pos;
+	while (count--)
+	{
+		const char* label = wire.data() + offsets[count];
+		for (size_t i = 1; i <= (unsigned char)label[0]; ++i)
+		{
+			unsigned char c = (unsigned char)label[i];
+			if (c <= 1)
+			{
+				keys += '\001';
+				c++;
+			}
+			keys += (char)c;
+		}
+		keys += '\0';
+	}
+}
+
+void NameIndex::build(const RecordStore& records)
+{
+	const NameTable& names = NameTable::global();
+
+	// Every name's key is built once, so sorting compares plain bytes and
+	// takes no table locks. A name's records are usually adjacent.
+	struct Entry
+	{
+		uint32_t key;
+		uint32_t length;
+		uint32_t position;
+	};
+	string keys;
+	vector<Entry> entries;
+	entries.reserve(records.size());
+	t_name_id last = NameTable::NOT_FOUND;
+	Entry entry = { 0, 0, 0 };
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		if (i == 0 || records.nameId(i) != last)
+		{
+			last = records.nameId(i);
+			entry.key = (uint32_t)keys.length();
+			appendKey(names.wire(last), keys);
+			entry.length = (uint32_t)keys.length() - entry.key;
+		}
+		entry.position = (uint32_t)i;
+		entries.push_back(entry);
+	}
+
+	const char* data = keys.data();
+	auto before = [data](const Entry& a, const Entry& b) {
+		int diff = a.key == b.key ? 0 : memcmp(data + a.key, data + b.key, min(a.length, b.length));
+		if (diff == 0 && a.key != b.key)
+			diff = (int)a.length - (int)b.length;
+		return diff < 0 || (diff == 0 && a.position < b.position);
+	};
+	// Zone images store records in canonical order already
+	if (!is_sorted(entries.begin(), entries.end(), before))
+		sort(entries.begin(), entries.end(), before);
+
+	order_.clear();
+	order_.reserve(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+		order_.push_back(entries[i].position);
+	valid_ = true;
+}
+
+void NameIndex::clear()
+{
+	vector<uint32_t>().swap(order_);
+	valid_ = false;
+}
+
+void NameIndex::added(const RecordStore& records)
+{
+	if (!valid_)
+		return;
+	const NameTable& names = NameTable::global();
+	uint32_t position = (uint32_t)records.size() - 1;
+	const string& wire = names.wire(records.nameId(position));
+
+	// After every record with the same name, as build() orders them
+	vector<uint32_t>::iterator at = upper_bound(order_.begin(), order_.end(), position,
+		[&](uint32_t, uint32_t other) {
+			return compareWire(names.wire(records.nameId(other)), wire.data(), wire.length()) > 0;
+		});
+	order_.insert(at, position);
+}
+
+void NameIndex::removed(size_t i)
+{
+	if (!valid_)
+		return;
+	size_t out = 0;
+	for (size_t k = 0; k < order_.size(); ++k)
+	{
+		uint32_t position = order_[k];
+		if (position == i)
+			continue;
+		order_[out++] = position > i ? position - 1 : position;
+	}
+	order_.resize(out);
+}
+
+void NameIndex::subtree(const RecordStore& records, const char* name, size_t len,
+                        size_t& first, size_t& last) const
+{
+	const NameTable& names = NameTable::global();
+
+	vector<uint32_t>::const_iterator begin = lower_bound(order_.begin(), order_.end(), 0u,
+		[&](uint32_t position, uint32_t) {
+			return compareWire(names.wire(records.nameId(position)), name, len) < 0;
+		});
+	// The subtree starts with `name` itself and ends at the first name that
+	// is not below it
+	vector<uint32_t>::const_iterator end = partition_point(begin, order_.end(),
+		[&](uint32_t position) {
+			const string& wire = names.wire(records.nameId(position));
+			return dns_wire_is_subdomain(wire.data(), wire.length(), name, len);
+		});
+
+	first = begin - order_.begin();
+	last = end - order_.begin();
+}
+
+void NameIndex::owner(const RecordStore& records, t_name_id name, size_t& first, size_t& last) const
+{
+	const NameTable& names = NameTable::global();
+	const string& wire = names.wire(name);
+
+	vector<uint32_t>::const_iterator begin = lower_bound(order_.begin(), order_.end(), 0u,
+		[&](uint32_t position, uint32_t) {
+			return compareWire(names.wire(records.nameId(position)), wire.data(), wire.length()) < 0;
+		});
+	vector<uint32_t>::const_iterator end = begin;
+	while (end != order_.end() && records.nameId(*end) == name)
+		++end;
+
+	first = begin - order_.begin();
+	last = end - order_.begin();
+}
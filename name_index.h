@@ -0,0 +1,53 @@
+#ifndef HAVE_NAME_INDEX_H
+#define HAVE_NAME_INDEX_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+#include "name_table.h"
+
+class RecordStore;
+
+// The records of a RecordStore in canonical name order (RFC 4034 section
+// 6.1, labels compared from the right), so that a name and everything
+// below it are one contiguous range. Enumeration queries (`*.suffix`,
+// `**.suffix`) scan that range instead of the whole zone.
+//
+// The index holds only record positions, four bytes per record, and reads
+// the names from the NameTable. It is built once a zone is loaded
+// (Zone::shrinkToFit) and then kept in step with each added or removed
+// record; until it is built, valid() is false and callers scan linearly.
+class NameIndex
+{
+public:
+	NameIndex();
+
+	bool valid() const { return valid_; }
+	size_t size() const { return order_.size(); }
+	// Position in the RecordStore of the k-th record in canonical order
+	size_t operator[](size_t k) const { return order_[k]; }
+
+	void build(const RecordStore& records);
+	void clear();  // Invalid until the next build
+
+	// Keep a valid index in step with the store: the last record was just
+	// added, or record `i` was just removed (later positions moved down)
+	void added(const RecordStore& records);
+	void removed(size_t i);
+
+	// Range [first, last) of index positions holding the records at or
+	// below canonical wire name `name`
+	void subtree(const RecordStore& records, const char* name, size_t len,
+	             size_t& first, size_t& last) const;
+	// Range [first, last) of index positions holding the records of `name`
+	// itself
+	void owner(const RecordStore& records, t_name_id name, size_t& first, size_t& last) const;
+
+	size_t bytes() const { return order_.capacity() * sizeof(uint32_t); }
+
+private:
+	std::vector<uint32_t> order_;
+	bool valid_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "name_table.h"
+#include "dns_name.h"
+#include "rr.h"
+
+using namespace std;
+
+const t_name_id NameTable::UNRESOLVED;
+const t_name_id NameTable::NOT_FOUND;
+
+NameTable& NameTable::global()
+{
+	static NameTable table;
+	return table;
+}
+
+NameTable::NameTable() : bytes_(0)
+{
+	pthread_rwlock_init(&lock_, NULL);
+	names_.push_back(NULL);  // ID 0 is UNRESOLVED
+}
+
+NameTable::~NameTable()
+{
+	pthread_rwlock_destroy(&lock_);
+}
+
+string NameTable::keyOf(const string& name)
+{
+	char wire[DNS_WIRE_NAME_MAX];
+	size_t len = dns_name_to_wire(name.data(), name.length(), wire);
+	if (len)
+		return string(wire, len);
+	return INVALID_WIRE + dns_name_tolower(name);
+}
+
+t_name_id NameTable::lookup(const string& key) const
+{
+	pthread_rwlock_rdlock(&lock_);
+	t_ids::const_iterator it = ids_.find(key);
+	t_name_id id = it != ids_.end() ? it->second : NOT_FOUND;
+	pthread_rwlock_unlock(&lock_);
+	return id;
+}
+
+t_name_id NameTable::intern(const string& name)
+{
+	string key = keyOf(name);
+	t_name_id id = lookup(key);
+	if (id != NOT_FOUND)
+		return id;
+
+	pthread_rwlock_wrlock(&lock_);
+	id = (t_name_id)names_.size();
+	pair<t_ids::iterator, bool> inserted = ids_.insert(make_pair(key, id));
+	if (inserted.second)
+	{
+		names_.push_back(&inserted.first->first);
+		// Hash node (entry, next pointer, cached hash), its bucket slot and
+		// the key's heap buffer when it does not fit the small-string buffer
+		const string& stored = inserted.first->first;
+		bytes_ += sizeof(t_ids::value_type) + 3 * sizeof(void*);
+		const char* object = reinterpret_cast<const char*>(&stored);
+		if (stored.data() < object || stored.data() >= object + sizeof(string))
+			bytes_ += stored.capacity() + 1;
+	}
+	else
+		id = inserted.first->second;  // Interned by another thread meanwhile
+	pthread_rwlock_unlock(&lock_);
+	return id;
+}
+
+t_name_id NameTable::find(const string& name) const
+{
+	return lookup(keyOf(name));
+}
+
+t_name_id NameTable::findWire(const char* wire, size_t len) const
+{
+	return lookup(string(wire, len));
+}
+
+const string& NameTable::wire(t_name_id id) const
+{
+	static const string empty;
+
+	pthread_rwlock_rdlock(&lock_);
+	const string* key = id < names_.size() ? names_[id] : NULL;
+	pthread_rwlock_unlock(&lock_);
+	// Keys of ids_ never move, so the reference outlives the lock
+	if (!key || (*key)[0] == INVALID_WIRE)
+		return empty;
+	return *key;
+}
+
+string NameTable::name(t_name_id id) const
+{
+	pthread_rwlock_rdlock(&lock_);
+	const string* key = id < names_.size() ? names_[id] : NULL;
+	pthread_rwlock_unlock(&lock_);
+
+	string text;
+	if (!key)
+		return text;
+	if ((*key)[0] == INVALID_WIRE)
+		return key->substr(1);
+	dns_wire_to_name(key->data(), text);
+	if (text.empty())
+		text = ".";  // The root, as zone files spell it
+	return text;
+}
+
+size_t NameTable::size() const
+{
+	pthread_rwlock_rdlock(&lock_);
+	size_t n = names_.size() - 1;
+	pthread_rwlock_unlock(&lock_);
+	return n;
+}
+
+size_t NameTable::bytes() const
+{
+	pthread_rwlock_rdlock(&lock_);
+	size_t n = bytes_ + names_.capacity() * sizeof(const string*);
+	pthread_rwlock_unlock(&lock_);
+	return n;
+}
+
+t_name_id NameTable::idOf(const RR* rr)
+{
+	if (rr->name_id != UNRESOLVED)
+		return rr->name_id;
+	return global().find(rr->name);
+}
@@ -0,0 +1,71 @@
+#ifndef HAVE_NAME_TABLE_H
+#define HAVE_NAME_TABLE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <pthread.h>
+
+class RR;
+
+typedef uint32_t t_name_id;
+
+// Process-wide table of owner names. Each distinct name is stored once,
+// in canonical wire form (see dns_name.h), and identified by a compact ID,
+// so comparing two interned names is an integer compare.
+//
+// Zone records are interned when they are added to a zone. Names seen in
+// queries are only looked up, never added, so clients cannot grow the
+// table. Entries are never removed; reloading a zone reuses existing IDs.
+class NameTable
+{
+public:
+	// RR::name_id of a record whose name has not been looked up yet
+	static const t_name_id UNRESOLVED = 0;
+	// Lookup result for a name no zone record carries; matches nothing
+	static const t_name_id NOT_FOUND = 0xFFFFFFFF;
+
+	static NameTable& global();
+
+	NameTable();
+	~NameTable();
+
+	// ID of dotted `name`, adding it if needed
+	t_name_id intern(const std::string& name);
+	// ID of dotted `name`, or NOT_FOUND
+	t_name_id find(const std::string& name) const;
+	// ID of canonical wire name `wire` of `len` bytes, or NOT_FOUND
+	t_name_id findWire(const char* wire, size_t len) const;
+	// Canonical dotted text of an interned ID
+	std::string name(t_name_id id) const;
+	// Canonical wire form of an interned ID. Empty for unknown IDs and for
+	// names that have no valid wire form (labels over 63 bytes).
+	const std::string& wire(t_name_id id) const;
+
+	size_t size() const;
+	size_t bytes() const;  // Memory held by the table, approximately
+
+	// ID of rr's name: the cached rr->name_id, or a lookup if unresolved
+	static t_name_id idOf(const RR* rr);
+
+private:
+	NameTable(const NameTable&);
+	NameTable& operator=(const NameTable&);
+
+	typedef std::unordered_map<std::string, t_name_id> t_ids;
+
+	static std::string keyOf(const std::string& name);
+	t_name_id lookup(const std::string& key) const;
+
+	// Keys are canonical wire names; a name without a valid wire form is
+	// keyed by INVALID_WIRE followed by its lowercased text
+	static const char INVALID_WIRE = '\xFF';
+
+	mutable pthread_rwlock_t lock_;
+	t_ids ids_;
+	std::vector<const std::string*> names_;  // Index is the ID; points at keys of ids_
+	size_t bytes_;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "name_tree.h"
+
+#include <cstring>
+#include "dns_name.h"
+#include "record_store.h"
+#include "name_index.h"
+
+using namespace std;
+
+// Offsets of the labels of wire name `wire`, the root's zero byte last;
+// the number of offsets, or 0 if the name is malformed
+static size_t labelOffsets(const char* wire, size_t len, size_t* offsets)
+{
+	size_t count = 0;
+	size_t pos = 0;
+	if (len > DNS_WIRE_NAME_MAX)
+		return 0;
+	while (pos < len)
+	{
+		offsets[count++] = pos;
+		unsigned char label = (unsigned char)wire[pos];
+		if (label == 0)
+			return pos + 1 == len ? count : 0;
+		pos += 1 + label;
+	}
+	return 0;
+}
+
+NameTree::NameTree() : valid_(false)
+{
+}
+
+string NameTree::key(uint32_t parent, const char* label, size_t len)
+{
+	string k((const char*)&parent, sizeof(parent));
+	k.append(label, len);
+	return k;
+}
+
+uint32_t NameTree::find(uint32_t parent, const char* label, size_t len) const
+{
+	unordered_map<string, uint32_t>::const_iterator it = children_.find(key(parent, label, len));
+	return it == children_.end() ? NONE : it->second;
+}
+
+uint32_t NameTree::child(uint32_t parent, const char* label, size_t len) const
+{
+	uint32_t node = find(parent, label, len);
+	return node != NONE && nodes_[node].below ? node : NONE;
+}
+
+void NameTree::build(const RecordStore& records, const NameIndex& index)
+{
+	clear();
+	Node root = { NONE, 0, 0, 0, NameTable::NOT_FOUND };
+	nodes_.push_back(root);
+	children_.reserve(records.size());
+	valid_ = true;
+
+	// In canonical order a name's records are adjacent and neighbours
+	// share their upper labels, so each name is inserted once, starting
+	// below the labels it shares with the previous name. Counts under a
+	// node are summed at the end: nodes are created after their parents,
+	// so a backwards pass sees every child before its parent.
+	const NameTable& names = NameTable::global();
+	const string* previous = NULL;
+	vector<uint32_t> path;
+	t_name_id last = NameTable::NOT_FOUND;
+	uint32_t node = NONE;
+	for (size_t k = 0; k < index.size(); ++k)
+	{
+		size_t i = index[k];
+		t_name_id name = records.nameId(i);
+		if (name != last)
+		{
+			const string& wire = names.wire(name);
+			node = insert(wire, previous, &path);
+			previous = node == NONE ? NULL : &wire;
+			last = name;
+		}
+		if (node == NONE)
+			continue;
+		nodes_[node].records++;
+		nodes_[node].name = name;
+		if (records.type(i) == RR::NS)
+			nodes_[node].ns++;
+	}
+	for (size_t n = nodes_.size(); n-- > 0; )
+	{
+		nodes_[n].below += nodes_[n].records;
+		if (nodes_[n].parent != NONE)
+			nodes_[nodes_[n].parent].below += nodes_[n].below;
+	}
+}
+
+void NameTree::clear()
+{
+	vector<Node>().swap(nodes_);
+	unordered_map<string, uint32_t>().swap(children_);
+	valid_ = false;
+}
+
+uint32_t NameTree::insert(const string& wire, const string* previous, vector<uint32_t>* path)
+{
+	size_t offsets[DNS_WIRE_NAME_MAX / 2 + 1];
+	size_t count = labelOffsets(wire.data(), wire.length(), offsets);
+	if (!count)
+		return NONE;
+
+	// Root first; offsets[count - 1] is the root itself. (*path)[d] is the
+	// node at depth d of `previous`, the root at depth 0.
+	uint32_t node = 0;
+	size_t depth = 1;
+	if (previous && path)
+	{
+		size_t previous_offsets[DNS_WIRE_NAME_MAX / 2 + 1];
+		size_t previous_count = labelOffsets(previous->data(), previous->length(), previous_offsets);
+		for (; depth < count && depth < previous_count && depth < path->size(); ++depth)
+		{
+			const char* label = wire.data() + offsets[count - 1 - depth];
+			const char* other = previous->data() + previous_offsets[previous_count - 1 - depth];
+			if (memcmp(label, other, 1 + (unsigned char)*label) != 0)
+				break;
+			node = (*path)[depth];
+		}
+	}
+	if (path)
+	{
+		path->resize(depth);
+		(*path)[0] = 0;
+	}
+
+	for (size_t l = count - depth; l-- > 0; )
+	{
+		const char* label = wire.data() + offsets[l];
+		size_t label_len = 1 + (unsigned char)*label;
+		uint32_t created = (uint32_t)nodes_.size();
+		pair<unordered_map<string, uint32_t>::iterator, bool> child =
+			children_.insert(make_pair(key(node, label, label_len), created));
+		if (child.second)
+		{
+			Node empty = { node, 0, 0, 0, NameTable::NOT_FOUND };
+			nodes_.push_back(empty);
+		}
+		node = child.first->second;
+		if (path)
+			path->push_back(node);
+	}
+	return node;
+}
+
+void NameTree::added(t_name_id name, RR::RRType type)
+{
+	if (!valid_)
+		return;
+	uint32_t node = insert(NameTable::global().wire(name), NULL, NULL);
+	if (node == NONE)
+		return;
+	nodes_[node].records++;
+	nodes_[node].name = name;
+	if (type == RR::NS)
+		nodes_[node].ns++;
+	for (; node != NONE; node = nodes_[node].parent)
+		nodes_[node].below++;
+}
+
+void NameTree::removed(t_name_id name, RR::RRType type)
+{
+	if (!valid_)
+		return;
+	const string& wire = NameTable::global().wire(name);
+	Lookup path;
+	lookup(wire.data(), wire.length(), path);
+	if (path.encloser == NONE || path.encloser_offset != 0 || nodes_[path.encloser].records == 0)
+		return;
+
+	// Nodes stay in place when their last record goes; below == 0 marks
+	// them as gone
+	uint32_t node = path.encloser;
+	nodes_[node].records--;
+	if (type == RR::NS && nodes_[node].ns)
+		nodes_[node].ns--;
+	for (; node != NONE; node = nodes_[node].parent)
+		nodes_[node].below--;
+}
+
+void NameTree::lookup(const char* wire, size_t len, Lookup& result) const
+{
+	result.encloser = NONE;
+	result.encloser_offset = len;
+	result.cut = NONE;
+	result.cut_offset = len;
+
+	size_t offsets[DNS_WIRE_NAME_MAX / 2 + 1];
+	size_t count = labelOffsets(wire, len, offsets);
+	if (!count || nodes_.empty() || !nodes_[0].below)
+		return;
+
+	uint32_t node = 0;
+	size_t offset = offsets[count - 1];
+	for (size_t l = count; ; )
+	{
+		result.encloser = node;
+		result.encloser_offset = offset;
+		if (nodes_[node].ns)
+		{
+			result.cut = node;
+			result.cut_offset = offset;
+		}
+		if (l-- == 1)
+			break;
+		offset = offsets[l - 1];
+		const char* label = wire + offset;
+		node = child(node, label, 1 + (unsigned char)*label);
+		if (node == NONE)
+			break;
+	}
+}
+
+size_t NameTree::bytes() const
+{
+	// Approximately: the nodes, the buckets and one allocation per child
+	return nodes_.capacity() * sizeof(Node) +
+	       children_.bucket_count() * sizeof(void*) +
+	       children_.size() * (sizeof(string) + sizeof(uint32_t) + 2 * sizeof(void*));
+}
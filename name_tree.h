@@ -0,0 +1,81 @@
+#ifndef HAVE_NAME_TREE_H
+#define HAVE_NAME_TREE_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "name_table.h"
+#include "rr.h"
+
+class RecordStore;
+class NameIndex;
+
+// The owner names of a RecordStore as a tree of labels, root first, so the
+// nodes on the path of a query name are found with one hash lookup per
+// label. Every ancestor of an owner name has a node, which makes empty
+// non-terminals (RFC 4592 section 2.2.2) exist as they should.
+//
+// Used for wildcard synthesis: lookup() finds a name's closest encloser
+// and the deepest name above it that holds NS records. Built and kept up
+// to date like the NameIndex.
+class NameTree
+{
+public:
+	static const uint32_t NONE = 0xFFFFFFFF;
+
+	struct Node
+	{
+		uint32_t parent;
+		uint32_t below;    // Records at this name and under it; 0 once all are gone
+		uint32_t records;  // Records at this name
+		uint32_t ns;       // NS records at this name
+		t_name_id name;    // NameTable ID, NOT_FOUND for empty non-terminals
+	};
+
+	// Where a name's path leaves the tree. Offsets are into the name's
+	// wire form; the suffix starting there is the name found.
+	struct Lookup
+	{
+		uint32_t encloser;         // Deepest existing node: the name itself or its closest encloser
+		size_t encloser_offset;    // 0 if the name itself exists
+		uint32_t cut;              // Deepest node at or above the encloser with NS records, or NONE
+		size_t cut_offset;
+	};
+
+	NameTree();
+
+	bool valid() const { return valid_; }
+	size_t size() const { return nodes_.size(); }
+	const Node& node(uint32_t i) const { return nodes_[i]; }
+
+	// Walks the records in the order of `index`, which must be valid
+	void build(const RecordStore& records, const NameIndex& index);
+	void clear();  // Invalid until the next build
+
+	// Keep a valid tree in step with the store
+	void added(t_name_id name, RR::RRType type);
+	void removed(t_name_id name, RR::RRType type);
+
+	void lookup(const char* wire, size_t len, Lookup& result) const;
+	// Existing child of `parent` with the given label, or NONE
+	uint32_t child(uint32_t parent, const char* label, size_t len) const;
+
+	size_t bytes() const;
+
+private:
+	// Node of `wire`, created with its ancestors as needed. Given the
+	// previous name inserted and the nodes on its path, root first, the
+	// labels the two share are not looked up again; `path` is updated.
+	uint32_t insert(const std::string& wire, const std::string* previous, std::vector<uint32_t>* path);
+	uint32_t find(uint32_t parent, const char* label, size_t len) const;
+	static std::string key(uint32_t parent, const char* label, size_t len);
+
+	std::vector<Node> nodes_;
+	// Child node by parent index (4 bytes) followed by the label bytes
+	std::unordered_map<std::string, uint32_t> children_;
+	bool valid_;
+};
+
+#endif
@@ -0,0 +1,396 @@
+#include "pcap.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "socket.h"
+
+using namespace std;
+
+namespace {
+
+const unsigned int PCAP_MAGIC_US = 0xA1B2C3D4;
+const unsigned int PCAP_MAGIC_NS = 0xA1B23C4D;
+const unsigned int PCAPNG_SHB = 0x0A0D0D0A;
+const unsigned int PCAPNG_BYTE_ORDER = 0x1A2B3C4D;
+const unsigned int PCAPNG_IDB = 1;
+const unsigned int PCAPNG_PB = 2;    // Obsolete packet block
+const unsigned int PCAPNG_SPB = 3;
+const unsigned int PCAPNG_EPB = 6;
+
+// Link types (LINKTYPE_* in the pcap specification)
+const int LINK_NULL = 0;
+const int LINK_ETHERNET = 1;
+const int LINK_RAW_OLD = 12;
+const int LINK_RAW = 101;
+const int LINK_LOOP = 108;
+const int LINK_SLL = 113;
+const int LINK_IPV4 = 228;
+const int LINK_IPV6 = 229;
+const int LINK_SLL2 = 276;
+
+// Capture files are in the byte order of the machine that wrote them
+struct Reader
+{
+	const unsigned char* data;
+	size_t len;
+	bool swap;
+
+	unsigned short u16(size_t offset) const
+	{
+		unsigned short v;
+		memcpy(&v, data + offset, 2);
+		return swap ? (unsigned short)((v >> 8) | (v << 8)) : v;
+	}
+
+	unsigned int u32(size_t offset) const
+	{
+		unsigned int v;
+		memcpy(&v, data + offset, 4);
+		return swap ? __builtin_bswap32(v) : v;
+	}
+};
+
+inline unsigned short be16(const unsigned char* p)
+{
+	return (unsigned short)((p[0] << 8) | p[1]);
+}
+
+string addressText(int family, const unsigned char* address)
+{
+	char text[INET6_ADDRSTRLEN];
+	if (!inet_ntop(family, address, text, sizeof(text)))
+		return "unknown";
+	return text;
+}
+
+void decodeTransport(int protocol, const unsigned char* p, size_t len, Pcap::Packet& packet,
+                     unsigned short port, vector<Pcap::Packet>& packets)
+{
+	if (protocol == 17)
+	{
+		if (len < 8)
+			return;
+		packet.src_port = be16(p);
+		packet.dst_port = be16(p + 2);
+		size_t udp_len = be16(p + 4);
+		if (udp_len < 8)
+			return;
+		size_t payload_len = min(udp_len, len) - 8;
+		if ((packet.src_port != port && packet.dst_port != port) || payload_len < 12)
+			return;
+		packet.tcp = false;
+		packet.payload.assign((const char*)p + 8, payload_len);
+		packets.push_back(packet);
+	}
+	else if (protocol == 6)
+	{
+		if (len < 20)
+			return;
+		packet.src_port = be16(p);
+		packet.dst_port = be16(p + 2);
+		size_t header_len = (p[12] >> 4) * 4;
+		if (header_len < 20 || header_len > len || (packet.src_port != port && packet.dst_port != port))
+			return;
+		packet.tcp = true;
+
+		// Whole messages behind their two-byte length; a message split over
+		// segments is skipped
+		const unsigned char* q = p + header_len;
+		size_t left = len - header_len;
+		while (left >= 2)
+		{
+			size_t message_len = be16(q);
+			if (message_len < 12 || message_len > left - 2)
+				break;
+			packet.payload.assign((const char*)q + 2, message_len);
+			packets.push_back(packet);
+			q += 2 + message_len;
+			left -= 2 + message_len;
+		}
+	}
+}
+
+void decodeIp(const unsigned char* p, size_t len, Pcap::Packet& packet,
+              unsigned short port, vector<Pcap::Packet>& packets)
+{
+	if (len < 1)
+		return;
+	int version = p[0] >> 4;
+	if (version == 4)
+	{
+		if (len < 20)
+			return;
+		size_t header_len = (p[0] & 0x0F) * 4;
+		size_t total_len = be16(p + 2);
+		if (header_len < 20 || total_len < header_len)
+			return;
+		total_len = min(total_len, len);
+		if (be16(p + 6) & 0x1FFF)
+			return;  // Not the first fragment
+		memcpy(&packet.src_ip, p + 12, 4);
+		packet.src = addressText(AF_INET, p + 12);
+		packet.dst = addressText(AF_INET, p + 16);
+		decodeTransport(p[9], p + header_len, total_len - header_len, packet, port, packets);
+	}
+	else if (version == 6)
+	{
+		if (len < 40)
+			return;
+		size_t total_len = min(40 + (size_t)be16(p + 4), len);
+		packet.src_ip = 0;
+		packet.src = addressText(AF_INET6, p + 8);
+		packet.dst = addressText(AF_INET6, p + 24);
+
+		int next = p[6];
+		size_t offset = 40;
+		for (;;)
+		{
+			if (next == 0 || next == 43 || next == 60)
+			{
+				// Hop-by-hop, routing and destination options
+				if (offset + 8 > total_len)
+					return;
+				int following = p[offset];
+				offset += (p[offset + 1] + 1) * 8;
+				next = following;
+			}
+			else if (next == 44)
+			{
+				if (offset + 8 > total_len || (be16(p + offset + 2) & 0xFFF8))
+					return;  // Not the first fragment
+				next = p[offset];
+				offset += 8;
+			}
+			else
+				break;
+		}
+		if (offset > total_len)
+			return;
+		decodeTransport(next, p + offset, total_len - offset, packet, port, packets);
+	}
+}
+
+void decodeEthertype(unsigned short type, const unsigned char* p, size_t len, Pcap::Packet& packet,
+                     unsigned short port, vector<Pcap::Packet>& packets)
+{
+	if (type == 0x0800 || type == 0x86DD)
+		decodeIp(p, len, packet, port, packets);
+}
+
+} // namespace
+
+void Pcap::decodeFrame(int link_type, const unsigned char* frame, size_t len,
+                       unsigned long long time_us, unsigned short port, vector<Packet>& packets)
+{
+	Packet packet;
+	packet.time_us = time_us;
+	packet.src_ip = 0;
+	packet.src_port = packet.dst_port = 0;
+	packet.tcp = false;
+
+	switch (link_type)
+	{
+	case LINK_ETHERNET:
+	{
+		if (len < 14)
+			return;
+		size_t offset = 12;
+		unsigned short type = be16(frame + offset);
+		while ((type == 0x8100 || type == 0x88A8) && offset + 6 <= len)
+		{
+			offset += 4;
+			type = be16(frame + offset);
+		}
+		offset += 2;
+		if (offset <= len)
+			decodeEthertype(type, frame + offset, len - offset, packet, port, packets);
+		break;
+	}
+	case LINK_NULL:
+	case LINK_LOOP:
+		// Address family in the writer's byte order (LOOP: network order);
+		// the IP version nibble tells v4 from v6 just as well
+		if (len > 4)
+			decodeIp(frame + 4, len - 4, packet, port, packets);
+		break;
+	case LINK_RAW_OLD:
+	case LINK_RAW:
+	case LINK_IPV4:
+	case LINK_IPV6:
+		decodeIp(frame, len, packet, port, packets);
+		break;
+	case LINK_SLL:
+		if (len >= 16)
+			decodeEthertype(be16(frame + 14), frame + 16, len - 16, packet, port, packets);
+		break;
+	case LINK_SLL2:
+		if (len >= 20)
+			decodeEthertype(be16(frame), frame + 20, len - 20, packet, port, packets);
+		break;
+	default:
+		break;
+	}
+}
+
+static bool readPcap(const Reader& r, unsigned short port, vector<Pcap::Packet>& packets, string& error)
+{
+	if (r.len < 24)
+	{
+		error = "truncated pcap header";
+		return false;
+	}
+	bool nanoseconds = r.u32(0) == PCAP_MAGIC_NS;
+	int link_type = (int)(r.u32(20) & 0x0FFFFFFF);
+
+	for (size_t offset = 24; offset + 16 <= r.len; )
+	{
+		unsigned long long seconds = r.u32(offset);
+		unsigned long long fraction = r.u32(offset + 4);
+		size_t caplen = r.u32(offset + 8);
+		offset += 16;
+		if (caplen > r.len - offset)
+			break;  // Truncated capture
+		unsigned long long time_us = seconds * 1000000ULL + (nanoseconds ? fraction / 1000 : fraction);
+		Pcap::decodeFrame(link_type, r.data + offset, caplen, time_us, port, packets);
+		offset += caplen;
+	}
+	return true;
+}
+
+static bool readPcapng(Reader r, unsigned short port, vector<Pcap::Packet>& packets, string& error)
+{
+	struct Interface
+	{
+		int link_type;
+		unsigned long long units_per_second;
+		unsigned int snaplen;
+	};
+	vector<Interface> interfaces;
+
+	for (size_t offset = 0; offset + 12 <= r.len; )
+	{
+		unsigned int type = r.u32(offset);
+		if (type == PCAPNG_SHB)
+		{
+			// Each section sets its own byte order
+			unsigned int magic;
+			memcpy(&magic, r.data + offset + 8, 4);
+			if (magic == PCAPNG_BYTE_ORDER)
+				r.swap = false;
+			else if (__builtin_bswap32(magic) == PCAPNG_BYTE_ORDER)
+				r.swap = true;
+			else
+			{
+				error = "bad pcapng byte-order magic";
+				return false;
+			}
+			interfaces.clear();
+		}
+
+		size_t block_len = r.u32(offset + 4);
+		if (block_len < 12 || block_len > r.len - offset)
+		{
+			if (offset == 0)
+			{
+				error = "truncated pcapng header";
+				return false;
+			}
+			break;  // Truncated capture
+		}
+		const size_t body = offset + 8;
+		const size_t body_end = offset + block_len - 4;
+
+		if (type == PCAPNG_IDB && body + 8 <= body_end)
+		{
+			Interface iface;
+			iface.link_type = r.u16(body);
+			iface.snaplen = r.u32(body + 4);
+			iface.units_per_second = 1000000;
+			// Options: if_tsresol (9) changes the timestamp unit
+			for (size_t opt = body + 8; opt + 4 <= body_end; )
+			{
+				unsigned short code = r.u16(opt);
+				unsigned short opt_len = r.u16(opt + 2);
+				if (code == 0 || opt + 4 + opt_len > body_end)
+					break;
+				if (code == 9 && opt_len >= 1)
+				{
+					unsigned char resolution = r.data[opt + 4];
+					unsigned long long units = 1;
+					for (int i = 0; i < (resolution & 0x7F) && units < 1000000000000000000ULL; ++i)
+						units *= (resolution & 0x80) ? 2 : 10;
+					iface.units_per_second = units;
+				}
+				opt += 4 + ((opt_len + 3) & ~3u);
+			}
+			interfaces.push_back(iface);
+		}
+		else if ((type == PCAPNG_EPB || type == PCAPNG_PB) && body + 20 <= body_end)
+		{
+			unsigned int id = type == PCAPNG_EPB ? r.u32(body) : r.u16(body);
+			unsigned long long timestamp = ((unsigned long long)r.u32(body + 4) << 32) | r.u32(body + 8);
+			size_t caplen = r.u32(body + 12);
+			if (id < interfaces.size() && caplen <= body_end - (body + 20))
+			{
+				const Interface& iface = interfaces[id];
+				unsigned long long time_us = iface.units_per_second >= 1000000
+					? timestamp / (iface.units_per_second / 1000000)
+					: timestamp * (1000000 / iface.units_per_second);
+				Pcap::decodeFrame(iface.link_type, r.data + body + 20, caplen, time_us, port, packets);
+			}
+		}
+		else if (type == PCAPNG_SPB && body + 4 <= body_end && !interfaces.empty())
+		{
+			// Simple packets belong to the first interface and carry no time
+			size_t caplen = min((size_t)r.u32(body), body_end - (body + 4));
+			if (interfaces[0].snaplen)
+				caplen = min(caplen, (size_t)interfaces[0].snaplen);
+			Pcap::decodeFrame(interfaces[0].link_type, r.data + body + 4, caplen, 0, port, packets);
+		}
+
+		offset += block_len;
+	}
+	return true;
+}
+
+bool Pcap::readBuffer(const string& data, unsigned short port, vector<Packet>& packets, string& error)
+{
+	Reader r;
+	r.data = (const unsigned char*)data.data();
+	r.len = data.length();
+	r.swap = false;
+	if (r.len < 4)
+	{
+		error = "not a capture file";
+		return false;
+	}
+
+	unsigned int magic;
+	memcpy(&magic, r.data, 4);
+	if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS)
+		return readPcap(r, port, packets, error);
+	if (__builtin_bswap32(magic) == PCAP_MAGIC_US || __builtin_bswap32(magic) == PCAP_MAGIC_NS)
+	{
+		r.swap = true;
+		return readPcap(r, port, packets, error);
+	}
+	if (magic == PCAPNG_SHB)
+		return readPcapng(r, port, packets, error);
+
+	error = "not a pcap or pcapng file";
+	return false;
+}
+
+bool Pcap::readFile(const string& path, unsigned short port, vector<Packet>& packets, string& error)
+{
+	ifstream in(path.c_str(), ios::binary);
+	if (!in)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	ostringstream contents;
+	contents << in.rdbuf();
+	return readBuffer(contents.str(), port, packets, error);
+}
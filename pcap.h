@@ -0,0 +1,45 @@
+#ifndef HAVE_PCAP_H
+#define HAVE_PCAP_H
+
+#include <string>
+#include <vector>
+
+// Reader for packet captures in pcap and pcapng format, just enough to get
+// DNS messages out of them: no libpcap, and only the link types, network
+// and transport headers that DNS traffic usually comes with.
+//
+// Link types: Ethernet (with 802.1Q tags), Linux cooked (SLL, SLL2),
+// BSD loopback and raw IP. Network: IPv4 (first fragments only) and IPv6
+// (skipping hop-by-hop, routing and destination options headers).
+// Transport: UDP, and TCP segments that carry whole length-prefixed DNS
+// messages; TCP streams are not reassembled.
+class Pcap
+{
+public:
+	struct Packet
+	{
+		unsigned long long time_us;   // Capture time, microseconds since the epoch
+		std::string src;              // Source address, numeric text
+		std::string dst;
+		unsigned long src_ip;         // IPv4 in network byte order, 0 for IPv6
+		unsigned short src_port;
+		unsigned short dst_port;
+		bool tcp;
+		std::string payload;          // One DNS message
+	};
+
+	// Reads every DNS message to or from `port` in the capture at `path`.
+	// Returns false with `error` set if the file is not a capture or is
+	// damaged before the first packet; a truncated tail is ignored.
+	static bool readFile(const std::string& path, unsigned short port,
+	                     std::vector<Packet>& packets, std::string& error);
+	static bool readBuffer(const std::string& data, unsigned short port,
+	                       std::vector<Packet>& packets, std::string& error);
+
+	// Link-layer frame (`link_type` as in the capture header) to DNS messages
+	static void decodeFrame(int link_type, const unsigned char* frame, size_t len,
+	                        unsigned long long time_us, unsigned short port,
+	                        std::vector<Packet>& packets);
+};
+
+#endif
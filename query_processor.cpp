@@ -1,98 +1,401 @@
 #include "query_processor.h"
 #include "rrdynamic.h"
+#include "dns_name.h"
 
 using namespace std;
 
+size_t QueryProcessor::max_wildcard_answers = 1000;
+size_t QueryProcessor::max_cname_chain = 8;
+
 void QueryProcessor::findMatches(const RR* query_rr,
                                 const Zone& zone,
                                 vector<RR*>& matches,
-                                RR** ns_record,
-                                vector<RR*>* dynamic_records)
+                                vector<RR*>* delegation,
+                                unsigned int space,
+                                bool* truncated)
 {
-    const vector<RR*>& all_records = zone.getAllRecords();
+    const RecordStore& records = zone.records();
+    const NameTable& names = NameTable::global();
+    
+    // Exact matches compare interned IDs; a name no zone record carries
+    // resolves to NOT_FOUND and matches nothing
+    t_name_id query_id = NameTable::idOf(query_rr);
+    
+    // Suffix checks walk the labels of canonical wire names (dns_name.h)
+    char query_wire[DNS_WIRE_NAME_MAX];
+    size_t query_length = dns_name_to_wire(query_rr->name.data(), query_rr->name.length(), query_wire);
     
     // Check for wildcard prefix queries
     bool is_single_wildcard = false;
     bool is_double_wildcard = false;
-    string suffix;
+    char suffix[DNS_WIRE_NAME_MAX];
+    size_t suffix_length = 0;
     
-    if (query_rr->name.length() >= 2 && query_rr->name.substr(0, 2) == "*.") {
+    if (query_rr->name.compare(0, 2, "*.") == 0) {
         is_single_wildcard = true;
-        suffix = query_rr->name.substr(2);
-    } else if (query_rr->name.length() >= 3 && query_rr->name.substr(0, 3) == "**.") {
+        suffix_length = dns_name_to_wire(query_rr->name.data() + 2, query_rr->name.length() - 2, suffix);
+    } else if (query_rr->name.compare(0, 3, "**.") == 0) {
         is_double_wildcard = true;
-        suffix = query_rr->name.substr(3);
+        suffix_length = dns_name_to_wire(query_rr->name.data() + 3, query_rr->name.length() - 3, suffix);
+    }
+    
+    if (is_single_wildcard || is_double_wildcard) {
+        if (suffix_length)
+            findEnumerated(query_rr, zone, is_single_wildcard, suffix, suffix_length, matches,
+                           space, truncated);
+        return;
+    }
+    
+    // Below a zone cut the zone only holds glue: the answer is a referral
+    size_t cut_length = query_length ? findCut(zone, query_wire, query_length) : 0;
+    if (cut_length)
+    {
+        if (delegation)
+        {
+            const char* cut = query_wire + query_length - cut_length;
+            t_name_id cut_id = names.findWire(cut, cut_length);
+            size_t first, last;
+            zone.ownerRange(cut_id, first, last);
+            for (size_t k = first; k < last; ++k)
+            {
+                size_t i = zone.recordAt(k);
+                if (records.nameId(i) == cut_id && records.type(i) == RR::NS)
+                    delegation->push_back(records.materialize(i));
+            }
+        }
+        return;
     }
     
-    for (vector<RR*>::const_iterator rriter = all_records.begin(); 
-         rriter != all_records.end(); ++rriter)
+    // Only the query name's own range of the index can match
+    size_t found = matches.size();
+    size_t first, last;
+    zone.ownerRange(query_id, first, last);
+    for (size_t k = first; k < last; ++k)
     {
-        RR *rr = *rriter;
+        size_t i = zone.recordAt(k);
+        RR::RRType type = records.type(i);
         
-        // Handle wildcard prefix queries
-        if (is_single_wildcard || is_double_wildcard) {
-            // Check if record name ends with suffix
-            if (rr->name.length() > suffix.length() && 
-                rr->name.substr(rr->name.length() - suffix.length()) == suffix) {
-                
-                // Extract the prefix part (before the suffix)
-                string prefix = rr->name.substr(0, rr->name.length() - suffix.length());
-                
-                // Remove trailing dot from prefix if present
-                if (!prefix.empty() && prefix[prefix.length() - 1] == '.') {
-                    prefix = prefix.substr(0, prefix.length() - 1);
-                }
-                
-                if (is_single_wildcard) {
-                    // For *.suffix: prefix should not contain dots (immediate subdomain only)
-                    if (prefix.find('.') == string::npos) {
-                        if (query_rr->type == RR::TYPESTAR || rr->type == query_rr->type) {
-                            matches.push_back(rr);
-                        }
-                    }
-                } else {
-                    // For **.suffix: any prefix is allowed (all subdomains)
-                    if (query_rr->type == RR::TYPESTAR || rr->type == query_rr->type) {
-                        matches.push_back(rr);
-                    }
+        // Match by exact name and type, or wildcard type; a CNAME
+        // answers for every type
+        if (records.nameId(i) == query_id &&
+            (type == query_rr->type ||
+             query_rr->type == RR::TYPESTAR ||
+             type == RR::CNAME ||
+             // DYNAMIC records match TXT queries (they resolve to TXT)
+             (type == RR::DYNAMIC && query_rr->type == RR::TXT)))
+        {
+            // Special handling for DYNAMIC records
+            if (type == RR::DYNAMIC) {
+                // Resolve the DYNAMIC to its cached TXT records; the clones
+                // keep the set alive even if the file changes meanwhile, and
+                // take the TTL of the DYNAMIC record
+                RRDYNAMIC::t_txt_set txt_records = RRDYNAMIC::resolve(records.dynamicCache(i));
+                for (size_t t = 0; t < txt_records->records.size(); ++t) {
+                    RR* rr = txt_records->records[t]->clone();
+                    rr->ttl = records.ttl(i);
+                    matches.push_back(rr);
                 }
+            } else {
+                matches.push_back(records.materialize(i));
             }
         }
-    // Match by exact name and type, or wildcard type (names already lowercased)
-    else if ((rr->type == query_rr->type && rr->name == query_rr->name) ||
-             (query_rr->type == RR::TYPESTAR && rr->name == query_rr->name) ||
-             // DYNAMIC records match TXT queries (they resolve to TXT)
-             (rr->type == RR::DYNAMIC && query_rr->type == RR::TXT && rr->name == query_rr->name))
+    }
+    
+    if (matches.size() == found && query_length)
+        synthesizeWildcard(query_rr, query_id, query_wire, query_length, zone, matches);
+}
+
+size_t QueryProcessor::findCut(const Zone& zone, const char* query_wire, size_t query_length)
+{
+    char apex[DNS_WIRE_NAME_MAX];
+    size_t apex_length = dns_name_to_wire(zone.name.data(), zone.name.length(), apex);
+    if (!apex_length || apex_length > query_length)
+        return 0;
+    
+    const NameTree& tree = zone.nameTree();
+    if (tree.valid())
     {
-        // Special handling for DYNAMIC records
-        if (rr->type == RR::DYNAMIC) {
-            // Resolve the DYNAMIC to TXT records
-            RRDYNAMIC* dynamic_rr = dynamic_cast<RRDYNAMIC*>(rr);
-            if (dynamic_rr) {
-                vector<RR*> txt_records = dynamic_rr->resolveTXT();
-                // Add all resolved TXT records to matches
-                for (vector<RR*>::iterator it = txt_records.begin(); it != txt_records.end(); ++it) {
-                    matches.push_back(*it);
-                    // Track these for cleanup if caller wants them
-                    if (dynamic_records) {
-                        dynamic_records->push_back(*it);
-                    }
-                }
+        // The tree counts NS records per name, so the walk down the query's
+        // labels passes every cut above it
+        NameTree::Lookup path;
+        tree.lookup(query_wire, query_length, path);
+        if (path.cut == NameTree::NONE || path.cut_offset >= query_length - apex_length)
+            return 0;
+        return query_length - path.cut_offset;
+    }
+    
+    // Not indexed yet (zone still loading): the longest NS owner in between
+    const RecordStore& records = zone.records();
+    const NameTable& names = NameTable::global();
+    size_t cut_length = 0;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        if (records.type(i) != RR::NS)
+            continue;
+        const string& ns_wire = names.wire(records.nameId(i));
+        if (ns_wire.length() > apex_length && ns_wire.length() > cut_length &&
+            dns_wire_is_subdomain(ns_wire.data(), ns_wire.length(), apex, apex_length) &&
+            dns_wire_is_subdomain(query_wire, query_length, ns_wire.data(), ns_wire.length()))
+            cut_length = ns_wire.length();
+    }
+    return cut_length;
+}
+
+string QueryProcessor::followCnames(const RR* query_rr,
+                                    const Zone& zone,
+                                    vector<RR*>& matches)
+{
+    if (query_rr->type == RR::CNAME || query_rr->type == RR::TYPESTAR)
+        return string();
+    
+    char apex[DNS_WIRE_NAME_MAX];
+    size_t apex_length = dns_name_to_wire(zone.name.data(), zone.name.length(), apex);
+    if (!apex_length)
+        return string();
+    
+    // Names seen so far, in wire form, for loop detection
+    vector<string> visited;
+    char wire[DNS_WIRE_NAME_MAX];
+    size_t length = dns_name_to_wire(query_rr->name.data(), query_rr->name.length(), wire);
+    visited.push_back(string(wire, length));
+    
+    size_t from = 0;
+    for (size_t depth = 0; depth < max_cname_chain; ++depth)
+    {
+        // The CNAME among the records found last
+        const RR* cname = NULL;
+        for (size_t i = from; i < matches.size() && !cname; ++i)
+        {
+            if (matches[i]->type == RR::CNAME)
+                cname = matches[i];
+        }
+        if (!cname)
+            return string();
+        
+        // Targets outside the zone or delegated from it are left to the
+        // resolver; a target starting with `*` would read as an enumeration
+        // query
+        length = dns_name_to_wire(cname->rdata.data(), cname->rdata.length(), wire);
+        if (!length || !dns_wire_is_subdomain(wire, length, apex, apex_length) ||
+            (wire[0] == 1 && wire[1] == '*') || findCut(zone, wire, length))
+            return string();
+        string target(wire, length);
+        for (size_t v = 0; v < visited.size(); ++v)
+        {
+            if (visited[v] == target)
+                return string();
+        }
+        visited.push_back(target);
+        
+        RR next;
+        next.name = cname->rdata;
+        next.type = query_rr->type;
+        next.rrclass = query_rr->rrclass;
+        next.query = true;
+        from = matches.size();
+        findMatches(&next, zone, matches);
+        if (matches.size() == from)
+            return next.name;
+    }
+    return string();
+}
+
+bool QueryProcessor::nameExists(const RR* query_rr, const Zone& zone)
+{
+    char wire[DNS_WIRE_NAME_MAX];
+    size_t length = dns_name_to_wire(query_rr->name.data(), query_rr->name.length(), wire);
+    if (!length)
+        return false;
+    
+    const NameTree& tree = zone.nameTree();
+    if (tree.valid())
+    {
+        NameTree::Lookup path;
+        tree.lookup(wire, length, path);
+        if (path.encloser == NameTree::NONE)
+            return false;
+        return path.encloser_offset == 0 ||
+               tree.child(path.encloser, "\001*", 2) != NameTree::NONE;
+    }
+    
+    // Not indexed yet (zone still loading): the name or one below it
+    const RecordStore& records = zone.records();
+    const NameTable& names = NameTable::global();
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const string& rr_wire = names.wire(records.nameId(i));
+        if (dns_wire_is_subdomain(rr_wire.data(), rr_wire.length(), wire, length))
+            return true;
+    }
+    return false;
+}
+
+void QueryProcessor::findAddresses(const Zone& zone, const string& name, vector<RR*>& addresses)
+{
+    const RecordStore& records = zone.records();
+    t_name_id name_id = NameTable::global().find(name);
+    size_t first, last;
+    zone.ownerRange(name_id, first, last);
+    for (size_t k = first; k < last; ++k)
+    {
+        size_t i = zone.recordAt(k);
+        if (records.nameId(i) != name_id)
+            continue;
+        if (records.type(i) == RR::A || records.type(i) == RR::AAAA)
+            addresses.push_back(records.materialize(i));
+    }
+}
+
+bool QueryProcessor::isGlue(const Zone& zone, const string& name)
+{
+    char wire[DNS_WIRE_NAME_MAX];
+    size_t length = dns_name_to_wire(name.data(), name.length(), wire);
+    return length && findCut(zone, wire, length) != 0;
+}
+
+void QueryProcessor::synthesizeWildcard(const RR* query_rr, t_name_id query_id,
+                                        const char* query_wire, size_t query_length,
+                                        const Zone& zone, vector<RR*>& matches)
+{
+    const NameTree& tree = zone.nameTree();
+    if (!tree.valid())
+        return;
+    
+    // Only names that do not exist are synthesized (RFC 4592 section 3.3.1);
+    // empty non-terminals exist
+    NameTree::Lookup path;
+    tree.lookup(query_wire, query_length, path);
+    if (path.encloser == NameTree::NONE || path.encloser_offset == 0)
+        return;
+    
+    // The closest encloser must lie within the zone and not below a zone
+    // cut: names under a delegation get the referral instead
+    char apex[DNS_WIRE_NAME_MAX];
+    size_t apex_length = dns_name_to_wire(zone.name.data(), zone.name.length(), apex);
+    if (!apex_length || apex_length > query_length)
+        return;
+    size_t apex_offset = query_length - apex_length;
+    if (path.encloser_offset > apex_offset)
+        return;
+    if (path.cut != NameTree::NONE && path.cut_offset < apex_offset)
+        return;
+    
+    uint32_t wildcard = tree.child(path.encloser, "\001*", 2);
+    if (wildcard == NameTree::NONE)
+        return;
+    t_name_id source = tree.node(wildcard).name;
+    if (source == NameTable::NOT_FOUND)
+        return;  // The wildcard only has names below it: no data
+    
+    const RecordStore& records = zone.records();
+    size_t first, last;
+    zone.ownerRange(source, first, last);
+    
+    for (size_t k = first; k < last; ++k)
+    {
+        size_t i = zone.recordAt(k);
+        if (records.nameId(i) != source)
+            continue;
+        
+        RR::RRType type = records.type(i);
+        if (type != query_rr->type && query_rr->type != RR::TYPESTAR && type != RR::CNAME &&
+            !(type == RR::DYNAMIC && query_rr->type == RR::TXT))
+            continue;
+        
+        // The synthesized records are owned by the query name
+        if (type == RR::DYNAMIC) {
+            RRDYNAMIC::t_txt_set txt_records = RRDYNAMIC::resolve(records.dynamicCache(i));
+            for (size_t t = 0; t < txt_records->records.size(); ++t) {
+                RR* rr = txt_records->records[t]->clone();
+                rr->name = query_rr->name;
+                rr->name_id = query_id;
+                rr->ttl = records.ttl(i);
+                matches.push_back(rr);
             }
         } else {
+            RR* rr = records.materialize(i);
+            rr->name = query_rr->name;
+            rr->name_id = query_id;
             matches.push_back(rr);
         }
     }
-        else if (rr->type == RR::NS)
-        {
-            // Check if query name ends with NS record name (subdomain check)
-            size_t pos = query_rr->name.rfind(rr->name);
-            if (pos != string::npos && pos == query_rr->name.length() - rr->name.length())
-            {
-                if (ns_record && *ns_record == NULL)
-                    *ns_record = rr;
+}
+
+void QueryProcessor::findEnumerated(const RR* query_rr, const Zone& zone, bool single_label,
+                                    const char* suffix, size_t suffix_length,
+                                    vector<RR*>& matches, unsigned int space, bool* truncated)
+{
+    const RecordStore& records = zone.records();
+    const NameIndex& index = zone.nameIndex();
+    const NameTable& names = NameTable::global();
+    size_t answers = 0;
+    
+    // The answers are packed as they are taken, so that they stop exactly
+    // where the response would overflow
+    vector<char> packed(space);
+    unsigned int offset = 0;
+    
+    // Takes record i if its type matches; false once a limit is reached
+    auto take = [&](size_t i) -> bool {
+        if (query_rr->type != RR::TYPESTAR && records.type(i) != query_rr->type)
+            return true;
+        if (max_wildcard_answers && answers >= max_wildcard_answers)
+            return false;
+        RR* rr = records.materialize(i);
+        if (space && !rr->pack(packed.data(), space, offset)) {
+            delete rr;
+            if (truncated)
+                *truncated = true;
+            return false;
+        }
+        matches.push_back(rr);
+        answers++;
+        return true;
+    };
+    
+    if (!index.valid()) {
+        // Not indexed yet (zone still loading): scan every record
+        for (size_t i = 0; i < records.size(); ++i) {
+            const string& rr_wire = names.wire(records.nameId(i));
+            
+            // Record name must lie strictly below the suffix
+            if (rr_wire.length() > suffix_length &&
+                dns_wire_is_subdomain(rr_wire.data(), rr_wire.length(), suffix, suffix_length)) {
+                
+                // For *.suffix only one label may precede the suffix
+                // (immediate subdomain); **.suffix allows any number
+                bool one_label = 1 + (unsigned char)rr_wire[0] + suffix_length == rr_wire.length();
+                if ((!single_label || one_label) && !take(i))
+                    return;
             }
         }
+        return;
+    }
+    
+    // The suffix and everything below it are one range in canonical order,
+    // the suffix's own records first
+    size_t first, last;
+    index.subtree(records, suffix, suffix_length, first, last);
+    for (size_t k = first; k < last; ++k) {
+        size_t i = index[k];
+        const string& rr_wire = names.wire(records.nameId(i));
+        if (rr_wire.length() == suffix_length)
+            continue;
+        
+        if (single_label && 1 + (unsigned char)rr_wire[0] + suffix_length != rr_wire.length()) {
+            // Deeper than one label: skip the rest of the subtree of the
+            // suffix's child this name lies in (the child's own records sort
+            // before it, so none are lost)
+            size_t child = 0;
+            while (child + 1 + (unsigned char)rr_wire[child] + suffix_length < rr_wire.length())
+                child += 1 + (unsigned char)rr_wire[child];
+            size_t child_first, child_last;
+            index.subtree(records, rr_wire.data() + child, rr_wire.length() - child,
+                          child_first, child_last);
+            k = child_last - 1;
+            continue;
+        }
+        if (!take(i))
+            return;
     }
 }
-
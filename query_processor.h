@@ -4,21 +4,77 @@
 #include <vector>
 #include "rr.h"
 #include "zone.h"
+#include "rrdynamic.h"
 
 // Handles DNS QUERY operations
-// Finds matching records for queries including wildcards
+// Finds matching records for queries, synthesizes answers from wildcard
+// owners (RFC 4592) and answers the *. and **. enumeration queries
 class QueryProcessor {
 public:
-    // Find records matching the query
-    // matches: output vector of matching records (may include dynamically created records)
-    // dynamic_records: output vector of temporary records that need to be freed by caller
-    //                  (these are also included in matches and are created from DYNAMIC RRs)
-    // ns_record: optional output for delegation NS record
+    // Find records matching the query. A name that does not exist in the zone
+    // is answered from the wildcard at its closest encloser, if there is one,
+    // with the query's name as the owner of the synthesized records.
+    // matches: output vector of matching records, materialized from the zone's compact
+    //          storage (see RecordStore) plus TXT records resolved from DYNAMIC RRs,
+    //          which hold their resolved set. The caller owns and deletes them: run it
+    //          inside the request's Arena::Scope, and delete them or move them into
+    //          the reply, which deletes its records (the scope runs no destructors).
+    // delegation: optional output of the NS RRset of the deepest zone cut at or
+    //             above the query name, other than the apex (owned likewise).
+    //             Names at or below a cut are not answered: matches stays as it was.
+    // space: bytes the answer section may take in the response, 0 for no limit.
+    //        Enumeration queries stop at the last record that fits and set
+    //        *truncated, if given.
     static void findMatches(const RR* query_rr,
                            const Zone& zone,
                            std::vector<RR*>& matches,
-                           RR** ns_record = NULL,
-                           std::vector<RR*>* dynamic_records = NULL);
+                           std::vector<RR*>* delegation = NULL,
+                           unsigned int space = 0,
+                           bool* truncated = NULL);
+
+    // Follows the CNAMEs among `matches` (RFC 1034 section 4.3.2): the records of
+    // the query type at each in-zone target are appended to matches, up to
+    // max_cname_chain targets. Stops at a target outside the zone, at one already
+    // visited (a loop), at one at or below a zone cut and at a target without a
+    // CNAME. Queries for CNAME or ANY are not followed.
+    // Returns the in-zone target the chain ended at with no records of the
+    // query type, else an empty string: the reply then answers for that name,
+    // NXDOMAIN or NODATA with the SOA (RFC 6604, RFC 2308).
+    static std::string followCnames(const RR* query_rr,
+                             const Zone& zone,
+                             std::vector<RR*>& matches);
+
+    static size_t max_cname_chain;
+
+    // True if the query name exists in the zone: it has records, names below it
+    // (an empty non-terminal) or, as for synthesis, a wildcard at its closest
+    // encloser once the zone is indexed. An empty answer for
+    // such a name is NODATA, for any other name NXDOMAIN (RFC 2308).
+    static bool nameExists(const RR* query_rr, const Zone& zone);
+
+    // Appends the A and AAAA records of `name` in the zone to `addresses`, for
+    // the additional section; materialized like matches
+    static void findAddresses(const Zone& zone, const std::string& name, std::vector<RR*>& addresses);
+
+    // True if `name` is at or below a zone cut: its records there are glue
+    // for the delegated zone, not data the zone is authoritative for
+    static bool isGlue(const Zone& zone, const std::string& name);
+
+    // Limit on the answers to an enumeration query (*.suffix, **.suffix):
+    // matching stops at max_wildcard_answers records, or earlier once the
+    // response has no space left. 0 disables the limit.
+    static size_t max_wildcard_answers;
+
+private:
+    // Length of the wire suffix of `query_wire` naming the deepest zone cut
+    // below the apex at or above it, or 0 if there is none
+    static size_t findCut(const Zone& zone, const char* query_wire, size_t query_length);
+    static void synthesizeWildcard(const RR* query_rr, t_name_id query_id,
+                                   const char* query_wire, size_t query_length,
+                                   const Zone& zone, std::vector<RR*>& matches);
+    static void findEnumerated(const RR* query_rr, const Zone& zone, bool single_label,
+                               const char* suffix, size_t suffix_length,
+                               std::vector<RR*>& matches, unsigned int space, bool* truncated);
 };
 
 #endif
@@ -0,0 +1,197 @@
+#include "rate_limit.h"
+
+#include "socket.h"
+
+using namespace std;
+
+const size_t RateLimiter::TABLE_SIZE;
+const unsigned int RateLimiter::MAX_RATE;
+const unsigned int RateLimiter::DEFAULT_SLIP;
+const unsigned int RateLimiter::MAX_SLIP;
+const unsigned int RateLimiter::DEFAULT_IPV4_PREFIX;
+const unsigned int RateLimiter::DEFAULT_IPV6_PREFIX;
+
+// A bucket word: the key's tag (20 bits), the second of its last reply
+// (20 bits, wrapping after 12 days), the limited replies since the last
+// slip (8 bits) and the tokens left in that second (16 bits). Zero is an
+// empty word; tags are never zero.
+static const unsigned int TAG_BITS = 20;
+static const unsigned int TIME_BITS = 20;
+static const uint32_t TAG_MASK = (1u << TAG_BITS) - 1;
+static const uint32_t TIME_MASK = (1u << TIME_BITS) - 1;
+
+static inline uint32_t tagOf(uint64_t word) { return (uint32_t)(word >> 44); }
+static inline uint32_t timeOf(uint64_t word) { return (uint32_t)(word >> 24) & TIME_MASK; }
+static inline unsigned int slipOf(uint64_t word) { return (unsigned int)(word >> 16) & 0xFF; }
+static inline unsigned int tokensOf(uint64_t word) { return (unsigned int)(word & 0xFFFF); }
+
+static inline uint64_t bucketWord(uint32_t tag, uint32_t time, unsigned int slip, unsigned int tokens)
+{
+	return ((uint64_t)tag << 44) | ((uint64_t)time << 24) | ((uint64_t)slip << 16) | tokens;
+}
+
+static inline uint64_t fnv1a(uint64_t h, unsigned char byte)
+{
+	return (h ^ byte) * 0x100000001b3ULL;
+}
+
+// FNV-1a over the name and the client's network (the family and the
+// address cut to `prefix` bits), then the rest of the key, through the
+// MurmurHash3 finalizer so that every bit of the key reaches the index
+// and the tag
+static uint64_t keyHash(const IpAddress& client, unsigned int prefix, RateLimiter::Kind kind,
+                        const string& name, unsigned int type)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < name.length(); ++i)
+		h = fnv1a(h, (unsigned char)name[i]);
+
+	h = fnv1a(h, (unsigned char)client.family);
+	if (prefix > 8 * client.length())
+		prefix = (unsigned int)(8 * client.length());
+	for (unsigned int i = 0; i < prefix / 8; ++i)
+		h = fnv1a(h, client.bytes[i]);
+	if (prefix % 8)
+		h = fnv1a(h, client.bytes[prefix / 8] & (unsigned char)(0xFF << (8 - prefix % 8)));
+
+	h ^= ((uint64_t)kind << 16) | (type & 0xFFFF);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+RateLimiter::Config::Config()
+	: slip(DEFAULT_SLIP), ipv4_prefix(DEFAULT_IPV4_PREFIX), ipv6_prefix(DEFAULT_IPV6_PREFIX)
+{
+	for (int k = 0; k < NUM_KINDS; ++k)
+		rate[k] = 0;
+}
+
+RateLimiter& RateLimiter::global()
+{
+	static RateLimiter limiter;
+	return limiter;
+}
+
+RateLimiter::RateLimiter() : table_(NULL), limited_(0), slipped_(0)
+{
+}
+
+RateLimiter::~RateLimiter()
+{
+	delete[] table_;
+}
+
+void RateLimiter::configure(const Config& config)
+{
+	config_ = config;
+	for (int k = 0; k < NUM_KINDS; ++k)
+	{
+		if (config_.rate[k] == 0)
+			config_.rate[k] = config_.rate[RESPONSE];
+		if (config_.rate[k] > MAX_RATE)
+			config_.rate[k] = MAX_RATE;
+	}
+	if (config_.slip > MAX_SLIP)
+		config_.slip = MAX_SLIP;
+	if (config_.ipv4_prefix > 32)
+		config_.ipv4_prefix = 32;
+	if (config_.ipv6_prefix > 128)
+		config_.ipv6_prefix = 128;
+
+	// The table is only allocated once limiting is turned on
+	if (enabled() && !table_)
+		table_ = new atomic<uint64_t>[TABLE_SIZE];
+	if (table_)
+	{
+		for (size_t i = 0; i < TABLE_SIZE; ++i)
+			table_[i].store(0, memory_order_relaxed);
+	}
+	limited_ = 0;
+	slipped_ = 0;
+}
+
+RateLimiter::Action RateLimiter::check(const IpAddress& client, Kind kind, const string& name, unsigned int type,
+                                       time_t now)
+{
+	if (!enabled())
+		return SEND;
+
+	unsigned int prefix = client.family == IpAddress::IPV6 ? config_.ipv6_prefix : config_.ipv4_prefix;
+	uint64_t h = keyHash(client, prefix, kind, name, type);
+	uint32_t tag = (uint32_t)(h >> (64 - TAG_BITS)) & TAG_MASK;
+	if (tag == 0)
+		tag = 1;
+	uint32_t second = (uint32_t)now & TIME_MASK;
+	atomic<uint64_t>* pair = table_ + (h & (TABLE_SIZE - 1) & ~(uint64_t)1);
+
+	// The key's bucket, else the one of the pair idle for longest
+	uint64_t words[2] = { pair[0].load(memory_order_relaxed), pair[1].load(memory_order_relaxed) };
+	int slot;
+	if (tagOf(words[0]) == tag)
+		slot = 0;
+	else if (tagOf(words[1]) == tag)
+		slot = 1;
+	else
+		slot = ((second - timeOf(words[0])) & TIME_MASK) >= ((second - timeOf(words[1])) & TIME_MASK) ? 0 : 1;
+
+	// A new bucket, or an old one in a new second, starts full. A bucket
+	// counts its own limited replies, so every slip-th one of each key
+	// slips, however many other keys are limited meanwhile.
+	uint64_t old = words[slot];
+	Action action;
+	for (;;)
+	{
+		unsigned int tokens = tokensOf(old);
+		unsigned int slip = slipOf(old);
+		if (tagOf(old) != tag)
+		{
+			tokens = config_.rate[kind];
+			slip = 0;
+		}
+		else if (timeOf(old) != second)
+			tokens = config_.rate[kind];
+
+		if (tokens > 0)
+		{
+			tokens--;
+			action = SEND;
+		}
+		else if (config_.slip && ++slip >= config_.slip)
+		{
+			slip = 0;
+			action = SLIP;
+		}
+		else
+			action = DROP;
+		uint64_t next = bucketWord(tag, second, slip, tokens);
+		if (next == old || pair[slot].compare_exchange_weak(old, next, memory_order_relaxed))
+			break;
+	}
+	if (action == SEND)
+		return SEND;
+
+	limited_.fetch_add(1, memory_order_relaxed);
+	if (action == SLIP)
+		slipped_.fetch_add(1, memory_order_relaxed);
+	return action;
+}
+
+void RateLimiter::dump(ostream& os) const
+{
+	unsigned long long limited_count = limited();
+	unsigned long long slipped_count = slipped();
+	os << "[RRL] responses_per_second=" << config_.rate[RESPONSE]
+	   << " nxdomains_per_second=" << config_.rate[NXDOMAIN]
+	   << " errors_per_second=" << config_.rate[ERROR]
+	   << " slip=" << config_.slip
+	   << " ipv4_prefix=" << config_.ipv4_prefix
+	   << " ipv6_prefix=" << config_.ipv6_prefix
+	   << " limited=" << limited_count
+	   << " dropped=" << limited_count - slipped_count
+	   << " slipped=" << slipped_count
+	   << endl;
+}
@@ -0,0 +1,94 @@
+#ifndef HAVE_RATE_LIMIT_H
+#define HAVE_RATE_LIMIT_H
+
+#include <atomic>
+#include <cstddef>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "ip_address.h"
+
+// Response rate limiting (RRL) of UDP replies, against reflection attacks
+// that spoof a victim's address and against floods in general.
+//
+// Replies are counted in token buckets keyed by the client's network (its
+// address cut to a prefix length) and by what it is sent: a name and a
+// query type for answers, a name for NXDOMAIN, nothing more for errors.
+// A bucket holds one second's worth of tokens, the rate, and is refilled
+// every second. A reply without a token is dropped, except that every
+// slip-th one of the bucket goes out truncated (TC), so a real client
+// behind a spoofed address can retry over TCP, which cannot be spoofed
+// and is not limited.
+//
+// The buckets live in a fixed table of 64-bit words updated with compare-
+// and-swap: checking takes no lock, and a flood from spoofed sources only
+// makes its buckets evict each other instead of growing the table. Each
+// key hashes to two neighbouring words; a new bucket replaces the one of
+// the pair that was used longest ago.
+class RateLimiter
+{
+public:
+	enum Action { SEND, DROP, SLIP };
+
+	enum Kind
+	{
+		RESPONSE,  // NOERROR: answers, referrals and NODATA
+		NXDOMAIN,
+		ERROR,     // REFUSED, SERVFAIL, FORMERR, ...
+		NUM_KINDS
+	};
+
+	struct Config
+	{
+		Config();
+
+		// Replies per second and bucket. 0 for RESPONSE turns rate
+		// limiting off; 0 for the others means the RESPONSE rate.
+		unsigned int rate[NUM_KINDS];
+		unsigned int slip;         // Every slip-th limited reply is truncated; 0 drops them all
+		unsigned int ipv4_prefix;  // Clients in one network of this length share buckets
+		unsigned int ipv6_prefix;  // The same for IPv6 clients
+	};
+
+	static const size_t TABLE_SIZE = 1 << 16;        // Buckets, 8 bytes each
+	static const unsigned int MAX_RATE = 0xFFFF;
+	static const unsigned int DEFAULT_SLIP = 2;
+	static const unsigned int MAX_SLIP = 255;         // What a bucket's slip counter holds
+	static const unsigned int DEFAULT_IPV4_PREFIX = 24;
+	static const unsigned int DEFAULT_IPV6_PREFIX = 56;
+
+	RateLimiter();
+	~RateLimiter();
+
+	// The limiter of the server's request engine
+	static RateLimiter& global();
+
+	// Not safe against concurrent check() calls: configure before serving.
+	// Empties the table and resets the counters.
+	void configure(const Config& config);
+	const Config& config() const { return config_; }
+	bool enabled() const { return config_.rate[RESPONSE] != 0; }
+
+	// Accounts one reply of `kind` to `client`. `name` and `type` tell
+	// replies of one kind apart; `now` is in seconds. Always SEND while
+	// disabled.
+	Action check(const IpAddress& client, Kind kind, const std::string& name, unsigned int type, time_t now);
+
+	unsigned long long limited() const { return limited_.load(std::memory_order_relaxed); }
+	unsigned long long slipped() const { return slipped_.load(std::memory_order_relaxed); }
+
+	// One [RRL] line with the configuration and the counters
+	void dump(std::ostream& os) const;
+
+private:
+	RateLimiter(const RateLimiter&);
+	RateLimiter& operator=(const RateLimiter&);
+
+	Config config_;
+	std::atomic<uint64_t>* table_;
+	std::atomic<unsigned long long> limited_;
+	std::atomic<unsigned long long> slipped_;
+};
+
+#endif
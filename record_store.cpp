@@ -0,0 +1,211 @@
+#include "record_store.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+RecordStore::RecordStore() : garbage_(0)
+{
+}
+
+uint32_t RecordStore::appendRdata(const char* rdata, size_t length)
+{
+	if (length > 0xFFFF)
+		throw runtime_error("rdata longer than 65535 bytes");
+	if (blob_.size() + length > 0xFFFFFFFFUL)
+		throw runtime_error("zone rdata exceeds 4 GiB");
+
+	uint32_t offset = (uint32_t)blob_.size();
+	blob_.append(rdata, length);
+	return offset;
+}
+
+void RecordStore::add(const RR& record)
+{
+	string wire;
+	record.packRdata(wire);
+	add(NameTable::global().intern(record.name), record.type, record.rrclass,
+	    (uint32_t)record.ttl, wire.data(), wire.length());
+}
+
+void RecordStore::add(t_name_id name, RR::RRType type, RR::RRClass rrclass, uint32_t ttl,
+                      const char* rdata, size_t length)
+{
+	uint32_t offset = appendRdata(rdata, length);
+	names_.push_back(name);
+	types_.push_back((uint16_t)type);
+	classes_.push_back((uint16_t)rrclass);
+	ttls_.push_back(ttl);
+	offsets_.push_back(offset);
+	lengths_.push_back((uint16_t)length);
+	if (type == RR::DYNAMIC)
+		bindDynamic(name, rdata, length);
+}
+
+void RecordStore::remove(size_t i)
+{
+	string filepath;
+	if (type(i) == RR::DYNAMIC)
+		filepath.assign(rdata(i), lengths_[i]);
+	t_name_id name = names_[i];
+	RR::RRType removed = type(i);
+
+	garbage_ += lengths_[i];
+	names_.erase(names_.begin() + i);
+	types_.erase(types_.begin() + i);
+	classes_.erase(classes_.begin() + i);
+	ttls_.erase(ttls_.begin() + i);
+	offsets_.erase(offsets_.begin() + i);
+	lengths_.erase(lengths_.begin() + i);
+	if (removed == RR::DYNAMIC)
+		unbindDynamic(name, filepath);
+
+	if (names_.empty())
+		clear();
+	else if (garbage_ > 4096 && garbage_ > blob_.size() / 2)
+		compact();
+}
+
+void RecordStore::setRdata(size_t i, const string& rdata)
+{
+	string filepath;
+	if (type(i) == RR::DYNAMIC)
+		filepath.assign(this->rdata(i), lengths_[i]);
+
+	if (rdata.length() == lengths_[i])
+		blob_.replace(offsets_[i], lengths_[i], rdata);
+	else
+	{
+		garbage_ += lengths_[i];
+		offsets_[i] = appendRdata(rdata.data(), rdata.length());
+		lengths_[i] = (uint16_t)rdata.length();
+	}
+
+	if (type(i) == RR::DYNAMIC && filepath != rdata)
+	{
+		bindDynamic(names_[i], rdata.data(), rdata.length());
+		unbindDynamic(names_[i], filepath);
+	}
+}
+
+void RecordStore::bindDynamic(t_name_id name, const char* filepath, size_t length)
+{
+	pair<t_dynamic::iterator, t_dynamic::iterator> range = dynamic_.equal_range(name);
+	for (t_dynamic::iterator it = range.first; it != range.second; ++it)
+	{
+		if (it->second.filepath.compare(0, string::npos, filepath, length) == 0)
+			return;
+	}
+	Dynamic dynamic;
+	dynamic.filepath.assign(filepath, length);
+	dynamic.cache = RRDYNAMIC::cacheFor(NameTable::global().name(name), dynamic.filepath);
+	dynamic_.insert(make_pair(name, dynamic));
+}
+
+void RecordStore::unbindDynamic(t_name_id name, const string& filepath)
+{
+	// Kept while another record of the name still reads the file
+	for (size_t i = 0; i < names_.size(); ++i)
+	{
+		if (names_[i] == name && type(i) == RR::DYNAMIC &&
+		    filepath.compare(0, string::npos, rdata(i), lengths_[i]) == 0)
+			return;
+	}
+	pair<t_dynamic::iterator, t_dynamic::iterator> range = dynamic_.equal_range(name);
+	for (t_dynamic::iterator it = range.first; it != range.second; ++it)
+	{
+		if (it->second.filepath == filepath)
+		{
+			dynamic_.erase(it);
+			return;
+		}
+	}
+}
+
+RRDYNAMIC::Cache& RecordStore::dynamicCache(size_t i) const
+{
+	pair<t_dynamic::const_iterator, t_dynamic::const_iterator> range = dynamic_.equal_range(names_[i]);
+	for (t_dynamic::const_iterator it = range.first; it != range.second; ++it)
+	{
+		if (it->second.filepath.compare(0, string::npos, rdata(i), lengths_[i]) == 0)
+			return *it->second.cache;
+	}
+	throw logic_error("DYNAMIC record without a cache");
+}
+
+void RecordStore::clear()
+{
+	names_.clear();
+	types_.clear();
+	classes_.clear();
+	ttls_.clear();
+	offsets_.clear();
+	lengths_.clear();
+	blob_.clear();
+	garbage_ = 0;
+	dynamic_.clear();
+}
+
+void RecordStore::shrink()
+{
+	if (garbage_)
+		compact();
+	names_.shrink_to_fit();
+	types_.shrink_to_fit();
+	classes_.shrink_to_fit();
+	ttls_.shrink_to_fit();
+	offsets_.shrink_to_fit();
+	lengths_.shrink_to_fit();
+	blob_.shrink_to_fit();
+}
+
+void RecordStore::reserve(size_t records, size_t rdata_bytes)
+{
+	names_.reserve(records);
+	types_.reserve(records);
+	classes_.reserve(records);
+	ttls_.reserve(records);
+	offsets_.reserve(records);
+	lengths_.reserve(records);
+	blob_.reserve(rdata_bytes);
+}
+
+void RecordStore::compact()
+{
+	string blob;
+	blob.reserve(blob_.size() - garbage_);
+	for (size_t i = 0; i < offsets_.size(); ++i)
+	{
+		uint32_t offset = (uint32_t)blob.size();
+		blob.append(blob_, offsets_[i], lengths_[i]);
+		offsets_[i] = offset;
+	}
+	blob_.swap(blob);
+	garbage_ = 0;
+}
+
+RR* RecordStore::materialize(size_t i) const
+{
+	RR* rr = RR::createByType(type(i));
+	rr->name = NameTable::global().name(names_[i]);
+	rr->name_id = names_[i];
+	rr->type = type(i);
+	rr->rrclass = rrclass(i);
+	rr->ttl = ttls_[i];
+	rr->query = false;
+	// The blob holds what packRdata produced, so this only fails for
+	// records that were stored empty (e.g. a DYNAMIC without a path)
+	rr->unpackRdata(rdata(i), lengths_[i]);
+	return rr;
+}
+
+size_t RecordStore::bytes() const
+{
+	return names_.capacity() * sizeof(t_name_id) +
+	       types_.capacity() * sizeof(uint16_t) +
+	       classes_.capacity() * sizeof(uint16_t) +
+	       ttls_.capacity() * sizeof(uint32_t) +
+	       offsets_.capacity() * sizeof(uint32_t) +
+	       lengths_.capacity() * sizeof(uint16_t) +
+	       blob_.capacity();
+}
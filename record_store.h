@@ -0,0 +1,78 @@
+#ifndef HAVE_RECORD_STORE_H
+#define HAVE_RECORD_STORE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "rr.h"
+#include "rrdynamic.h"
+
+// A zone's records in struct-of-arrays form. Record i is the i-th entry
+// of each array: interned owner name, 16-bit type and class, 32-bit TTL,
+// and the offset/length of its rdata in one shared blob. Rdata is kept in
+// wire format, exactly as RR::packRdata produces it.
+//
+// RR objects are not stored; materialize() builds one on demand using
+// the type's unpackRdata, so the RR classes only parse and serialize.
+// DYNAMIC records also keep the handle of their TXT cache, by owner, so
+// queries reach it without materializing the record.
+class RecordStore
+{
+public:
+	RecordStore();
+
+	size_t size() const { return names_.size(); }
+	bool empty() const { return names_.empty(); }
+
+	t_name_id nameId(size_t i) const { return names_[i]; }
+	RR::RRType type(size_t i) const { return (RR::RRType)types_[i]; }
+	RR::RRClass rrclass(size_t i) const { return (RR::RRClass)classes_[i]; }
+	uint32_t ttl(size_t i) const { return ttls_[i]; }
+	const char* rdata(size_t i) const { return blob_.data() + offsets_[i]; }
+	uint16_t rdataLength(size_t i) const { return lengths_[i]; }
+
+	// Appends a record. Throws if its rdata is longer than 64 KiB.
+	void add(const RR& record);
+	void add(t_name_id name, RR::RRType type, RR::RRClass rrclass, uint32_t ttl,
+	         const char* rdata, size_t length);
+	void remove(size_t i);
+	void setRdata(size_t i, const std::string& rdata);
+	void clear();
+	void shrink();  // Releases spare capacity once loading is done
+	void reserve(size_t records, size_t rdata_bytes);  // Before a bulk load of known size
+
+	// New RR for record i. It is allocated like any RR, i.e. from the
+	// current Arena inside a request; the caller deletes it.
+	RR* materialize(size_t i) const;
+
+	// The TXT cache of DYNAMIC record i (see RRDYNAMIC::resolve)
+	RRDYNAMIC::Cache& dynamicCache(size_t i) const;
+
+	size_t bytes() const;  // Memory held by the arrays and the blob
+
+private:
+	uint32_t appendRdata(const char* rdata, size_t length);
+	void compact();
+	void bindDynamic(t_name_id name, const char* filepath, size_t length);
+	void unbindDynamic(t_name_id name, const std::string& filepath);
+
+	struct Dynamic
+	{
+		std::string filepath;
+		std::shared_ptr<RRDYNAMIC::Cache> cache;
+	};
+	typedef std::unordered_multimap<t_name_id, Dynamic> t_dynamic;
+
+	std::vector<t_name_id> names_;
+	std::vector<uint16_t> types_;
+	std::vector<uint16_t> classes_;
+	std::vector<uint32_t> ttls_;
+	std::vector<uint32_t> offsets_;
+	std::vector<uint16_t> lengths_;
+	std::string blob_;
+	size_t garbage_;  // Blob bytes no record refers to any more
+	t_dynamic dynamic_;  // One entry per owner and file of DYNAMIC records
+};
+
+#endif
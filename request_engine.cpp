@@ -0,0 +1,727 @@
+#include "request_engine.h"
+
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+#include <strings.h>
+#include "mutex_guard.h"
+#include "rr.h"
+#include "dns_name.h"
+#include "rrtxt.h"
+#include "rrsoa.h"
+#include "zone_authority.h"
+#include "update_processor.h"
+#include "query_processor.h"
+#include "tsig.h"
+#include "arena.h"
+#include "stats.h"
+#include "stage_trace.h"
+#include "slow_log.h"
+#include "rate_limit.h"
+#include "cookie.h"
+#include "client_subnet.h"
+#include "rropt.h"
+#include "version.h"
+
+using namespace std;
+
+pthread_mutex_t g_zone_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void dumpPacketHex(const char* label, const char *buf, unsigned int len)
+{
+	cerr << "[" << label << "] Packet dump (" << len << " bytes):" << endl;
+	for (unsigned int i = 0; i < len; i++)
+	{
+		cerr << hex << setfill('0') << setw(2) << (int)(unsigned char)buf[i];
+		if (i % 16 == 15)
+			cerr << endl;
+		else if (i % 2 == 1)
+			cerr << " ";
+	}
+	if ((len - 1) % 16 != 15)
+		cerr << endl;
+	cerr << dec << flush;
+}
+
+// Empties the reply down to its header, question and OPT record, with TC
+// set: the client retries over TCP
+static void truncateReply(Message* reply)
+{
+	Message::t_section* sections[] = { &reply->an, &reply->ns, &reply->ar };
+	for (size_t s = 0; s < 3; ++s)
+	{
+		Message::t_section& section = *sections[s];
+		size_t kept = 0;
+		for (size_t i = 0; i < section.size(); ++i)
+		{
+			if (section[i]->type == RR::OPT)
+				section[kept++] = section[i];
+			else
+				delete section[i];
+		}
+		section.resize(kept);
+	}
+	reply->truncation = true;
+}
+
+// The data of the request's EDNS option `code`, or NULL
+static const string* findOption(const Message* request, uint16_t code)
+{
+	const RROPT* opt = dynamic_cast<const RROPT*>(request->getOPT());
+	if (!opt)
+		return NULL;
+	for (size_t i = 0; i < opt->options.size(); ++i)
+	{
+		if (opt->options[i].code == code)
+			return &opt->options[i].data;
+	}
+	return NULL;
+}
+
+// Bytes left for the answer section of the reply to `request`, once the
+// header, the question and the OPT record with its cookie and ECS options
+// are packed
+static unsigned int answerSpace(const Message* request)
+{
+	char wire[DNS_WIRE_NAME_MAX + 4];
+	unsigned int size = 0;
+	if (!request->qd[0]->pack(wire, sizeof(wire), size))
+		return 0;
+	size += 12;
+	if (request->getOPT())
+	{
+		size += 11;
+		if (findOption(request, DnsCookies::OPTION_CODE))
+			size += 4 + DnsCookies::CLIENT_COOKIE_SIZE + DnsCookies::SERVER_COOKIE_SIZE;
+		const string* ecs = findOption(request, ClientSubnet::OPTION_CODE);
+		if (ecs)
+			size += 4 + ecs->length();
+	}
+	return size < Message::MAX_SIZE ? Message::MAX_SIZE - size : 0;
+}
+
+RequestEngine::RequestEngine(vector<Zone*>& zones, bool log)
+	: zones_(zones), log_(log)
+{
+}
+
+bool RequestEngine::handle(char* request, unsigned int len, const Client& client,
+                           Transport transport, Response& response)
+{
+	unsigned long long start = StageTrace::now();
+	StageTrace::beginRequest();
+	response.length = 0;
+
+	if (log_)
+	{
+		time_t t = time(NULL);
+		tm *tmt = localtime(&t);
+		char tmp[200];
+		strftime(tmp, sizeof(tmp), "%Y.%m.%d %H:%M:%S", tmt);
+		cout << "\n" << tmp << " [" << client.address << "] {-} : " << len << endl << flush;
+	}
+
+	// Everything built for this request comes from the thread's arena and is
+	// released in one step when the scope ends, after the response was packed.
+	// Declared after the scope, `accounting` reads the arena before the reset.
+	Arena::Scope arena_scope(Arena::forThread());
+	Stats::Request accounting(Arena::forThread());
+
+	try {
+		Message *msgtest = new Message();
+		unsigned int offset = 0;
+		bool unpacked;
+		{
+			StageTrace::Timer timer(StageTrace::UNPACK);
+			unpacked = msgtest->unpack(request, len, offset);
+		}
+		if (!unpacked)
+		{
+			delete msgtest;
+			cerr << "[UNPACK_FAILED] Message unpacking failed" << endl;
+			cerr << "[UNPACK_FAILED] Client: " << client.address << ", Packet length: " << len << " bytes" << endl;
+			dumpPacketHex("UNPACK_FAILED", request, len);
+			cerr << flush;
+			if (log_)
+				cout << "faulty" << endl << flush;
+			finishRequest(start, client, NULL, NULL, NULL, response);
+			return false;
+		}
+
+		if (log_)
+			cout << *msgtest << flush;
+
+		// A valid server cookie proves the client's address: it skips rate
+		// limiting and the UDP size cap for clients without one
+		time_t now = time(NULL);
+		const string* cookie = findOption(msgtest, DnsCookies::OPTION_CODE);
+		DnsCookies::Status cookie_status = cookie ?
+			DnsCookies::global().check(*cookie, client.addr, now) : DnsCookies::NONE;
+		bool malformed = cookie_status == DnsCookies::MALFORMED;
+
+		// A resolver's query may carry the end user's network, which then
+		// selects the ACL view instead of the resolver's address
+		ClientSubnet subnet;
+		const string* ecs = msgtest->opcode == Message::QUERY ?
+			findOption(msgtest, ClientSubnet::OPTION_CODE) : NULL;
+		if (ecs && !subnet.parse(*ecs))
+			malformed = true;
+		unsigned int scope_prefix = 0;
+
+		Message *reply = NULL;
+		const Zone* zone = NULL;
+		if (malformed && msgtest->query &&
+		    (msgtest->opcode == Message::QUERY || msgtest->opcode == Message::UPDATE) &&
+		    msgtest->qd.size() == 1 && msgtest->qd[0])
+		{
+			reply = newReply(msgtest, Message::CODEFORMATERROR);
+			reply->opcode = msgtest->opcode;
+			reply->copyEDNS(msgtest);
+		}
+		else if (msgtest->query && msgtest->opcode == Message::UPDATE)
+			reply = handleUpdate(request, len, client, msgtest, zone);
+		else if (msgtest->query && msgtest->opcode == Message::QUERY)
+			reply = handleQuery(request, len, client, ecs ? &subnet : NULL, msgtest, zone, scope_prefix);
+
+		if (!reply)
+		{
+			finishRequest(start, client, msgtest, zone, NULL, response);
+			delete msgtest;
+			return false;
+		}
+
+		// Answer a client cookie with a fresh server cookie for the next query
+		bool verified = cookie_status == DnsCookies::VALID;
+		if (cookie_status == DnsCookies::CLIENT || verified)
+		{
+			RROPT* opt = dynamic_cast<RROPT*>(reply->getOPT());
+			if (opt)
+				opt->addOption(DnsCookies::OPTION_CODE, DnsCookies::global().reply(*cookie, client.addr, now));
+		}
+		if (ecs && !malformed)
+		{
+			RROPT* opt = dynamic_cast<RROPT*>(reply->getOPT());
+			if (opt)
+				opt->addOption(ClientSubnet::OPTION_CODE, subnet.reply(scope_prefix));
+		}
+
+		// Spoofed sources can only be answered over UDP
+		if (transport == UDP && msgtest->opcode == Message::QUERY && !verified)
+		{
+			RateLimiter::Action action = rateLimit(client, msgtest, reply, now);
+			if (action == RateLimiter::DROP)
+			{
+				if (log_)
+					cout << "rate limited" << endl << flush;
+				finishRequest(start, client, msgtest, zone, NULL, response);
+				delete msgtest;
+				delete reply;
+				return false;
+			}
+			if (action == RateLimiter::SLIP)
+				truncateReply(reply);
+		}
+
+		{
+			StageTrace::Timer timer(StageTrace::PACK);
+			packReply(reply, msgtest, zone, transport, verified, response);
+		}
+		finishRequest(start, client, msgtest, zone, reply, response);
+		delete msgtest;
+		delete reply;
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "\n[EXCEPTION] Caught exception in handle(): " << e.what() << endl;
+		cerr << "[EXCEPTION] Client: " << client.address << ", Packet length: " << len << " bytes" << endl;
+		dumpPacketHex("EXCEPTION", request, len);
+		cerr << flush;
+	}
+	catch (...)
+	{
+		cerr << "\n[EXCEPTION] Caught unknown exception in handle()" << endl;
+		cerr << "[EXCEPTION] Client: " << client.address << ", Packet length: " << len << " bytes" << endl;
+		dumpPacketHex("EXCEPTION", request, len);
+		cerr << flush;
+	}
+	response.length = 0;
+	finishRequest(start, client, NULL, NULL, NULL, response);
+	return false;
+}
+
+void RequestEngine::finishRequest(unsigned long long start, const Client& client, const Message* request,
+                                  const Zone* zone, const Message* reply, const Response& response)
+{
+	unsigned long long elapsed = StageTrace::now() - start;
+	StageTrace::record(StageTrace::HANDLE, elapsed);
+	if (request && SlowLog::isSlow(elapsed))
+		SlowLog::add(client.address ? client.address : "unknown", *request, zone, reply,
+		             reply ? response.length : 0);
+}
+
+void RequestEngine::packReply(Message* reply, const Message* request, const Zone* zone,
+                              Transport transport, bool verified, Response& response)
+{
+	bool udp = transport == UDP && request->query;
+	unsigned int limit = Message::MAX_SIZE;
+	if (udp)
+	{
+		limit = request->maxUdpPayload();
+		// A spoofed query must not get a large reply sent to its victim
+		unsigned int cap = DnsCookies::max_udp_without_cookie;
+		if (!verified && cap && limit > cap)
+			limit = cap < 512 ? 512 : cap;
+	}
+
+	response.length = 0;
+	bool packed = reply->pack(response.data, limit, response.length);
+	if (packed && zone && reply->opcode == Message::QUERY && !reply->truncation)
+	{
+		// Addresses for the additional section, as many as the space left
+		// holds. A referral without all its glue is truncated (RFC 9471).
+		bool complete = addAdditional(*zone, reply, limit - response.length);
+		if (!complete && udp && !reply->authoritative)
+			reply->truncation = true;
+		response.length = 0;
+		packed = reply->pack(response.data, limit, response.length);
+	}
+	if (packed)
+		return;
+
+	// The answer itself does not fit. The header, question and OPT record
+	// always do: with TC set a UDP client retries over TCP, while over TCP
+	// there is no larger reply to retry with.
+	truncateReply(reply);
+	if (!udp)
+	{
+		reply->truncation = false;
+		reply->rcode = Message::CODESERVERFAILURE;
+	}
+	response.length = 0;
+	reply->pack(response.data, limit, response.length);
+}
+
+RateLimiter::Action RequestEngine::rateLimit(const Client& client, const Message* request,
+                                             const Message* reply, time_t now)
+{
+	RateLimiter& limiter = RateLimiter::global();
+	if (!limiter.enabled())
+		return RateLimiter::SEND;
+
+	// Answers count per query name and type. Empty answers count per owner
+	// of their authority record, the zone or the delegation, so that random
+	// names below it share one bucket; errors only per client network.
+	const RR* qrr = request->qd[0];
+	if (reply->rcode == Message::CODENOERROR && !reply->an.empty())
+		return limiter.check(client.addr, RateLimiter::RESPONSE, qrr->name, qrr->type, now);
+	if (reply->rcode != Message::CODENOERROR && reply->rcode != Message::CODENAMEERROR)
+		return limiter.check(client.addr, RateLimiter::ERROR, string(), 0, now);
+	const string& owner = reply->ns.empty() ? qrr->name : reply->ns[0]->name;
+	return limiter.check(client.addr, reply->rcode == Message::CODENOERROR ? RateLimiter::RESPONSE : RateLimiter::NXDOMAIN,
+	                     owner, 0, now);
+}
+
+// Bytes an address record takes in a reply: its rdata packs as it is
+static unsigned int addressSize(const RR* rr)
+{
+	const string& wire = NameTable::global().wire(NameTable::idOf(rr));
+	size_t name = wire.empty() ? rr->name.length() + 2 : wire.length();
+	return (unsigned int)(name + 10 + rr->rdata.length());
+}
+
+bool RequestEngine::addAdditional(const Zone& zone, Message* reply, unsigned int budget)
+{
+	vector<const string*> targets;
+	const Message::t_section* sections[] = { &reply->an, &reply->ns };
+	for (size_t s = 0; s < 2; ++s)
+	{
+		for (size_t i = 0; i < sections[s]->size(); ++i)
+		{
+			const RR* rr = (*sections[s])[i];
+			if (rr->type == RR::NS || rr->type == RR::MX)
+				targets.push_back(&rr->rdata);
+		}
+	}
+
+	// Before the OPT record, where the additional section had them so far
+	size_t at = reply->ar.size();
+	if (at && reply->ar[at - 1]->type == RR::OPT)
+		at--;
+
+	for (size_t t = 0; t < targets.size(); ++t)
+	{
+		// Each name once, and not if the answer already has its addresses
+		bool seen = false;
+		for (size_t p = 0; p < t && !seen; ++p)
+			seen = strcasecmp(targets[p]->c_str(), targets[t]->c_str()) == 0;
+		for (size_t i = 0; i < reply->an.size() && !seen; ++i)
+			seen = (reply->an[i]->type == RR::A || reply->an[i]->type == RR::AAAA) &&
+			       strcasecmp(reply->an[i]->name.c_str(), targets[t]->c_str()) == 0;
+		if (seen)
+			continue;
+
+		// Addresses at or below a zone cut belong to the delegated zone: only
+		// a referral carries them, as glue, never an authoritative answer
+		if (reply->authoritative && QueryProcessor::isGlue(zone, *targets[t]))
+			continue;
+
+		// A name's addresses go in together or, once the space is used up,
+		// not at all, and neither do those of the names after it
+		vector<RR*> addresses;
+		QueryProcessor::findAddresses(zone, *targets[t], addresses);
+		unsigned int size = 0;
+		for (size_t i = 0; i < addresses.size(); ++i)
+			size += addressSize(addresses[i]);
+		if (size > budget)
+		{
+			for (size_t i = 0; i < addresses.size(); ++i)
+				delete addresses[i];
+			return false;
+		}
+		budget -= size;
+		for (size_t i = 0; i < addresses.size(); ++i)
+		{
+			addresses[i]->query = false;
+			reply->ar.insert(reply->ar.begin() + at++, addresses[i]);
+		}
+	}
+	return true;
+}
+
+Message* RequestEngine::newReply(const Message* request, Message::RCode rcode)
+{
+	Message *reply = new Message();
+	reply->id = request->id;
+	reply->opcode = Message::QUERY;
+	reply->qd.push_back(request->qd[0]->clone());
+	reply->truncation = false;
+	reply->query = false;
+	reply->authoritative = true;
+	reply->rcode = rcode;
+	reply->recursionavailable = reply->recursiondesired = request->recursiondesired;
+	return reply;
+}
+
+Message* RequestEngine::handleVersionBind(Message* request)
+{
+	try {
+		const RR *qrr = request->qd[0];
+		Message *reply = newReply(request, Message::CODENOERROR);
+
+		// Check if there's a version.bind record in the zone file
+		string version_text = VERSION;
+		for (vector<Zone*>::iterator zone_iter = zones_.begin(); zone_iter != zones_.end(); ++zone_iter)
+		{
+			Zone* zone = *zone_iter;
+			const RecordStore& records = zone->records();
+			for (size_t i = 0; i < records.size(); ++i)
+			{
+				if (records.nameId(i) == qrr->name_id && records.type(i) == RR::TXT &&
+				    records.rrclass(i) == RR::CH)
+				{
+					// Found zone file entry - prepend it to version
+					RR* rr = records.materialize(i);
+					version_text = rr->rdata + " " + VERSION;
+					delete rr;
+					break;
+				}
+			}
+		}
+
+		// Create TXT record with version
+		RR *arr = new RRTXT();
+		arr->name = qrr->name;
+		arr->rrclass = RR::CH;
+		arr->type = RR::TXT;
+		arr->ttl = 0;
+		arr->query = false;
+		arr->rdata = version_text;
+		reply->an.push_back(arr);
+
+		// Add EDNS(0) support to response if client supports it
+		reply->copyEDNS(request);
+
+		if (log_)
+			cout << *reply << flush;
+		return reply;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "\n[EXCEPTION] In handleVersionBind(): " << e.what() << endl;
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+	catch (...)
+	{
+		cerr << "\n[EXCEPTION] Unknown exception in handleVersionBind()" << endl;
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+}
+
+Message* RequestEngine::handleQuery(char* buf, unsigned int len, const Client& client,
+                                    const ClientSubnet* subnet, Message* request, const Zone*& zone,
+                                    unsigned int& scope_prefix)
+{
+	try {
+		if (request->qd.size() != 1 || !request->qd[0])
+		{
+			return NULL;
+		}
+
+		// RR::unpack already resolved the query name's ID from its wire form
+		const RR *qrr = request->qd[0];
+
+		// Handle CHAOS class version.bind queries
+		if (qrr->rrclass == RR::CH && qrr->type == RR::TXT &&
+		    (qrr->name == "version.bind." || qrr->name == "version."))
+		{
+			return handleVersionBind(request);
+		}
+
+		// Find zone using ZoneAuthority
+		ZoneAuthority authority(zones_);
+		ZoneLookupResult lookup;
+		{
+			StageTrace::Timer timer(StageTrace::FIND_ZONE);
+			lookup = authority.findZoneForName(qrr->name, client.ip);
+			// The subnet picks among the views only for a trusted resolver
+			// that may see the zone itself
+			if (subnet && subnet->selectsView() && lookup.authorized && ClientSubnet::trusted(client.addr))
+			{
+				lookup = authority.findZoneForName(qrr->name, subnet->ipv4(), subnet->source_prefix);
+				scope_prefix = lookup.scope_prefix;
+			}
+		}
+		zone = lookup.zone;
+
+		if (!lookup.found)
+		{
+			// Zone not found - return SERVFAIL instead of no response
+			Message *reply = newReply(request, Message::CODESERVERFAILURE);
+			reply->copyEDNS(request);
+			return reply;
+		}
+
+		if (!lookup.authorized)
+		{
+			// Return REFUSED per RFC 1035 - client gets explicit error instead of silent drop
+			Message *reply = newReply(request, Message::CODEREFUSED);
+			reply->copyEDNS(request);
+			return reply;
+		}
+
+		Message *reply = newReply(request, Message::CODENOERROR);
+
+		vector<RR*> matches;
+		vector<RR*> delegation;
+		bool truncated = false;
+		string dangling;
+
+		// Search the zone (ACL longest-match already applied in zone_authority).
+		// An enumeration larger than any message is cut short with TC set.
+		{
+			StageTrace::Timer timer(StageTrace::FIND_MATCHES);
+			QueryProcessor::findMatches(qrr, *lookup.zone, matches, &delegation,
+			                            answerSpace(request), &truncated);
+			dangling = QueryProcessor::followCnames(qrr, *lookup.zone, matches);
+		}
+
+		// The matches are ours: the reply takes them over as its answer
+		reply->an.insert(reply->an.end(), matches.begin(), matches.end());
+		reply->truncation = truncated;
+
+		// No answer: a referral, or a negative answer that resolvers cache for
+		// the SOA's negative TTL (RFC 2308): NXDOMAIN if the name does not
+		// exist, else NODATA (NOERROR, no answer). A CNAME chain ending at an
+		// in-zone name without an answer gets the negative answer for that
+		// name after the CNAMEs (RFC 6604).
+		if (reply->an.size() == 0 || !dangling.empty()) {
+			if (reply->an.size() == 0 && !delegation.empty()) {
+				// Referral: NOERROR with the delegation's NS RRset as authority,
+				// its glue follows in the additional section
+				reply->ns.insert(reply->ns.end(), delegation.begin(), delegation.end());
+				reply->authoritative = false;
+			} else {
+				// Per RFC 2308 section 3, the SOA's TTL is its negative TTL:
+				// the smaller of its own TTL and its MINIMUM field
+				vector<RR*> soa_rrs = lookup.zone->materializeRecords(
+					NameTable::global().find(lookup.zone->name), RR::SOA);
+				if (!soa_rrs.empty()) {
+					RRSoa *soa = static_cast<RRSoa*>(soa_rrs[0]);
+					if (soa->minttl < soa->ttl)
+						soa->ttl = soa->minttl;
+					reply->ns.push_back(soa);
+					for (size_t i = 1; i < soa_rrs.size(); ++i)
+						delete soa_rrs[i];
+				}
+				RR last;
+				last.name = dangling.empty() ? qrr->name : dangling;
+				if (!QueryProcessor::nameExists(&last, *lookup.zone))
+					reply->rcode = Message::CODENAMEERROR;
+			}
+		}
+
+		// Add EDNS(0) support to response if client supports it
+		reply->copyEDNS(request);
+
+		if (log_)
+			cout << *reply << flush;
+		return reply;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "\n[EXCEPTION] In handleQuery(): " << e.what() << endl;
+		cerr << "[EXCEPTION] Query: " << (request->qd[0] ? request->qd[0]->name : "NULL")
+		     << " from " << client.address << endl;
+		dumpPacketHex("QUERY_EXCEPTION", buf, len);
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+	catch (...)
+	{
+		cerr << "\n[EXCEPTION] Unknown exception in handleQuery()" << endl;
+		cerr << "[EXCEPTION] Query: " << (request->qd[0] ? request->qd[0]->name : "NULL")
+		     << " from " << client.address << endl;
+		dumpPacketHex("QUERY_EXCEPTION", buf, len);
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+}
+
+Message* RequestEngine::handleUpdate(char* buf, unsigned int len, const Client& client, Message* request,
+                                     const Zone*& zone)
+{
+	try {
+		const RR *zone_rr = NULL;
+		Message *reply = new Message();
+		reply->id = request->id;
+		reply->opcode = Message::UPDATE;
+		reply->query = false;
+		reply->authoritative = true;
+		reply->truncation = false;
+		reply->recursiondesired = false;
+		reply->recursionavailable = false;
+		reply->rcode = Message::CODENOERROR;
+
+		if (request->qd.size() != 1 || !request->qd[0])
+		{
+			if (log_)
+				cout << "UPDATE: Invalid zone section" << endl << flush;
+			reply->rcode = Message::CODEFORMATERROR;
+			goto send_response;
+		}
+
+		zone_rr = request->qd[0];
+		if (zone_rr->type != RR::SOA)
+		{
+			if (log_)
+				cout << "UPDATE: Zone section must be SOA" << endl << flush;
+			reply->rcode = Message::CODEFORMATERROR;
+			goto send_response;
+		}
+
+		if (log_)
+			cout << "UPDATE: Processing zone " << zone_rr->name << endl << flush;
+
+		{
+			// Find zone using ZoneAuthority
+			ZoneAuthority authority(zones_);
+			ZoneLookupResult lookup;
+			{
+				StageTrace::Timer timer(StageTrace::FIND_ZONE);
+				lookup = authority.findZoneForName(zone_rr->name, client.ip);
+			}
+			zone = lookup.zone;
+
+			if (!lookup.found || !lookup.authorized)
+			{
+				if (log_)
+					cout << "UPDATE: " << lookup.error_message << endl << flush;
+				reply->rcode = Message::CODEREFUSED;
+				goto send_response;
+			}
+
+			Zone *target_zone = lookup.zone;
+			if (log_)
+				cout << "UPDATE: Target zone found: " << target_zone->name << endl << flush;
+
+			// TSIG Authentication Check
+			if (target_zone->tsig_key)
+			{
+				string tsig_error;
+				if (!TSIG::verify(request, buf, len, target_zone->tsig_key, tsig_error))
+				{
+					if (log_)
+						cout << "UPDATE: TSIG verification failed: " << tsig_error << endl << flush;
+					reply->rcode = Message::CODEREFUSED;
+					goto send_response;
+				}
+				if (log_)
+					cout << "UPDATE: TSIG verification successful" << endl << flush;
+			}
+
+			if (log_)
+				cout << "UPDATE: Prerequisites: " << request->an.size() << ", Updates: " << request->ns.size() << endl << flush;
+
+			// Check prerequisites using UpdateProcessor
+			string prereq_error;
+			Message::RCode prereq_result = UpdateProcessor::checkPrerequisites(request, *target_zone, prereq_error);
+			if (prereq_result != Message::CODENOERROR)
+			{
+				if (log_)
+					cout << "UPDATE: " << prereq_error << endl << flush;
+				reply->rcode = prereq_result;
+				goto send_response;
+			}
+
+			if (log_)
+				cout << "UPDATE: All prerequisites passed" << endl << flush;
+
+			// CRITICAL SECTION START: Protect all zone modifications
+			unsigned long long lock_start = StageTrace::now();
+			MutexGuard<pthread_mutex_t> lock(&g_zone_mutex);
+			StageTrace::record(StageTrace::ZONE_LOCK_WAIT, StageTrace::now() - lock_start);
+
+			// Apply updates using UpdateProcessor
+			string update_error;
+			UpdateProcessor::applyUpdates(request, *target_zone, update_error);
+
+			// MutexGuard auto-unlocks on destruction
+			// CRITICAL SECTION END
+
+			if (log_)
+				cout << "UPDATE: Success" << endl << flush;
+		}
+
+send_response:
+		if (zone_rr)
+			reply->qd.push_back(zone_rr->clone());
+
+		// Add EDNS(0) support to response if client supports it
+		reply->copyEDNS(request);
+
+		if (log_)
+			cout << *reply << endl << flush;
+		return reply;
+	}
+	catch (const std::exception& e)
+	{
+		cerr << "\n[EXCEPTION] In handleUpdate(): " << e.what() << endl;
+		cerr << "[EXCEPTION] Zone: " << (request->qd[0] ? request->qd[0]->name : "NULL")
+		     << " from " << client.address << endl;
+		dumpPacketHex("UPDATE_EXCEPTION", buf, len);
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+	catch (...)
+	{
+		cerr << "\n[EXCEPTION] Unknown exception in handleUpdate()" << endl;
+		cerr << "[EXCEPTION] Zone: " << (request->qd[0] ? request->qd[0]->name : "NULL")
+		     << " from " << client.address << endl;
+		dumpPacketHex("UPDATE_EXCEPTION", buf, len);
+		cerr << flush;
+		throw; // Re-throw to be caught by handle()
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef HAVE_REQUEST_ENGINE_H
+#define HAVE_REQUEST_ENGINE_H
+
+#include <vector>
+#include <pthread.h>
+#include "message.h"
+#include "zone.h"
+#include "rate_limit.h"
+#include "client_subnet.h"
+#include "ip_address.h"
+
+// Serializes zone modifications (UPDATE, reload, saving)
+extern pthread_mutex_t g_zone_mutex;
+
+// Handles one DNS request, bytes in and bytes out. Knows nothing about
+// sockets: the server loop, benchmarks and test harnesses feed it request
+// packets and send (or inspect) the response it produces.
+class RequestEngine
+{
+public:
+	enum Transport { UDP, TCP };
+
+	struct Client
+	{
+		unsigned long ip;     // IPv4 in network byte order, for ACLs
+		const char* address;  // Numeric text, for logs
+		IpAddress addr;       // Either family, for cookies and rate limiting
+
+		// Sets all three from numeric text; `numeric` must outlive the request
+		void setAddress(const char* numeric)
+		{
+			address = numeric;
+			addr.parse(numeric);
+			ip = addr.ipv4();
+		}
+	};
+
+	// Wire-format response. Keep one per thread and reuse it.
+	struct Response
+	{
+		char data[0x10000];
+		unsigned int length;
+	};
+
+	// With `log` set every request and reply is printed to stdout, as the
+	// server does; errors always go to stderr
+	explicit RequestEngine(std::vector<Zone*>& zones, bool log = true);
+
+	// Handles the message in `request` (`len` bytes; it may be modified).
+	// Returns true with the reply in `response`, or false if nothing is to
+	// be sent: unparseable messages, responses, opcodes other than QUERY
+	// and UPDATE, requests that failed with an exception, and UDP queries
+	// dropped by RateLimiter::global(). DNS cookies are checked and answered
+	// with DnsCookies::global(); an EDNS Client Subnet option from a
+	// ClientSubnet::trusted() resolver selects the ACL view of a query, and
+	// any valid one is echoed with its scope. A request with a malformed
+	// COOKIE or ECS option gets FORMERR. Requests slower than
+	// SlowLog::threshold() are added to the slow log.
+	bool handle(char* request, unsigned int len, const Client& client,
+	            Transport transport, Response& response);
+
+private:
+	// `zone` is set to the zone selected for the request, if any. With a
+	// client `subnet` from a trusted resolver authorized for the zone, the
+	// view is selected by it and `scope_prefix` set to the bits of it the
+	// answer depends on.
+	Message* handleQuery(char* buf, unsigned int len, const Client& client, const ClientSubnet* subnet,
+	                     Message* request, const Zone*& zone, unsigned int& scope_prefix);
+	Message* handleVersionBind(Message* request);
+	Message* handleUpdate(char* buf, unsigned int len, const Client& client, Message* request,
+	                      const Zone*& zone);
+	Message* newReply(const Message* request, Message::RCode rcode);
+	// Adds the zone's addresses of the NS and MX targets in the answer and
+	// authority sections to the additional section, as long as they fit in
+	// `budget` more bytes. False if some did not.
+	bool addAdditional(const Zone& zone, Message* reply, unsigned int budget);
+	// Packs `reply` into `response`, with the additional records of a reply
+	// to a QUERY in `zone` that fit. Over UDP a reply larger than the client
+	// accepts is truncated (TC); unless the client is `verified` by a server
+	// cookie, it accepts at most DnsCookies::max_udp_without_cookie bytes.
+	// Over TCP a reply larger than the response buffer becomes SERVFAIL.
+	void packReply(Message* reply, const Message* request, const Zone* zone, Transport transport,
+	               bool verified, Response& response);
+	// Accounts the reply to a UDP query with the rate limiter
+	RateLimiter::Action rateLimit(const Client& client, const Message* request, const Message* reply,
+	                              time_t now);
+	// Records the time since `start` and adds slow requests to the slow log
+	void finishRequest(unsigned long long start, const Client& client, const Message* request,
+	                   const Zone* zone, const Message* reply, const Response& response);
+
+	std::vector<Zone*>& zones_;
+	bool log_;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "rr.h"
 #include "socket.h"
 #include "wire.h"
+#include "dns_name.h"
 
 #include "rrsoa.h"
 #include "rrmx.h"
@@ -51,7 +52,12 @@ std::ostream& operator <<(std::ostream& os, const RR::RRClass rrc)
 
 std::ostream& operator <<(std::ostream& os, const RR& r)
 {
-	os << r.rrclass << " " << r.type << " " << r.name;
+	os << r.rrclass << " " << r.type << " ";
+	// Records packed from an interned name may carry no text of it
+	if (r.name.empty() && r.name_id != NameTable::UNRESOLVED && r.name_id != NameTable::NOT_FOUND)
+		os << NameTable::global().name(r.name_id);
+	else
+		os << r.name;
 	if (r.query)
 		return os;
 
@@ -71,37 +77,59 @@ std::ostream& RR::dumpContents(std::ostream& os) const
 	return os;	
 }
 
-void RR::packName(char *data, unsigned int /* len */, unsigned int& offset, std::string name, bool terminate)
+bool RR::packName(char *data, unsigned int len, unsigned int& offset, const std::string& name, bool terminate)
 {
-	std::string part;
-	do
+	// One pass over the dotted text: copy each label behind its length byte
+	std::string::size_type start = 0;
+	while (start < name.length())
 	{
-		std::string::size_type dot;
-		if ((dot = name.find('.')) != std::string::npos)
-		{
-			part = name.substr(0, dot);
-			name.erase(0, dot + 1);
-		} else
-		{
-			part = name;
-			name.clear();
-		};
+		std::string::size_type dot = name.find('.', start);
+		if (dot == std::string::npos)
+			dot = name.length();
+		if (dot == start)
+			break;
 
-		if (terminate || !part.empty())
-		{
-			data[offset++] = (unsigned char)part.length();
-			part.copy(&data[offset], part.length());
-			offset += (unsigned int)part.length();
-		}
-		
-	} while (!part.empty());
+		if (offset + 1 + (dot - start) > len)
+			return false;
+		data[offset++] = (unsigned char)(dot - start);
+		memcpy(&data[offset], name.data() + start, dot - start);
+		offset += (unsigned int)(dot - start);
+		start = dot + 1;
+	}
+	if (terminate)
+	{
+		if (offset + 1 > len)
+			return false;
+		data[offset++] = 0;
+	}
+	return true;
 }
 
-std::string RR::unpackName(char *data, unsigned int len, unsigned int& offset)
+void RR::appendName(std::string& out, const std::string& name)
+{
+	// Same label layout as packName(), but appended to a growable buffer
+	std::string::size_type start = 0;
+	while (start < name.length())
+	{
+		std::string::size_type dot = name.find('.', start);
+		if (dot == std::string::npos)
+			dot = name.length();
+		if (dot == start)
+			break;
+
+		out += (char)(unsigned char)(dot - start);
+		out.append(name, start, dot - start);
+		start = dot + 1;
+	}
+	out += '\0';
+}
+
+unsigned int RR::unpackWireName(char *data, unsigned int len, unsigned int& offset, char *out, bool lowercase)
 {
-	std::string name;
 	unsigned int& iter = offset;
 	bool packed = false;
+	unsigned int w = 0;
+	bool long_labels = false;  // Labels over 63 bytes have length bytes 'A' and up
 	
 	// Track visited offsets to detect compression loops
 	// DNS packet max size is 65536 bytes, need 65536 bits = 8192 bytes
@@ -112,7 +140,8 @@ std::string RR::unpackName(char *data, unsigned int len, unsigned int& offset)
 	unsigned int jump_count = 0;
 	static const unsigned int MAX_JUMPS = 64;
 	
-	// Limit total name length (RFC 1035: max 255 bytes)
+	// Limit total name length (RFC 1035: max 255 bytes), counted as dotted
+	// text like the rest of the server does; the wire form is 2 bytes longer
 	static const unsigned int MAX_NAME_LENGTH = 255;
 
 	for (unsigned int i = iter; ;)
@@ -194,35 +223,83 @@ std::string RR::unpackName(char *data, unsigned int len, unsigned int& offset)
 			                        details.str(), i, len);
 		}
 
-		// Check name length doesn't exceed maximum
-		if (name.length() + tokencode + 1 > MAX_NAME_LENGTH)
+		// Dotted length so far is w - 1 (labels plus separators)
+		unsigned int text_length = w ? w - 1 : 0;
+		if (text_length + tokencode + 1 > MAX_NAME_LENGTH)
 		{
 			std::ostringstream details;
-			details << "Current name '" << name << "' + label of " << (int)tokencode 
+			details << "Name of " << text_length << " bytes + label of " << (int)tokencode 
 			        << " bytes exceeds " << MAX_NAME_LENGTH;
 			throw DNSParseException(DNSParseException::NAME_TOO_LONG,
 			                        details.str(), i, len);
 		}
 
-		if (!name.empty())
-			name += '.';
-
-		name.append(data + i, tokencode);
-		
+		out[w++] = (char)tokencode;
+		memcpy(out + w, data + i, tokencode);
+		w += tokencode;
+		if (tokencode > 63)
+			long_labels = true;
 
 		i += tokencode;
 		if (!packed)
 			iter = i;
 	}
 
+	out[w++] = 0;
+
+	if (lowercase)
+	{
+		if (!long_labels)
+			dns_ascii_tolower(out, out, w);  // Length bytes (< 'A') stay as they are
+		else
+			for (unsigned int k = 0; out[k] != 0; k += 1 + (unsigned char)out[k])
+				dns_ascii_tolower(out + k + 1, out + k + 1, (unsigned char)out[k]);
+	}
+	return w;
+}
+
+bool RR::skipName(const char *data, unsigned int len, unsigned int& offset)
+{
+	for (;;)
+	{
+		if (offset >= len)
+			return false;
+
+		unsigned char tokencode = (unsigned char)data[offset];
+		if ((tokencode & 0xC0) == 0xC0)
+		{
+			// A pointer always ends the name in this part of the packet
+			if (offset + 1 >= len)
+				return false;
+			offset += 2;
+			return true;
+		}
+
+		offset += 1 + tokencode;
+		if (tokencode == 0)
+			return true;
+	}
+}
+
+std::string RR::unpackName(char *data, unsigned int len, unsigned int& offset)
+{
+	char wire[DNS_WIRE_NAME_MAX];
+	unpackWireName(data, len, offset, wire, false);
+
+	std::string name;
+	dns_wire_to_name(wire, name);
+	if (!name.empty())
+		name.erase(name.length() - 1);
 	return name;
 }
 
 std::string RR::unpackNameWithDot(char *data, unsigned int len, unsigned int& offset)
 {
-	std::string name = unpackName(data, len, offset);
-	if (!name.empty() && name[name.length()-1] != '.')
-		name += '.';
+	char wire[DNS_WIRE_NAME_MAX];
+	unpackWireName(data, len, offset, wire, false);
+
+	std::string name;
+	dns_wire_to_name(wire, name);
 	return name;
 }
 
@@ -276,6 +353,129 @@ RR* RR::createByType(RRType type)
 	}
 }
 
+namespace {
+
+struct RRTypeName
+{
+	const char* name;
+	RR::RRType type;
+};
+
+constexpr RRTypeName RR_TYPE_NAMES[] = {
+	{ "A", RR::A }, { "NS", RR::NS }, { "MD", RR::MD }, { "CNAME", RR::CNAME },
+	{ "SOA", RR::SOA }, { "MB", RR::MB }, { "RRNULL", RR::RRUNDEF }, { "WKS", RR::WKS },
+	{ "PTR", RR::PTR }, { "MINFO", RR::MINFO }, { "MX", RR::MX }, { "TXT", RR::TXT },
+	{ "AAAA", RR::AAAA }, { "CERT", RR::CERT }, { "DHCID", RR::DHCID },
+	{ "DYNAMIC", RR::DYNAMIC }, { "AXFR", RR::AXFR }, { "MAILB", RR::MAILB },
+	{ "MAILA", RR::MAILA }, { "STAR", RR::TYPESTAR },
+};
+
+constexpr size_t RR_TYPE_NAME_COUNT = sizeof(RR_TYPE_NAMES) / sizeof(RR_TYPE_NAMES[0]);
+constexpr unsigned int RR_TYPE_HASH_SIZE = 32;
+
+constexpr size_t constLength(const char* s)
+{
+	size_t n = 0;
+	while (s[n])
+		++n;
+	return n;
+}
+
+// Length, first and last character are enough to tell the mnemonics
+// apart; the static_assert below keeps it that way when types are added.
+constexpr unsigned int rrTypeHash(const char* s, size_t len)
+{
+	return (unsigned int)(len + (unsigned char)s[0] * 8 + (unsigned char)s[len - 1] * 30) % RR_TYPE_HASH_SIZE;
+}
+
+struct RRTypeHashTable
+{
+	signed char slot[RR_TYPE_HASH_SIZE];
+	bool perfect;
+};
+
+constexpr RRTypeHashTable buildRRTypeHashTable()
+{
+	RRTypeHashTable table = {};
+	for (unsigned int i = 0; i < RR_TYPE_HASH_SIZE; ++i)
+		table.slot[i] = -1;
+	table.perfect = true;
+	for (size_t i = 0; i < RR_TYPE_NAME_COUNT; ++i)
+	{
+		unsigned int h = rrTypeHash(RR_TYPE_NAMES[i].name, constLength(RR_TYPE_NAMES[i].name));
+		if (table.slot[h] != -1)
+			table.perfect = false;
+		table.slot[h] = (signed char)i;
+	}
+	return table;
+}
+
+constexpr RRTypeHashTable RR_TYPE_HASH = buildRRTypeHashTable();
+static_assert(RR_TYPE_HASH.perfect, "RR type mnemonic hash has collisions");
+
+} // namespace
+
+const unsigned long RR::DEFAULT_TTL;
+
+unsigned long RR::TTLFromString(const char* sttl, size_t len)
+{
+	unsigned long ttl = 0;
+	size_t i = 0;
+	if (len == 0)
+		throw std::invalid_argument("empty TTL");
+	while (i < len)
+	{
+		if (!isdigit((unsigned char)sttl[i]))
+			throw std::invalid_argument("invalid TTL: " + std::string(sttl, len));
+		size_t begin = i;
+		unsigned long value = 0;
+		for (; i < len && isdigit((unsigned char)sttl[i]); ++i)
+		{
+			unsigned long digit = sttl[i] - '0';
+			if (value > (0xFFFFFFFFUL - digit) / 10)
+				throw std::out_of_range("TTL out of range");
+			value = value * 10 + digit;
+		}
+
+		unsigned long unit = 1;
+		if (i < len)
+		{
+			switch (tolower((unsigned char)sttl[i++]))
+			{
+			case 's': unit = 1; break;
+			case 'm': unit = 60; break;
+			case 'h': unit = 60 * 60; break;
+			case 'd': unit = 24 * 60 * 60; break;
+			case 'w': unit = 7 * 24 * 60 * 60; break;
+			default:
+				throw std::invalid_argument("invalid TTL: " + std::string(sttl, len));
+			}
+		}
+		else if (begin != 0)  // Plain seconds only on their own: 1h30 is an error
+			throw std::invalid_argument("invalid TTL: " + std::string(sttl, len));
+
+		if (value > (0xFFFFFFFFUL - ttl) / unit)
+			throw std::out_of_range("TTL out of range");
+		ttl += value * unit;
+	}
+	return ttl;
+}
+
+RR::RRType RR::RRTypeFromString(const char* srrtype, size_t len)
+{
+	if (len == 0)
+		return RRUNDEF;
+
+	int i = RR_TYPE_HASH.slot[rrTypeHash(srrtype, len)];
+	if (i < 0)
+		return RRUNDEF;
+
+	const char* name = RR_TYPE_NAMES[i].name;
+	if (strlen(name) != len || memcmp(name, srrtype, len) != 0)
+		return RRUNDEF;
+	return RR_TYPE_NAMES[i].type;
+}
+
 void RR::fromString(const std::vector<std::string>& tokens, const std::string& origin, const std::string& previousName)
 {
 	// Handle empty name (use previous name)
@@ -284,14 +484,14 @@ void RR::fromString(const std::vector<std::string>& tokens, const std::string& o
 	name = process_domain_name(rawName, origin);
 
 	// Parse: name [ttl] class type rdata...
-	// ttl is optional and numeric
+	// ttl is optional and starts with a digit
 	size_t idx = 1;
-	ttl = 0; // default TTL
+	ttl = DEFAULT_TTL;
 	
 	// Check if next token is a number (TTL)
-	if (idx < tokens.size() && !tokens[idx].empty() && isdigit(tokens[idx][0]))
+	if (idx < tokens.size() && !tokens[idx].empty() && isdigit((unsigned char)tokens[idx][0]))
 	{
-		ttl = std::stoul(tokens[idx]);
+		ttl = TTLFromString(tokens[idx].data(), tokens[idx].length());
 		idx++;
 	}
 	
@@ -303,14 +503,7 @@ void RR::fromString(const std::vector<std::string>& tokens, const std::string& o
 		return;
 	}
 	
-	if (tokens[idx] == "IN")
-		rrclass = CLASSIN;
-	else if (tokens[idx] == "CH")
-		rrclass = CH;
-	else if (tokens[idx] == "*" || tokens[idx] == "ANY")
-		rrclass = CLASSANY;
-	else
-		rrclass = CLASSUNDEF;
+	rrclass = RRClassFromString(tokens[idx].data(), tokens[idx].length());
 	idx++;
 	
 	// Parse type
@@ -334,16 +527,44 @@ void RR::fromStringContents(const std::vector<std::string>& /* tokens */, const
 	throw std::runtime_error(oss.str());
 }
 
-void RR::packContents(char* data, unsigned int /* len */, unsigned int& offset)
+void RR::packRdata(std::string& out) const
+{
+	out = rdata;
+}
+
+bool RR::unpackRdata(const char* data, unsigned int len)
+{
+	rdata.assign(data, len);
+	rdlen = static_cast<unsigned short>(len);
+	return true;
+}
+
+bool RR::packContents(char* data, unsigned int len, unsigned int& offset)
 {
+	if (offset + rdlen > len)
+		return false;
 	rdata.copy(&data[offset], rdlen);
 	offset += rdlen;
+	return true;
 }
 
-void RR::pack(char *data, unsigned int len, unsigned int& offset)
+bool RR::pack(char *data, unsigned int len, unsigned int& offset)
 {
-	packName(data, len, offset, name);
+	// Names of zone records are interned with their wire form: copy it
+	const std::string* wire = name_id != NameTable::UNRESOLVED ?
+		&NameTable::global().wire(name_id) : NULL;
+	if (wire && !wire->empty())
+	{
+		if (offset + wire->length() > len)
+			return false;
+		memcpy(&data[offset], wire->data(), wire->length());
+		offset += (unsigned int)wire->length();
+	}
+	else if (!packName(data, len, offset, name))
+		return false;
 
+	if (offset + (query ? 4 : 10) > len)
+		return false;
 	wire_write_u16(data, offset, type);
 	offset += 2;
 
@@ -351,7 +572,7 @@ void RR::pack(char *data, unsigned int len, unsigned int& offset)
 	offset += 2;
 
 	if (query)
-		return;
+		return true;
 
 	wire_write_u32(data, offset, ttl);
 	offset += 4;
@@ -360,19 +581,19 @@ void RR::pack(char *data, unsigned int len, unsigned int& offset)
 	wire_write_u16(data, offset, rdlen);
 	offset += 2;
 
-	packContents(data, len, offset);
+	return packContents(data, len, offset);
 }
 
 bool RR::unpack(char *data, unsigned int len, unsigned int& offset, bool isQuery)
 {
 	query = isQuery;
-	name.clear();
 
-	name = dns_name_tolower(unpackName(data, len, offset));
-	
-	// Ensure name has trailing dot for consistency with zone file loading
-	if (!name.empty() && name[name.length()-1] != '.')
-		name += '.';
+	// Canonical wire form straight from the packet: the ID lookup needs no
+	// dotted text, and the text keeps the trailing dot zone files use
+	char wire[DNS_WIRE_NAME_MAX];
+	unsigned int wire_len = unpackWireName(data, len, offset, wire, true);
+	dns_wire_to_name(wire, name);
+	name_id = NameTable::global().findWire(wire, wire_len);
 
 	if (offset + 1 >= len)
 		return false;
@@ -8,7 +8,11 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <stdexcept>
+#include "arena.h"
+#include "name_table.h"
+#include "dns_name.h"
 
 // Custom exception for DNS parsing errors with context
 class DNSParseException : public std::runtime_error {
@@ -82,8 +86,7 @@ std::string bin2hex(unsigned char bin);
 // Utility function to lowercase DNS names (case-insensitive per RFC)
 inline std::string dns_name_tolower(const std::string& name) {
 	std::string result = name;
-	std::transform(result.begin(), result.end(), result.begin(), 
-	               [](unsigned char c){ return std::tolower(c); });
+	dns_ascii_tolower(&result[0], result.data(), result.length());
 	return result;
 }
 
@@ -96,24 +99,30 @@ inline std::string normalize_dns_name(const std::string& name) {
 
 // Utility function to process domain name with origin
 inline std::string process_domain_name(const std::string& name, const std::string& origin) {
-	std::string result = name;
+	std::string result;
+	result.reserve(name.length() + origin.length() + 2);
+	result = name;
 	
 	// Append origin if name is relative (no trailing dot)
 	if (!result.empty() && result[result.length()-1] != '.' && !origin.empty())
-		result = result + "." + origin;
+	{
+		result += '.';
+		result += origin;
+	}
 	
 	// Ensure trailing dot
 	if (!result.empty() && result[result.length()-1] != '.')
-		result += ".";
+		result += '.';
 	
-	return dns_name_tolower(result);
+	dns_ascii_tolower(&result[0], result.data(), result.length());
+	return result;
 }
 
 #define SC(x) case x: return #x
 #define SC2(x, y) case x: return #y;
-#define MATCHSTRING(haystack, needle, match) if (haystack == #needle) return match;
 
-class RR
+// RRs built while a request is handled live in the request arena (see arena.h)
+class RR : public ArenaAllocated
 {
 public:
 	enum RRType { RRUNDEF = 0, A = 1, NS, MD, MF, CNAME, SOA, MB, MG, MR,RRNULL,WKS, PTR, HINFO, MINFO, MX, TXT,AAAA = 28, CERT = 37, OPT = 41, DHCID = 49, DYNAMIC = 65280, TSIG = 250, AXFR = 252, MAILB = 253, MAILA = 254, TYPESTAR = 255};
@@ -121,6 +130,9 @@ public:
 
 	
 	RRType type;
+	// Interned name, see name_table.h. pack() copies its wire form, so code
+	// that renames a record must update or reset this as well.
+	t_name_id name_id = NameTable::UNRESOLVED;
 	std::string name;
 	RRClass rrclass;
 	bool query;
@@ -130,39 +142,34 @@ public:
 
 	static RR* createByType(RRType type);
 	virtual bool unpack(char *data, unsigned int len, unsigned int& offset, bool isQuery);
-	void pack(char *data, unsigned int len, unsigned int& offset);
-	virtual void packContents(char* data, unsigned int len, unsigned int& offset);
+	// Appends the record at `offset` of the `len` bytes at `data`. False if
+	// it does not fit; `offset` is then past whatever part was written.
+	bool pack(char *data, unsigned int len, unsigned int& offset);
+	virtual bool packContents(char* data, unsigned int len, unsigned int& offset);
 	virtual std::ostream& dumpContents(std::ostream& os) const;
 	virtual std::string toString() const;  // Serialize full record: name + type + rdata
 	virtual void fromString(const std::vector<std::string>& v, const std::string& origin = "", const std::string& previousName = "");
 	virtual void fromStringContents(const std::vector<std::string>& v, const std::string& origin = "");
+	// Standalone (uncompressed) wire-format rdata, used by compiled zone images
+	virtual void packRdata(std::string& out) const;
+	virtual bool unpackRdata(const char* data, unsigned int len);
 	virtual RR* clone() const { return new RR(*this); }
 	virtual ~RR() {};
 
 	
+	// TTL of zone file records that give none, unless a $TTL directive
+	// sets another
+	static const unsigned long DEFAULT_TTL = 3600;
+
+	// Zone file TTL: seconds, or BIND units such as 1h30m (s, m, h, d, w);
+	// throws std::invalid_argument or std::out_of_range
+	static unsigned long TTLFromString(const char* sttl, size_t len);
+
+	// Zone file type mnemonics, resolved through a perfect hash (see rr.cpp)
+	static RRType RRTypeFromString(const char* srrtype, size_t len);
 	static RRType RRTypeFromString(const std::string& srrtype)
 	{
-		MATCHSTRING(srrtype, A, A);
-		MATCHSTRING(srrtype, NS, NS);
-		MATCHSTRING(srrtype, MD, MD);
-		MATCHSTRING(srrtype, CNAME, CNAME);
-		MATCHSTRING(srrtype, SOA, SOA);
-		MATCHSTRING(srrtype, MB, MB);
-		MATCHSTRING(srrtype, RRNULL, RRUNDEF);
-		MATCHSTRING(srrtype, WKS, WKS);
-		MATCHSTRING(srrtype, PTR, PTR);
-		MATCHSTRING(srrtype, MINFO, MINFO);
-		MATCHSTRING(srrtype, MX, MX);
-		MATCHSTRING(srrtype, TXT, TXT);
-		MATCHSTRING(srrtype, AAAA, AAAA);
-		MATCHSTRING(srrtype, CERT, CERT);
-		MATCHSTRING(srrtype, DHCID, DHCID);
-		MATCHSTRING(srrtype, DYNAMIC, DYNAMIC);
-		MATCHSTRING(srrtype, AXFR, AXFR);
-		MATCHSTRING(srrtype, MAILB, MAILB);
-		MATCHSTRING(srrtype, MAILA, MAILA);
-		MATCHSTRING(srrtype, STAR, TYPESTAR);
-		return RRUNDEF;
+		return RRTypeFromString(srrtype.data(), srrtype.length());
 	}
 
 	static std::string RRTypeToString(RRType t)
@@ -178,6 +185,17 @@ public:
 		}
 	}
 
+	static RRClass RRClassFromString(const char* srrclass, size_t len)
+	{
+		if (len == 2 && srrclass[0] == 'I' && srrclass[1] == 'N')
+			return CLASSIN;
+		if (len == 2 && srrclass[0] == 'C' && srrclass[1] == 'H')
+			return CH;
+		if ((len == 1 && srrclass[0] == '*') || (len == 3 && memcmp(srrclass, "ANY", 3) == 0))
+			return CLASSANY;
+		return CLASSUNDEF;
+	}
+
 	static std::string RRClassToString(RRClass c)
 	{
 		switch (c)
@@ -190,7 +208,15 @@ public:
 		}
 	}
 
-	static void packName(char *data, unsigned int len, unsigned int& offset, std::string name, bool terminate = true);
+	// False, like pack(), if the name does not fit in `len` bytes
+	static bool packName(char *data, unsigned int len, unsigned int& offset, const std::string& name, bool terminate = true);
+	static void appendName(std::string& out, const std::string& name);
+	// Decompresses the name at `offset` into wire form in `out` (at least
+	// DNS_WIRE_NAME_MAX bytes, see dns_name.h), lowercased if `lowercase`.
+	// Returns its length. Throws DNSParseException on malformed names.
+	static unsigned int unpackWireName(char *data, unsigned int len, unsigned int& offset, char *out, bool lowercase);
+	// Moves `offset` past the name there without decompressing it
+	static bool skipName(const char *data, unsigned int len, unsigned int& offset);
 	static std::string unpackName(char *data, unsigned int len, unsigned int& offset);
 	static std::string unpackNameWithDot(char *data, unsigned int len, unsigned int& offset);
 
@@ -38,10 +38,26 @@ bool RRCNAME::unpack(char* data, unsigned int len, unsigned int& offset, bool is
 	return true;
 }
 
-void RRCNAME::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RRCNAME::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
-	packName(data, len, offset, rdata);
+	if (!packName(data, len, offset, rdata))
+		return false;
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);
-}
\ No newline at end of file
+	return true;
+}
+
+void RRCNAME::packRdata(std::string& out) const
+{
+	out.clear();
+	appendName(out, rdata);
+}
+
+bool RRCNAME::unpackRdata(const char* data, unsigned int len)
+{
+	unsigned int rdataOffset = 0;
+	rdata = unpackNameWithDot(const_cast<char*>(data), len, rdataOffset);
+	rdlen = static_cast<unsigned short>(len);
+	return rdataOffset == len;
+}
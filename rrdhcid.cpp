@@ -35,13 +35,29 @@ void RRDHCID::fromStringContents(const std::vector<std::string>& tokens, const s
 	}
 }
 
-void RRDHCID::packContents(char* data, unsigned int /* len */, unsigned int& offset)
+bool RRDHCID::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
+	if (offset + identifier.length() > len)
+		return false;
 	
 	identifier.copy(&data[offset], identifier.length());
 	offset += static_cast<unsigned int>(identifier.length());
 	
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);
+	return true;
+}
+
+void RRDHCID::packRdata(std::string& out) const
+{
+	out = identifier;
+}
+
+bool RRDHCID::unpackRdata(const char* data, unsigned int len)
+{
+	identifier.assign(data, len);
+	rdata = identifier;
+	rdlen = static_cast<unsigned short>(len);
+	return true;
 }
@@ -12,9 +12,11 @@ class RRDHCID : public RR
 	public:
 		std::string identifier;
 		virtual bool unpack(char* data, unsigned int len, unsigned int& offset, bool isQuery);
-		virtual void packContents(char* data, unsigned int len, unsigned int& offset);
+		virtual bool packContents(char* data, unsigned int len, unsigned int& offset);
 		virtual std::ostream& dumpContents(std::ostream& os) const;
 		virtual void fromStringContents(const std::vector<std::string>& v, const std::string& origin = "");
+		virtual void packRdata(std::string& out) const;
+		virtual bool unpackRdata(const char* data, unsigned int len);
 		virtual RR* clone() const { return new RRDHCID(*this); }
 		virtual ~RRDHCID() {};
 };
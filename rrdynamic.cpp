@@ -1,9 +1,14 @@
 #include "rrdynamic.h"
-#include "rrtxt.h"
+#include "mutex_guard.h"
+#include "wire.h"
+#include <cstring>
 #include <fstream>
 #include <set>
+#include <map>
+#include <ctime>
+#include <sys/stat.h>
 
-void RRDYNAMIC::packContents(char* /* data */, unsigned int /* len */, unsigned int& /* offset */)
+bool RRDYNAMIC::packContents(char* /* data */, unsigned int /* len */, unsigned int& /* offset */)
 {
 	// DYNAMIC records should never be packed directly into DNS responses
 	// They are resolved to TXT records at query time via resolveTXT()
@@ -30,16 +35,144 @@ std::string RRDYNAMIC::toString() const
 	return name + " " + std::to_string(ttl) + " IN DYNAMIC " + filepath;
 }
 
-std::vector<RR*> RRDYNAMIC::resolveTXT() const
+void RRDYNAMIC::packRdata(std::string& out) const
 {
-	std::vector<RR*> result;
-	
-	std::ifstream file(filepath);
-	if (!file.is_open())
+	// Private type: the "rdata" is just the backing file path
+	out = filepath;
+}
+
+bool RRDYNAMIC::unpackRdata(const char* data, unsigned int len)
+{
+	filepath.assign(data, len);
+	return !filepath.empty();
+}
+
+RRDYNAMIC::TXTSet::~TXTSet()
+{
+	for (std::vector<RR*>::iterator it = records.begin(); it != records.end(); ++it)
+		delete *it;
+}
+
+RRDYNAMIC::Answer::Answer(const TXTSet* set, size_t offset, size_t length)
+	: set_(set), offset_(offset), length_(length)
+{
+	type = RR::TXT;
+	rrclass = RR::CLASSIN;
+	query = false;
+	ttl = 0;  // Queries send clones with the TTL of the DYNAMIC record
+	rdlen = static_cast<unsigned short>(length);
+}
+
+bool RRDYNAMIC::Answer::packContents(char* data, unsigned int len, unsigned int& offset)
+{
+	if (offset + length_ > len)
+		return false;
+	// RR::pack wrote the length of the empty rdata string
+	wire_write_u16(data, offset - 2, static_cast<unsigned short>(length_));
+	memcpy(&data[offset], set_->wire.data() + offset_, length_);
+	offset += (unsigned int)length_;
+	return true;
+}
+
+std::ostream& RRDYNAMIC::Answer::dumpContents(std::ostream& os) const
+{
+	// One character-string: the length octet, then the text
+	return os.write(set_->wire.data() + offset_ + 1, length_ - 1);
+}
+
+std::string RRDYNAMIC::Answer::toString() const
+{
+	std::string owner = name.empty() ? NameTable::global().name(name_id) : name;
+	return owner + " " + std::to_string(ttl) + " IN TXT " +
+	       std::string(set_->wire, offset_ + 1, length_ - 1);
+}
+
+void RRDYNAMIC::Answer::packRdata(std::string& out) const
+{
+	out.assign(set_->wire, offset_, length_);
+}
+
+RR* RRDYNAMIC::Answer::clone() const
+{
+	Answer* copy = new Answer(*this);
+	copy->hold_ = set_->shared_from_this();
+	return copy;
+}
+
+struct RRDYNAMIC::Cache
+{
+	Cache(const std::string& name, const std::string& filepath)
+		: name(name), name_id(NameTable::global().find(name)), filepath(filepath),
+		  exists(false), size(0), mtime_sec(0), mtime_nsec(0), inode(0), checked_ms(0)
 	{
-		std::cerr << "Warning: RRDYNAMIC file not found: " << filepath << std::endl;
-		return result;  // Return empty result if file doesn't exist
+		pthread_mutex_init(&mutex, NULL);
+		pthread_mutex_init(&refresh_mutex, NULL);
 	}
+	~Cache()
+	{
+		pthread_mutex_destroy(&mutex);
+		pthread_mutex_destroy(&refresh_mutex);
+	}
+
+	TXTSet* readFile() const;
+
+	const std::string name;
+	const t_name_id name_id;        // NOT_FOUND if the name is not interned
+	const std::string filepath;
+
+	pthread_mutex_t mutex;          // Guards everything below
+	pthread_mutex_t refresh_mutex;  // Held by the one thread re-reading the file
+	t_txt_set current;
+
+	// What `current` was built from
+	bool exists;
+	off_t size;
+	time_t mtime_sec;
+	long mtime_nsec;
+	ino_t inode;
+	uint64_t checked_ms;            // When the file was last stat()ed
+};
+
+unsigned int RRDYNAMIC::check_interval_ms = 1000;
+
+std::shared_ptr<RRDYNAMIC::Cache> RRDYNAMIC::cacheFor(const std::string& name, const std::string& filepath)
+{
+	static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+	static std::map<std::pair<std::string, std::string>, std::shared_ptr<Cache> > registry;
+
+	MutexGuard<pthread_mutex_t> lock(&registry_mutex);
+	std::shared_ptr<Cache>& entry = registry[std::make_pair(name, filepath)];
+	if (!entry)
+		entry = std::make_shared<Cache>(name, filepath);
+	return entry;
+}
+
+std::shared_ptr<RRDYNAMIC::Cache> RRDYNAMIC::cache() const
+{
+	std::shared_ptr<Cache> cache = std::atomic_load(&cache_);
+	if (cache)
+		return cache;
+	cache = cacheFor(name, filepath);
+	std::atomic_store(&cache_, cache);
+	return cache;
+}
+
+static uint64_t monotonicMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+RRDYNAMIC::TXTSet* RRDYNAMIC::Cache::readFile() const
+{
+	// The set outlives the request that triggered the read
+	Arena::Suspend suspend;
+	TXTSet* set = new TXTSet();
+
+	std::ifstream file(filepath);
+	if (!file.is_open())
+		return set;  // Empty set if file doesn't exist
 	
 	// Read unique non-empty lines (like acmeshit.py does)
 	std::set<std::string> unique_lines;
@@ -58,17 +191,97 @@ std::vector<RR*> RRDYNAMIC::resolveTXT() const
 		}
 	}
 	
-	// Create TXT records for each unique line (sorted)
+	// One TXT record per unique line (sorted), packed as a single
+	// character-string. It holds at most 255 octets, so longer lines are
+	// cut rather than letting the length octet wrap.
 	for (const std::string& txt : unique_lines)
 	{
-		RRTXT* txtRecord = new RRTXT();
-		txtRecord->name = this->name;
-		txtRecord->ttl = 1;  // Short TTL like acmeshit.py
-		txtRecord->rrclass = RR::CLASSIN;
-		txtRecord->type = RR::TXT;
-		txtRecord->rdata = txt;
-		result.push_back(txtRecord);
+		size_t length = txt.length() < 255 ? txt.length() : 255;
+		size_t offset = set->wire.length();
+		set->wire += (char)(unsigned char)length;
+		set->wire.append(txt, 0, length);
+
+		Answer* answer = new Answer(set, offset, length + 1);
+		// Interned owners are packed from the name table's wire form
+		if (name_id == NameTable::NOT_FOUND)
+			answer->name = name;
+		else
+			answer->name_id = name_id;
+		set->records.push_back(answer);
+	}
+	
+	return set;
+}
+
+RRDYNAMIC::t_txt_set RRDYNAMIC::resolveTXT() const
+{
+	return resolve(*cache());
+}
+
+RRDYNAMIC::t_txt_set RRDYNAMIC::resolve(Cache& cache)
+{
+	uint64_t now = monotonicMs();
+
+	{
+		MutexGuard<pthread_mutex_t> lock(&cache.mutex);
+		if (cache.current && now - cache.checked_ms < check_interval_ms)
+			return cache.current;
+	}
+
+	// Only one thread checks the file; the others keep serving the set
+	// they have (and only wait if there is none yet)
+	if (pthread_mutex_trylock(&cache.refresh_mutex) != 0)
+	{
+		{
+			MutexGuard<pthread_mutex_t> lock(&cache.mutex);
+			if (cache.current)
+				return cache.current;
+		}
+		pthread_mutex_lock(&cache.refresh_mutex);
+	}
+	const std::string& filepath = cache.filepath;
+	struct stat st;
+	bool exists = stat(filepath.c_str(), &st) == 0;
+	long mtime_nsec = 0;
+#ifdef LINUX
+	if (exists)
+		mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+	bool changed = !cache.current || exists != cache.exists ||
+	               (exists && (st.st_size != cache.size || st.st_mtime != cache.mtime_sec ||
+	                           mtime_nsec != cache.mtime_nsec || st.st_ino != cache.inode));
+
+	t_txt_set set;
+	if (changed)
+	{
+		if (!exists)
+			std::cerr << "Warning: RRDYNAMIC file not found: " << filepath << std::endl;
+		try
+		{
+			set.reset(cache.readFile());
+		}
+		catch (...)
+		{
+			pthread_mutex_unlock(&cache.refresh_mutex);
+			throw;
+		}
+	}
+
+	{
+		MutexGuard<pthread_mutex_t> lock(&cache.mutex);
+		if (changed)
+		{
+			cache.current = set;
+			cache.exists = exists;
+			cache.size = exists ? st.st_size : 0;
+			cache.mtime_sec = exists ? st.st_mtime : 0;
+			cache.mtime_nsec = mtime_nsec;
+			cache.inode = exists ? st.st_ino : 0;
+		}
+		cache.checked_ms = now;
+		set = cache.current;
 	}
+	pthread_mutex_unlock(&cache.refresh_mutex);
 	
-	return result;
+	return set;
 }
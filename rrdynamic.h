@@ -4,28 +4,85 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
 
 #include "rr.h"
 
 // RRDYNAMIC: A special RR type for ACME challenges and other dynamic content
-// Stores a file path and reads it on each query to generate TXT records
+// Stores a file path and serves the file's lines as TXT records
 // Each non-empty line in the file becomes a separate TXT record
 class RRDYNAMIC : public RR
 {
 public:
+	// Resolved TXT records for one version of the backing file. Sets are
+	// immutable once published; readers keep the set alive while they use
+	// its records, so a concurrent refresh never frees them underneath.
+	// The rdata is kept in wire form, so answers only copy it out.
+	struct TXTSet : public std::enable_shared_from_this<TXTSet>
+	{
+		~TXTSet();
+		std::vector<RR*> records;  // Answer records, ready to pack
+		std::string wire;          // Their rdata, back to back
+	};
+	typedef std::shared_ptr<const TXTSet> t_txt_set;
+
+	// A TXT record of a set. It packs its rdata straight from the set's
+	// wire form and is named by the interned owner, so cloning one into a
+	// reply copies neither. Clones keep the set alive until they are
+	// deleted with the reply.
+	class Answer : public RR
+	{
+	public:
+		Answer(const TXTSet* set, size_t offset, size_t length);
+
+		virtual bool packContents(char* data, unsigned int len, unsigned int& offset);
+		virtual std::ostream& dumpContents(std::ostream& os) const;
+		virtual std::string toString() const;
+		virtual void packRdata(std::string& out) const;
+		virtual RR* clone() const;
+
+	private:
+		const TXTSet* set_;
+		t_txt_set hold_;  // Empty in the set's own records
+		size_t offset_;
+		size_t length_;
+	};
+
+	// The shared state of the records served from one file for one name
+	struct Cache;
+
+	// Minimum time between checks of the backing file for changes
+	static unsigned int check_interval_ms;
+
 	std::string filepath;  // Path to the dynamic content file
-	
+
 	// Dynamic records are never packed into responses directly
 	// They are resolved to TXT records at query time
-	virtual void packContents(char* data, unsigned int len, unsigned int& offset);
+	virtual bool packContents(char* data, unsigned int len, unsigned int& offset);
 	virtual std::ostream& dumpContents(std::ostream& os) const;
 	virtual std::string toString() const;
 	virtual void fromStringContents(const std::vector<std::string>& v, const std::string& origin = "");
+	virtual void packRdata(std::string& out) const;
+	virtual bool unpackRdata(const char* data, unsigned int len);
 	virtual RR* clone() const { return new RRDYNAMIC(*this); }
 	virtual ~RRDYNAMIC() {};
-	
-	// Read file and return TXT records for the current name
-	std::vector<RR*> resolveTXT() const;
+
+	// The cache for `name` and `filepath`. There is one per name and file
+	// for the life of the process, so a reloaded zone keeps serving the
+	// set already loaded. Takes a process-wide lock: RecordStore looks it
+	// up once, when the record is stored, and keeps it with the record.
+	static std::shared_ptr<Cache> cacheFor(const std::string& name, const std::string& filepath);
+
+	// TXT records for the current file contents. The file is re-read only
+	// when its size, mtime or inode changed, and checked at most once per
+	// check_interval_ms. Safe to call from concurrent query threads.
+	static t_txt_set resolve(Cache& cache);
+	t_txt_set resolveTXT() const;
+
+private:
+	// Bound on the first resolveTXT()
+	mutable std::shared_ptr<Cache> cache_;
+	std::shared_ptr<Cache> cache() const;
 };
 
 #endif
@@ -48,13 +48,37 @@ bool RRMX::unpack(char* data, unsigned int len, unsigned int& offset, bool isQue
 	return true;
 }
 
-void RRMX::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RRMX::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
+	if (offset + 2 > len)
+		return false;
 	wire_write_u16(data, offset, pref);
 	offset += 2;
-	packName(data, len, offset, rdata);
+	if (!packName(data, len, offset, rdata))
+		return false;
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);
+	return true;
 }
 
+
+void RRMX::packRdata(std::string& out) const
+{
+	char prefbuf[2];
+	wire_write_u16(prefbuf, 0, pref);
+	out.assign(prefbuf, 2);
+	appendName(out, rdata);
+}
+
+bool RRMX::unpackRdata(const char* data, unsigned int len)
+{
+	if (len < 2)
+		return false;
+
+	pref = wire_read_u16(data, 0);
+	unsigned int rdataOffset = 2;
+	rdata = unpackNameWithDot(const_cast<char*>(data), len, rdataOffset);
+	rdlen = static_cast<unsigned short>(len);
+	return rdataOffset == len;
+}
@@ -38,10 +38,26 @@ bool RRNS::unpack(char* data, unsigned int len, unsigned int& offset, bool isQue
 	return true;
 }
 
-void RRNS::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RRNS::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
-	packName(data, len, offset, rdata);
+	if (!packName(data, len, offset, rdata))
+		return false;
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);
-}
\ No newline at end of file
+	return true;
+}
+
+void RRNS::packRdata(std::string& out) const
+{
+	out.clear();
+	appendName(out, rdata);
+}
+
+bool RRNS::unpackRdata(const char* data, unsigned int len)
+{
+	unsigned int rdataOffset = 0;
+	rdata = unpackNameWithDot(const_cast<char*>(data), len, rdataOffset);
+	rdlen = static_cast<unsigned short>(len);
+	return rdataOffset == len;
+}
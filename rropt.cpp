@@ -66,39 +66,41 @@ bool RROPT::unpack(char *data, unsigned int len, unsigned int& offset, bool isQu
     return true;
 }
 
-void RROPT::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RROPT::packContents(char* data, unsigned int len, unsigned int& offset)
 {
     // Pack RDATA only (rdata should already be built by pack())
     // This matches the base RR::packContents() pattern
     if (offset + rdlen > len)
-        return;
+        return false;
     rdata.copy(&data[offset], rdlen);
     offset += rdlen;
+    return true;
 }
 
-void RROPT::pack(char *data, unsigned int len, unsigned int& offset)
+bool RROPT::pack(char *data, unsigned int len, unsigned int& offset)
 {
     // Sync fields before packing
     syncFields();
     
     // Pack name (root ".")
-    RR::packName(data, len, offset, name);
+    if (!RR::packName(data, len, offset, name))
+        return false;
     
     // Pack type (OPT = 41)
     if (offset + 2 > len)
-        return;
+        return false;
     wire_write_u16(data, offset, OPT);
     offset += 2;
     
     // Pack CLASS (UDP payload size)
     if (offset + 2 > len)
-        return;
+        return false;
     wire_write_u16(data, offset, udp_payload_size);
     offset += 2;
     
     // Pack TTL (extended RCODE | version | flags)
     if (offset + 4 > len)
-        return;
+        return false;
     wire_write_u32(data, offset, ttl);
     offset += 4;
     
@@ -117,12 +119,12 @@ void RROPT::pack(char *data, unsigned int len, unsigned int& offset)
     
     // Pack RDLEN
     if (offset + 2 > len)
-        return;
+        return false;
     wire_write_u16(data, offset, rdlen);
     offset += 2;
     
     // Pack contents (RDATA with options)
-    packContents(data, len, offset);
+    return packContents(data, len, offset);
 }
 
 ostream& RROPT::dumpContents(ostream& os) const
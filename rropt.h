@@ -2,6 +2,7 @@
 #define HAVE_RROPT_H
 
 #include "rr.h"
+#include "wire.h"
 #include <string>
 #include <cstdint>
 #include <vector>
@@ -41,8 +42,8 @@ public:
     }
     
     virtual bool unpack(char *data, unsigned int len, unsigned int& offset, bool isQuery) override;
-    virtual void packContents(char* data, unsigned int len, unsigned int& offset) override;
-    void pack(char *data, unsigned int len, unsigned int& offset);
+    virtual bool packContents(char* data, unsigned int len, unsigned int& offset) override;
+    bool pack(char *data, unsigned int len, unsigned int& offset);
     virtual std::ostream& dumpContents(std::ostream& os) const override;
     virtual RR* clone() const override { return new RROPT(*this); }
     
@@ -55,11 +56,19 @@ public:
             flags &= ~0x8000; 
     }
     
+    // Message::pack writes rdata as it is, so the option is encoded there too
     void addOption(uint16_t code, const std::string& data) {
         EDNSOption opt;
         opt.code = code;
         opt.data = data;
         options.push_back(opt);
+
+        char header[4];
+        wire_write_u16(header, 0, code);
+        wire_write_u16(header, 2, (uint16_t)data.length());
+        rdata.append(header, sizeof(header));
+        rdata.append(data);
+        rdlen = (unsigned short)rdata.length();
     }
     
     // Synchronize the pseudo-RR fields with base RR fields
@@ -74,11 +74,13 @@ bool RRSoa::unpack(char* data, unsigned int len, unsigned int& offset, bool isQu
 	return true;
 }
 
-void RRSoa::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RRSoa::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
-	packName(data, len, offset, ns); // ns
-	packName(data, len, offset, mail); // mail
+	if (!packName(data, len, offset, ns) || !packName(data, len, offset, mail))
+		return false;
+	if (offset + 5 * 4 > len)
+		return false;
 	wire_write_u32(data, offset, serial); // serial
 	offset += 4;
 	wire_write_u32(data, offset, refresh); // refresh
@@ -92,6 +94,7 @@ void RRSoa::packContents(char* data, unsigned int len, unsigned int& offset)
 
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);	
+	return true;
 }
 
 std::string RRSoa::toString() const
@@ -101,3 +104,36 @@ ss << name << " IN SOA " << ns << " " << mail << " " << serial << " "
    << refresh << " " << retry << " " << expire << " " << minttl;
 return ss.str();
 }
+
+void RRSoa::packRdata(std::string& out) const
+{
+	out.clear();
+	appendName(out, ns);
+	appendName(out, mail);
+
+	char timers[20];
+	wire_write_u32(timers, 0, serial);
+	wire_write_u32(timers, 4, refresh);
+	wire_write_u32(timers, 8, retry);
+	wire_write_u32(timers, 12, expire);
+	wire_write_u32(timers, 16, minttl);
+	out.append(timers, sizeof(timers));
+}
+
+bool RRSoa::unpackRdata(const char* data, unsigned int len)
+{
+	unsigned int rdataOffset = 0;
+	ns = unpackNameWithDot(const_cast<char*>(data), len, rdataOffset);
+	mail = unpackNameWithDot(const_cast<char*>(data), len, rdataOffset);
+
+	if (rdataOffset + 20 != len)
+		return false;
+
+	serial = wire_read_u32(data, rdataOffset);
+	refresh = wire_read_u32(data, rdataOffset + 4);
+	retry = wire_read_u32(data, rdataOffset + 8);
+	expire = wire_read_u32(data, rdataOffset + 12);
+	minttl = wire_read_u32(data, rdataOffset + 16);
+	rdlen = static_cast<unsigned short>(len);
+	return true;
+}
@@ -71,10 +71,17 @@ bool RRTSIG::unpack(char *data, unsigned int len, unsigned int& offset, bool isQ
     return true;
 }
 
-void RRTSIG::packContents(char* data, unsigned int len, unsigned int& offset)
+bool RRTSIG::packContents(char* data, unsigned int len, unsigned int& offset)
 {
+    // RDLENGTH was written from the (empty) rdata; patched below
+    unsigned int rdlen_offset = offset - 2;
+    
     // Pack algorithm name
-    RR::packName(data, len, offset, algorithm);
+    if (!RR::packName(data, len, offset, algorithm))
+        return false;
+    // Time (6), fudge, MAC size, MAC, original ID, error, other length, other data
+    if (offset + 16 + mac_size + other_len > len)
+        return false;
     
     // Pack time signed (48 bits)
     *(uint16_t*)&data[offset] = htons(time_signed_high);
@@ -107,6 +114,9 @@ void RRTSIG::packContents(char* data, unsigned int len, unsigned int& offset)
         other_data.copy(&data[offset], other_len);
         offset += other_len;
     }
+    
+    *(uint16_t*)&data[rdlen_offset] = htons(offset - (rdlen_offset + 2));
+    return true;
 }
 
 ostream& RRTSIG::dumpContents(ostream& os) const
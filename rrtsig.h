@@ -34,7 +34,7 @@ public:
     }
     
     virtual bool unpack(char *data, unsigned int len, unsigned int& offset, bool isQuery) override;
-    virtual void packContents(char* data, unsigned int len, unsigned int& offset) override;
+    virtual bool packContents(char* data, unsigned int len, unsigned int& offset) override;
     virtual std::ostream& dumpContents(std::ostream& os) const override;
     virtual RR* clone() const override { return new RRTSIG(*this); }
     
@@ -2,14 +2,17 @@
 #include "wire.h"
 #include "rrtxt.h"
 
-void RRTXT::packContents(char* data, unsigned int /* len */, unsigned int& offset)
+bool RRTXT::packContents(char* data, unsigned int len, unsigned int& offset)
 {
 	unsigned int oldoffset = offset - 2;
+	if (offset + 1 + rdata.length() > len)
+		return false;
 	data[offset++] = (unsigned char)rdata.length();
 	rdata.copy(&data[offset], rdata.length());
 	offset += (unsigned int)rdata.length();
 	unsigned int packedrdlen = offset - (oldoffset + 2);
 	wire_write_u16(data, oldoffset, packedrdlen);
+	return true;
 }
 
 void RRTXT::fromStringContents(const std::vector<std::string>& tokens, const std::string& /* origin */)
@@ -27,3 +30,19 @@ std::string RRTXT::toString() const
 {
 	return name + " " + std::to_string(ttl) + " IN TXT " + rdata;
 }
+
+void RRTXT::packRdata(std::string& out) const
+{
+	out.assign(1, (char)(unsigned char)rdata.length());
+	out += rdata;
+}
+
+bool RRTXT::unpackRdata(const char* data, unsigned int len)
+{
+	// Inverse of packRdata(): drop the character-string length octet
+	if (len == 0)
+		return false;
+	rdata.assign(data + 1, len - 1);
+	rdlen = static_cast<unsigned short>(len);
+	return true;
+}
@@ -0,0 +1,124 @@
+#include "slow_log.h"
+
+#include <cstring>
+#include <pthread.h>
+#include "acl.h"
+#include "mutex_guard.h"
+#include "zone.h"
+
+using namespace std;
+
+std::atomic<unsigned long long> SlowLog::threshold_(SlowLog::DEFAULT_THRESHOLD_NS);
+
+const unsigned long long SlowLog::DEFAULT_THRESHOLD_NS;
+const size_t SlowLog::DEFAULT_CAPACITY;
+
+namespace {
+
+pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+vector<SlowLog::Entry> s_ring;   // Guarded by s_mutex
+size_t s_capacity = SlowLog::DEFAULT_CAPACITY;
+size_t s_next = 0;               // Slot of the next entry
+size_t s_count = 0;              // Entries stored, up to s_capacity
+
+// Subnets through which clients reach an ACL sub-zone
+string viewOf(const Zone* zone)
+{
+	if (!zone || !zone->parent || !zone->parent->acl)
+		return "default";
+	string view;
+	const vector<Acl::AclEntry>& acl = zone->parent->acl->getEntries();
+	for (size_t i = 0; i < acl.size(); ++i)
+	{
+		if (acl[i].zone != zone)
+			continue;
+		if (!view.empty())
+			view += ",";
+		view += acl[i].subnet.toString();
+	}
+	return view.empty() ? "acl" : view;
+}
+
+} // namespace
+
+void SlowLog::setCapacity(size_t entries)
+{
+	MutexGuard<pthread_mutex_t> lock(&s_mutex);
+	s_capacity = entries ? entries : 1;
+	s_ring.clear();
+	s_next = s_count = 0;
+}
+
+void SlowLog::add(const string& client, const Message& request, const Zone* zone,
+                  const Message* reply, unsigned int response_size)
+{
+	Entry entry;
+	entry.time = time(NULL);
+	entry.client = client;
+	entry.qname = !request.qd.empty() && request.qd[0] ? request.qd[0]->name : "";
+	entry.qtype = !request.qd.empty() && request.qd[0] ? request.qd[0]->type : RR::RRUNDEF;
+	entry.zone = zone ? zone->name : "";
+	entry.view = zone ? viewOf(zone) : "";
+	entry.opcode = request.opcode;
+	entry.answered = reply != NULL;
+	entry.rcode = reply ? reply->rcode : Message::CODENOERROR;
+	entry.answers = reply ? (unsigned int)reply->an.size() : 0;
+	entry.response_size = response_size;
+	const unsigned long long* stages = StageTrace::requestTimes();
+	for (int stage = 0; stage < StageTrace::NUM_STAGES; ++stage)
+		entry.stage_ns[stage] = stages ? stages[stage] : 0;
+
+	MutexGuard<pthread_mutex_t> lock(&s_mutex);
+	if (s_ring.size() < s_capacity)
+		s_ring.resize(s_capacity);
+	s_ring[s_next] = entry;
+	s_next = (s_next + 1) % s_capacity;
+	if (s_count < s_capacity)
+		s_count++;
+}
+
+vector<SlowLog::Entry> SlowLog::entries()
+{
+	MutexGuard<pthread_mutex_t> lock(&s_mutex);
+	vector<Entry> result;
+	result.reserve(s_count);
+	size_t first = (s_next + s_capacity - s_count) % s_capacity;
+	for (size_t i = 0; i < s_count; ++i)
+		result.push_back(s_ring[(first + i) % s_capacity]);
+	return result;
+}
+
+void SlowLog::clear()
+{
+	MutexGuard<pthread_mutex_t> lock(&s_mutex);
+	s_next = s_count = 0;
+}
+
+void SlowLog::dump(ostream& os)
+{
+	vector<Entry> slow = entries();
+	for (size_t i = 0; i < slow.size(); ++i)
+	{
+		const Entry& e = slow[i];
+		char when[32];
+		strftime(when, sizeof(when), "%Y.%m.%d %H:%M:%S", localtime(&e.time));
+
+		os << "[SLOW] " << when
+		   << " client=" << e.client
+		   << " qname=" << e.qname
+		   << " qtype=" << RR::RRTypeToString(e.qtype)
+		   << " opcode=" << Message::OpcodeToString(e.opcode)
+		   << " zone=" << (e.zone.empty() ? "-" : e.zone)
+		   << " view=" << (e.view.empty() ? "-" : e.view);
+		if (e.answered)
+			os << " rcode=" << Message::RCodeToString(e.rcode)
+			   << " answers=" << e.answers
+			   << " size=" << e.response_size;
+		else
+			os << " rcode=-";
+		for (int stage = 0; stage < StageTrace::NUM_STAGES; ++stage)
+			if (e.stage_ns[stage])
+				os << " " << StageTrace::stageName((StageTrace::Stage)stage) << "_ns=" << e.stage_ns[stage];
+		os << endl;
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef HAVE_SLOW_LOG_H
+#define HAVE_SLOW_LOG_H
+
+#include <atomic>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "message.h"
+#include "stage_trace.h"
+
+class Zone;
+
+// The most recent requests that took longer than a threshold, with what
+// they asked and where their time went. The entries sit in a fixed-size
+// ring, the oldest overwritten first, and are printed on SIGUSR1 and at
+// shutdown (see STATISTICS.md). A request under the threshold costs one
+// comparison; the lock is only taken to store a slow one.
+//
+// Times come from stage tracing, so building with -DSTAGE_TRACE=0 turns
+// the slow log off as well.
+class SlowLog
+{
+public:
+	struct Entry
+	{
+		time_t time;
+		std::string client;
+		std::string qname;
+		RR::RRType qtype;
+		std::string zone;            // Empty if no zone was selected
+		std::string view;            // ACL subnet(s) of the zone, "default" without ACL
+		Message::Opcode opcode;
+		Message::RCode rcode;
+		bool answered;
+		unsigned int answers;
+		unsigned int response_size;
+		unsigned long long stage_ns[StageTrace::NUM_STAGES];
+	};
+
+	static const unsigned long long DEFAULT_THRESHOLD_NS = 10000000ULL;  // 10 ms
+	static const size_t DEFAULT_CAPACITY = 128;
+
+	// 0 turns the log off
+	static void setThreshold(unsigned long long ns) { threshold_.store(ns, std::memory_order_relaxed); }
+	static unsigned long long threshold() { return threshold_.load(std::memory_order_relaxed); }
+	// Drops the current entries
+	static void setCapacity(size_t entries);
+
+#if STAGE_TRACE
+	static bool isSlow(unsigned long long ns)
+	{
+		unsigned long long limit = threshold();
+		return limit && ns >= limit;
+	}
+#else
+	static bool isSlow(unsigned long long) { return false; }
+#endif
+
+	// Stores the calling thread's current request. `zone` and `reply` may
+	// be NULL; stage times are taken from StageTrace::requestTimes().
+	static void add(const std::string& client, const Message& request, const Zone* zone,
+	                const Message* reply, unsigned int response_size);
+
+	// Oldest first
+	static std::vector<Entry> entries();
+	static void clear();
+	// One [SLOW] line per entry, oldest first
+	static void dump(std::ostream& os);
+
+private:
+	static std::atomic<unsigned long long> threshold_;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "stage_trace.h"
+
+#include <algorithm>
+#include <vector>
+#include <pthread.h>
+#include <time.h>
+#include "mutex_guard.h"
+
+using namespace std;
+
+// Each histogram has one writer, the thread that owns it, while dump() may
+// read it from another. Fields are therefore read and written as relaxed
+// atomics: on x86 these are the same plain loads and stores, but the
+// concurrent read is defined and never sees a torn value.
+template<typename T>
+static inline T loadRelaxed(const T& field)
+{
+	return __atomic_load_n(&field, __ATOMIC_RELAXED);
+}
+
+template<typename T>
+static inline void storeRelaxed(T& field, T value)
+{
+	__atomic_store_n(&field, value, __ATOMIC_RELAXED);
+}
+
+const int StageTrace::Histogram::SUB_BUCKET_BITS;
+const int StageTrace::Histogram::BUCKETS;
+const int StageTrace::Histogram::COUNTS;
+const unsigned long long StageTrace::Histogram::MAX_VALUE;
+
+const char* StageTrace::stageName(Stage stage)
+{
+	static const char* const names[NUM_STAGES] = {
+		"recv", "unpack", "find_zone", "find_matches", "pack", "send", "zone_lock_wait", "handle"
+	};
+	return stage < NUM_STAGES ? names[stage] : "unknown";
+}
+
+StageTrace::Histogram::Histogram()
+{
+	reset();
+}
+
+void StageTrace::Histogram::reset()
+{
+	for (int i = 0; i < COUNTS; ++i)
+		storeRelaxed(counts_[i], 0ULL);
+	storeRelaxed(count_, 0ULL);
+	storeRelaxed(sum_, 0ULL);
+	storeRelaxed(min_, ~0ULL);
+	storeRelaxed(max_, 0ULL);
+}
+
+int StageTrace::Histogram::index(unsigned long long ns)
+{
+	if (ns > MAX_VALUE)
+		ns = MAX_VALUE;
+	const int half_bits = SUB_BUCKET_BITS - 1;
+	const unsigned long long sub_bucket_mask = (1ULL << SUB_BUCKET_BITS) - 1;
+	// Values below 2^SUB_BUCKET_BITS are bucket 0; each further bucket
+	// covers twice the range at half the resolution
+	int bucket = (63 - half_bits) - __builtin_clzll(ns | sub_bucket_mask);
+	int sub_bucket = (int)(ns >> bucket);
+	return ((bucket + 1) << half_bits) + sub_bucket - (1 << half_bits);
+}
+
+unsigned long long StageTrace::Histogram::highestEquivalent(int index)
+{
+	const int half_bits = SUB_BUCKET_BITS - 1;
+	int bucket = (index >> half_bits) - 1;
+	int sub_bucket = (index & ((1 << half_bits) - 1)) + (1 << half_bits);
+	if (bucket < 0)
+	{
+		bucket = 0;
+		sub_bucket -= 1 << half_bits;
+	}
+	return ((unsigned long long)(sub_bucket + 1) << bucket) - 1;
+}
+
+void StageTrace::Histogram::record(unsigned long long ns)
+{
+	int i = index(ns);
+	storeRelaxed(counts_[i], loadRelaxed(counts_[i]) + 1);
+	storeRelaxed(count_, loadRelaxed(count_) + 1);
+	storeRelaxed(sum_, loadRelaxed(sum_) + ns);
+	if (ns < loadRelaxed(min_))
+		storeRelaxed(min_, ns);
+	if (ns > loadRelaxed(max_))
+		storeRelaxed(max_, ns);
+}
+
+void StageTrace::Histogram::add(const Histogram& other)
+{
+	for (int i = 0; i < COUNTS; ++i)
+		counts_[i] += loadRelaxed(other.counts_[i]);
+	count_ += loadRelaxed(other.count_);
+	sum_ += loadRelaxed(other.sum_);
+	min_ = std::min(min_, loadRelaxed(other.min_));
+	max_ = std::max(max_, loadRelaxed(other.max_));
+}
+
+unsigned long long StageTrace::Histogram::percentile(double percentile) const
+{
+	if (!count_)
+		return 0;
+	// Counts may trail count_ while the owner records; rank by the counts
+	unsigned long long total = 0;
+	for (int i = 0; i < COUNTS; ++i)
+		total += counts_[i];
+	unsigned long long rank = (unsigned long long)(percentile / 100.0 * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	unsigned long long seen = 0;
+	for (int i = 0; i < COUNTS; ++i)
+	{
+		seen += counts_[i];
+		if (seen >= rank)
+			return std::min(highestEquivalent(i), max_);
+	}
+	return max_;
+}
+
+#if STAGE_TRACE
+
+namespace {
+
+struct ThreadHistograms
+{
+	StageTrace::Histogram stages[StageTrace::NUM_STAGES];
+};
+
+// Histograms of every thread that recorded. They are never freed: a thread
+// that exits leaves its counts to later dumps, and threads are few.
+pthread_mutex_t s_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+vector<ThreadHistograms*>& registry()
+{
+	static vector<ThreadHistograms*>* threads = new vector<ThreadHistograms*>();
+	return *threads;
+}
+
+thread_local ThreadHistograms* t_histograms = NULL;
+thread_local unsigned long long t_request[StageTrace::NUM_STAGES];
+
+ThreadHistograms* threadHistograms()
+{
+	if (!t_histograms)
+	{
+		ThreadHistograms* histograms = new ThreadHistograms();
+		MutexGuard<pthread_mutex_t> lock(&s_registry_mutex);
+		registry().push_back(histograms);
+		t_histograms = histograms;
+	}
+	return t_histograms;
+}
+
+} // namespace
+
+unsigned long long StageTrace::now()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void StageTrace::record(Stage stage, unsigned long long ns)
+{
+	threadHistograms()->stages[stage].record(ns);
+	if (stage == RECV)
+		t_request[stage] = ns;
+	else
+		t_request[stage] += ns;
+}
+
+void StageTrace::beginRequest()
+{
+	for (int stage = 0; stage < NUM_STAGES; ++stage)
+		if (stage != RECV)
+			t_request[stage] = 0;
+}
+
+const unsigned long long* StageTrace::requestTimes()
+{
+	return t_request;
+}
+
+StageTrace::Histogram StageTrace::merged(Stage stage)
+{
+	Histogram total;
+	MutexGuard<pthread_mutex_t> lock(&s_registry_mutex);
+	for (size_t i = 0; i < registry().size(); ++i)
+		total.add(registry()[i]->stages[stage]);
+	return total;
+}
+
+void StageTrace::reset()
+{
+	// Samples recorded while this runs may be lost
+	MutexGuard<pthread_mutex_t> lock(&s_registry_mutex);
+	for (size_t i = 0; i < registry().size(); ++i)
+		for (int stage = 0; stage < NUM_STAGES; ++stage)
+			registry()[i]->stages[stage].reset();
+}
+
+void StageTrace::dump(ostream& os)
+{
+	for (int stage = 0; stage < NUM_STAGES; ++stage)
+	{
+		Histogram h = merged((Stage)stage);
+		if (!h.count())
+			continue;
+		os << "[TRACE] stage=" << stageName((Stage)stage)
+		   << " count=" << h.count()
+		   << " mean_ns=" << (unsigned long long)h.mean()
+		   << " min_ns=" << h.min()
+		   << " p50_ns=" << h.percentile(50)
+		   << " p90_ns=" << h.percentile(90)
+		   << " p99_ns=" << h.percentile(99)
+		   << " p999_ns=" << h.percentile(99.9)
+		   << " max_ns=" << h.max()
+		   << endl;
+	}
+}
+
+#else
+
+StageTrace::Histogram StageTrace::merged(Stage)
+{
+	return Histogram();
+}
+
+void StageTrace::reset()
+{
+}
+
+void StageTrace::dump(ostream&)
+{
+}
+
+#endif
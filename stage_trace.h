@@ -0,0 +1,117 @@
+#ifndef HAVE_STAGE_TRACE_H
+#define HAVE_STAGE_TRACE_H
+
+#include <iostream>
+
+// Per-stage latency tracing of the request path. Each stage's durations go
+// into a histogram owned by the recording thread, so recording takes no
+// lock and shares no cache line; the histograms of all threads are merged
+// when they are read. Printed with the other statistics (see STATISTICS.md).
+//
+// Build with -DSTAGE_TRACE=0 to compile the tracing out: the calls below
+// become empty inline functions and no histograms exist.
+#ifndef STAGE_TRACE
+#define STAGE_TRACE 1
+#endif
+
+class StageTrace
+{
+public:
+	enum Stage
+	{
+		RECV,            // recvfrom()/recv() of the request
+		UNPACK,          // Message::unpack
+		FIND_ZONE,       // ZoneAuthority::findZoneForName
+		FIND_MATCHES,    // QueryProcessor::findMatches
+		PACK,            // Message::pack of the reply
+		SEND,            // send_dns_response
+		ZONE_LOCK_WAIT,  // Waiting for g_zone_mutex
+		HANDLE,          // All of RequestEngine::handle
+		NUM_STAGES
+	};
+
+	static const char* stageName(Stage stage);
+
+	// Log-linear histogram of durations in nanoseconds, as in HdrHistogram:
+	// 64 linear sub-buckets per power of two keep every recorded value
+	// within 1/64 (1.6%) of the truth, from 1 ns up to MAX_VALUE. Larger
+	// values are counted as MAX_VALUE.
+	class Histogram
+	{
+	public:
+		static const int SUB_BUCKET_BITS = 7;
+		static const int BUCKETS = 30;
+		static const int COUNTS = (BUCKETS + 1) << (SUB_BUCKET_BITS - 1);
+		static const unsigned long long MAX_VALUE = (1ULL << (BUCKETS + SUB_BUCKET_BITS - 1)) - 1;  // ~68 s
+
+		Histogram();
+
+		void record(unsigned long long ns);
+		void add(const Histogram& other);
+		void reset();
+
+		unsigned long long count() const { return count_; }
+		unsigned long long min() const { return count_ ? min_ : 0; }
+		unsigned long long max() const { return max_; }
+		double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+		// Smallest recorded value (to histogram precision) that `percentile`
+		// percent of the values do not exceed
+		unsigned long long percentile(double percentile) const;
+
+		static int index(unsigned long long ns);
+		static unsigned long long highestEquivalent(int index);
+
+	private:
+		unsigned long long counts_[COUNTS];
+		unsigned long long count_;
+		unsigned long long sum_;
+		unsigned long long min_;
+		unsigned long long max_;
+	};
+
+#if STAGE_TRACE
+	// Monotonic clock in nanoseconds (clock_gettime through the vDSO)
+	static unsigned long long now();
+	// Adds one duration to the calling thread's histogram of `stage`, and
+	// to the times of its current request
+	static void record(Stage stage, unsigned long long ns);
+
+	// Times of the calling thread's current request by stage, for the slow
+	// log. beginRequest() clears them, except RECV: the server loop records
+	// that before it hands the request over, and each RECV replaces the last.
+	static void beginRequest();
+	static const unsigned long long* requestTimes();
+#else
+	static unsigned long long now() { return 0; }
+	static void record(Stage, unsigned long long) {}
+	static void beginRequest() {}
+	static const unsigned long long* requestTimes() { return NULL; }
+#endif
+
+	// Histograms of all threads for `stage`, merged
+	static Histogram merged(Stage stage);
+	static void reset();
+	// One [TRACE] line per stage that has been recorded
+	static void dump(std::ostream& os);
+
+	// Records the time from construction to destruction
+	class Timer
+	{
+	public:
+#if STAGE_TRACE
+		explicit Timer(Stage stage) : stage_(stage), start_(now()) {}
+		~Timer() { record(stage_, now() - start_); }
+#else
+		explicit Timer(Stage) {}
+#endif
+	private:
+		Timer(const Timer&);
+		Timer& operator=(const Timer&);
+#if STAGE_TRACE
+		Stage stage_;
+		unsigned long long start_;
+#endif
+	};
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "stats.h"
+
+#include "arena.h"
+#include "name_table.h"
+#include "stage_trace.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+static atomic<unsigned long long> s_requests(0);
+static atomic<unsigned long long> s_heap_allocations(0);
+static atomic<unsigned long long> s_arena_allocations(0);
+static atomic<unsigned long long> s_arena_bytes(0);
+
+// Per-thread count of global operator new calls. The replacements below
+// only add this counter to the default malloc-based behaviour.
+static thread_local unsigned long long t_heap_allocations = 0;
+
+void* operator new(size_t size)
+{
+	t_heap_allocations++;
+	if (size == 0)
+		size = 1;
+	for (;;)
+	{
+		void* p = malloc(size);
+		if (p)
+			return p;
+		new_handler handler = get_new_handler();
+		if (!handler)
+			throw bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+unsigned long long Stats::threadHeapAllocations()
+{
+	return t_heap_allocations;
+}
+
+Stats::Snapshot Stats::snapshot()
+{
+	Snapshot s;
+	s.requests = s_requests.load(memory_order_relaxed);
+	s.heap_allocations = s_heap_allocations.load(memory_order_relaxed);
+	s.arena_allocations = s_arena_allocations.load(memory_order_relaxed);
+	s.arena_bytes = s_arena_bytes.load(memory_order_relaxed);
+	return s;
+}
+
+void Stats::reset()
+{
+	s_requests = 0;
+	s_heap_allocations = 0;
+	s_arena_allocations = 0;
+	s_arena_bytes = 0;
+}
+
+static double perRequest(unsigned long long value, unsigned long long requests)
+{
+	return requests ? (double)value / requests : 0.0;
+}
+
+void Stats::dump(ostream& os)
+{
+	Snapshot s = snapshot();
+	os << "[STATS] requests=" << s.requests
+	   << " heap_allocations=" << s.heap_allocations
+	   << " heap_allocations_per_request=" << perRequest(s.heap_allocations, s.requests)
+	   << " arena_allocations_per_request=" << perRequest(s.arena_allocations, s.requests)
+	   << " arena_bytes_per_request=" << perRequest(s.arena_bytes, s.requests)
+	   << " names=" << NameTable::global().size()
+	   << " name_bytes=" << NameTable::global().bytes()
+	   << endl;
+	StageTrace::dump(os);
+}
+
+Stats::Request::Request(const Arena& arena)
+	: arena_(arena), heap_start_(t_heap_allocations)
+{
+}
+
+Stats::Request::~Request()
+{
+	s_requests.fetch_add(1, memory_order_relaxed);
+	s_heap_allocations.fetch_add(t_heap_allocations - heap_start_, memory_order_relaxed);
+	s_arena_allocations.fetch_add(arena_.allocations(), memory_order_relaxed);
+	s_arena_bytes.fetch_add(arena_.bytesUsed(), memory_order_relaxed);
+}
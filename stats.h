@@ -0,0 +1,43 @@
+#ifndef HAVE_STATS_H
+#define HAVE_STATS_H
+
+#include <iostream>
+
+class Arena;
+
+// Server-wide counters. Updated lock-free from the request path, dumped
+// to stderr on SIGUSR1 and at shutdown (see STATISTICS.md).
+class Stats
+{
+public:
+	struct Snapshot
+	{
+		unsigned long long requests;
+		unsigned long long heap_allocations;   // operator new calls while handling requests
+		unsigned long long arena_allocations;  // Message/RR objects placed in the request arena
+		unsigned long long arena_bytes;
+	};
+
+	static Snapshot snapshot();
+	static void reset();
+	static void dump(std::ostream& os);
+
+	// Heap allocations made by the calling thread so far
+	static unsigned long long threadHeapAllocations();
+
+	// Accounts one request. Declare it after the request's Arena::Scope
+	// so it reads the arena before the scope resets it.
+	class Request
+	{
+	public:
+		explicit Request(const Arena& arena);
+		~Request();
+	private:
+		Request(const Request&);
+		Request& operator=(const Request&);
+		const Arena& arena_;
+		unsigned long long heap_start_;
+	};
+};
+
+#endif
@@ -236,6 +236,73 @@ void testMultipleOverlappingAcls()
 cout << "PASS: Multiple overlapping ACLs" << endl << endl;
 }
 
+// Test lookups by an EDNS client subnet, which only knows a prefix of the
+// client address, and the scope of the answers
+void testAclClientSubnet()
+{
+	cout << "TEST: ACL lookups by client subnet" << endl;
+	
+	Zone* parent_zone = new Zone();
+	parent_zone->name = "geo.test.";
+	Zone* wide = new Zone();
+	wide->name = "geo.test.";
+	Zone* site = new Zone();
+	site->name = "geo.test.";
+	Zone* host = new Zone();
+	host->name = "geo.test.";
+	
+	parent_zone->acl->addSubnet("10.0.0.0/8", wide);
+	parent_zone->acl->addSubnet("10.1.0.0/16", site);
+	parent_zone->acl->addSubnet("10.1.1.128/25", host);
+	
+	// A full address: the longest subnet, the scope where no other subnet
+	// inside the answer's network contains the client any more
+	unsigned int scope = 99;
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.2.3"), 32, &scope) == site);
+	assert(scope == 23);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.200.0.1"), 32, &scope) == wide);
+	assert(scope == 9);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.1.200"), 32, &scope) == host);
+	assert(scope == 25);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("192.0.2.1"), 32, &scope) == NULL);
+	assert(scope == 1);
+	cout << "  ✓ Full addresses select the longest subnet with its scope" << endl;
+	
+	// A /24 client subnet cannot match the /25 inside it: the answer is for
+	// the /16, and the scope says that part of the /24 would differ
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.1.0"), 24, &scope) == site);
+	assert(scope == 25);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.7.0"), 24, &scope) == site);
+	assert(scope == 22);
+	// A /12 only tells the /8; any scope over 12 says the answer is for
+	// this client subnet alone
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.0.0.0"), 12, &scope) == wide);
+	assert(scope == 25);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.16.0.0"), 12, &scope) == wide);
+	assert(scope == 12);
+	cout << "  ✓ Client subnets match subnets no longer than theirs" << endl;
+	
+	// Without a scope pointer it is the plain lookup
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.1.129")) == host);
+	
+	// Of equal subnets the last one added wins, a /0 matches everyone
+	Zone* later = new Zone();
+	later->name = "geo.test.";
+	Zone* everyone = new Zone();
+	everyone->name = "geo.test.";
+	parent_zone->acl->addSubnet("10.1.0.0/16", later);
+	parent_zone->acl->addSubnet("0.0.0.0/0", everyone);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("10.1.2.3")) == later);
+	assert(parent_zone->acl->findMostSpecificMatch(inet_addr("192.0.2.1"), 32, &scope) == everyone);
+	assert(scope == 1);
+	cout << "  ✓ Equal subnets and /0" << endl;
+	
+	delete parent_zone;
+	// ACL sub-zones are deleted by Acl::~Acl()
+	
+cout << "PASS: ACL client subnets" << endl << endl;
+}
+
 int main()
 {
 	cout << "=== ACL Longest Match Tests ===" << endl << endl;
@@ -243,6 +310,7 @@ int main()
 	testAclLongestMatch();
 	testAclConflictingRecords();
 	testMultipleOverlappingAcls();
+	testAclClientSubnet();
 	
 	cout << "=== All ACL Longest Match Tests Passed ===" << endl;
 	
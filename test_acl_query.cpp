@@ -65,7 +65,7 @@ void test_acl_query_returns_both_zones()
     
     // Test 1: Query from ACL subnet should return records from both zones
     vector<RR*> matches;
-    RR* ns = NULL;
+    vector<RR*> ns;
     
     // First search ACL zone
     QueryProcessor::findMatches(&query, *acl_zone, matches, &ns);
@@ -0,0 +1,201 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <sstream>
+#include "arena.h"
+#include "stats.h"
+#include "message.h"
+#include "rr.h"
+#include "rra.h"
+#include "rropt.h"
+
+static unsigned int buildQuery(char* packet, unsigned int len, const char* name, RR::RRType type)
+{
+    Message query;
+    query.id = 0x1234;
+    query.query = true;
+    query.opcode = Message::QUERY;
+    query.authoritative = false;
+    query.truncation = false;
+    query.recursiondesired = true;
+    query.recursionavailable = false;
+    query.rcode = Message::CODENOERROR;
+
+    RR* q = RR::createByType(type);
+    q->name = name;
+    q->type = type;
+    q->rrclass = RR::CLASSIN;
+    q->query = true;
+    query.qd.push_back(q);
+    query.ar.push_back(new RROPT());
+
+    unsigned int size = 0;
+    query.pack(packet, len, size);
+    return size;
+}
+
+TEST_CASE("Arena: allocations are aligned and counted", "[arena]")
+{
+    Arena arena(64);
+
+    void* a = arena.allocate(1);
+    void* b = arena.allocate(24);
+    void* c = arena.allocate(200);  // Larger than a chunk
+
+    CHECK(((size_t)a % 16) == 0);
+    CHECK(((size_t)b % 16) == 0);
+    CHECK(((size_t)c % 16) == 0);
+    CHECK(a != b);
+    CHECK(arena.allocations() == 3);
+    CHECK(arena.bytesUsed() == 16 + 32 + 208);
+
+    arena.reset();
+    CHECK(arena.allocations() == 0);
+    CHECK(arena.bytesUsed() == 0);
+
+    // The first chunk is reused after a reset
+    CHECK(arena.allocate(8) == a);
+}
+
+TEST_CASE("Arena: objects created in a scope come from the arena", "[arena]")
+{
+    Arena arena;
+    REQUIRE(Arena::current() == NULL);
+
+    {
+        Arena::Scope scope(arena);
+        CHECK(Arena::current() == &arena);
+
+        RR* rr = new RRA();
+        rr->name = "www.example.com.";
+        Message* msg = new Message();
+        msg->an.push_back(rr);
+        CHECK(arena.allocations() == 3);
+
+        // delete runs destructors but leaves the memory to the arena
+        delete msg;
+        CHECK(arena.allocations() == 3);
+    }
+
+    CHECK(Arena::current() == NULL);
+    CHECK(arena.allocations() == 0);
+
+    // Outside a scope the heap is used
+    RR* heap_rr = new RRA();
+    CHECK(arena.allocations() == 0);
+    delete heap_rr;
+}
+
+TEST_CASE("Arena: Suspend keeps long-lived objects on the heap", "[arena]")
+{
+    Arena arena;
+    RR* kept = NULL;
+    {
+        Arena::Scope scope(arena);
+        RR* temp = new RRA();
+        {
+            Arena::Suspend suspend;
+            CHECK(Arena::current() == NULL);
+            kept = temp->clone();
+        }
+        CHECK(Arena::current() == &arena);
+        CHECK(arena.allocations() == 1);
+        delete temp;
+    }
+
+    // Still valid after the arena was reset
+    kept->name = "kept.example.com.";
+    CHECK(kept->name == "kept.example.com.");
+    delete kept;
+}
+
+TEST_CASE("Arena: decoding a query allocates its RRs from the arena", "[arena][message]")
+{
+    char packet[512];
+    unsigned int len = buildQuery(packet, sizeof(packet), "www.example.com.", RR::A);
+
+    Arena arena;
+    for (int i = 0; i < 3; ++i)
+    {
+        Arena::Scope scope(arena);
+        Message* request = new Message();
+        unsigned int offset = 0;
+        REQUIRE(request->unpack(packet, len, offset));
+        REQUIRE(request->qd.size() == 1);
+        CHECK(request->qd[0]->name == "www.example.com.");
+
+        Message* reply = new Message();
+        reply->qd.push_back(request->qd[0]->clone());
+        reply->copyEDNS(request);
+
+        // Message, question, OPT, reply, cloned question, reply OPT, and
+        // the buffers of the four sections used
+        CHECK(arena.allocations() == 10);
+        delete reply;
+        delete request;
+    }
+}
+
+TEST_CASE("Stats: requests report arena and heap allocations", "[arena][stats]")
+{
+    Stats::reset();
+    Arena arena;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        Arena::Scope scope(arena);
+        Stats::Request accounting(arena);
+        Message* msg = new Message();
+        msg->an.push_back(new RRA());
+        delete msg;
+    }
+
+    Stats::Snapshot s = Stats::snapshot();
+    CHECK(s.requests == 4);
+    CHECK(s.arena_allocations == 12);
+    CHECK(s.arena_bytes > 0);
+    // The answer section grows in the arena too: the only heap allocation
+    // is the arena's list of chunks, on the first request
+    CHECK(s.heap_allocations == 1);
+
+    unsigned long long before = Stats::threadHeapAllocations();
+    int* p = new int(1);
+    CHECK(Stats::threadHeapAllocations() == before + 1);
+    delete p;
+
+    std::ostringstream out;
+    Stats::dump(out);
+    CHECK(out.str().find("requests=4") != std::string::npos);
+    CHECK(out.str().find("arena_allocations_per_request=3") != std::string::npos);
+}
+
+TEST_CASE("Arena: message sections bind to the arena they are made in", "[arena][message]")
+{
+    Arena arena;
+    Message* outside = new Message();
+    {
+        Arena::Scope scope(arena);
+        Message* inside = new Message();
+        inside->an.push_back(NULL);
+        CHECK(inside->an.get_allocator().arena() == &arena);
+        CHECK(arena.allocations() == 2);
+
+        // Made on the heap, so it grows there and may outlive the scope
+        outside->an.push_back(NULL);
+        CHECK(outside->an.get_allocator().arena() == NULL);
+        CHECK(arena.allocations() == 2);
+
+        // Copies bind to where they are made, not where the original was
+        {
+            Arena::Suspend suspend;
+            Message::t_section copy(inside->an);
+            CHECK(copy.get_allocator().arena() == NULL);
+        }
+        inside->an.clear();
+        delete inside;
+    }
+    outside->an.clear();
+    outside->an.push_back(NULL);
+    CHECK(outside->an.size() == 1);
+    outside->an.clear();
+    delete outside;
+}
@@ -0,0 +1,144 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <string>
+#include "cookie.h"
+
+static std::string fromHex(const char* hex)
+{
+    std::string bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+        bytes += (char)std::stoi(std::string(hex + i, 2), NULL, 16);
+    return bytes;
+}
+
+static IpAddress ip(const char* address)
+{
+    IpAddress parsed;
+    REQUIRE(parsed.parse(address));
+    return parsed;
+}
+
+TEST_CASE("DnsCookies: SipHash-2-4 test vectors", "[cookie]")
+{
+    unsigned char key[16];
+    unsigned char message[15];
+    for (int i = 0; i < 16; ++i)
+        key[i] = (unsigned char)i;
+    for (int i = 0; i < 15; ++i)
+        message[i] = (unsigned char)i;
+
+    // From the reference implementation
+    CHECK(DnsCookies::siphash24(key, message, 0) == 0x726fdb47dd0e0e31ULL);
+    CHECK(DnsCookies::siphash24(key, message, 8) == 0x93f5f5799a932462ULL);
+    CHECK(DnsCookies::siphash24(key, message, 15) == 0xa129ca6149be45e5ULL);
+}
+
+TEST_CASE("DnsCookies: server cookies as in RFC 9018", "[cookie]")
+{
+    DnsCookies cookies;
+    REQUIRE(cookies.setSecret("e5e973e5a6b2a43f48e7dc849e37bfcf"));
+
+    // Appendix A.1: the first query from 198.51.100.100 gets this cookie
+    std::string client = fromHex("2464c4abcf10c957");
+    time_t now = 1559731985;
+    std::string reply = cookies.reply(client, ip("198.51.100.100"), now);
+    CHECK(reply == fromHex("2464c4abcf10c957010000005cf79f111f8130c3eee29480"));
+
+    CHECK(cookies.check(client, ip("198.51.100.100"), now) == DnsCookies::CLIENT);
+    CHECK(cookies.check(reply, ip("198.51.100.100"), now) == DnsCookies::VALID);
+    CHECK(cookies.check(reply, ip("198.51.100.100"), now + 1800) == DnsCookies::VALID);
+
+    // Bound to the client's address and to the hash
+    CHECK(cookies.check(reply, ip("198.51.100.101"), now) == DnsCookies::CLIENT);
+    std::string forged = reply;
+    forged[23] ^= 1;
+    CHECK(cookies.check(forged, ip("198.51.100.100"), now) == DnsCookies::CLIENT);
+    std::string other_client = reply;
+    other_client[0] ^= 1;
+    CHECK(cookies.check(other_client, ip("198.51.100.100"), now) == DnsCookies::CLIENT);
+
+    // Expired after an hour; not accepted from more than five minutes ahead
+    CHECK(cookies.check(reply, ip("198.51.100.100"), now + DnsCookies::LIFETIME + 1) == DnsCookies::CLIENT);
+    CHECK(cookies.check(reply, ip("198.51.100.100"), now - 301) == DnsCookies::CLIENT);
+    CHECK(cookies.check(reply, ip("198.51.100.100"), now - 300) == DnsCookies::VALID);
+
+    // Other versions are not ours
+    std::string version = reply;
+    version[8] = 2;
+    CHECK(cookies.check(version, ip("198.51.100.100"), now) == DnsCookies::CLIENT);
+}
+
+TEST_CASE("DnsCookies: IPv6 clients", "[cookie]")
+{
+    DnsCookies cookies;
+    REQUIRE(cookies.setSecret("e5e973e5a6b2a43f48e7dc849e37bfcf"));
+
+    std::string client = fromHex("22681ab97d52c298");
+    time_t now = 1559734385;
+    std::string reply = cookies.reply(client, ip("2001:db8:220:1:59de:d0f4:8769:82b8"), now);
+    REQUIRE(reply.length() == 24);
+    CHECK(cookies.check(reply, ip("2001:db8:220:1:59de:d0f4:8769:82b8"), now) == DnsCookies::VALID);
+
+    // The whole address counts, not just a part shared by other clients
+    CHECK(cookies.check(reply, ip("2001:db8:220:1:59de:d0f4:8769:82b9"), now) == DnsCookies::CLIENT);
+    CHECK(cookies.check(reply, ip("2001:db8:221:1:59de:d0f4:8769:82b8"), now) == DnsCookies::CLIENT);
+
+    // IPv4 clients on a dual-stack socket are IPv4 clients
+    std::string v4 = cookies.reply(client, ip("::ffff:198.51.100.100"), now);
+    CHECK(cookies.check(v4, ip("198.51.100.100"), now) == DnsCookies::VALID);
+    CHECK(cookies.check(v4, ip("::198.51.100.100"), now) == DnsCookies::CLIENT);
+}
+
+TEST_CASE("DnsCookies: option lengths", "[cookie]")
+{
+    DnsCookies cookies;
+    const IpAddress client = ip("192.0.2.1");
+    CHECK(cookies.check(std::string(), client, 100) == DnsCookies::MALFORMED);
+    CHECK(cookies.check(std::string(7, 'c'), client, 100) == DnsCookies::MALFORMED);
+    CHECK(cookies.check(std::string(8, 'c'), client, 100) == DnsCookies::CLIENT);
+    CHECK(cookies.check(std::string(15, 'c'), client, 100) == DnsCookies::MALFORMED);
+    // Server cookies of other servers, 8 to 32 bytes
+    CHECK(cookies.check(std::string(16, 'c'), client, 100) == DnsCookies::CLIENT);
+    CHECK(cookies.check(std::string(40, 'c'), client, 100) == DnsCookies::CLIENT);
+    CHECK(cookies.check(std::string(41, 'c'), client, 100) == DnsCookies::MALFORMED);
+
+    CHECK(cookies.reply(std::string(8, 'c'), client, 100).length() == 24);
+    // A stale server cookie is replaced, the client cookie kept
+    std::string reply = cookies.reply(std::string(40, 'c'), client, 100);
+    CHECK(reply.substr(0, 8) == std::string(8, 'c'));
+    CHECK(cookies.check(reply, client, 100) == DnsCookies::VALID);
+}
+
+TEST_CASE("DnsCookies: secrets", "[cookie]")
+{
+    DnsCookies cookies;
+    const IpAddress client = ip("192.0.2.1");
+    std::string cookie = cookies.reply(std::string(8, 'c'), client, 1000);
+    REQUIRE(cookies.check(cookie, client, 1000) == DnsCookies::VALID);
+
+    // The previous secret stays valid for one rotation
+    cookies.rotate(1000);
+    CHECK(cookies.check(cookie, client, 1000) == DnsCookies::VALID);
+    std::string newer = cookies.reply(std::string(8, 'c'), client, 1000);
+    CHECK(newer != cookie);
+    cookies.rotate(1000);
+    CHECK(cookies.check(cookie, client, 1000) == DnsCookies::CLIENT);
+    CHECK(cookies.check(newer, client, 1000) == DnsCookies::VALID);
+
+    // Another server does not accept them
+    DnsCookies other;
+    CHECK(other.check(newer, client, 1000) == DnsCookies::CLIENT);
+
+    // Servers sharing a secret accept each other's
+    CHECK_FALSE(cookies.setSecret("e5e973e5a6b2a43f48e7dc849e37bfc"));
+    CHECK_FALSE(cookies.setSecret("e5e973e5a6b2a43f48e7dc849e37bfcg"));
+    REQUIRE(cookies.setSecret("E5E973E5A6B2A43F48E7DC849E37BFCF"));
+    REQUIRE(other.setSecret("e5e973e5a6b2a43f48e7dc849e37bfcf"));
+    std::string shared = cookies.reply(std::string(8, 'c'), client, 1000);
+    CHECK(other.check(shared, client, 1000) == DnsCookies::VALID);
+    CHECK(cookies.check(newer, client, 1000) == DnsCookies::CLIENT);
+
+    // A fixed secret is not rotated
+    cookies.rotateIfDue(1000 + 2 * DnsCookies::ROTATE_INTERVAL);
+    CHECK(cookies.check(shared, client, 1000) == DnsCookies::VALID);
+}
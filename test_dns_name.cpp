@@ -0,0 +1,570 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "dns_name.h"
+#include "name_table.h"
+#include "name_index.h"
+#include "name_tree.h"
+#include "zone.h"
+#include "zone_authority.h"
+#include "message.h"
+#include "rr.h"
+#include "rra.h"
+#include "rrns.h"
+#include "query_processor.h"
+#include "socket.h"
+
+static std::string wire(const char* bytes, size_t len)
+{
+    return std::string(bytes, len);
+}
+
+static RR* makeRecord(RR* rr, const std::string& name, RR::RRType type)
+{
+    rr->name = name;
+    rr->type = type;
+    rr->rrclass = RR::CLASSIN;
+    rr->ttl = 300;
+    rr->query = false;
+    return rr;
+}
+
+TEST_CASE("dns_name: text converts to canonical wire form", "[dnsname]")
+{
+    CHECK(dns_name_to_wire("www.Example.COM.") == wire("\3www\7example\3com\0", 17));
+    CHECK(dns_name_to_wire("www.example.com") == wire("\3www\7example\3com\0", 17));
+    CHECK(dns_name_to_wire(".") == wire("\0", 1));
+    CHECK(dns_name_to_wire("") == wire("\0", 1));
+
+    // Labels over 63 bytes have no wire form
+    CHECK(dns_name_to_wire(std::string(64, 'a') + ".test.").empty());
+    CHECK(dns_name_to_wire(std::string(63, 'a') + ".test.").length() == 70);
+
+    std::string text;
+    dns_wire_to_name("\3www\7example\3com\0", text);
+    CHECK(text == "www.example.com.");
+    dns_wire_to_name("\0", text);
+    CHECK(text.empty());
+
+    CHECK(dns_wire_length("\3www\7example\3com\0") == 17);
+    CHECK(dns_wire_label_count("\3www\7example\3com\0") == 3);
+    CHECK(dns_wire_label_count("\0") == 0);
+}
+
+TEST_CASE("dns_name: subdomain checks split at label boundaries", "[dnsname]")
+{
+    std::string zone = dns_name_to_wire("example.com.");
+    std::string below = dns_name_to_wire("a.b.example.com.");
+    std::string lookalike = dns_name_to_wire("fooexample.com.");
+    std::string root = dns_name_to_wire(".");
+
+    CHECK(dns_wire_is_subdomain(below.data(), below.length(), zone.data(), zone.length()));
+    CHECK(dns_wire_is_subdomain(zone.data(), zone.length(), zone.data(), zone.length()));
+    CHECK_FALSE(dns_wire_is_subdomain(lookalike.data(), lookalike.length(), zone.data(), zone.length()));
+    CHECK_FALSE(dns_wire_is_subdomain(zone.data(), zone.length(), below.data(), below.length()));
+    CHECK(dns_wire_is_subdomain(zone.data(), zone.length(), root.data(), root.length()));
+}
+
+TEST_CASE("NameTable: names are keyed by their wire form", "[dnsname][nametable]")
+{
+    NameTable table;
+    t_name_id id = table.intern("Mail.Wire.Test");
+    CHECK(table.intern("mail.wire.test.") == id);
+    CHECK(table.name(id) == "mail.wire.test.");
+    CHECK(table.wire(id) == dns_name_to_wire("mail.wire.test."));
+
+    std::string w = dns_name_to_wire("mail.wire.test.");
+    CHECK(table.findWire(w.data(), w.length()) == id);
+    CHECK(table.wire(NameTable::NOT_FOUND).empty());
+
+    // Overlong labels are still interned, by their text
+    std::string odd = std::string(70, 'x') + ".wire.test.";
+    t_name_id odd_id = table.intern(odd);
+    CHECK(table.find(odd) == odd_id);
+    CHECK(table.name(odd_id) == odd);
+    CHECK(table.wire(odd_id).empty());
+}
+
+TEST_CASE("RR: unpack yields lowercase text and the interned ID", "[dnsname][rr]")
+{
+    t_name_id id = NameTable::global().intern("host.unpack.test.");
+
+    // Question "HOST.Unpack.test" A IN, after a 12-byte header
+    char packet[64] = {0};
+    unsigned int len = 12;
+    const char qname[] = "\4HOST\6Unpack\4test";
+    memcpy(packet + len, qname, sizeof(qname));
+    len += sizeof(qname);
+    packet[len + 1] = RR::A;
+    packet[len + 3] = RR::CLASSIN;
+    len += 4;
+
+    RRA question;
+    unsigned int offset = 12;
+    REQUIRE(question.unpack(packet, len, offset, true));
+    CHECK(offset == len);
+    CHECK(question.name == "host.unpack.test.");
+    CHECK(question.name_id == id);
+
+    RRA unknown;
+    packet[13] = 'X';
+    offset = 12;
+    REQUIRE(unknown.unpack(packet, len, offset, true));
+    CHECK(unknown.name == "xost.unpack.test.");
+    CHECK(unknown.name_id == NameTable::NOT_FOUND);
+}
+
+TEST_CASE("RR: pack copies the interned wire name", "[dnsname][rr]")
+{
+    RRA rr;
+    makeRecord(&rr, "www.pack.test.", RR::A);
+    rr.rdata = std::string("\xc0\x00\x02\x01", 4);
+
+    char plain[128];
+    unsigned int plain_len = 0;
+    rr.pack(plain, sizeof(plain), plain_len);
+
+    rr.name_id = NameTable::global().intern(rr.name);
+    char copied[128];
+    unsigned int copied_len = 0;
+    rr.pack(copied, sizeof(copied), copied_len);
+
+    REQUIRE(copied_len == plain_len);
+    CHECK(memcmp(plain, copied, plain_len) == 0);
+    CHECK(memcmp(copied, "\3www\4pack\4test\0", 15) == 0);
+}
+
+TEST_CASE("Zone lookup and delegations respect label boundaries", "[dnsname][zone]")
+{
+    Zone example;
+    example.name = "example.com.";
+    Zone lookalike;
+    lookalike.name = "fooexample.com.";
+    std::vector<Zone*> zones;
+    zones.push_back(&example);
+    zones.push_back(&lookalike);
+
+    ZoneAuthority authority(zones);
+    CHECK(authority.findZoneForName("www.fooexample.com.", 0).zone == &lookalike);
+    CHECK(authority.findZoneForName("www.EXAMPLE.com.", 0).zone == &example);
+    CHECK_FALSE(authority.findZoneForName("xample.com.", 0).found);
+
+    RRNS* ns = new RRNS();
+    makeRecord(ns, "sub.example.com.", RR::NS);
+    ns->rdata = "ns1.elsewhere.test.";
+    example.addRecord(ns);
+
+    RRA query;
+    makeRecord(&query, "host.sub.example.com.", RR::A);
+    query.query = true;
+    std::vector<RR*> matches;
+    std::vector<RR*> delegation;
+    QueryProcessor::findMatches(&query, example, matches, &delegation);
+    REQUIRE(delegation.size() == 1);
+    CHECK(delegation[0]->name == "sub.example.com.");
+    delete delegation[0];
+
+    // "xsub.example.com." is not below "sub.example.com."
+    query.name = "xsub.example.com.";
+    delegation.clear();
+    QueryProcessor::findMatches(&query, example, matches, &delegation);
+    CHECK(delegation.empty());
+}
+
+TEST_CASE("Wildcard queries match whole labels", "[dnsname][wildcard]")
+{
+    Zone zone;
+    zone.name = "wild.test.";
+    RRA* a = new RRA();
+    makeRecord(a, "www.wild.test.", RR::A);
+    a->rdata = std::string("\xc0\x00\x02\x01", 4);
+    zone.addRecord(a);
+    RRA* deep = new RRA();
+    makeRecord(deep, "a.b.wild.test.", RR::A);
+    deep->rdata = std::string("\xc0\x00\x02\x02", 4);
+    zone.addRecord(deep);
+    RRA* lookalike = new RRA();
+    makeRecord(lookalike, "xwild.test.", RR::A);
+    lookalike->rdata = std::string("\xc0\x00\x02\x03", 4);
+    zone.addRecord(lookalike);
+
+    RRA query;
+    makeRecord(&query, "*.wild.test.", RR::A);
+    query.query = true;
+    std::vector<RR*> matches;
+    QueryProcessor::findMatches(&query, zone, matches);
+    REQUIRE(matches.size() == 1);
+    CHECK(matches[0]->name == "www.wild.test.");
+    delete matches[0];
+
+    query.name = "**.wild.test.";
+    matches.clear();
+    QueryProcessor::findMatches(&query, zone, matches);
+    CHECK(matches.size() == 2);
+    for (size_t i = 0; i < matches.size(); ++i)
+        delete matches[i];
+}
+
+TEST_CASE("Wire names sort in canonical order", "[dnsname][nameindex]")
+{
+    // RFC 4034 section 6.1, example list
+    const char* sorted[] = {
+        "example.", "a.example.", "yljkjljk.a.example.", "z.a.example.",
+        "zabc.a.example.", "z.example.", "*.z.example.", "\\200.z.example."
+    };
+    const size_t count = sizeof(sorted) / sizeof(sorted[0]);
+    std::vector<std::string> wires;
+    for (size_t i = 0; i < count; ++i)
+    {
+        char buf[DNS_WIRE_NAME_MAX];
+        size_t len = dns_name_to_wire(sorted[i], strlen(sorted[i]), buf);
+        REQUIRE(len);
+        wires.push_back(std::string(buf, len));
+    }
+    // "\200" is a literal label here, which sorts after "*" all the same
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (size_t j = 0; j < count; ++j)
+        {
+            int diff = dns_wire_canonical_compare(wires[i].data(), wires[i].length(),
+                                                  wires[j].data(), wires[j].length());
+            CHECK((diff < 0) == (i < j));
+            CHECK((diff == 0) == (i == j));
+        }
+    }
+
+    // Labels compare case-blind, as the wire form is already lowercase
+    char upper[DNS_WIRE_NAME_MAX];
+    size_t upper_len = dns_name_to_wire("Z.A.Example.", 12, upper);
+    CHECK(dns_wire_canonical_compare(upper, upper_len, wires[3].data(), wires[3].length()) == 0);
+}
+
+static std::vector<std::string> enumerate(const Zone& zone, const char* qname, RR::RRType type)
+{
+    RRA query;
+    makeRecord(&query, qname, type);
+    query.query = true;
+    std::vector<RR*> matches;
+    QueryProcessor::findMatches(&query, zone, matches);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        names.push_back(matches[i]->name);
+        delete matches[i];
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+TEST_CASE("Name index keeps subtrees contiguous", "[dnsname][nameindex]")
+{
+    Zone zone;
+    zone.name = "tree.test.";
+    const char* names[] = {
+        "b.tree.test.", "tree.test.", "x.a.tree.test.", "a.tree.test.",
+        "xtree.test.", "c.b.tree.test.", "a.tree.test.", "other.test."
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        RRA* a = new RRA();
+        makeRecord(a, names[i], RR::A);
+        a->rdata = std::string("\xc0\x00\x02\x01", 4);
+        zone.addRecord(a);
+    }
+    CHECK_FALSE(zone.nameIndex().valid());
+    zone.shrinkToFit();
+    const NameIndex& index = zone.nameIndex();
+    REQUIRE(index.valid());
+    REQUIRE(index.size() == zone.records().size());
+
+    const NameTable& table = NameTable::global();
+    char suffix[DNS_WIRE_NAME_MAX];
+    size_t suffix_len = dns_name_to_wire("a.tree.test.", 12, suffix);
+    size_t first, last;
+    index.subtree(zone.records(), suffix, suffix_len, first, last);
+    REQUIRE(last - first == 3);
+    for (size_t k = first; k < last; ++k)
+    {
+        const std::string& w = table.wire(zone.records().nameId(index[k]));
+        CHECK(dns_wire_is_subdomain(w.data(), w.length(), suffix, suffix_len));
+    }
+    // Equal names keep their record order, and come before their subtree
+    CHECK(index[first] == 3);
+    CHECK(index[first + 1] == 6);
+    CHECK(index[first + 2] == 2);
+
+    // A name's own records open its subtree
+    size_t own_first, own_last;
+    index.owner(zone.records(), table.find("a.tree.test."), own_first, own_last);
+    CHECK(own_first == first);
+    CHECK(own_last == first + 2);
+    index.owner(zone.records(), table.find("c.b.tree.test."), own_first, own_last);
+    REQUIRE(own_last - own_first == 1);
+    CHECK(index[own_first] == 5);
+    index.owner(zone.records(), NameTable::global().intern("missing.tree.test."), own_first, own_last);
+    CHECK(own_first == own_last);
+    CHECK(zone.materializeRecords(table.find("missing.tree.test.")).empty());
+    CHECK(zone.hasRecordWithNameAndType("A.Tree.Test.", RR::A));
+    CHECK_FALSE(zone.hasRecordWithNameAndType("a.tree.test.", RR::AAAA));
+    CHECK_FALSE(zone.hasRecordWithName("x.b.tree.test."));
+    std::vector<RR*> own = zone.materializeRecords(table.find("a.tree.test."), RR::A);
+    CHECK(own.size() == 2);
+    for (size_t i = 0; i < own.size(); ++i)
+        delete own[i];
+
+    // Added and removed records keep the index in step
+    RRA* added = new RRA();
+    makeRecord(added, "d.a.tree.test.", RR::A);
+    added->rdata = std::string("\xc0\x00\x02\x02", 4);
+    zone.addRecord(added);
+    index.subtree(zone.records(), suffix, suffix_len, first, last);
+    CHECK(last - first == 4);
+    CHECK(index[last - 2] == zone.records().size() - 1);
+
+    CHECK(zone.removeRecords("x.a.tree.test.", RR::A, "") == 1);
+    REQUIRE(index.size() == zone.records().size());
+    index.subtree(zone.records(), suffix, suffix_len, first, last);
+    CHECK(last - first == 3);
+    CHECK(enumerate(zone, "**.a.tree.test.", RR::A) == std::vector<std::string>(1, "d.a.tree.test."));
+}
+
+TEST_CASE("Name index sorts as the canonical comparison does", "[dnsname][nameindex]")
+{
+    // Labels holding the bytes the index's sort keys escape
+    Zone zone;
+    zone.name = "key.test.";
+    const char* names[] = {
+        "a\\001.key.test.", "ab.key.test.", "a.key.test.", "a\\000b.key.test.",
+        "key.test.", "a\\000.b.key.test.", "b.key.test.", "a\\002.key.test.",
+        "\\000.key.test.", "z.a.key.test."
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        RRA* a = new RRA();
+        makeRecord(a, names[i], RR::A);
+        a->rdata = std::string("\xc0\x00\x02\x01", 4);
+        zone.addRecord(a);
+    }
+    zone.shrinkToFit();
+    const NameIndex& index = zone.nameIndex();
+    REQUIRE(index.size() == zone.records().size());
+
+    const NameTable& table = NameTable::global();
+    for (size_t k = 1; k < index.size(); ++k)
+    {
+        const std::string& a = table.wire(zone.records().nameId(index[k - 1]));
+        const std::string& b = table.wire(zone.records().nameId(index[k]));
+        INFO(table.name(zone.records().nameId(index[k - 1])) << " before " <<
+             table.name(zone.records().nameId(index[k])));
+        CHECK(dns_wire_canonical_compare(a.data(), a.length(), b.data(), b.length()) < 0);
+    }
+}
+
+TEST_CASE("Indexed enumeration matches the linear scan", "[dnsname][nameindex][wildcard]")
+{
+    Zone linear;
+    Zone indexed;
+    linear.name = indexed.name = "enum.test.";
+    for (int i = 0; i < 40; ++i)
+    {
+        for (int depth = 0; depth < 3; ++depth)
+        {
+            std::string name = "enum.test.";
+            for (int d = 0; d <= depth; ++d)
+                name = "n" + std::to_string((i * 7 + d) % 13) + "." + name;
+            RR::RRType type = i % 3 ? RR::A : RR::AAAA;
+            RR* a = makeRecord(new RRA(), name, type);
+            a->rdata = std::string(type == RR::A ? 4 : 16, '\x01');
+            RR* b = makeRecord(new RRA(), name, type);
+            b->rdata = a->rdata;
+            linear.addRecord(a);
+            indexed.addRecord(b);
+        }
+    }
+    indexed.shrinkToFit();
+    REQUIRE(indexed.nameIndex().valid());
+    REQUIRE_FALSE(linear.nameIndex().valid());
+
+    const char* queries[] = {
+        "*.enum.test.", "**.enum.test.", "*.n1.enum.test.", "**.n1.enum.test.",
+        "*.n5.n4.enum.test.", "**.missing.enum.test.", "*.test."
+    };
+    RR::RRType types[] = { RR::A, RR::AAAA, RR::TYPESTAR };
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q)
+    {
+        for (size_t t = 0; t < 3; ++t)
+        {
+            INFO(queries[q] << " type " << types[t]);
+            CHECK(enumerate(indexed, queries[q], types[t]) == enumerate(linear, queries[q], types[t]));
+        }
+    }
+
+    // Both paths stop at the limits
+    size_t max_answers = QueryProcessor::max_wildcard_answers;
+    REQUIRE(enumerate(indexed, "**.enum.test.", RR::TYPESTAR).size() > 10);
+    QueryProcessor::max_wildcard_answers = 10;
+    CHECK(enumerate(indexed, "**.enum.test.", RR::TYPESTAR).size() == 10);
+    CHECK(enumerate(linear, "**.enum.test.", RR::TYPESTAR).size() == 10);
+    QueryProcessor::max_wildcard_answers = max_answers;
+
+    // and at the last record that fits in the space given:
+    // n0.enum.test. is 14 wire bytes, plus 10 fixed and 4 of rdata
+    RRA enumeration;
+    makeRecord(&enumeration, "*.enum.test.", RR::A);
+    enumeration.query = true;
+    const Zone* zones[] = { &indexed, &linear };
+    for (size_t z = 0; z < 2; ++z)
+    {
+        std::vector<RR*> matches;
+        bool truncated = false;
+        QueryProcessor::findMatches(&enumeration, *zones[z], matches, NULL, 4 * 28 - 1, &truncated);
+        CHECK(matches.size() == 3);
+        CHECK(truncated);
+        for (size_t i = 0; i < matches.size(); ++i)
+            delete matches[i];
+    }
+}
+
+TEST_CASE("Name tree finds the closest encloser", "[dnsname][nametree]")
+{
+    Zone zone;
+    zone.name = "tree.test.";
+    const char* owners[] = { "tree.test.", "a.b.tree.test.", "c.tree.test.", "d.c.tree.test." };
+    RR::RRType types[] = { RR::NS, RR::A, RR::NS, RR::A };
+    for (size_t i = 0; i < 4; ++i)
+    {
+        RR* rr = makeRecord(new RRA(), owners[i], types[i]);
+        rr->rdata = types[i] == RR::A ? std::string("\xc0\x00\x02\x01", 4) : std::string("\x00", 1);
+        zone.addRecord(rr);
+    }
+    zone.shrinkToFit();
+    const NameTree& tree = zone.nameTree();
+    REQUIRE(tree.valid());
+
+    char name[DNS_WIRE_NAME_MAX];
+    NameTree::Lookup path;
+
+    // An existing name is its own encloser
+    size_t len = dns_name_to_wire("a.b.tree.test.", 14, name);
+    tree.lookup(name, len, path);
+    CHECK(path.encloser_offset == 0);
+    CHECK(tree.node(path.encloser).name == NameTable::global().find("a.b.tree.test."));
+
+    // b.tree.test. is an empty non-terminal, and exists
+    len = dns_name_to_wire("x.b.tree.test.", 14, name);
+    tree.lookup(name, len, path);
+    CHECK(path.encloser_offset == 2);
+    CHECK(tree.node(path.encloser).name == NameTable::NOT_FOUND);
+    CHECK(tree.node(path.encloser).below == 1);
+    CHECK(path.cut_offset == 4);  // tree.test.
+
+    len = dns_name_to_wire("x.y.d.c.tree.test.", 18, name);
+    tree.lookup(name, len, path);
+    CHECK(path.encloser_offset == 4);
+    CHECK(path.cut_offset == 6);  // c.tree.test.
+
+    // A name whose records are all gone no longer exists, nor does its parent
+    CHECK(zone.removeRecords("a.b.tree.test.", RR::A, "") == 1);
+    len = dns_name_to_wire("a.b.tree.test.", 14, name);
+    tree.lookup(name, len, path);
+    CHECK(path.encloser_offset == 4);
+}
+
+TEST_CASE("Case kernels agree with the byte-at-a-time versions", "[dnsname][kernels]")
+{
+    // Every byte value, at every length and offset a name buffer can have
+    std::string input;
+    for (int i = 0; i < 300; ++i)
+        input += (char)((i * 37 + 11) & 0xFF);
+    input += "ABCDEFGHIJKLMNOPQRSTUVWXYZ@[`{";
+
+    for (size_t offset = 0; offset < 33; ++offset)
+    {
+        for (size_t len = 0; offset + len <= input.length() && len < 300; ++len)
+        {
+            const char* src = input.data() + offset;
+            std::string expected(len, '\0');
+            std::string actual(len, '\0');
+            dns_ascii_tolower_scalar(&expected[0], src, len);
+            dns_ascii_tolower(&actual[0], src, len);
+            REQUIRE(actual == expected);
+
+            // In place gives the same result
+            std::string in_place(src, len);
+            dns_ascii_tolower(&in_place[0], in_place.data(), len);
+            REQUIRE(in_place == expected);
+
+            REQUIRE(dns_ascii_equal_nocase(src, expected.data(), len));
+            if (len > 0)
+            {
+                // A difference in any position is found
+                std::string other = expected;
+                other[len / 2] ^= 0x01;
+                REQUIRE(dns_ascii_equal_nocase(src, other.data(), len) ==
+                        dns_ascii_equal_nocase_scalar(src, other.data(), len));
+                other = expected;
+                other[len - 1] ^= 0x40;
+                REQUIRE(dns_ascii_equal_nocase(src, other.data(), len) ==
+                        dns_ascii_equal_nocase_scalar(src, other.data(), len));
+            }
+        }
+    }
+
+    // Only A-Z fold; '@', '[', '`', '{' and high bytes stay
+    char folded[8];
+    dns_ascii_tolower(folded, "AZ@[`{\xC1\xDA", 8);
+    CHECK(memcmp(folded, "az@[`{\xC1\xDA", 8) == 0);
+    CHECK_FALSE(dns_ascii_equal_nocase("@", "`", 1));
+    CHECK_FALSE(dns_ascii_equal_nocase("[", "{", 1));
+    CHECK(std::string(dns_name_kernel()).length() > 0);
+}
+
+TEST_CASE("Wire names compare ignoring case", "[dnsname][kernels]")
+{
+    char mixed[DNS_WIRE_NAME_MAX];
+    size_t mixed_len = dns_name_to_wire("WWW.Example.COM.", 16, mixed, false);
+    REQUIRE(mixed_len == 17);
+    CHECK(memcmp(mixed, "\3WWW\7Example\3COM\0", 17) == 0);
+
+    std::string lower = dns_name_to_wire("www.example.com.");
+    std::string zone = dns_name_to_wire("example.com.");
+    std::string lookalike = dns_name_to_wire("xample.com.");
+
+    CHECK(dns_wire_equal_nocase(mixed, mixed_len, lower.data(), lower.length()));
+    CHECK_FALSE(dns_wire_equal_nocase(mixed, mixed_len, zone.data(), zone.length()));
+    CHECK(dns_wire_is_subdomain_nocase(mixed, mixed_len, zone.data(), zone.length()));
+    CHECK_FALSE(dns_wire_is_subdomain_nocase(mixed, mixed_len, lookalike.data(), lookalike.length()));
+
+    // A 40-character label exercises the vector paths
+    std::string long_name = std::string(40, 'Q') + ".Example.COM.";
+    char long_wire[DNS_WIRE_NAME_MAX];
+    size_t long_len = dns_name_to_wire(long_name.data(), long_name.length(), long_wire, false);
+    std::string canonical = dns_name_to_wire(long_name);
+    CHECK(canonical[1] == 'q');
+    CHECK(dns_wire_equal_nocase(long_wire, long_len, canonical.data(), canonical.length()));
+    CHECK(dns_wire_is_subdomain_nocase(long_wire, long_len, zone.data(), zone.length()));
+}
+
+TEST_CASE("RR: unpack lowercases names with long labels label by label", "[dnsname][rr]")
+{
+    // A 65-byte label has length byte 'A'; it must not be folded to 'a'
+    char packet[128] = {0};
+    packet[0] = 65;
+    memset(packet + 1, 'B', 65);
+    packet[66] = 2;
+    packet[67] = 'X';
+    packet[68] = 'Y';
+    packet[69] = 0;
+
+    char wire[DNS_WIRE_NAME_MAX];
+    unsigned int offset = 0;
+    unsigned int len = RR::unpackWireName(packet, sizeof(packet), offset, wire, true);
+    REQUIRE(len == 70);
+    CHECK(offset == 70);
+    CHECK(wire[0] == 65);
+    CHECK(wire[1] == 'b');
+    CHECK(wire[66] == 2);
+    CHECK(memcmp(wire + 67, "xy", 2) == 0);
+}
@@ -1431,10 +1431,10 @@ TEST_CASE("QueryProcessor::findMatches finds RR by name and type", "[logic][quer
     query_rr.type = RR::A;
     
     std::vector<RR*> matches;
-    RR* ns_record = nullptr;
+    std::vector<RR*> delegation;
     
     Zone* zone = zones[0];
-    QueryProcessor::findMatches(&query_rr, *zone, matches, &ns_record);
+    QueryProcessor::findMatches(&query_rr, *zone, matches, &delegation);
     
     CHECK(matches.size() >= 1);
     if (matches.size() > 0) {
@@ -1461,10 +1461,10 @@ TEST_CASE("QueryProcessor::findMatches finds all RRs for ANY query", "[logic][qu
     query_rr.type = RR::TYPESTAR;
     
     std::vector<RR*> matches;
-    RR* ns_record = nullptr;
+    std::vector<RR*> delegation;
     
     Zone* zone = zones[0];
-    QueryProcessor::findMatches(&query_rr, *zone, matches, &ns_record);
+    QueryProcessor::findMatches(&query_rr, *zone, matches, &delegation);
     
     CHECK(matches.size() == 3);  // Should match all three records
 }
@@ -5,6 +5,7 @@
 #include "message.h"
 #include "rr.h"
 #include "rropt.h"
+#include "client_subnet.h"
 
 // ===== Test RROPT Construction =====
 
@@ -339,3 +340,126 @@ TEST_CASE("RROPT: dumpContents output", "[rr][opt][display]")
     CHECK(output.find("do") != std::string::npos);
     CHECK(output.find("options=1") != std::string::npos);
 }
+
+// ===== EDNS Client Subnet (RFC 7871) =====
+
+static std::string ecsOption(uint16_t family, unsigned char source, unsigned char scope, const std::string& address)
+{
+    std::string data;
+    data += (char)(family >> 8);
+    data += (char)(family & 0xFF);
+    data += (char)source;
+    data += (char)scope;
+    return data + address;
+}
+
+TEST_CASE("ClientSubnet: parse and reply", "[edns][ecs]")
+{
+    ClientSubnet subnet;
+    std::string v4 = ecsOption(ClientSubnet::IPV4, 24, 0, std::string("\xC6\x33\x64", 3));
+    REQUIRE(subnet.parse(v4));
+    CHECK(subnet.family == ClientSubnet::IPV4);
+    CHECK(subnet.source_prefix == 24);
+    CHECK(subnet.selectsView());
+    CHECK(subnet.ipv4() == inet_addr("198.51.100.0"));
+
+    // The reply echoes family, source prefix and address with the scope
+    CHECK(subnet.reply(16) == ecsOption(ClientSubnet::IPV4, 24, 16, std::string("\xC6\x33\x64", 3)));
+    CHECK(subnet.reply(40) == ecsOption(ClientSubnet::IPV4, 24, 32, std::string("\xC6\x33\x64", 3)));
+
+    // Odd prefix lengths use the bytes they touch
+    REQUIRE(subnet.parse(ecsOption(ClientSubnet::IPV4, 20, 0, std::string("\x0A\x01\x10", 3))));
+    CHECK(subnet.ipv4() == inet_addr("10.1.16.0"));
+
+    // IPv6 and /0 subnets are valid but select no view
+    REQUIRE(subnet.parse(ecsOption(ClientSubnet::IPV6, 56, 0, std::string("\x20\x01\x0d\xb8\x00\x01\x02", 7))));
+    CHECK(subnet.family == ClientSubnet::IPV6);
+    CHECK_FALSE(subnet.selectsView());
+    CHECK(subnet.reply(0).length() == 11);
+    REQUIRE(subnet.parse(ecsOption(ClientSubnet::IPV4, 0, 0, "")));
+    CHECK_FALSE(subnet.selectsView());
+    CHECK(subnet.reply(0) == ecsOption(ClientSubnet::IPV4, 0, 0, ""));
+}
+
+TEST_CASE("ClientSubnet: malformed options", "[edns][ecs]")
+{
+    ClientSubnet subnet;
+    CHECK_FALSE(subnet.parse(""));
+    CHECK_FALSE(subnet.parse(std::string("\x00\x01\x18", 3)));
+    // Unknown family
+    CHECK_FALSE(subnet.parse(ecsOption(3, 24, 0, std::string("\xC6\x33\x64", 3))));
+    // Source prefix longer than the address
+    CHECK_FALSE(subnet.parse(ecsOption(ClientSubnet::IPV4, 33, 0, std::string(5, '\0'))));
+    // A scope in a query
+    CHECK_FALSE(subnet.parse(ecsOption(ClientSubnet::IPV4, 24, 24, std::string("\xC6\x33\x64", 3))));
+    // Address bytes not matching the prefix
+    CHECK_FALSE(subnet.parse(ecsOption(ClientSubnet::IPV4, 24, 0, std::string("\xC6\x33\x64\x00", 4))));
+    CHECK_FALSE(subnet.parse(ecsOption(ClientSubnet::IPV4, 24, 0, std::string("\xC6\x33", 2))));
+    // Bits past the prefix set
+    CHECK_FALSE(subnet.parse(ecsOption(ClientSubnet::IPV4, 20, 0, std::string("\x0A\x01\x11", 3))));
+}
+
+static IpAddress address(const char* text)
+{
+    IpAddress parsed;
+    REQUIRE(parsed.parse(text));
+    return parsed;
+}
+
+TEST_CASE("ClientSubnet: trusted resolvers", "[edns][ecs]")
+{
+    ClientSubnet::clearTrusted();
+    CHECK_FALSE(ClientSubnet::trusted(address("192.0.2.53")));
+
+    REQUIRE(ClientSubnet::addTrusted("192.0.2.0/28,2001:db8:53::/48,198.51.100.1"));
+    CHECK(ClientSubnet::trusted(address("192.0.2.15")));
+    CHECK_FALSE(ClientSubnet::trusted(address("192.0.2.16")));
+    CHECK(ClientSubnet::trusted(address("::ffff:192.0.2.1")));
+    CHECK(ClientSubnet::trusted(address("2001:db8:53:ffff::1")));
+    CHECK_FALSE(ClientSubnet::trusted(address("2001:db8:54::1")));
+    CHECK(ClientSubnet::trusted(address("198.51.100.1")));
+    CHECK_FALSE(ClientSubnet::trusted(address("198.51.100.2")));
+    CHECK_FALSE(ClientSubnet::trusted(IpAddress()));
+
+    // A malformed list adds nothing
+    CHECK_FALSE(ClientSubnet::addTrusted("203.0.113.0/24,"));
+    CHECK_FALSE(ClientSubnet::addTrusted("203.0.113.0/33"));
+    CHECK_FALSE(ClientSubnet::addTrusted("203.0.113.0/"));
+    CHECK_FALSE(ClientSubnet::addTrusted("203.0.113.0/x"));
+    CHECK_FALSE(ClientSubnet::addTrusted("resolver.example"));
+    CHECK_FALSE(ClientSubnet::addTrusted(""));
+    CHECK_FALSE(ClientSubnet::trusted(address("203.0.113.1")));
+
+    ClientSubnet::clearTrusted();
+    CHECK_FALSE(ClientSubnet::trusted(address("192.0.2.1")));
+}
+
+TEST_CASE("RROPT: added options are packed", "[rr][opt][network]")
+{
+    RROPT opt;
+    opt.addOption(ClientSubnet::OPTION_CODE, ecsOption(ClientSubnet::IPV4, 24, 0, std::string("\xC6\x33\x64", 3)));
+    opt.syncFields();
+
+    Message message;
+    message.id = 1;
+    message.query = true;
+    message.opcode = Message::QUERY;
+    message.authoritative = false;
+    message.truncation = false;
+    message.recursiondesired = false;
+    message.recursionavailable = false;
+    message.rcode = Message::CODENOERROR;
+    message.ar.push_back(opt.clone());
+    char buffer[512];
+    unsigned int size = 0;
+    message.pack(buffer, sizeof(buffer), size);
+
+    Message unpacked;
+    unsigned int offset = 0;
+    REQUIRE(unpacked.unpack(buffer, size, offset));
+    const RROPT* read = dynamic_cast<const RROPT*>(unpacked.getOPT());
+    REQUIRE(read != NULL);
+    REQUIRE(read->options.size() == 1);
+    CHECK(read->options[0].code == ClientSubnet::OPTION_CODE);
+    CHECK(read->options[0].data == opt.options[0].data);
+}
@@ -0,0 +1,142 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <pthread.h>
+#include <sstream>
+#include "name_table.h"
+#include "zone.h"
+#include "rr.h"
+#include "rra.h"
+#include "query_processor.h"
+#include "socket.h"
+
+static RR* makeA(const std::string& name, const char* address)
+{
+    RRA* rr = new RRA();
+    rr->name = name;
+    rr->type = RR::A;
+    rr->rrclass = RR::CLASSIN;
+    rr->ttl = 300;
+    rr->query = false;
+    unsigned long addr = inet_addr(address);
+    rr->rdata.assign(reinterpret_cast<char*>(&addr), 4);
+    return rr;
+}
+
+TEST_CASE("NameTable: interning returns one ID per canonical name", "[nametable]")
+{
+    NameTable table;
+    CHECK(table.size() == 0);
+
+    t_name_id www = table.intern("www.example.com.");
+    t_name_id mail = table.intern("mail.example.com.");
+    CHECK(www != NameTable::UNRESOLVED);
+    CHECK(www != NameTable::NOT_FOUND);
+    CHECK(www != mail);
+
+    CHECK(table.intern("www.example.com.") == www);
+    CHECK(table.intern("WWW.Example.COM.") == www);
+    CHECK(table.find("www.EXAMPLE.com.") == www);
+    CHECK(table.name(www) == "www.example.com.");
+    CHECK(table.size() == 2);
+    CHECK(table.bytes() > 0);
+}
+
+TEST_CASE("NameTable: find never adds names", "[nametable]")
+{
+    NameTable table;
+    table.intern("example.com.");
+
+    CHECK(table.find("attacker-chosen.example.com.") == NameTable::NOT_FOUND);
+    CHECK(table.size() == 1);
+    CHECK(table.name(NameTable::NOT_FOUND).empty());
+}
+
+struct InternJob
+{
+    NameTable* table;
+    std::vector<t_name_id> ids;
+};
+
+static void* internNames(void* arg)
+{
+    InternJob* job = static_cast<InternJob*>(arg);
+    for (int i = 0; i < 500; ++i)
+    {
+        std::ostringstream name;
+        name << "host" << i << ".example.com.";
+        job->ids.push_back(job->table->intern(name.str()));
+    }
+    return NULL;
+}
+
+TEST_CASE("NameTable: concurrent interning agrees on IDs", "[nametable]")
+{
+    NameTable table;
+    InternJob jobs[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        jobs[i].table = &table;
+        pthread_create(&threads[i], NULL, internNames, &jobs[i]);
+    }
+    for (int i = 0; i < 4; ++i)
+        pthread_join(threads[i], NULL);
+
+    CHECK(table.size() == 500);
+    for (int i = 1; i < 4; ++i)
+        CHECK(jobs[i].ids == jobs[0].ids);
+    CHECK(table.name(jobs[0].ids[42]) == "host42.example.com.");
+}
+
+TEST_CASE("Zone: records are looked up by interned name", "[nametable][zone]")
+{
+    Zone zone;
+    zone.name = "ids.test.";
+    zone.addRecord(makeA("www.ids.test.", "192.0.2.1"));
+    zone.addRecord(makeA("www.ids.test.", "192.0.2.2"));
+    zone.addRecord(makeA("mail.ids.test.", "192.0.2.3"));
+
+    t_name_id www = zone.records().nameId(0);
+    CHECK(www == NameTable::global().find("www.ids.test."));
+    CHECK(zone.records().nameId(1) == www);
+    CHECK(zone.findRecordsByName("www.ids.test.").size() == 2);
+    CHECK(zone.findRecordsByName("WWW.ids.TEST.", RR::A).size() == 2);
+    CHECK(zone.findRecordsByName(www, RR::A).size() == 2);
+    CHECK(zone.findRecordsByName(NameTable::NOT_FOUND).empty());
+    CHECK(zone.findRecordsByName("never-seen.ids.test.").empty());
+    CHECK(zone.hasRecordWithName("mail.ids.test."));
+    CHECK(zone.hasRecordWithNameAndType("mail.ids.test.", RR::A));
+    CHECK_FALSE(zone.hasRecordWithNameAndType("mail.ids.test.", RR::MX));
+
+    CHECK(zone.removeRecords("never-seen.ids.test.") == 0);
+    CHECK(zone.removeRecords("WWW.ids.test.") == 2);
+    CHECK(zone.findRecordsByName("www.ids.test.").empty());
+    CHECK(zone.getAllRecords().size() == 1);
+}
+
+TEST_CASE("QueryProcessor: query names are resolved once and compared by ID", "[nametable][query]")
+{
+    Zone zone;
+    zone.name = "qp-ids.test.";
+    zone.addRecord(makeA("host.qp-ids.test.", "192.0.2.10"));
+
+    RRA query;
+    query.name = "host.qp-ids.test.";
+    query.type = RR::A;
+    query.rrclass = RR::CLASSIN;
+
+    std::vector<RR*> matches;
+    QueryProcessor::findMatches(&query, zone, matches);
+    CHECK(matches.size() == 1);
+
+    // A pre-resolved ID is used as is
+    matches.clear();
+    query.name_id = NameTable::global().find(query.name);
+    QueryProcessor::findMatches(&query, zone, matches);
+    CHECK(matches.size() == 1);
+
+    matches.clear();
+    query.name_id = NameTable::NOT_FOUND;
+    QueryProcessor::findMatches(&query, zone, matches);
+    CHECK(matches.empty());
+}
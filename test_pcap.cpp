@@ -0,0 +1,324 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <cstring>
+#include "pcap.h"
+
+// Captures are built in memory, in the byte order of this machine unless a
+// test swaps it
+
+static void put16(std::string& s, unsigned short v, bool swap = false)
+{
+    if (swap)
+        v = (unsigned short)((v >> 8) | (v << 8));
+    s.append((const char*)&v, 2);
+}
+
+static void put32(std::string& s, unsigned int v, bool swap = false)
+{
+    if (swap)
+        v = __builtin_bswap32(v);
+    s.append((const char*)&v, 4);
+}
+
+static void putBe16(std::string& s, unsigned short v)
+{
+    s += (char)(v >> 8);
+    s += (char)(v & 0xFF);
+}
+
+// A 12-byte DNS header with the given ID, as a stand-in for a message
+static std::string dnsHeader(unsigned short id, bool response = false)
+{
+    std::string m;
+    putBe16(m, id);
+    putBe16(m, response ? 0x8400 : 0x0100);
+    putBe16(m, 1);
+    putBe16(m, 0);
+    putBe16(m, 0);
+    putBe16(m, 0);
+    return m;
+}
+
+static std::string udp(unsigned short src_port, unsigned short dst_port, const std::string& payload)
+{
+    std::string s;
+    putBe16(s, src_port);
+    putBe16(s, dst_port);
+    putBe16(s, (unsigned short)(8 + payload.length()));
+    putBe16(s, 0);
+    return s + payload;
+}
+
+static std::string tcp(unsigned short src_port, unsigned short dst_port, const std::string& payload)
+{
+    std::string s;
+    putBe16(s, src_port);
+    putBe16(s, dst_port);
+    s.append(8, '\0');          // Sequence and acknowledgement numbers
+    s += (char)0x50;            // 20-byte header
+    s += (char)0x18;            // PSH, ACK
+    s.append(6, '\0');
+    return s + payload;
+}
+
+static std::string ipv4(int protocol, const char src[4], const char dst[4], const std::string& payload,
+                        unsigned short fragment = 0)
+{
+    std::string s;
+    s += (char)0x45;
+    s += '\0';
+    putBe16(s, (unsigned short)(20 + payload.length()));
+    putBe16(s, 0);
+    putBe16(s, fragment);
+    s += (char)64;
+    s += (char)protocol;
+    putBe16(s, 0);
+    s.append(src, 4);
+    s.append(dst, 4);
+    return s + payload;
+}
+
+static std::string ipv6(int protocol, const std::string& payload)
+{
+    std::string s;
+    s += (char)0x60;
+    s.append(3, '\0');
+    putBe16(s, (unsigned short)payload.length());
+    s += (char)protocol;
+    s += (char)64;
+    s.append(15, '\0');
+    s += (char)1;               // ::1
+    s += (char)0x20;            // 2001:db8::53
+    s += (char)0x01;
+    s += (char)0x0d;
+    s += (char)0xb8;
+    s.append(10, '\0');
+    s += (char)0;
+    s += (char)0x53;
+    return s + payload;
+}
+
+static std::string ethernet(unsigned short type, const std::string& payload, bool vlan = false)
+{
+    std::string s(12, '\x02');
+    if (vlan)
+    {
+        putBe16(s, 0x8100);
+        putBe16(s, 7);
+    }
+    putBe16(s, type);
+    return s + payload;
+}
+
+static std::string pcapFile(int link_type, const std::vector<std::string>& frames, bool swap = false,
+                            bool nanoseconds = false)
+{
+    std::string s;
+    put32(s, nanoseconds ? 0xA1B23C4D : 0xA1B2C3D4, swap);
+    put16(s, 2, swap);
+    put16(s, 4, swap);
+    put32(s, 0, swap);
+    put32(s, 0, swap);
+    put32(s, 65535, swap);
+    put32(s, link_type, swap);
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        put32(s, 1700000000 + (unsigned int)i, swap);
+        put32(s, nanoseconds ? 500000000 : 500000, swap);
+        put32(s, (unsigned int)frames[i].length(), swap);
+        put32(s, (unsigned int)frames[i].length(), swap);
+        s += frames[i];
+    }
+    return s;
+}
+
+static std::string pcapngBlock(unsigned int type, const std::string& body)
+{
+    std::string padded = body;
+    padded.append((4 - padded.length() % 4) % 4, '\0');
+    std::string s;
+    put32(s, type);
+    put32(s, (unsigned int)(12 + padded.length()));
+    s += padded;
+    put32(s, (unsigned int)(12 + padded.length()));
+    return s;
+}
+
+static std::string pcapngFile(int link_type, const std::vector<std::string>& frames, int tsresol = -1)
+{
+    std::string shb;
+    put32(shb, 0x1A2B3C4D);
+    put16(shb, 1);
+    put16(shb, 0);
+    put32(shb, 0xFFFFFFFF);
+    put32(shb, 0xFFFFFFFF);
+
+    std::string idb;
+    put16(idb, (unsigned short)link_type);
+    put16(idb, 0);
+    put32(idb, 0);
+    if (tsresol >= 0)
+    {
+        put16(idb, 9);
+        put16(idb, 1);
+        idb += (char)tsresol;
+        idb.append(3, '\0');
+        put32(idb, 0);          // opt_endofopt
+    }
+
+    std::string s = pcapngBlock(0x0A0D0D0A, shb) + pcapngBlock(1, idb);
+    unsigned long long units = tsresol == 9 ? 1000000000ULL : 1000000ULL;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        unsigned long long timestamp = (1700000000ULL + i) * units + units / 2;
+        std::string epb;
+        put32(epb, 0);
+        put32(epb, (unsigned int)(timestamp >> 32));
+        put32(epb, (unsigned int)timestamp);
+        put32(epb, (unsigned int)frames[i].length());
+        put32(epb, (unsigned int)frames[i].length());
+        epb += frames[i];
+        s += pcapngBlock(6, epb);
+    }
+    return s;
+}
+
+static const char CLIENT[4] = {10, 0, 0, 1};
+static const char SERVER[4] = {10, 0, 0, 53};
+
+TEST_CASE("pcap Ethernet IPv4 UDP query and response", "[pcap]")
+{
+    std::vector<std::string> frames;
+    frames.push_back(ethernet(0x0800, ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(0x1234)))));
+    frames.push_back(ethernet(0x0800, ipv4(17, SERVER, CLIENT, udp(53, 40000, dnsHeader(0x1234, true))), true));
+    frames.push_back(ethernet(0x0800, ipv4(17, CLIENT, SERVER, udp(40000, 123, dnsHeader(1)))));  // Other port
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapFile(1, frames), 53, packets, error));
+    REQUIRE(packets.size() == 2);
+
+    CHECK(packets[0].src == "10.0.0.1");
+    CHECK(packets[0].dst == "10.0.0.53");
+    CHECK(packets[0].src_port == 40000);
+    CHECK(packets[0].dst_port == 53);
+    CHECK_FALSE(packets[0].tcp);
+    CHECK(packets[0].payload == dnsHeader(0x1234));
+    CHECK(packets[0].time_us == 1700000000500000ULL);
+    unsigned long ip = 0;
+    memcpy(&ip, CLIENT, 4);
+    CHECK(packets[0].src_ip == ip);
+
+    CHECK(packets[1].src == "10.0.0.53");
+    CHECK(packets[1].src_port == 53);
+    CHECK(packets[1].payload == dnsHeader(0x1234, true));
+}
+
+TEST_CASE("pcap byte-swapped with nanosecond timestamps", "[pcap]")
+{
+    std::vector<std::string> frames;
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(7))));
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapFile(101, frames, true, true), 53, packets, error));
+    REQUIRE(packets.size() == 1);
+    CHECK(packets[0].time_us == 1700000000500000ULL);
+    CHECK(packets[0].payload == dnsHeader(7));
+}
+
+TEST_CASE("pcap TCP segment with two messages", "[pcap]")
+{
+    std::string stream;
+    putBe16(stream, 12);
+    stream += dnsHeader(1);
+    putBe16(stream, 12);
+    stream += dnsHeader(2);
+    putBe16(stream, 100);       // Continues in the next segment
+    stream += dnsHeader(3);
+
+    std::vector<std::string> frames;
+    frames.push_back(ethernet(0x0800, ipv4(6, CLIENT, SERVER, tcp(40001, 53, stream))));
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapFile(1, frames), 53, packets, error));
+    REQUIRE(packets.size() == 2);
+    CHECK(packets[0].tcp);
+    CHECK(packets[0].payload == dnsHeader(1));
+    CHECK(packets[1].payload == dnsHeader(2));
+}
+
+TEST_CASE("pcap skips later fragments and short payloads", "[pcap]")
+{
+    std::vector<std::string> frames;
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(1)), 0x0010));
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, "short")));
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(2)), 0x2000));  // MF, first fragment
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapFile(101, frames), 53, packets, error));
+    REQUIRE(packets.size() == 1);
+    CHECK(packets[0].payload == dnsHeader(2));
+}
+
+TEST_CASE("pcap truncated tail keeps earlier packets", "[pcap]")
+{
+    std::vector<std::string> frames;
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(1))));
+    frames.push_back(ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(2))));
+    std::string file = pcapFile(101, frames);
+    file.resize(file.length() - 10);
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(file, 53, packets, error));
+    REQUIRE(packets.size() == 1);
+    CHECK(packets[0].payload == dnsHeader(1));
+}
+
+TEST_CASE("pcap rejects other files", "[pcap]")
+{
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    CHECK_FALSE(Pcap::readBuffer("$ORIGIN example.com.\n", 53, packets, error));
+    CHECK_FALSE(error.empty());
+    CHECK_FALSE(Pcap::readBuffer(std::string("\xd4\xc3\xb2\xa1", 4), 53, packets, error));
+    CHECK(packets.empty());
+}
+
+TEST_CASE("pcapng SLL2 IPv6 with nanosecond resolution", "[pcap]")
+{
+    std::string sll2;
+    putBe16(sll2, 0x86DD);
+    sll2.append(18, '\0');
+
+    std::vector<std::string> frames;
+    frames.push_back(sll2 + ipv6(17, udp(40000, 53, dnsHeader(9))));
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapngFile(276, frames, 9), 53, packets, error));
+    REQUIRE(packets.size() == 1);
+    CHECK(packets[0].src == "::1");
+    CHECK(packets[0].dst == "2001:db8::53");
+    CHECK(packets[0].src_ip == 0);
+    CHECK(packets[0].time_us == 1700000000500000ULL);
+    CHECK(packets[0].payload == dnsHeader(9));
+}
+
+TEST_CASE("pcapng Ethernet with default resolution", "[pcap]")
+{
+    std::vector<std::string> frames;
+    frames.push_back(ethernet(0x0800, ipv4(17, CLIENT, SERVER, udp(40000, 53, dnsHeader(1)))));
+    frames.push_back(ethernet(0x0800, ipv4(17, SERVER, CLIENT, udp(53, 40000, dnsHeader(1, true)))));
+
+    std::vector<Pcap::Packet> packets;
+    std::string error;
+    REQUIRE(Pcap::readBuffer(pcapngFile(1, frames), 53, packets, error));
+    REQUIRE(packets.size() == 2);
+    CHECK(packets[0].time_us == 1700000000500000ULL);
+    CHECK(packets[1].time_us == 1700000001500000ULL);
+    CHECK(packets[1].payload == dnsHeader(1, true));
+}
@@ -1,12 +1,18 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 #include "query_processor.h"
 #include "zone.h"
 #include "rra.h"
 #include "rraaaa.h"
 #include "rrcname.h"
 #include "rrns.h"
+#include "rrdynamic.h"
+#include "zoneFileLoader.h"
 #include "socket.h"
 
 using namespace std;
@@ -124,12 +130,13 @@ void test_ns_record_detection() {
     query_rr.rrclass = RR::CLASSIN;
     
     vector<RR*> matches;
-    RR *ns_record = NULL;
-    QueryProcessor::findMatches(&query_rr, z, matches, &ns_record);
+    vector<RR*> delegation;
+    QueryProcessor::findMatches(&query_rr, z, matches, &delegation);
     
     // Should find NS record for delegation
-    assert(ns_record != NULL);
-    assert(ns_record->type == RR::NS);
+    assert(delegation.size() == 1);
+    assert(delegation[0]->type == RR::NS);
+    assert(matches.empty());
     cout << "  Found NS record for delegation" << endl;
     cout << "  PASSED" << endl;
 }
@@ -340,6 +347,260 @@ void test_wildcard_no_matches() {
     cout << "  PASSED" << endl;
 }
 
+// Text of a TXT record with a single character-string
+void test_delegation_deepest_cut() {
+    cout << "Testing delegations at the deepest cut..." << endl;
+    
+    Zone linear;
+    Zone indexed;
+    linear.name = indexed.name = "cut.test.";
+    const char* owners[] = { "cut.test.", "a.cut.test.", "a.cut.test.", "b.a.cut.test.", "xa.cut.test." };
+    for (size_t i = 0; i < 5; ++i) {
+        for (int z = 0; z < 2; ++z) {
+            RRNS *ns = new RRNS();
+            ns->name = owners[i];
+            ns->type = RR::NS;
+            ns->rrclass = RR::CLASSIN;
+            ns->ttl = 300;
+            ns->rdata = "ns" + to_string(i) + ".elsewhere.test.";
+            (z ? indexed : linear).addRecord(ns);
+        }
+    }
+    // The name tree answers once the zone is indexed, a scan before that
+    indexed.shrinkToFit();
+    assert(indexed.nameTree().valid());
+    assert(!linear.nameTree().valid());
+    
+    struct { const char* name; const char* cut; size_t count; } cases[] = {
+        { "host.cut.test.", "", 0 },            // The apex is not a cut
+        { "cut.test.", "", 0 },
+        { "a.cut.test.", "a.cut.test.", 2 },
+        { "x.y.a.cut.test.", "a.cut.test.", 2 },
+        { "c.b.a.cut.test.", "b.a.cut.test.", 1 },
+        { "ba.cut.test.", "", 0 },              // Label boundaries
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        for (int z = 0; z < 2; ++z) {
+            RR query_rr;
+            query_rr.name = cases[c].name;
+            query_rr.type = RR::A;
+            query_rr.rrclass = RR::CLASSIN;
+            
+            vector<RR*> matches;
+            vector<RR*> delegation;
+            QueryProcessor::findMatches(&query_rr, z ? indexed : linear, matches, &delegation);
+            assert(matches.empty());
+            assert(delegation.size() == cases[c].count);
+            for (size_t i = 0; i < delegation.size(); ++i) {
+                assert(delegation[i]->name == cases[c].cut);
+                delete delegation[i];
+            }
+        }
+    }
+    cout << "  PASSED" << endl;
+}
+
+void test_name_exists() {
+    cout << "Testing name existence (NODATA vs NXDOMAIN)..." << endl;
+    
+    Zone linear;
+    Zone indexed;
+    linear.name = indexed.name = "exist.test.";
+    const char* owners[] = { "www.exist.test.", "a.ent.exist.test.", "*.wild.exist.test." };
+    for (size_t i = 0; i < 3; ++i) {
+        for (int z = 0; z < 2; ++z) {
+            RRA *rr = new RRA();
+            rr->name = owners[i];
+            rr->type = RR::A;
+            rr->rrclass = RR::CLASSIN;
+            rr->ttl = 300;
+            rr->rdata = string("\xc0\x00\x02\x01", 4);
+            (z ? indexed : linear).addRecord(rr);
+        }
+    }
+    indexed.shrinkToFit();
+    
+    // Names with records, and empty non-terminals, exist
+    RR query_rr;
+    query_rr.name = "www.exist.test.";
+    query_rr.type = RR::TXT;
+    query_rr.rrclass = RR::CLASSIN;
+    assert(QueryProcessor::nameExists(&query_rr, linear));
+    assert(QueryProcessor::nameExists(&query_rr, indexed));
+    query_rr.name = "ent.exist.test.";
+    assert(QueryProcessor::nameExists(&query_rr, linear));
+    assert(QueryProcessor::nameExists(&query_rr, indexed));
+    query_rr.name = "nothing.exist.test.";
+    assert(!QueryProcessor::nameExists(&query_rr, linear));
+    assert(!QueryProcessor::nameExists(&query_rr, indexed));
+    
+    // A wildcard at the closest encloser makes the name exist
+    query_rr.name = "x.wild.exist.test.";
+    assert(QueryProcessor::nameExists(&query_rr, indexed));
+    query_rr.name = "x.ent.exist.test.";
+    assert(!QueryProcessor::nameExists(&query_rr, indexed));
+    cout << "  PASSED" << endl;
+}
+
+// The records `findMatches` returns for `name` and `type`; deleted by release()
+static vector<RR*> query(const Zone& zone, const char* name, RR::RRType type) {
+    RR query_rr;
+    query_rr.name = name;
+    query_rr.type = type;
+    query_rr.rrclass = RR::CLASSIN;
+    vector<RR*> matches;
+    QueryProcessor::findMatches(&query_rr, zone, matches);
+    return matches;
+}
+
+static void release(vector<RR*>& matches) {
+    for (size_t i = 0; i < matches.size(); ++i)
+        delete matches[i];
+    matches.clear();
+}
+
+void test_wildcard_synthesis() {
+    cout << "Testing answers synthesized from wildcard owners..." << endl;
+    
+    t_zones zones;
+    t_data data;
+    data.push_back("$ORIGIN synth.test.");
+    data.push_back("synth.test. 3600 IN SOA ns1.synth.test. admin.synth.test. 1 3600 1800 604800 300");
+    data.push_back("synth.test. IN NS ns1.synth.test.");
+    data.push_back("* IN A 192.0.2.1");
+    data.push_back("* IN MX 10 mail.synth.test.");
+    data.push_back("www IN A 192.0.2.2");
+    data.push_back("a.empty IN A 192.0.2.3");
+    data.push_back("*.sub IN TXT \"sub\"");
+    data.push_back("sub IN A 192.0.2.4");
+    data.push_back("deleg IN NS ns.elsewhere.test.");
+    data.push_back("*.deleg IN A 192.0.2.5");
+    bool loaded = ZoneFileLoader::load(data, zones);
+    assert(loaded && zones.size() == 1);
+    const Zone& zone = *zones[0];
+    
+    // The answer is owned by the query name, deep names included
+    vector<RR*> matches = query(zone, "host.synth.test.", RR::A);
+    assert(matches.size() == 1);
+    assert(matches[0]->name == "host.synth.test.");
+    assert(matches[0]->toString().find("192.0.2.1") != string::npos);
+    release(matches);
+    matches = query(zone, "a.b.c.synth.test.", RR::MX);
+    assert(matches.size() == 1);
+    assert(matches[0]->name == "a.b.c.synth.test.");
+    release(matches);
+    matches = query(zone, "host.synth.test.", RR::TYPESTAR);
+    assert(matches.size() == 2);
+    release(matches);
+    
+    // Existing names are never synthesized: www has no MX, and empty.synth.test.
+    // exists as the parent of a.empty
+    assert(query(zone, "www.synth.test.", RR::MX).empty());
+    assert(query(zone, "empty.synth.test.", RR::A).empty());
+    matches = query(zone, "www.synth.test.", RR::A);
+    assert(matches.size() == 1);
+    assert(matches[0]->toString().find("192.0.2.2") != string::npos);
+    release(matches);
+    
+    // The closest encloser picks the wildcard, not the deepest one in the zone
+    matches = query(zone, "x.sub.synth.test.", RR::TXT);
+    assert(matches.size() == 1);
+    assert(matches[0]->name == "x.sub.synth.test.");
+    release(matches);
+    assert(query(zone, "x.sub.synth.test.", RR::A).empty());
+    // x.empty.synth.test. has empty.synth.test. as closest encloser, which has no wildcard
+    assert(query(zone, "x.empty.synth.test.", RR::A).empty());
+    
+    // Nothing is synthesized below a zone cut
+    assert(query(zone, "host.deleg.synth.test.", RR::A).empty());
+    
+    for (size_t i = 0; i < zones.size(); ++i)
+        delete zones[i];
+    cout << "  PASSED" << endl;
+}
+
+static string txtOf(const RR* rr) {
+    ostringstream text;
+    rr->dumpContents(text);
+    return text.str();
+}
+
+void test_dynamic_txt_cache() {
+    cout << "Testing DYNAMIC TXT caching..." << endl;
+    
+    const char* path = "test_query_processor_dynamic.txt";
+    {
+        ofstream out(path);
+        out << "token-b\n  token-a  \n\ntoken-b\n";
+    }
+    
+    Zone z;
+    z.name = "acme.test.";
+    RRDYNAMIC dynamic;
+    dynamic.name = "_acme-challenge.acme.test.";
+    dynamic.type = RR::DYNAMIC;
+    dynamic.rrclass = RR::CLASSIN;
+    dynamic.filepath = path;
+    dynamic.ttl = 30;
+    z.addRecord(dynamic);
+    
+    // Any RRDYNAMIC for this name and file shares the zone's cache
+    RRDYNAMIC *dyn = dynamic_cast<RRDYNAMIC*>(z.getAllRecords()[0]);
+    
+    RR query_rr;
+    query_rr.name = "_acme-challenge.acme.test.";
+    query_rr.type = RR::TXT;
+    query_rr.rrclass = RR::CLASSIN;
+    
+    unsigned int saved_interval = RRDYNAMIC::check_interval_ms;
+    RRDYNAMIC::check_interval_ms = 60000;
+    
+    // Sorted, trimmed, deduplicated
+    vector<RR*> matches;
+    QueryProcessor::findMatches(&query_rr, z, matches);
+    assert(matches.size() == 2);
+    assert(matches[0]->type == RR::TXT && txtOf(matches[0]) == "token-a");
+    assert(txtOf(matches[1]) == "token-b");
+    assert(matches[0]->name_id == NameTable::global().find("_acme-challenge.acme.test."));
+    assert(matches[0]->ttl == 30 && matches[1]->ttl == 30);
+    
+    // Served from the cache while the check interval has not passed
+    {
+        ofstream out(path);
+        out << "token-c\n";
+    }
+    RRDYNAMIC::t_txt_set first = dyn->resolveTXT();
+    assert(first->records.size() == 2);
+    
+    // Once the file is checked again the change is picked up, and the
+    // records of the earlier query, which hold their set, stay valid
+    RRDYNAMIC::check_interval_ms = 0;
+    first.reset();
+    vector<RR*> matches2;
+    QueryProcessor::findMatches(&query_rr, z, matches2);
+    assert(matches2.size() == 1);
+    assert(txtOf(matches2[0]) == "token-c");
+    assert(txtOf(matches[0]) == "token-a" && txtOf(matches[1]) == "token-b");
+    for (size_t i = 0; i < matches.size(); ++i)
+        delete matches[i];
+    delete matches2[0];
+    
+    // Unchanged file: the same set is reused, nothing is re-read
+    assert(dyn->resolveTXT() == dyn->resolveTXT());
+    
+    // Clones share the cache
+    RR* clone = dyn->clone();
+    assert(dynamic_cast<RRDYNAMIC*>(clone)->resolveTXT() == dyn->resolveTXT());
+    delete clone;
+    
+    // Removing the file yields an empty answer
+    remove(path);
+    assert(dyn->resolveTXT()->records.empty());
+    
+    RRDYNAMIC::check_interval_ms = saved_interval;
+    cout << "  PASSED" << endl;
+}
+
 int main() {
     cout << "Running QueryProcessor unit tests..." << endl << endl;
     
@@ -351,6 +612,10 @@ int main() {
         test_double_wildcard_prefix();
         test_wildcard_with_typestar();
         test_wildcard_no_matches();
+        test_delegation_deepest_cut();
+        test_name_exists();
+        test_wildcard_synthesis();
+        test_dynamic_txt_cache();
         
         cout << endl << "All tests PASSED!" << endl;
         return 0;
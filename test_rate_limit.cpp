@@ -0,0 +1,240 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sstream>
+#include "rate_limit.h"
+
+static RateLimiter::Config limits(unsigned int responses, unsigned int slip)
+{
+    RateLimiter::Config config;
+    config.rate[RateLimiter::RESPONSE] = responses;
+    config.slip = slip;
+    return config;
+}
+
+static IpAddress ip(const char* address)
+{
+    IpAddress parsed;
+    REQUIRE(parsed.parse(address));
+    return parsed;
+}
+
+TEST_CASE("RateLimiter: sends everything while off", "[rrl]")
+{
+    RateLimiter limiter;
+    CHECK_FALSE(limiter.enabled());
+    for (int i = 0; i < 1000; ++i)
+        REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+
+    limiter.configure(limits(0, 2));
+    CHECK_FALSE(limiter.enabled());
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::ERROR, "", 0, 100) == RateLimiter::SEND);
+}
+
+TEST_CASE("RateLimiter: buckets hold one second of replies", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(5, 2));
+    REQUIRE(limiter.enabled());
+
+    for (int i = 0; i < 5; ++i)
+        CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    // Over the rate every second reply slips through truncated
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SLIP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.limited() == 3);
+    CHECK(limiter.slipped() == 1);
+
+    // The next second starts with a full bucket
+    for (int i = 0; i < 5; ++i)
+        CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 101) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 101) != RateLimiter::SEND);
+
+    std::ostringstream out;
+    limiter.dump(out);
+    CHECK(out.str() == "[RRL] responses_per_second=5 nxdomains_per_second=5 errors_per_second=5 "
+                       "slip=2 ipv4_prefix=24 ipv6_prefix=56 limited=4 dropped=2 slipped=2\n");
+
+    // configure() starts over
+    limiter.configure(limits(5, 2));
+    CHECK(limiter.limited() == 0);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 101) == RateLimiter::SEND);
+}
+
+TEST_CASE("RateLimiter: keys are the client network and the reply", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(1, 0));
+
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    // The same /24 shares the bucket
+    CHECK(limiter.check(ip("192.0.2.200"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+    // Other networks, names, types and kinds have their own
+    CHECK(limiter.check(ip("192.0.3.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "mail.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 28, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::NXDOMAIN, "www.example.com.", 1, 100) == RateLimiter::SEND);
+
+    // Errors count per network only
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::ERROR, "", 0, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.9"), RateLimiter::ERROR, "", 0, 100) == RateLimiter::DROP);
+
+    // With slip 0 nothing slips
+    CHECK(limiter.slipped() == 0);
+
+    RateLimiter::Config host = limits(1, 1);
+    host.ipv4_prefix = 32;
+    limiter.configure(host);
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.2"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    // Slip 1 truncates every limited reply
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SLIP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SLIP);
+}
+
+TEST_CASE("RateLimiter: every bucket slips on its own count", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(1, 2));
+
+    // Two keys limited in turn: a shared count would slip only one of them
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 100) == RateLimiter::SEND);
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "b.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "b.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 100) == RateLimiter::SLIP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "b.example.com.", 1, 100) == RateLimiter::SLIP);
+
+    // The count carries over into the next second
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 101) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 101) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "a.example.com.", 1, 101) == RateLimiter::SLIP);
+    CHECK(limiter.limited() == 6);
+    CHECK(limiter.slipped() == 3);
+
+    RateLimiter::Config large = limits(1, 1000);
+    limiter.configure(large);
+    CHECK(limiter.config().slip == RateLimiter::MAX_SLIP);
+}
+
+TEST_CASE("RateLimiter: IPv6 clients have networks of their own", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(1, 0));
+
+    // The same /56 shares a bucket, the next /56 does not
+    REQUIRE(limiter.check(ip("2001:db8:1:100::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("2001:db8:1:1ff::2"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("2001:db8:1:200::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("2001:db9:1:100::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+
+    // Mapped addresses are IPv4
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("::ffff:192.0.2.7"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+
+    // With no prefix at all the families still count apart
+    RateLimiter::Config everyone = limits(1, 0);
+    everyone.ipv4_prefix = 0;
+    everyone.ipv6_prefix = 0;
+    limiter.configure(everyone);
+    REQUIRE(limiter.check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("2001:db8::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("203.0.113.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+    CHECK(limiter.check(ip("2001:db9::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+
+    RateLimiter::Config hosts = limits(1, 0);
+    hosts.ipv6_prefix = 200;
+    limiter.configure(hosts);
+    CHECK(limiter.config().ipv6_prefix == 128);
+    REQUIRE(limiter.check(ip("2001:db8::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("2001:db8::2"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("2001:db8::1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::DROP);
+}
+
+TEST_CASE("RateLimiter: rates per kind", "[rrl]")
+{
+    RateLimiter limiter;
+    RateLimiter::Config config = limits(100000, 2);
+    config.rate[RateLimiter::NXDOMAIN] = 2;
+    config.ipv4_prefix = 40;
+    limiter.configure(config);
+
+    CHECK(limiter.config().rate[RateLimiter::RESPONSE] == RateLimiter::MAX_RATE);
+    CHECK(limiter.config().rate[RateLimiter::NXDOMAIN] == 2);
+    CHECK(limiter.config().rate[RateLimiter::ERROR] == RateLimiter::MAX_RATE);
+    CHECK(limiter.config().ipv4_prefix == 32);
+    CHECK(limiter.config().ipv6_prefix == RateLimiter::DEFAULT_IPV6_PREFIX);
+
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::NXDOMAIN, "example.com.", 0, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::NXDOMAIN, "example.com.", 0, 100) == RateLimiter::SEND);
+    CHECK(limiter.check(ip("192.0.2.1"), RateLimiter::NXDOMAIN, "example.com.", 0, 100) == RateLimiter::DROP);
+}
+
+TEST_CASE("RateLimiter: a spoofed flood keeps the table and the limit", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(10, 0));
+
+    // 200,000 sources share the fixed table with the victim. Its bucket can
+    // be evicted when a source lands on the same pair, which refills it,
+    // but that is rare.
+    IpAddress victim = ip("198.51.100.7");
+    unsigned int sent = 0;
+    for (unsigned int i = 0; i < 200000; ++i)
+    {
+        limiter.check(IpAddress::fromIpv4(htonl(0x0A000000 | (i << 8))), RateLimiter::RESPONSE, "www.example.com.", 1, 100 + i / 50000);
+        if (i % 100 == 0)
+            sent += limiter.check(victim, RateLimiter::RESPONSE, "www.example.com.", 1, 100 + i / 50000) == RateLimiter::SEND;
+    }
+    // 2,000 attempts over four seconds, 10 a second get through
+    CHECK(sent >= 40);
+    CHECK(sent <= 200);
+    CHECK(limiter.limited() > 0);
+}
+
+namespace {
+
+struct Hammer
+{
+    RateLimiter* limiter;
+    unsigned int sent;
+};
+
+void* hammer(void* arg)
+{
+    Hammer* h = (Hammer*)arg;
+    for (int i = 0; i < 10000; ++i)
+    {
+        if (h->limiter->check(ip("192.0.2.1"), RateLimiter::RESPONSE, "www.example.com.", 1, 100) == RateLimiter::SEND)
+            h->sent++;
+    }
+    return NULL;
+}
+
+} // namespace
+
+TEST_CASE("RateLimiter: concurrent checks share one bucket", "[rrl]")
+{
+    RateLimiter limiter;
+    limiter.configure(limits(1000, 2));
+
+    pthread_t threads[4];
+    Hammer hammers[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        hammers[i].limiter = &limiter;
+        hammers[i].sent = 0;
+        REQUIRE(pthread_create(&threads[i], NULL, hammer, &hammers[i]) == 0);
+    }
+    unsigned int sent = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        sent += hammers[i].sent;
+    }
+    CHECK(sent == 1000);
+    CHECK(limiter.limited() == 39000);
+    CHECK(limiter.slipped() == 19500);
+}
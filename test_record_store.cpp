@@ -0,0 +1,265 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "record_store.h"
+#include "zone.h"
+#include "rr.h"
+#include "rra.h"
+#include "rrsoa.h"
+#include "rrmx.h"
+#include "rrdynamic.h"
+#include "zoneFileLoader.h"
+#include "socket.h"
+
+static RR* makeA(const std::string& name, const char* address, unsigned long ttl = 300)
+{
+    RRA* rr = new RRA();
+    rr->name = name;
+    rr->type = RR::A;
+    rr->rrclass = RR::CLASSIN;
+    rr->ttl = ttl;
+    rr->query = false;
+    unsigned long addr = inet_addr(address);
+    rr->rdata.assign(reinterpret_cast<char*>(&addr), 4);
+    return rr;
+}
+
+static std::string materializedString(const RecordStore& store, size_t i)
+{
+    RR* rr = store.materialize(i);
+    std::string s = rr->toString();
+    delete rr;
+    return s;
+}
+
+TEST_CASE("RecordStore: records round trip through the compact arrays", "[recordstore]")
+{
+    t_data data;
+    data.push_back("$ORIGIN store.test.");
+    data.push_back("store.test. 3600 IN SOA ns1.store.test. admin.store.test. 5 3600 1800 604800 300");
+    data.push_back("store.test. IN MX 10 mail.store.test.");
+    data.push_back("www 120 IN A 192.0.2.10");
+    data.push_back("www IN AAAA 2001:0db8:0000:0000:0000:0000:0000:0001");
+    data.push_back("txt IN TXT \"hello world\"");
+    data.push_back("alias IN CNAME www.store.test.");
+
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(data, zones));
+    const RecordStore& store = zones[0]->records();
+    REQUIRE(store.size() == 6);
+
+    CHECK(store.type(0) == RR::SOA);
+    CHECK(store.ttl(0) == 3600);
+    CHECK(store.type(2) == RR::A);
+    CHECK(store.rrclass(2) == RR::CLASSIN);
+    CHECK(store.ttl(2) == 120);
+    CHECK(store.rdataLength(2) == 4);
+    CHECK(store.nameId(2) == store.nameId(3));
+    CHECK(NameTable::global().name(store.nameId(2)) == "www.store.test.");
+
+    // The materialized view matches what the loader parsed
+    const std::vector<RR*>& rrs = zones[0]->getAllRecords();
+    REQUIRE(rrs.size() == store.size());
+    for (size_t i = 0; i < store.size(); ++i)
+        CHECK(materializedString(store, i) == rrs[i]->toString());
+
+    RRMX* mx = dynamic_cast<RRMX*>(rrs[1]);
+    REQUIRE(mx != NULL);
+    CHECK(mx->pref == 10);
+    CHECK(mx->rdata == "mail.store.test.");
+
+    delete zones[0];
+}
+
+TEST_CASE("RecordStore: remove keeps order and compacts the blob", "[recordstore]")
+{
+    RecordStore store;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::ostringstream name;
+        name << "h" << i << ".compact.test.";
+        RR* rr = makeA(name.str(), "192.0.2.1", i);
+        store.add(*rr);
+        delete rr;
+    }
+
+    size_t before = store.bytes();
+    for (size_t i = 0; i < store.size(); )
+    {
+        if (store.ttl(i) % 4 != 0)
+            store.remove(i);
+        else
+            ++i;
+    }
+    store.shrink();
+
+    REQUIRE(store.size() == 500);
+    for (size_t i = 0; i < store.size(); ++i)
+    {
+        CHECK(store.ttl(i) == i * 4);
+        CHECK(store.rdataLength(i) == 4);
+        CHECK((unsigned char)store.rdata(i)[0] == 192);
+    }
+    CHECK(store.bytes() < before);
+}
+
+TEST_CASE("RecordStore: setRdata replaces in place or appends", "[recordstore]")
+{
+    RecordStore store;
+    RR* rr = makeA("set.test.", "192.0.2.1");
+    store.add(*rr);
+    delete rr;
+
+    store.setRdata(0, std::string("\x0a\x00\x00\x01", 4));
+    CHECK(materializedString(store, 0) == "set.test. 300 IN A 10.0.0.1");
+
+    store.setRdata(0, std::string("\x01\x02\x03\x04\x05", 5));
+    CHECK(store.rdataLength(0) == 5);
+}
+
+TEST_CASE("Zone: updates go to the compact storage", "[recordstore][zone]")
+{
+    t_data data;
+    data.push_back("$ORIGIN serial.test.");
+    data.push_back("serial.test. IN SOA ns1.serial.test. admin.serial.test. 41 3600 1800 604800 300");
+    data.push_back("www IN A 192.0.2.1");
+
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(data, zones));
+    Zone* zone = zones[0];
+
+    zone->recordUpdate();
+    std::vector<RR*> soa = zone->findRecordsByName("serial.test.", RR::SOA);
+    REQUIRE(soa.size() == 1);
+    CHECK(dynamic_cast<RRSoa*>(soa[0])->serial == 42);
+
+    RR* added = makeA("new.serial.test.", "192.0.2.2");
+    zone->addRecord(*added);
+    delete added;
+    CHECK(zone->getAllRecords().size() == 3);
+    CHECK(zone->findRecordsByName("new.serial.test.", RR::A).size() == 1);
+
+    // The change freed the earlier view; its records are looked up again
+    soa = zone->findRecordsByName("serial.test.", RR::SOA);
+    REQUIRE(soa.size() == 1);
+    CHECK(dynamic_cast<RRSoa*>(soa[0])->serial == 42);
+
+    std::vector<RR*> fresh = zone->materializeRecords(NameTable::global().find("www.serial.test."));
+    REQUIRE(fresh.size() == 1);
+    CHECK(fresh[0]->name == "www.serial.test.");
+    CHECK(fresh[0]->type == RR::A);
+    delete fresh[0];
+
+    delete zone;
+}
+
+TEST_CASE("RRDYNAMIC: materialized records share one cache", "[recordstore][dynamic]")
+{
+    const char* path = "test_record_store_dynamic.txt";
+    {
+        std::ofstream out(path);
+        out << "token-one\n";
+    }
+
+    t_data data;
+    data.push_back("$ORIGIN dyn.test.");
+    data.push_back(std::string("$DYNAMIC _acme-challenge.dyn.test. ") + path);
+    data.push_back(std::string("$DYNAMIC other.dyn.test. ") + path + " 5m");
+
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(data, zones));
+    const RecordStore& store = zones[0]->records();
+    REQUIRE(store.size() == 2);
+
+    // Answers are sent with the TTL of their DYNAMIC record: 1 second
+    // unless the directive gives one
+    CHECK(store.ttl(0) == 1);
+    CHECK(store.ttl(1) == 300);
+
+    RRDYNAMIC* first = dynamic_cast<RRDYNAMIC*>(store.materialize(0));
+    RRDYNAMIC* second = dynamic_cast<RRDYNAMIC*>(store.materialize(0));
+    REQUIRE(first != NULL);
+    REQUIRE(second != NULL);
+    CHECK(first->filepath == path);
+
+    RRDYNAMIC::t_txt_set a = first->resolveTXT();
+    RRDYNAMIC::t_txt_set b = second->resolveTXT();
+    CHECK(a.get() == b.get());
+    REQUIRE(a->records.size() == 1);
+    CHECK(a->records[0]->toString() == "_acme-challenge.dyn.test. 0 IN TXT token-one");
+
+    // The stored record keeps that same cache: queries need not
+    // materialize it
+    CHECK(RRDYNAMIC::resolve(store.dynamicCache(0)).get() == a.get());
+
+    delete first;
+    delete second;
+    delete zones[0];
+    remove(path);
+}
+
+TEST_CASE("RRDYNAMIC: answers pack the cached wire form", "[recordstore][dynamic]")
+{
+    const char* path = "test_record_store_packed.txt";
+    {
+        std::ofstream out(path);
+        out << "token-two\n";
+    }
+
+    t_data data;
+    data.push_back("$ORIGIN dyn.test.");
+    data.push_back(std::string("$DYNAMIC packed.dyn.test. ") + path);
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(data, zones));
+    const RecordStore& store = zones[0]->records();
+    REQUIRE(store.size() == 1);
+
+    RRDYNAMIC::t_txt_set set = RRDYNAMIC::resolve(store.dynamicCache(0));
+    REQUIRE(set->records.size() == 1);
+    CHECK(set->wire == std::string("\x09token-two"));
+
+    // A clone in a reply keeps the set alive after the cache drops it
+    RR* answer = set->records[0]->clone();
+    answer->ttl = store.ttl(0);
+    std::weak_ptr<const RRDYNAMIC::TXTSet> weak = set;
+    set.reset();
+    remove(path);
+    unsigned int saved_interval = RRDYNAMIC::check_interval_ms;
+    RRDYNAMIC::check_interval_ms = 0;
+    CHECK(RRDYNAMIC::resolve(store.dynamicCache(0))->records.empty());
+    RRDYNAMIC::check_interval_ms = saved_interval;
+    CHECK_FALSE(weak.expired());
+
+    char packet[128];
+    unsigned int offset = 0;
+    answer->pack(packet, sizeof(packet), offset);
+    const char expected[] = "\x06packed\x03" "dyn\x04test\x00"
+                            "\x00\x10\x00\x01\x00\x00\x00\x01\x00\x0a"
+                            "\x09token-two";
+    CHECK(std::string(packet, offset) == std::string(expected, sizeof(expected) - 1));
+
+    delete answer;
+    CHECK(weak.expired());
+
+    CHECK(zones[0]->removeRecords("packed.dyn.test.", RR::DYNAMIC) == 1);
+    delete zones[0];
+}
+
+TEST_CASE("RecordStore: A records take a few dozen bytes", "[recordstore]")
+{
+    RecordStore store;
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::ostringstream name;
+        name << "host" << i << ".size.test.";
+        RR* rr = makeA(name.str(), "192.0.2.1");
+        store.add(*rr);
+        delete rr;
+    }
+    store.shrink();
+
+    // 18 bytes of per-record fields plus 4 bytes of rdata
+    CHECK(store.bytes() == 10000 * 22);
+}
@@ -0,0 +1,430 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <cstring>
+#include "request_engine.h"
+#include "query_processor.h"
+#include "stage_trace.h"
+#include "slow_log.h"
+#include "zoneFileLoader.h"
+#include "rropt.h"
+#include "cookie.h"
+#include "client_subnet.h"
+#include "socket.h"
+
+// `payload` is the EDNS UDP size advertised, 0 for a query without EDNS;
+// a `cookie` is sent in a COOKIE option, an `ecs` in a client subnet option
+static unsigned int packQuery(char* packet, unsigned int len, const std::string& name, RR::RRType type,
+                              RR::RRClass rrclass = RR::CLASSIN, unsigned short id = 0x4242,
+                              unsigned short payload = 4096, const std::string& cookie = std::string(),
+                              const std::string& ecs = std::string())
+{
+    Message query;
+    query.id = id;
+    query.query = true;
+    query.opcode = Message::QUERY;
+    query.authoritative = false;
+    query.truncation = false;
+    query.recursiondesired = true;
+    query.recursionavailable = false;
+    query.rcode = Message::CODENOERROR;
+
+    RR* q = RR::createByType(type);
+    q->name = name;
+    q->type = type;
+    q->rrclass = rrclass;
+    q->query = true;
+    query.qd.push_back(q);
+    if (payload)
+    {
+        RROPT* opt = new RROPT();
+        opt->udp_payload_size = payload;
+        opt->syncFields();
+        if (!cookie.empty())
+            opt->addOption(DnsCookies::OPTION_CODE, cookie);
+        if (!ecs.empty())
+            opt->addOption(ClientSubnet::OPTION_CODE, ecs);
+        query.ar.push_back(opt);
+    }
+
+    unsigned int size = 0;
+    query.pack(packet, len, size);
+    return size;
+}
+
+// The data of option `code` in `reply`, empty if there is none
+static std::string replyOption(const Message& reply, uint16_t code = DnsCookies::OPTION_CODE)
+{
+    const RROPT* opt = dynamic_cast<const RROPT*>(reply.getOPT());
+    if (!opt)
+        return std::string();
+    for (size_t i = 0; i < opt->options.size(); ++i)
+    {
+        if (opt->options[i].code == code)
+            return opt->options[i].data;
+    }
+    return std::string();
+}
+
+struct EngineFixture
+{
+    t_zones zones;
+    RequestEngine engine;
+    RequestEngine::Client client;
+    RequestEngine::Response response;
+
+    EngineFixture() : engine(zones, false)
+    {
+        t_data data;
+        data.push_back("www IN A 192.0.2.10");
+        data.push_back("www IN A 192.0.2.11");
+        data.push_back("*.wild IN A 192.0.2.20");
+        data.push_back("alias IN CNAME alias2");
+        data.push_back("alias2 IN CNAME www");
+        data.push_back("loop1 IN CNAME loop2");
+        data.push_back("loop2 IN CNAME loop1");
+        data.push_back("away IN CNAME www.elsewhere.test.");
+        data.push_back("dangling IN CNAME nowhere");
+        data.push_back("*.wildalias IN CNAME host.wild");
+        data.push_back("engine.test. IN MX 10 mail");
+        data.push_back("engine.test. IN MX 20 mail.elsewhere.test.");
+        data.push_back("mail IN A 192.0.2.30");
+        data.push_back("mail IN AAAA 2001:db8::30");
+        data.push_back("engine.test. IN NS ns1");
+        data.push_back("ns1 IN A 192.0.2.1");
+        data.push_back("sub IN NS ns.sub");
+        data.push_back("sub IN NS ns2.sub");
+        data.push_back("sub IN NS ns.elsewhere.test.");
+        data.push_back("ns.sub IN A 192.0.2.40");
+        data.push_back("ns2.sub IN AAAA 2001:db8::41");
+        data.push_back("relay IN MX 10 ns.sub");
+        data.push_back("short 30 IN A 192.0.2.50");
+        data.push_back("$TTL 2h");
+        data.push_back("long IN CNAME short");
+        for (int i = 0; i < 40; ++i)
+            data.push_back("big IN TXT \"record " + std::to_string(i) + " of a set too large for 512 bytes\"");
+        addZone("engine.test.", data);
+
+        client.setAddress("127.0.0.1");
+    }
+
+    ~EngineFixture()
+    {
+        for (size_t i = 0; i < zones.size(); ++i)
+            delete zones[i];
+    }
+
+    // Loads a zone `origin` with an SOA and `records`, relative to the origin
+    void addZone(const std::string& origin, const t_data& records)
+    {
+        t_data data;
+        data.push_back("$ORIGIN " + origin);
+        data.push_back(origin + " 3600 IN SOA ns1." + origin + " admin." + origin + " 1 3600 1800 604800 300");
+        data.insert(data.end(), records.begin(), records.end());
+        REQUIRE(ZoneFileLoader::load(data, zones));
+    }
+
+    // Runs `packet` through the engine and decodes the reply into `reply`
+    bool exchange(char* packet, unsigned int size, Message& reply)
+    {
+        if (!engine.handle(packet, size, client, RequestEngine::UDP, response))
+            return false;
+        unsigned int offset = 0;
+        REQUIRE(reply.unpack(response.data, response.length, offset));
+        CHECK(offset == response.length);
+        return true;
+    }
+};
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: answers a query from the zone", "[engine]")
+{
+    char packet[512];
+    unsigned int size = packQuery(packet, sizeof(packet), "WWW.engine.test.", RR::A);
+
+    Message reply;
+    REQUIRE(exchange(packet, size, reply));
+    CHECK(reply.id == 0x4242);
+    CHECK_FALSE(reply.query);
+    CHECK(reply.authoritative);
+    CHECK(reply.rcode == Message::CODENOERROR);
+    REQUIRE(reply.qd.size() == 1);
+    CHECK(reply.an.size() == 2);
+    CHECK(reply.getOPT() != NULL);
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: negative and out-of-zone answers", "[engine]")
+{
+    char packet[512];
+
+    unsigned int size = packQuery(packet, sizeof(packet), "missing.engine.test.", RR::A);
+    Message nxdomain;
+    REQUIRE(exchange(packet, size, nxdomain));
+    CHECK(nxdomain.rcode == Message::CODENAMEERROR);
+    CHECK(nxdomain.an.empty());
+    REQUIRE(nxdomain.ns.size() == 1);
+    CHECK(nxdomain.ns[0]->type == RR::SOA);
+
+    size = packQuery(packet, sizeof(packet), "www.elsewhere.test.", RR::A);
+    Message servfail;
+    REQUIRE(exchange(packet, size, servfail));
+    CHECK(servfail.rcode == Message::CODESERVERFAILURE);
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: wildcard answers carry the query name", "[engine]")
+{
+    char packet[512];
+    unsigned int size = packQuery(packet, sizeof(packet), "Host.Wild.engine.test.", RR::A);
+
+    Message reply;
+    REQUIRE(exchange(packet, size, reply));
+    CHECK(reply.rcode == Message::CODENOERROR);
+    REQUIRE(reply.an.size() == 1);
+    CHECK(reply.an[0]->name == "host.wild.engine.test.");
+    CHECK(reply.an[0]->type == RR::A);
+    CHECK(reply.an[0]->rdata == std::string("\xc0\x00\x02\x14", 4));
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: follows in-zone CNAME chains", "[engine]")
+{
+    char packet[512];
+    Message reply;
+
+    // Both CNAMEs and the target's records, in chain order
+    unsigned int size = packQuery(packet, sizeof(packet), "alias.engine.test.", RR::A);
+    REQUIRE(exchange(packet, size, reply));
+    CHECK(reply.rcode == Message::CODENOERROR);
+    REQUIRE(reply.an.size() == 4);
+    CHECK(reply.an[0]->type == RR::CNAME);
+    CHECK(reply.an[0]->name == "alias.engine.test.");
+    CHECK(reply.an[1]->type == RR::CNAME);
+    CHECK(reply.an[1]->name == "alias2.engine.test.");
+    CHECK(reply.an[2]->type == RR::A);
+    CHECK(reply.an[2]->name == "www.engine.test.");
+
+    // A CNAME query returns just the CNAME
+    size = packQuery(packet, sizeof(packet), "alias.engine.test.", RR::CNAME);
+    Message cname;
+    REQUIRE(exchange(packet, size, cname));
+    CHECK(cname.an.size() == 1);
+
+    // Loops end when a name comes round again
+    size = packQuery(packet, sizeof(packet), "loop1.engine.test.", RR::A);
+    Message loop;
+    REQUIRE(exchange(packet, size, loop));
+    CHECK(loop.an.size() == 2);
+
+    // Out-of-zone targets are left to the resolver
+    size = packQuery(packet, sizeof(packet), "away.engine.test.", RR::A);
+    Message away;
+    REQUIRE(exchange(packet, size, away));
+    CHECK(away.rcode == Message::CODENOERROR);
+    CHECK(away.an.size() == 1);
+    CHECK(away.ns.empty());
+
+    // The rcode is that of the last name in the chain (RFC 6604): NXDOMAIN
+    // with the SOA for an in-zone target that does not exist...
+    size = packQuery(packet, sizeof(packet), "dangling.engine.test.", RR::A);
+    Message dangling;
+    REQUIRE(exchange(packet, size, dangling));
+    CHECK(dangling.rcode == Message::CODENAMEERROR);
+    REQUIRE(dangling.an.size() == 1);
+    CHECK(dangling.an[0]->type == RR::CNAME);
+    REQUIRE(dangling.ns.size() == 1);
+    CHECK(dangling.ns[0]->type == RR::SOA);
+
+    // ...and NODATA for one without records of the query type
+    size = packQuery(packet, sizeof(packet), "alias.engine.test.", RR::TXT);
+    Message nodata;
+    REQUIRE(exchange(packet, size, nodata));
+    CHECK(nodata.rcode == Message::CODENOERROR);
+    CHECK(nodata.an.size() == 2);
+    REQUIRE(nodata.ns.size() == 1);
+    CHECK(nodata.ns[0]->type == RR::SOA);
+
+    // Synthesized CNAMEs are followed to synthesized targets
+    size = packQuery(packet, sizeof(packet), "x.wildalias.engine.test.", RR::A);
+    Message wild;
+    REQUIRE(exchange(packet, size, wild));
+    REQUIRE(wild.an.size() == 2);
+    CHECK(wild.an[0]->name == "x.wildalias.engine.test.");
+    CHECK(wild.an[1]->name == "host.wild.engine.test.");
+
+    // The depth limit cuts long chains
+    size_t max_chain = QueryProcessor::max_cname_chain;
+    QueryProcessor::max_cname_chain = 1;
+    size = packQuery(packet, sizeof(packet), "alias.engine.test.", RR::A);
+    Message cut;
+    REQUIRE(exchange(packet, size, cut));
+    CHECK(cut.an.size() == 2);
+    QueryProcessor::max_cname_chain = max_chain;
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: answers carry the zone's TTLs", "[engine]")
+{
+    char packet[512];
+
+    // Each record keeps its own TTL, along a CNAME chain too
+    unsigned int size = packQuery(packet, sizeof(packet), "long.engine.test.", RR::A);
+    Message chain;
+    REQUIRE(exchange(packet, size, chain));
+    REQUIRE(chain.an.size() == 2);
+    CHECK(chain.an[0]->ttl == 7200);
+    CHECK(chain.an[1]->ttl == 30);
+
+    // Records without one get the default, additional records as well
+    size = packQuery(packet, sizeof(packet), "engine.test.", RR::MX);
+    Message mx;
+    REQUIRE(exchange(packet, size, mx));
+    REQUIRE(mx.an.size() == 2);
+    CHECK(mx.an[0]->ttl == RR::DEFAULT_TTL);
+    REQUIRE(mx.ar.size() == 3);
+    CHECK(mx.ar[0]->ttl == RR::DEFAULT_TTL);
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: additional addresses for MX and NS targets", "[engine]")
+{
+    char packet[512];
+
+    // In-zone exchanges get their A and AAAA; the other is left alone
+    unsigned int size = packQuery(packet, sizeof(packet), "engine.test.", RR::MX);
+    Message mx;
+    REQUIRE(exchange(packet, size, mx));
+    CHECK(mx.an.size() == 2);
+    REQUIRE(mx.ar.size() == 3);
+    CHECK(mx.ar[0]->name == "mail.engine.test.");
+    CHECK(mx.ar[1]->name == "mail.engine.test.");
+    CHECK(mx.ar[0]->type != mx.ar[1]->type);
+    CHECK(mx.ar[2]->type == RR::OPT);
+
+    // Referrals carry the glue of the delegation
+    size = packQuery(packet, sizeof(packet), "host.sub.engine.test.", RR::A);
+    Message referral;
+    REQUIRE(exchange(packet, size, referral));
+    REQUIRE(referral.ns.size() == 3);
+    CHECK(referral.ns[0]->type == RR::NS);
+    REQUIRE(referral.ar.size() == 3);
+    CHECK(referral.ar[0]->name == "ns.sub.engine.test.");
+    CHECK(referral.ar[0]->type == RR::A);
+
+    // An authoritative answer does not: that glue is the delegated zone's
+    size = packQuery(packet, sizeof(packet), "relay.engine.test.", RR::MX);
+    Message relay;
+    REQUIRE(exchange(packet, size, relay));
+    CHECK(relay.authoritative);
+    REQUIRE(relay.an.size() == 1);
+    REQUIRE(relay.ar.size() == 1);
+    CHECK(relay.ar[0]->type == RR::OPT);
+
+    // Without EDNS the 512 byte limit drops the additional records first
+    size = packQuery(packet, sizeof(packet), "engine.test.", RR::MX, RR::CLASSIN, 0x4242, 0);
+    Message plain;
+    REQUIRE(exchange(packet, size, plain));
+    CHECK(plain.ar.size() == 2);
+    CHECK_FALSE(plain.truncation);
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: UDP replies fit the client's payload size", "[engine]")
+{
+    char packet[512];
+
+    // Too large for 512 bytes: truncated to the question, TC set
+    unsigned int size = packQuery(packet, sizeof(packet), "big.engine.test.", RR::TXT, RR::CLASSIN, 0x4242, 0);
+    Message small;
+    REQUIRE(exchange(packet, size, small));
+    CHECK(response.length <= 512);
+    CHECK(small.truncation);
+    CHECK(small.an.empty());
+    CHECK(small.qd.size() == 1);
+
+    size = packQuery(packet, sizeof(packet), "big.engine.test.", RR::TXT, RR::CLASSIN, 0x4242, 1232);
+    Message edns;
+    REQUIRE(exchange(packet, size, edns));
+    CHECK(response.length <= 1232);
+    CHECK(edns.truncation);
+    REQUIRE(edns.getOPT() != NULL);
+
+    // Without a server cookie a larger payload is capped
+    size = packQuery(packet, sizeof(packet), "big.engine.test.", RR::TXT, RR::CLASSIN, 0x4242, 4096,
+                     std::string(8, 'c'));
+    Message capped;
+    REQUIRE(exchange(packet, size, capped));
+    CHECK(response.length <= DnsCookies::max_udp_without_cookie);
+    CHECK(capped.truncation);
+
+    // With one the client gets what it asks for
+    size = packQuery(packet, sizeof(packet), "big.engine.test.", RR::TXT, RR::CLASSIN, 0x4242, 4096,
+                     replyOption(capped));
+    Message large;
+    REQUIRE(exchange(packet, size, large));
+    CHECK_FALSE(large.truncation);
+    CHECK(large.an.size() == 40);
+
+    // TCP is not limited
+    size = packQuery(packet, sizeof(packet), "big.engine.test.", RR::TXT, RR::CLASSIN, 0x4242, 0);
+    REQUIRE(engine.handle(packet, size, client, RequestEngine::TCP, response));
+    Message tcp;
+    unsigned int offset = 0;
+    REQUIRE(tcp.unpack(response.data, response.length, offset));
+    CHECK_FALSE(tcp.truncation);
+    CHECK(tcp.an.size() == 40);
+}
+
+TEST_CASE_METHOD(EngineFixture, "RequestEngine: replies never outgrow the response buffer", "[engine]")
+{
+    // 3000 delegations whose name servers have addresses: far more answer
+    // and additional data than one message holds
+    t_data data;
+    for (int i = 0; i < 3000; ++i)
+    {
+        std::string n = std::to_string(i);
+        data.push_back("d" + n + ".dl IN NS ns" + n + ".hosts");
+        data.push_back("ns" + n + ".hosts IN A 10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+        data.push_back("big IN TXT \"record " + n + " of an RRset larger than one message\"");
+    }
+    addZone("ex.test.", data);
+
+    // Over TCP the answers come with as many addresses as still fit
+    char packet[512];
+    unsigned int size = packQuery(packet, sizeof(packet), "**.dl.ex.test.", RR::NS);
+    REQUIRE(engine.handle(packet, size, client, RequestEngine::TCP, response));
+    CHECK(response.length <= Message::MAX_SIZE);
+    Message tcp;
+    unsigned int offset = 0;
+    REQUIRE(tcp.unpack(response.data, response.length, offset));
+    CHECK(tcp.rcode == Message::CODENOERROR);
+    CHECK(tcp.an.size() == QueryProcessor::max_wildcard_answers);
+    CHECK(tcp.ar.size() > 1);
+    CHECK(tcp.ar.size() < tcp.an.size());
+    CHECK(tcp.ar.back()->type == RR::OPT);
+
+    // Over UDP they do not fit at all
+    Message udp;
+    REQUIRE(exchange(packet, size, udp));
+    CHECK(udp.truncation);
+    CHECK(udp.an.empty());
+
+    // Without a count limit the enumeration stops where the message is full
+    size_t answers = QueryProcessor::max_wildcard_answers;
+    QueryProcessor::max_wildcard_answers = 0;
+    REQUIRE(engine.handle(packet, size, client, RequestEngine::TCP, response));
+    QueryProcessor::max_wildcard_answers = answers;
+    CHECK(response.length <= Message::MAX_SIZE);
+    CHECK(response.length > Message::MAX_SIZE - 64);
+    Message full;
+    offset = 0;
+    REQUIRE(full.unpack(response.data, response.length, offset));
+    CHECK(full.rcode == Message::CODENOERROR);
+    CHECK(full.truncation);
+    CHECK(full.an.size() > QueryProcessor::max_wildcard_answers);
+    CHECK(full.an.size() < 3000);
+
+    // An RRset larger than any message is SERVFAIL over TCP
+    size = packQuery(packet, sizeof(packet), "big.ex.test.", RR::TXT);
+    REQUIRE(engine.handle(packet, size, client, RequestEngine::TCP, response));
+    Message failed;
+    offset = 0;
+    REQUIRE(failed.unpack(response.data, response.length, offset));
+    CHECK(failed.rcode == Message::CODESERVERFAILURE);
+    CHECK_FALSE(failed.truncation);
+    CHECK(failed.an.empty());
+    CHECK(failed.qd.size() == 1);
+}
@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch_all.hpp>
 #include <cstring>
+#include <sstream>
 #include <arpa/inet.h>
 #include "message.h"
 #include "rr.h"
@@ -14,7 +15,9 @@
 #include "rrptr.h"
 #include "rrsoa.h"
 #include "rrtxt.h"
+#include "acl.h"
 #include "zoneFileLoader.h"
+#include "zoneFileSaver.h"
 #include "zone.h"
 
 // ===== Test A Records =====
@@ -939,3 +942,205 @@ TEST_CASE("Network message with multiple RR types", "[rr][integration][network]"
     CHECK(msg.an[2]->name == "www.test.");
     CHECK(msg.an[2]->ttl == 300);
 }
+
+// ===== Zone file parser =====
+
+TEST_CASE("RRTypeFromString: mnemonics resolve through the perfect hash", "[rr][zonefile]")
+{
+    CHECK(RR::RRTypeFromString("A") == RR::A);
+    CHECK(RR::RRTypeFromString("AAAA") == RR::AAAA);
+    CHECK(RR::RRTypeFromString("MB") == RR::MB);
+    CHECK(RR::RRTypeFromString("MD") == RR::MD);
+    CHECK(RR::RRTypeFromString("MX") == RR::MX);
+    CHECK(RR::RRTypeFromString("MAILA") == RR::MAILA);
+    CHECK(RR::RRTypeFromString("MAILB") == RR::MAILB);
+    CHECK(RR::RRTypeFromString("DYNAMIC") == RR::DYNAMIC);
+    CHECK(RR::RRTypeFromString("STAR") == RR::TYPESTAR);
+    CHECK(RR::RRTypeFromString("RRNULL") == RR::RRUNDEF);
+
+    // Names are case sensitive and must match exactly
+    CHECK(RR::RRTypeFromString("a") == RR::RRUNDEF);
+    CHECK(RR::RRTypeFromString("AA") == RR::RRUNDEF);
+    CHECK(RR::RRTypeFromString("MXX") == RR::RRUNDEF);
+    CHECK(RR::RRTypeFromString("") == RR::RRUNDEF);
+    CHECK(RR::RRTypeFromString(std::string("A\0AA", 4)) == RR::RRUNDEF);
+    CHECK(RR::RRTypeFromString("MX 10", 2) == RR::MX);
+}
+
+TEST_CASE("ZoneFileLoader: buffer and line loading agree", "[zonefile]")
+{
+    std::string text =
+        "$ORIGIN Parse.Test. ; trailing comment\n"
+        "@ 3600 IN SOA ns1 admin.parse.test. 1 3600 1800 604800 300\n"
+        "\t\n"
+        "www\t120  IN  A 192.0.2.1   \n"
+        "    IN AAAA 2001:0db8:0000:0000:0000:0000:0000:0001\n"
+        "mx IN MX 10 mail ! bang comment\n"
+        "txt IN TXT \"two  words\"\n"
+        "last IN CNAME www";   // No final newline
+
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line))
+        lines.push_back(line);
+
+    std::ostringstream log;
+    t_zones from_lines, from_buffer;
+    REQUIRE(ZoneFileLoader::load(lines, from_lines, "", log));
+    REQUIRE(ZoneFileLoader::loadBuffer(text.data(), text.length(), from_buffer, "", log));
+    REQUIRE(from_lines.size() == 1);
+    REQUIRE(from_buffer.size() == 1);
+
+    const std::vector<RR*>& a = from_lines[0]->getAllRecords();
+    const std::vector<RR*>& b = from_buffer[0]->getAllRecords();
+    REQUIRE(a.size() == 6);
+    REQUIRE(b.size() == a.size());
+    for (size_t i = 0; i < a.size(); ++i)
+        CHECK(b[i]->toString() == a[i]->toString());
+
+    CHECK(from_buffer[0]->name == "parse.test.");
+    CHECK(b[1]->name == "www.parse.test.");
+    CHECK(b[1]->ttl == 120);
+    CHECK(b[2]->name == "www.parse.test.");     // Empty owner repeats the previous one
+    CHECK(b[2]->type == RR::AAAA);
+    CHECK(b[3]->rdata == "mail.parse.test.");
+    CHECK(b[4]->rdata == "\"two words\"");
+    CHECK(b[5]->rdata == "www.parse.test.");
+
+    delete from_lines[0];
+    delete from_buffer[0];
+}
+
+TEST_CASE("ZoneFileLoader: record echo is gated by verbosity", "[zonefile]")
+{
+    std::vector<std::string> lines;
+    lines.push_back("$ORIGIN quiet.test.");
+    lines.push_back("$AUTOSAVE no");
+    lines.push_back("www IN A 192.0.2.1");
+    lines.push_back("$TSIG");
+
+    int saved = ZoneFileLoader::verbosity;
+    const int levels[] = { ZoneFileLoader::QUIET, ZoneFileLoader::NORMAL, ZoneFileLoader::VERBOSE };
+    for (int i = 0; i < 3; ++i)
+    {
+        ZoneFileLoader::verbosity = levels[i];
+        std::ostringstream log;
+        t_zones zones;
+        REQUIRE(ZoneFileLoader::load(lines, zones, "", log));
+        // Warnings are always shown
+        CHECK(log.str().find("Warning: Invalid $TSIG") != std::string::npos);
+        CHECK((log.str().find("Auto-save disabled") != std::string::npos) == (levels[i] >= ZoneFileLoader::NORMAL));
+        CHECK((log.str().find("www.quiet.test.") != std::string::npos) == (levels[i] >= ZoneFileLoader::VERBOSE));
+        delete zones[0];
+    }
+    ZoneFileLoader::verbosity = saved;
+}
+
+TEST_CASE("TTLs: units, defaults and $TTL", "[rr][zonefile][ttl]")
+{
+    CHECK(RR::TTLFromString("300", 3) == 300);
+    CHECK(RR::TTLFromString("1h30m", 5) == 5400);
+    CHECK(RR::TTLFromString("2D", 2) == 172800);
+    CHECK(RR::TTLFromString("1w", 2) == 604800);
+    CHECK(RR::TTLFromString("4294967295", 10) == 4294967295UL);
+    CHECK_THROWS_AS(RR::TTLFromString("4294967296", 10), std::out_of_range);
+    CHECK_THROWS_AS(RR::TTLFromString("1h30", 4), std::invalid_argument);
+    CHECK_THROWS_AS(RR::TTLFromString("10x", 3), std::invalid_argument);
+
+    // RR::fromString defaults a missing TTL like the loader does
+    RRA a;
+    std::vector<std::string> tokens;
+    tokens.push_back("www");
+    tokens.push_back("IN");
+    tokens.push_back("A");
+    tokens.push_back("192.0.2.1");
+    a.fromString(tokens, "example.com");
+    CHECK(a.ttl == RR::DEFAULT_TTL);
+
+    t_data zoneData;
+    zoneData.push_back("$ORIGIN ttl.test.");
+    zoneData.push_back("before IN A 192.0.2.1");
+    zoneData.push_back("$TTL 1d");
+    zoneData.push_back("after IN A 192.0.2.2");
+    zoneData.push_back("explicit 60 IN A 192.0.2.3");
+    zoneData.push_back("$ORIGIN other.test.");
+    zoneData.push_back("carried IN A 192.0.2.4");
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(zoneData, zones));
+    REQUIRE(zones.size() == 2);
+
+    std::vector<RR*> records = zones[0]->getAllRecords();
+    REQUIRE(records.size() == 3);
+    CHECK(records[0]->ttl == RR::DEFAULT_TTL);
+    CHECK(records[1]->ttl == 86400);
+    CHECK(records[2]->ttl == 60);
+    // $TTL holds for the rest of the file
+    records = zones[1]->getAllRecords();
+    REQUIRE(records.size() == 1);
+    CHECK(records[0]->ttl == 86400);
+
+    delete zones[0];
+    delete zones[1];
+}
+
+TEST_CASE("TTLs: zones autosaved by older builds", "[rr][zonefile][ttl]")
+{
+    // As builds before $TTL support autosaved them: every TTL 0
+    t_data legacy;
+    legacy.push_back("; Zone file for old.test.");
+    legacy.push_back("; Auto-generated by dnsserver");
+    legacy.push_back("; Last updated: 2026-02-15 00:41:34");
+    legacy.push_back("");
+    legacy.push_back("$ORIGIN old.test.");
+    legacy.push_back("$AUTOSAVE yes");
+    legacy.push_back("old.test. IN SOA ns1.old.test. admin.old.test. 1 3600 1800 604800 86400");
+    legacy.push_back("old.test. 0 IN NS ns1.old.test.");
+    legacy.push_back("www.old.test. 0 IN A 192.0.2.1");
+    legacy.push_back("$ACL 192.0.2.0/24");
+    legacy.push_back("www.old.test. 0 IN A 192.0.2.2");
+
+    std::ostringstream log;
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(legacy, zones, "", log));
+    REQUIRE(zones.size() == 1);
+    CHECK(log.str().find("Warning: old.test was autosaved by an older build") != std::string::npos);
+    std::vector<RR*> records = zones[0]->getAllRecords();
+    REQUIRE(records.size() == 3);
+    CHECK(records[0]->ttl == RR::DEFAULT_TTL);
+    CHECK(records[1]->ttl == ZoneFileLoader::LEGACY_AUTOSAVE_TTL);
+    CHECK(records[2]->ttl == ZoneFileLoader::LEGACY_AUTOSAVE_TTL);
+    Zone* view = zones[0]->acl->findMostSpecificMatch(inet_addr("192.0.2.9"));
+    REQUIRE(view != NULL);
+    CHECK(view->getAllRecords()[0]->ttl == ZoneFileLoader::LEGACY_AUTOSAVE_TTL);
+
+    // Saving writes $TTL, and the file loads with the TTLs it holds
+    std::ostringstream saved;
+    ZoneFileSaver::serialize(zones[0], saved);
+    CHECK(saved.str().find("$TTL 3600\n") != std::string::npos);
+    t_data resaved;
+    std::istringstream lines(saved.str());
+    std::string line;
+    while (std::getline(lines, line))
+        resaved.push_back(line);
+    t_zones reloaded;
+    std::ostringstream quiet;
+    REQUIRE(ZoneFileLoader::load(resaved, reloaded, "", quiet));
+    CHECK(quiet.str().find("older build") == std::string::npos);
+    std::vector<RR*> again = reloaded[0]->getAllRecords();
+    REQUIRE(again.size() == 3);
+    for (size_t i = 0; i < again.size(); ++i)
+        CHECK(again[i]->ttl == records[i]->ttl);
+
+    // Zones written by hand keep their TTL 0
+    t_data manual;
+    manual.push_back("$ORIGIN new.test.");
+    manual.push_back("www 0 IN A 192.0.2.1");
+    t_zones written;
+    REQUIRE(ZoneFileLoader::load(manual, written));
+    CHECK(written[0]->getAllRecords()[0]->ttl == 0);
+
+    delete zones[0];
+    delete reloaded[0];
+    delete written[0];
+}
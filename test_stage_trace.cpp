@@ -0,0 +1,121 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <pthread.h>
+#include "stage_trace.h"
+
+TEST_CASE("Histogram buckets cover every value within precision", "[stage_trace]")
+{
+    typedef StageTrace::Histogram H;
+
+    // Exact below 128 ns
+    for (unsigned long long v = 0; v < 128; ++v)
+    {
+        CHECK(H::highestEquivalent(H::index(v)) == v);
+    }
+
+    int last = -1;
+    for (unsigned long long v = 1; v < H::MAX_VALUE; v += v / 37 + 1)
+    {
+        int i = H::index(v);
+        REQUIRE(i >= 0);
+        REQUIRE(i < H::COUNTS);
+        CHECK(i >= last);
+        last = i;
+        unsigned long long high = H::highestEquivalent(i);
+        CHECK(high >= v);
+        CHECK(high - v <= v / 64);
+    }
+
+    CHECK(H::index(H::MAX_VALUE) == H::COUNTS - 1);
+    CHECK(H::index(~0ULL) == H::COUNTS - 1);
+}
+
+TEST_CASE("Histogram percentiles and summary", "[stage_trace]")
+{
+    StageTrace::Histogram h;
+    CHECK(h.count() == 0);
+    CHECK(h.percentile(50) == 0);
+    CHECK(h.min() == 0);
+
+    for (unsigned long long v = 1; v <= 100000; ++v)
+        h.record(v);
+
+    CHECK(h.count() == 100000);
+    CHECK(h.min() == 1);
+    CHECK(h.max() == 100000);
+    CHECK(h.mean() == 50000.5);
+    CHECK(h.percentile(50) >= 50000);
+    CHECK(h.percentile(50) <= 50000 + 50000 / 64);
+    CHECK(h.percentile(99) >= 99000);
+    CHECK(h.percentile(99) <= 99000 + 99000 / 64);
+    CHECK(h.percentile(100) == 100000);
+
+    h.reset();
+    CHECK(h.count() == 0);
+    CHECK(h.max() == 0);
+}
+
+TEST_CASE("Histogram add merges counts", "[stage_trace]")
+{
+    StageTrace::Histogram a, b;
+    for (int i = 0; i < 90; ++i)
+        a.record(100);
+    for (int i = 0; i < 10; ++i)
+        b.record(1000000);
+    a.add(b);
+
+    CHECK(a.count() == 100);
+    CHECK(a.min() == 100);
+    CHECK(a.max() == 1000000);
+    CHECK(a.percentile(90) == 100);
+    CHECK(a.percentile(95) >= 1000000);
+    CHECK(a.percentile(95) <= 1000000 + 1000000 / 64);
+}
+
+#if STAGE_TRACE
+static void* recordSends(void*)
+{
+    for (int i = 0; i < 1000; ++i)
+        StageTrace::record(StageTrace::SEND, 5000);
+    return NULL;
+}
+
+TEST_CASE("Per-thread histograms are merged on demand", "[stage_trace]")
+{
+    StageTrace::reset();
+
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i)
+        REQUIRE(pthread_create(&threads[i], NULL, recordSends, NULL) == 0);
+    for (int i = 0; i < 4; ++i)
+        pthread_join(threads[i], NULL);
+    StageTrace::record(StageTrace::SEND, 7000);
+
+    StageTrace::Histogram send = StageTrace::merged(StageTrace::SEND);
+    CHECK(send.count() == 4001);
+    CHECK(send.min() == 5000);
+    CHECK(send.max() == 7000);
+    CHECK(StageTrace::merged(StageTrace::RECV).count() == 0);
+
+    std::ostringstream out;
+    StageTrace::dump(out);
+    CHECK(out.str().find("[TRACE] stage=send count=4001") == 0);
+    CHECK(out.str().find("stage=recv") == std::string::npos);
+
+    StageTrace::reset();
+    CHECK(StageTrace::merged(StageTrace::SEND).count() == 0);
+}
+
+TEST_CASE("Timer records elapsed time", "[stage_trace]")
+{
+    StageTrace::reset();
+    {
+        StageTrace::Timer timer(StageTrace::PACK);
+        struct timespec ts = {0, 2000000};
+        nanosleep(&ts, NULL);
+    }
+    StageTrace::Histogram pack = StageTrace::merged(StageTrace::PACK);
+    CHECK(pack.count() == 1);
+    CHECK(pack.min() >= 2000000);
+}
+#endif
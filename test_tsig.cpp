@@ -339,6 +339,58 @@ void test_tsig_key_name_mismatch() {
     cout << "  PASSED" << endl;
 }
 
+void test_tsig_sign_verify_roundtrip() {
+    cout << "Testing TSIG sign, unpack and verify round trip..." << endl;
+    
+    TSIG::Key key;
+    key.name = "testkey.example.com.";
+    key.algorithm = TSIG::HMAC_SHA256;
+    key.secret = "K2tf3TRrmE7TJd+m2NPBuw==";
+    key.decoded_secret = TSIG::base64Decode(key.secret);
+    
+    Message msg;
+    msg.id = 4321;
+    msg.query = true;
+    msg.opcode = Message::UPDATE;
+    msg.authoritative = false;
+    msg.truncation = false;
+    msg.recursiondesired = false;
+    msg.recursionavailable = false;
+    msg.rcode = Message::CODENOERROR;
+    RR* zone = RR::createByType(RR::SOA);
+    zone->name = "example.com.";
+    zone->type = RR::SOA;
+    zone->rrclass = RR::CLASSIN;
+    zone->query = true;
+    msg.qd.push_back(zone);
+    
+    // sign() repacks into a 64 KiB buffer
+    static char raw_buffer[65536];
+    unsigned int raw_len = 0;
+    msg.pack(raw_buffer, sizeof(raw_buffer), raw_len);
+    
+    string error;
+    assert(TSIG::sign(&msg, raw_buffer, raw_len, &key, msg.id, error));
+    
+    // The TSIG record carries its TTL and RDLENGTH on the wire
+    Message received;
+    unsigned int offset = 0;
+    assert(received.unpack(raw_buffer, raw_len, offset));
+    assert(offset == raw_len);
+    assert(received.ar.size() == 1);
+    
+    bool result = TSIG::verify(&received, raw_buffer, raw_len, &key, error);
+    assert(result == true);
+    
+    // A flipped bit in the signed part is caught
+    raw_buffer[13] ^= 0x01;
+    result = TSIG::verify(&received, raw_buffer, raw_len, &key, error);
+    assert(result == false);
+    assert(error == "TSIG signature verification failed");
+    
+    cout << "  PASSED" << endl;
+}
+
 int main() {
     cout << "Running TSIG unit tests..." << endl << endl;
     
@@ -355,6 +407,7 @@ int main() {
         test_tsig_algorithm_mismatch();
         test_tsig_time_check();
         test_tsig_key_name_mismatch();
+        test_tsig_sign_verify_roundtrip();
         
         cout << endl << "All TSIG tests PASSED!" << endl;
         return 0;
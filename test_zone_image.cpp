@@ -0,0 +1,283 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include "zone.h"
+#include "acl.h"
+#include "rr.h"
+#include "rrsoa.h"
+#include "rrmx.h"
+#include "rrdynamic.h"
+#include "zoneFileLoader.h"
+#include "zoneImage.h"
+
+static const char* SOURCE = "test_zone_image.zone";
+
+static void writeSource(const t_data& lines)
+{
+    std::ofstream out(SOURCE);
+    for (size_t i = 0; i < lines.size(); ++i)
+        out << lines[i] << "\n";
+}
+
+static t_data sampleZone()
+{
+    t_data data;
+    data.push_back("$ORIGIN image.test.");
+    data.push_back("$AUTOSAVE yes");
+    data.push_back("$TSIG key.image.test. hmac-sha256 K2tf3TRrmE7TJd+m2NPBuw==");
+    data.push_back("image.test. 3600 IN SOA ns1.image.test. admin.image.test. 7 3600 1800 604800 300");
+    data.push_back("image.test. IN NS ns1.image.test.");
+    data.push_back("image.test. IN MX 10 mail.image.test.");
+    data.push_back("ns1 IN A 192.0.2.1");
+    data.push_back("www 120 IN A 192.0.2.10");
+    data.push_back("www 120 IN A 192.0.2.11");
+    data.push_back("www IN AAAA 2001:0db8:0000:0000:0000:0000:0000:0001");
+    data.push_back("txt IN TXT \"hello world\"");
+    data.push_back("alias IN CNAME www.image.test.");
+    data.push_back("$DYNAMIC _acme-challenge.image.test. /tmp/acme.txt");
+    data.push_back("$ACL 10.0.0.0/8 192.168.0.0/16");
+    data.push_back("www IN A 10.1.1.1");
+    return data;
+}
+
+static void freeZones(t_zones& zones)
+{
+    for (size_t i = 0; i < zones.size(); ++i)
+        delete zones[i];
+    zones.clear();
+}
+
+static std::vector<std::string> recordStrings(const Zone* zone)
+{
+    std::vector<std::string> out;
+    const std::vector<RR*>& rrs = zone->getAllRecords();
+    for (size_t i = 0; i < rrs.size(); ++i)
+        out.push_back(rrs[i]->toString());
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+TEST_CASE("ZoneImage: compile and load preserves zone contents", "[zoneimage]")
+{
+    writeSource(sampleZone());
+
+    t_zones text;
+    REQUIRE(ZoneFileLoader::loadFile(SOURCE, text));
+    REQUIRE(text.size() == 1);
+
+    std::string image_path = ZoneImage::pathFor(SOURCE);
+    std::string error;
+    REQUIRE(ZoneImage::compile(text, SOURCE, image_path, error));
+
+    t_zones loaded;
+    REQUIRE(ZoneImage::load(image_path, SOURCE, loaded, error));
+    REQUIRE(loaded.size() == 1);
+
+    Zone* a = text[0];
+    Zone* b = loaded[0];
+    CHECK(b->name == a->name);
+    CHECK(b->filename == SOURCE);
+    CHECK(b->auto_save);
+    CHECK(recordStrings(b) == recordStrings(a));
+
+    REQUIRE(b->tsig_key != NULL);
+    CHECK(b->tsig_key->name == "key.image.test.");
+    CHECK(b->tsig_key->decoded_secret == a->tsig_key->decoded_secret);
+
+    // Typed fields are rebuilt from wire rdata
+    std::vector<RR*> soa = b->findRecordsByName("image.test.", RR::SOA);
+    REQUIRE(soa.size() == 1);
+    RRSoa* s = dynamic_cast<RRSoa*>(soa[0]);
+    REQUIRE(s != NULL);
+    CHECK(s->serial == 7);
+    CHECK(s->minttl == 300);
+    CHECK(s->ttl == 3600);
+
+    std::vector<RR*> mx = b->findRecordsByName("image.test.", RR::MX);
+    REQUIRE(mx.size() == 1);
+    CHECK(dynamic_cast<RRMX*>(mx[0])->pref == 10);
+    CHECK(mx[0]->rdata == "mail.image.test.");
+
+    std::vector<RR*> dyn = b->findRecordsByName("_acme-challenge.image.test.", RR::DYNAMIC);
+    REQUIRE(dyn.size() == 1);
+    CHECK(dynamic_cast<RRDYNAMIC*>(dyn[0])->filepath == "/tmp/acme.txt");
+
+    // ACL sub-zone keeps both subnets and its own records
+    REQUIRE(b->acl->size() == 2);
+    Zone* view = b->acl->findMostSpecificMatch(inet_addr("10.2.3.4"));
+    REQUIRE(view != NULL);
+    CHECK(view == b->acl->findMostSpecificMatch(inet_addr("192.168.1.1")));
+    CHECK(view->parent == b);
+    CHECK(view->tsig_key != NULL);
+    CHECK(recordStrings(view) == recordStrings(a->acl->findMostSpecificMatch(inet_addr("10.2.3.4"))));
+
+    // Indexes match those built for the text zone, sub-zones' included
+    REQUIRE(b->nameIndex().valid());
+    REQUIRE(b->nameTree().valid());
+    CHECK(b->nameTree().size() == a->nameTree().size());
+    for (size_t k = 1; k < b->nameIndex().size(); ++k)
+    {
+        const std::string& before = NameTable::global().wire(b->records().nameId(b->nameIndex()[k - 1]));
+        const std::string& after = NameTable::global().wire(b->records().nameId(b->nameIndex()[k]));
+        CHECK(dns_wire_canonical_compare(before.data(), before.length(), after.data(), after.length()) <= 0);
+    }
+    for (size_t i = 0; i < b->nameTree().size(); ++i)
+        CHECK(b->nameTree().node((uint32_t)i).below > 0);
+    CHECK(b->nameTree().node(0).below == b->records().size());
+    CHECK(view->nameIndex().valid());
+    CHECK(view->nameTree().node(0).below == view->records().size());
+
+    freeZones(text);
+    freeZones(loaded);
+    remove(image_path.c_str());
+    remove(SOURCE);
+}
+
+TEST_CASE("ZoneImage: index lookups", "[zoneimage]")
+{
+    writeSource(sampleZone());
+
+    t_zones text;
+    REQUIRE(ZoneFileLoader::loadFile(SOURCE, text));
+    std::string image_path = ZoneImage::pathFor(SOURCE);
+    std::string error;
+    REQUIRE(ZoneImage::compile(text, SOURCE, image_path, error));
+
+    ZoneImage::Mapping image;
+    REQUIRE(image.open(image_path, error));
+    CHECK(image.header().zone_count == 2);
+
+    uint32_t name_index;
+    REQUIRE(image.findName("WWW.Image.Test.", name_index));
+    CHECK(image.nameText(name_index) == "www.image.test.");
+    CHECK_FALSE(image.findName("nope.image.test.", name_index));
+
+    REQUIRE(image.findName("www.image.test.", name_index));
+    uint32_t rrset_index;
+    REQUIRE(image.findRRset(0, name_index, RR::A, RR::CLASSIN, rrset_index));
+    CHECK(image.rrset(rrset_index).rdata_count == 2);
+    CHECK(image.rdata(image.rrset(rrset_index).first_rdata).ttl == 120);
+    REQUIRE(image.findRRset(1, name_index, RR::A, RR::CLASSIN, rrset_index));
+    CHECK(image.rrset(rrset_index).rdata_count == 1);
+    CHECK_FALSE(image.findRRset(0, name_index, RR::MX, RR::CLASSIN, rrset_index));
+
+    // Names are stored in canonical order
+    for (uint32_t i = 1; i < image.header().name_count; ++i)
+        CHECK(ZoneImage::canonicalKey(image.nameText(i - 1)) < ZoneImage::canonicalKey(image.nameText(i)));
+
+    image.close();
+    freeZones(text);
+    remove(image_path.c_str());
+    remove(SOURCE);
+}
+
+TEST_CASE("ZoneImage: stale or corrupt images are rejected", "[zoneimage]")
+{
+    writeSource(sampleZone());
+
+    t_zones text;
+    REQUIRE(ZoneFileLoader::loadFile(SOURCE, text));
+    std::string image_path = ZoneImage::pathFor(SOURCE);
+    std::string error;
+    REQUIRE(ZoneImage::compile(text, SOURCE, image_path, error));
+    freeZones(text);
+
+    SECTION("source modified after compile")
+    {
+        t_data data = sampleZone();
+        data.push_back("extra IN A 192.0.2.99");
+        writeSource(data);
+
+        t_zones loaded;
+        CHECK_FALSE(ZoneImage::load(image_path, SOURCE, loaded, error));
+        CHECK(error == "image is stale");
+        CHECK(loaded.empty());
+    }
+
+    SECTION("bad magic")
+    {
+        std::fstream f(image_path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        f.write("XXXX", 4);
+        f.close();
+
+        t_zones loaded;
+        CHECK_FALSE(ZoneImage::load(image_path, SOURCE, loaded, error));
+        CHECK(error == "not a zone image");
+    }
+
+    SECTION("malformed rdata")
+    {
+        // A compression pointer where the CNAME target's first label starts
+        uint64_t offset;
+        {
+            ZoneImage::Mapping image;
+            REQUIRE(image.open(image_path, error));
+            uint32_t name, rrset;
+            REQUIRE(image.findName("alias.image.test.", name));
+            REQUIRE(image.findRRset(0, name, RR::CNAME, RR::CLASSIN, rrset));
+            const ZoneImage::RdataEntry& rdata = image.rdata(image.rrset(rrset).first_rdata);
+            offset = image.header().blob_offset + rdata.rdata.offset;
+        }
+        std::fstream f(image_path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(offset);
+        f.write("\xc0", 1);
+        f.close();
+
+        t_zones loaded;
+        CHECK_FALSE(ZoneImage::load(image_path, SOURCE, loaded, error));
+        CHECK(error == "corrupt rdata table");
+        CHECK(loaded.empty());
+    }
+
+    SECTION("truncated")
+    {
+        REQUIRE(truncate(image_path.c_str(), 200) == 0);
+
+        t_zones loaded;
+        CHECK_FALSE(ZoneImage::load(image_path, SOURCE, loaded, error));
+        CHECK(loaded.empty());
+    }
+
+    remove(image_path.c_str());
+    remove(SOURCE);
+}
+
+TEST_CASE("RR: wire rdata adapters round trip", "[zoneimage][rr]")
+{
+    t_data data;
+    data.push_back("$ORIGIN rt.test.");
+    data.push_back("rt.test. IN SOA ns.rt.test. hostmaster.rt.test. 42 1 2 3 4");
+    data.push_back("rt.test. IN MX 5 mx.rt.test.");
+    data.push_back("ptr IN PTR host.rt.test.");
+    data.push_back("txt IN TXT \"v=spf1 -all\"");
+    data.push_back("dh IN DHCID AAIBY2/AuCccgoJbsaxcQc9TUapptP69lOjxfNuVAA2kjEA=");
+
+    t_zones zones;
+    REQUIRE(ZoneFileLoader::load(data, zones));
+    const std::vector<RR*>& rrs = zones[0]->getAllRecords();
+    for (size_t i = 0; i < rrs.size(); ++i)
+    {
+        std::string wire;
+        rrs[i]->packRdata(wire);
+
+        RR* copy = RR::createByType(rrs[i]->type);
+        copy->name = rrs[i]->name;
+        copy->type = rrs[i]->type;
+        copy->rrclass = rrs[i]->rrclass;
+        copy->ttl = rrs[i]->ttl;
+        copy->query = false;
+        REQUIRE(copy->unpackRdata(wire.data(), (unsigned int)wire.length()));
+        CHECK(copy->toString() == rrs[i]->toString());
+
+        // packRdata output is exactly what pack() puts on the wire
+        char packet[512];
+        unsigned int offset = 0;
+        rrs[i]->pack(packet, sizeof(packet), offset);
+        CHECK(std::string(packet + offset - wire.length(), wire.length()) == wire);
+        delete copy;
+    }
+    freeZones(zones);
+}
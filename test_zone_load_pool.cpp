@@ -0,0 +1,123 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "zone.h"
+#include "zoneFileLoader.h"
+#include "zoneLoadPool.h"
+
+static std::vector<std::string> writeZoneFiles(int count)
+{
+    std::vector<std::string> files;
+    for (int i = 0; i < count; ++i)
+    {
+        std::ostringstream path, origin;
+        path << "test_zone_load_pool_" << i << ".zone";
+        origin << "pool" << i << ".test.";
+
+        std::ofstream out(path.str().c_str());
+        out << "$ORIGIN " << origin.str() << "\n";
+        out << "@ IN SOA ns1." << origin.str() << " admin." << origin.str() << " 1 3600 1800 604800 300\n";
+        for (int r = 0; r < 50; ++r)
+            out << "host" << r << " IN A 192.0.2." << (r + 1) << "\n";
+        files.push_back(path.str());
+    }
+    return files;
+}
+
+static void removeFiles(const std::vector<std::string>& files)
+{
+    for (size_t i = 0; i < files.size(); ++i)
+        remove(files[i].c_str());
+}
+
+static bool loadText(const std::string& path, t_zones& zones, std::ostream& log)
+{
+    return ZoneFileLoader::loadFile(path, zones, log);
+}
+
+static bool throwingLoader(const std::string& path, t_zones& zones, std::ostream& log)
+{
+    if (path == "throw")
+        throw std::runtime_error("boom");
+    return loadText(path, zones, log);
+}
+
+static void freeResults(std::vector<ZoneLoadPool::Result>& results)
+{
+    for (size_t i = 0; i < results.size(); ++i)
+        for (size_t z = 0; z < results[i].zones.size(); ++z)
+            delete results[i].zones[z];
+}
+
+TEST_CASE("ZoneLoadPool: results follow file order for any thread count", "[zoneloadpool]")
+{
+    std::vector<std::string> files = writeZoneFiles(12);
+    int saved_verbosity = ZoneFileLoader::verbosity;
+    ZoneFileLoader::verbosity = ZoneFileLoader::VERBOSE;  // Echo records so every log is non-empty
+
+    unsigned int thread_counts[] = { 1, 3, 8, 32 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t)
+    {
+        std::vector<ZoneLoadPool::Result> results;
+        ZoneLoadPool::loadAll(files, loadText, results, thread_counts[t]);
+
+        REQUIRE(results.size() == files.size());
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            std::ostringstream origin;
+            origin << "pool" << i << ".test.";
+            CHECK(results[i].ok);
+            REQUIRE(results[i].zones.size() == 1);
+            CHECK(results[i].zones[0]->name == origin.str());
+            CHECK(results[i].zones[0]->getAllRecords().size() == 51);
+            CHECK(results[i].zones[0]->filename == files[i]);
+            // Diagnostics are kept per file, never interleaved
+            CHECK(results[i].log.find(origin.str()) != std::string::npos);
+            for (size_t j = 0; j < files.size(); ++j)
+            {
+                std::ostringstream other;
+                other << "[pool" << j << ".test.]";
+                if (j != i)
+                    CHECK(results[i].log.find(other.str()) == std::string::npos);
+            }
+        }
+        freeResults(results);
+    }
+
+    ZoneFileLoader::verbosity = saved_verbosity;
+    removeFiles(files);
+}
+
+TEST_CASE("ZoneLoadPool: per-file failures are isolated", "[zoneloadpool]")
+{
+    std::vector<std::string> files = writeZoneFiles(2);
+    files.insert(files.begin() + 1, "test_zone_load_pool_missing.zone");
+    files.push_back("throw");
+
+    std::vector<ZoneLoadPool::Result> results;
+    ZoneLoadPool::loadAll(files, throwingLoader, results, 4);
+
+    REQUIRE(results.size() == 4);
+    CHECK(results[0].ok);
+    CHECK_FALSE(results[1].ok);
+    CHECK(results[1].zones.empty());
+    CHECK(results[1].log.find("Cannot open zone file: test_zone_load_pool_missing.zone") != std::string::npos);
+    CHECK(results[2].ok);
+    CHECK_FALSE(results[3].ok);
+    CHECK(results[3].log.find("boom") != std::string::npos);
+
+    freeResults(results);
+    files.pop_back();
+    removeFiles(files);
+}
+
+TEST_CASE("ZoneLoadPool: empty file list", "[zoneloadpool]")
+{
+    std::vector<std::string> files;
+    std::vector<ZoneLoadPool::Result> results;
+    ZoneLoadPool::loadAll(files, loadText, results);
+    CHECK(results.empty());
+}
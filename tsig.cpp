@@ -271,7 +271,8 @@ bool TSIG::verify(const Message* msg,
     }
     
     // Check key name matches
-    if (dns_name_tolower(tsig->name) != dns_name_tolower(key->name)) {
+    if (tsig->name.length() != key->name.length() ||
+        !dns_ascii_equal_nocase(tsig->name.data(), key->name.data(), key->name.length())) {
         error = "TSIG key name mismatch";
         return false;
     }
@@ -326,6 +327,7 @@ bool TSIG::sign(Message* msg,
     tsig->type = RR::TSIG;
     tsig->rrclass = RR::CLASSANY;
     tsig->ttl = 0;
+    tsig->query = false;
     tsig->algorithm = algorithmToName(key->algorithm);
     tsig->setTimeSigned(time(NULL));
     tsig->fudge = 300;
@@ -345,7 +347,8 @@ bool TSIG::sign(Message* msg,
     
     // Repack message with TSIG
     unsigned int new_offset = 0;
-    msg->pack(raw_message, 65536, new_offset);
+    if (!msg->pack(raw_message, 65536, new_offset))
+        return false;
     raw_length = new_offset;
     
     return true;
@@ -7,7 +7,7 @@ Message::RCode UpdateProcessor::checkPrerequisites(const Message* request,
                                          Zone& zone,
                                          string& error_message)
 {
-    for (vector<RR*>::const_iterator iter = request->an.begin(); iter != request->an.end(); ++iter)
+    for (Message::t_section::const_iterator iter = request->an.begin(); iter != request->an.end(); ++iter)
     {
         RR *prereq = *iter;
         
@@ -64,7 +64,7 @@ bool UpdateProcessor::applyUpdates(const Message* request,
 {
     bool zone_modified = false;
     
-    for (vector<RR*>::const_iterator iter = request->ns.begin(); iter != request->ns.end(); ++iter)
+    for (Message::t_section::const_iterator iter = request->ns.begin(); iter != request->ns.end(); ++iter)
     {
         RR *update = *iter;
         
@@ -85,9 +85,8 @@ bool UpdateProcessor::applyUpdates(const Message* request,
         }
         else if (update->rrclass == RR::CLASSIN)
         {
-            // Add RR
-            RR *new_rr = update->clone();
-            zone.addRecord(new_rr);
+            // Add RR (the zone keeps a compact copy)
+            zone.addRecord(*update);
             zone_modified = true;
         }
     }
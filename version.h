@@ -0,0 +1,9 @@
+#ifndef VERSION_H
+#define VERSION_H
+#define GIT_HASH "e7dc0c6"
+#define GIT_BRANCH "master"
+#define BUILD_DATE "2026-10-19 00:41:38"
+#define VERSION "master-e7dc0c6 (built 2026-10-19 00:41:38)"
+#define BUILD_COMPILER "g++ (Debian 12.2.0-14+deb12u1) 12.2.0"
+#define BUILD_FLAGS "-Wall -Wextra -std=c++14 -g -DLINUX"
+#endif
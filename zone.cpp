@@ -2,35 +2,108 @@
 #include "acl.h"
 #include "rr.h"
 #include "rrsoa.h"
+#include "mutex_guard.h"
 #include <algorithm>
 
 using namespace std;
 
-Zone::Zone() : auto_save(false), modified(false), acl(NULL), tsig_key(NULL), parent(NULL)
+Zone::Zone() : auto_save(false), modified(false), acl(NULL), tsig_key(NULL), parent(NULL),
+               view_valid_(false)
 {
 	acl = new Acl();
+	pthread_mutex_init(&view_mutex_, NULL);
 }
 
 Zone::~Zone()
 {
+	invalidateView();
+	pthread_mutex_destroy(&view_mutex_);
 	delete acl;
 	delete tsig_key;
 }
 
+void Zone::invalidateView()
+{
+    MutexGuard<pthread_mutex_t> guard(&view_mutex_);
+    if (!view_valid_)
+        return;
+    
+    for (vector<RR*>::iterator it = view_.begin(); it != view_.end(); ++it)
+        delete *it;
+    view_.clear();
+    view_valid_ = false;
+}
+
+const vector<RR*>& Zone::getAllRecords() const
+{
+    MutexGuard<pthread_mutex_t> guard(&view_mutex_);
+    if (!view_valid_)
+    {
+        // Zone-owned, so never from a request's arena
+        Arena::Suspend suspend;
+        view_.reserve(records_.size());
+        for (size_t i = 0; i < records_.size(); ++i)
+            view_.push_back(records_.materialize(i));
+        view_valid_ = true;
+    }
+    return view_;
+}
+
 vector<RR*> Zone::findRecordsByName(const string& name, RR::RRType type) const
+{
+    return findRecordsByName(NameTable::global().find(name), type);
+}
+
+vector<RR*> Zone::findRecordsByName(t_name_id name_id, RR::RRType type) const
 {
     vector<RR*> matches;
+    if (name_id == NameTable::NOT_FOUND)
+        return matches;
     
-    for (vector<RR*>::const_iterator it = rrs.begin(); it != rrs.end(); ++it)
+    const vector<RR*>& rrs = getAllRecords();
+    size_t first, last;
+    ownerRange(name_id, first, last);
+    for (size_t k = first; k < last; ++k)
     {
-        RR* rr = *it;
-        
-        if (rr->name == name)
+        size_t i = recordAt(k);
+        if (records_.nameId(i) == name_id &&
+            (type == RR::RRUNDEF || records_.type(i) == type))
         {
-            if (type == RR::RRUNDEF || rr->type == type)
-            {
-                matches.push_back(rr);
-            }
+            matches.push_back(rrs[i]);
+        }
+    }
+    
+    return matches;
+}
+
+void Zone::ownerRange(t_name_id name_id, size_t& first, size_t& last) const
+{
+    if (name_id == NameTable::NOT_FOUND)
+    {
+        first = last = 0;  // Nothing is owned by a name never interned
+        return;
+    }
+    if (name_index_.valid() && name_id != NameTable::UNRESOLVED)
+    {
+        name_index_.owner(records_, name_id, first, last);
+        return;
+    }
+    first = 0;
+    last = records_.size();
+}
+
+vector<RR*> Zone::materializeRecords(t_name_id name_id, RR::RRType type) const
+{
+    vector<RR*> matches;
+    size_t first, last;
+    ownerRange(name_id, first, last);
+    for (size_t k = first; k < last; ++k)
+    {
+        size_t i = recordAt(k);
+        if (records_.nameId(i) == name_id &&
+            (type == RR::RRUNDEF || records_.type(i) == type))
+        {
+            matches.push_back(records_.materialize(i));
         }
     }
     
@@ -39,11 +112,15 @@ vector<RR*> Zone::findRecordsByName(const string& name, RR::RRType type) const
 
 bool Zone::hasRecordWithName(const string& name) const
 {
-    for (vector<RR*>::const_iterator it = rrs.begin(); it != rrs.end(); ++it)
+    t_name_id name_id = NameTable::global().find(name);
+    if (name_id == NameTable::NOT_FOUND)
+        return false;
+    
+    size_t first, last;
+    ownerRange(name_id, first, last);
+    for (size_t k = first; k < last; ++k)
     {
-        RR* rr = *it;
-        
-        if (rr->name == name)
+        if (records_.nameId(recordAt(k)) == name_id)
             return true;
     }
     
@@ -52,63 +129,118 @@ bool Zone::hasRecordWithName(const string& name) const
 
 bool Zone::hasRecordWithNameAndType(const string& name, RR::RRType type) const
 {
-    for (vector<RR*>::const_iterator it = rrs.begin(); it != rrs.end(); ++it)
+    t_name_id name_id = NameTable::global().find(name);
+    if (name_id == NameTable::NOT_FOUND)
+        return false;
+    
+    size_t first, last;
+    ownerRange(name_id, first, last);
+    for (size_t k = first; k < last; ++k)
     {
-        RR* rr = *it;
-        
-        if (rr->name == name && rr->type == type)
+        size_t i = recordAt(k);
+        if (records_.nameId(i) == name_id && records_.type(i) == type)
             return true;
     }
     
     return false;
 }
 
+void Zone::addRecord(const RR& record)
+{
+    records_.add(record);
+    name_index_.added(records_);
+    name_tree_.added(records_.nameId(records_.size() - 1), record.type);
+    invalidateView();
+}
+
 void Zone::addRecord(RR* record)
 {
-    rrs.push_back(record);
+    addRecord(*record);
+    delete record;
+}
+
+void Zone::addRecord(t_name_id name, RR::RRType type, RR::RRClass rrclass, uint32_t ttl,
+                     const char* rdata, size_t length)
+{
+    records_.add(name, type, rrclass, ttl, rdata, length);
+    name_index_.added(records_);
+    name_tree_.added(name, type);
+    invalidateView();
 }
 
 int Zone::removeRecords(const string& name, RR::RRType type, const string& rdata)
 {
     int removed_count = 0;
+    t_name_id name_id = NameTable::global().find(name);
+    if (name_id == NameTable::NOT_FOUND)
+        return 0;
     
-    vector<RR*>::iterator it = rrs.begin();
-    while (it != rrs.end())
+    size_t i = 0;
+    while (i < records_.size())
     {
-        RR* rr = *it;
+        bool name_matches = (records_.nameId(i) == name_id);
+        bool type_matches = (type == RR::RRUNDEF || records_.type(i) == type);
+        bool rdata_matches = rdata.empty();
         
-        bool name_matches = (rr->name == name);
-        bool type_matches = (type == RR::RRUNDEF || rr->type == type);
-        bool rdata_matches = (rdata.empty() || rr->rdata == rdata);
+        if (name_matches && type_matches && !rdata_matches)
+        {
+            // rdata is given in RR::rdata form, which differs from the
+            // stored wire form for some types
+            RR* rr = records_.materialize(i);
+            rdata_matches = (rr->rdata == rdata);
+            delete rr;
+        }
         
         if (name_matches && type_matches && rdata_matches)
         {
-            delete rr;
-            it = rrs.erase(it);
+            name_tree_.removed(records_.nameId(i), records_.type(i));
+            records_.remove(i);
+            name_index_.removed(i);
             removed_count++;
         }
         else
         {
-            ++it;
+            ++i;
         }
     }
     
+    if (removed_count)
+        invalidateView();
     return removed_count;
 }
 
+void Zone::shrinkToFit()
+{
+    records_.shrink();
+    name_index_.build(records_);
+    name_tree_.build(records_, name_index_);
+    
+    const vector<Acl::AclEntry>& entries = acl->getEntries();
+    for (vector<Acl::AclEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (it->zone && it->zone != this)
+        {
+            it->zone->records_.shrink();
+            it->zone->name_index_.build(it->zone->records_);
+            it->zone->name_tree_.build(it->zone->records_, it->zone->name_index_);
+        }
+    }
+}
+
 bool Zone::incrementSerial()
 {
-    for (vector<RR*>::iterator it = rrs.begin(); it != rrs.end(); ++it)
+    for (size_t i = 0; i < records_.size(); ++i)
     {
-        RR* rr = *it;
-        if (rr->type == RR::SOA)
+        if (records_.type(i) == RR::SOA)
         {
-            RRSoa* soa = dynamic_cast<RRSoa*>(rr);
-            if (soa)
-            {
-                soa->serial++;
-                return true;
-            }
+            RRSoa* soa = static_cast<RRSoa*>(records_.materialize(i));
+            soa->serial++;
+            string wire;
+            soa->packRdata(wire);
+            records_.setRdata(i, wire);
+            delete soa;
+            invalidateView();
+            return true;
         }
     }
     
@@ -3,8 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <pthread.h>
 #include "rr.h"
 #include "tsig.h"
+#include "record_store.h"
+#include "name_index.h"
+#include "name_tree.h"
 
 class Acl;
 
@@ -22,23 +26,63 @@ public:
 	Zone();
 	~Zone();
 	
-	// Record operations
-	std::vector<RR*> findRecordsByName(const std::string& name, 
-	                                   RR::RRType type = RR::RRUNDEF) const;
+	// Record operations. Names are compared by their interned ID, so
+	// lookups are case-insensitive.
+	const RecordStore& records() const { return records_; }
+	// records() in canonical name order; valid once shrinkToFit() ran
+	const NameIndex& nameIndex() const { return name_index_; }
+	// Owner names as a label tree, for wildcard synthesis; valid likewise
+	const NameTree& nameTree() const { return name_tree_; }
+	// Positions [first, last), read through recordAt(), that hold every
+	// record of `name_id`: its own range of nameIndex() once that is
+	// built, else the whole zone, in which callers still compare names.
+	// Empty for NameTable::NOT_FOUND.
+	void ownerRange(t_name_id name_id, size_t& first, size_t& last) const;
+	size_t recordAt(size_t k) const { return name_index_.valid() ? name_index_[k] : k; }
 	bool hasRecordWithName(const std::string& name) const;
 	bool hasRecordWithNameAndType(const std::string& name, RR::RRType type) const;
-	void addRecord(RR* record);
+	void addRecord(const RR& record);
+	void addRecord(RR* record);  // Stores a copy and deletes `record`
+	void addRecord(t_name_id name, RR::RRType type, RR::RRClass rrclass, uint32_t ttl,
+	               const char* rdata, size_t length);  // rdata in wire form
 	int removeRecords(const std::string& name, 
 	                  RR::RRType type = RR::RRUNDEF,
 	                  const std::string& rdata = "");
-	const std::vector<RR*>& getAllRecords() const { return rrs; }
+	void shrinkToFit();  // Once loaded: compacts, builds nameIndex() and nameTree(); includes ACL sub-zones
+	void reserveRecords(size_t records, size_t rdata_bytes) { records_.reserve(records, rdata_bytes); }
+	
+	// New RR objects for the matching records; the caller deletes them
+	// (inside a request they come from, and go back to, the Arena)
+	std::vector<RR*> materializeRecords(t_name_id name_id, RR::RRType type = RR::RRUNDEF) const;
+	
+	// RR objects for the whole zone, owned by the zone. They are built on
+	// first use, under a lock so concurrent readers build them once, and
+	// freed when the zone changes: the caller must not hold them across a
+	// change. Meant for tools and tests: the server reads records() so it
+	// never holds a second copy.
+	const std::vector<RR*>& getAllRecords() const;
+	std::vector<RR*> findRecordsByName(const std::string& name, 
+	                                   RR::RRType type = RR::RRUNDEF) const;
+	std::vector<RR*> findRecordsByName(t_name_id name_id,
+	                                   RR::RRType type = RR::RRUNDEF) const;
 	
 	// Update tracking
 	void recordUpdate();  // Increment serial and mark as modified (marks parent if ACL zone)
 	void clearModified() { modified = false; }
 
 private:
-	std::vector<RR *> rrs;
+	Zone(const Zone&);
+	Zone& operator=(const Zone&);
+	
+	RecordStore records_;
+	NameIndex name_index_;
+	NameTree name_tree_;
+	
+	// Materialized view for getAllRecords()
+	mutable std::vector<RR*> view_;
+	mutable bool view_valid_;
+	mutable pthread_mutex_t view_mutex_;
+	void invalidateView();
 	
 	// SOA serial management (internal)
 	bool incrementSerial();
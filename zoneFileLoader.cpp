@@ -6,263 +6,344 @@
 #include "rrdynamic.h"
 #include "tsig.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#ifdef LINUX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-std::string ZoneFileLoader::stripComments(const std::string& line)
+int ZoneFileLoader::verbosity = ZoneFileLoader::NORMAL;
+const unsigned long ZoneFileLoader::LEGACY_AUTOSAVE_TTL;
+
+// The header line ZoneFileSaver writes, old builds included
+static const char GENERATED_HEADER[] = "; Auto-generated by dnsserver";
+
+const char* ZoneFileLoader::commentStart(const char* begin, const char* end)
 {
-	std::string result = line;
 	// Strip both ! and ; style comments
-	std::string::size_type cmtpos = result.find(';');
-	if (cmtpos == std::string::npos)
-		cmtpos = result.find('!');
-	if (cmtpos != std::string::npos)
-		result.erase(cmtpos);
-	return result;
+	const char* cmt = (const char*)memchr(begin, ';', end - begin);
+	if (cmt == NULL)
+		cmt = (const char*)memchr(begin, '!', end - begin);
+	return cmt ? cmt : end;
 }
 
-std::vector<std::string> ZoneFileLoader::tokenize(const std::string& line)
+void ZoneFileLoader::tokenize(const char* begin, const char* end, t_tokens& tokens)
 {
-	std::vector<std::string> tokens;
-	std::string remaining = line;
-	
-	while (remaining.length() != 0)
-	{
-		std::string::size_type seppos = remaining.find_first_of(" \t");
-		tokens.push_back(remaining.substr(0, seppos));
-		std::string::size_type nextpos = remaining.find_first_not_of(" \t", seppos);
-		remaining.erase(0, nextpos);
-	}
-	
-	return tokens;
+	tokens.clear();
+
+	// A leading separator yields an empty first token ("same owner as
+	// the previous record"); trailing separators yield nothing.
+	const char* p = begin;
+	while (p != end)
+	{
+		const char* q = p;
+		while (q != end && *q != ' ' && *q != '\t')
+			++q;
+		Token token = { p, (size_t)(q - p) };
+		tokens.push_back(token);
+		while (q != end && (*q == ' ' || *q == '\t'))
+			++q;
+		p = q;
+	}
 }
 
-void ZoneFileLoader::handleOrigin(const std::vector<std::string>& tokens, Zone*& parent, Zone*& current, t_zones& zones, std::string& previousName)
+void ZoneFileLoader::setCurrent(State& state, Zone* zone)
 {
-	if (parent != NULL)
+	state.current = zone;
+	// Get origin without trailing dot for fromString processing
+	state.origin = normalize_dns_name(zone->name);
+}
+
+void ZoneFileLoader::handleOrigin(const t_tokens& tokens, State& state, t_zones& zones)
+{
+	if (state.parent != NULL)
 	{
-		zones.push_back(parent);
-		parent = NULL;
+		zones.push_back(state.parent);
+		state.parent = NULL;
 	}
 	Zone* z = new Zone();
-	parent = z;
-	z->name = dns_name_tolower(tokens[1]);
-	current = z;
-	previousName.clear();
+	state.parent = z;
+	z->name = dns_name_tolower(tokens[1].str());
+	setCurrent(state, z);
+	state.previousName.clear();
 }
 
-void ZoneFileLoader::handleAutoSave(const std::vector<std::string>& tokens, Zone* parent)
+void ZoneFileLoader::handleAutoSave(const t_tokens& tokens, Zone* parent, std::ostream& log)
 {
 	if (!parent)
 	{
-		std::cerr << "Warning: $AUTOSAVE must come after $ORIGIN" << std::endl;
+		log << "Warning: $AUTOSAVE must come after $ORIGIN" << std::endl;
 		return;
 	}
-	
+
 	// $AUTOSAVE [yes|no] (default: yes if present)
-	if (tokens.size() < 2 || tokens[1] == "yes" || tokens[1] == "YES" || tokens[1] == "1")
+	if (tokens.size() < 2 || tokens[1].equals("yes") || tokens[1].equals("YES") || tokens[1].equals("1"))
 	{
 		parent->auto_save = true;
-		std::cerr << "[" << parent->name << "] Auto-save enabled" << std::endl;
+		if (verbosity >= NORMAL)
+			log << "[" << parent->name << "] Auto-save enabled" << std::endl;
 	}
 	else
 	{
 		parent->auto_save = false;
-		std::cerr << "[" << parent->name << "] Auto-save disabled" << std::endl;
+		if (verbosity >= NORMAL)
+			log << "[" << parent->name << "] Auto-save disabled" << std::endl;
 	}
 }
 
-void ZoneFileLoader::handleACL(const std::vector<std::string>& tokens, Zone* parent, Zone*& current)
-{
-Zone* acl = new Zone();
-acl->name = parent->name;
-acl->parent = parent;  // Set parent pointer for ACL sub-zone
-// Copy TSIG key from parent to ACL zone
-if (parent->tsig_key) {
-std::cerr << "[" << parent->name << "] Copying TSIG key to ACL zone" << std::endl;
-acl->tsig_key = new TSIG::Key(*parent->tsig_key);
-}
-for (std::string::size_type i = 1; i < tokens.size(); ++i)
+void ZoneFileLoader::handleACL(const t_tokens& tokens, State& state, std::ostream& log)
 {
-parent->acl->addSubnet(tokens[i], acl);
-}
-current = acl;
+	Zone* parent = state.parent;
+	if (!parent)
+	{
+		log << "Warning: $ACL must come after $ORIGIN" << std::endl;
+		return;
+	}
+
+	Zone* acl = new Zone();
+	acl->name = parent->name;
+	acl->parent = parent;  // Set parent pointer for ACL sub-zone
+	// Copy TSIG key from parent to ACL zone
+	if (parent->tsig_key) {
+		if (verbosity >= NORMAL)
+			log << "[" << parent->name << "] Copying TSIG key to ACL zone" << std::endl;
+		acl->tsig_key = new TSIG::Key(*parent->tsig_key);
+	}
+	for (t_tokens::size_type i = 1; i < tokens.size(); ++i)
+	{
+		parent->acl->addSubnet(tokens[i].str(), acl);
+	}
+	setCurrent(state, acl);
 }
 
-void ZoneFileLoader::handleTSIG(const std::vector<std::string>& tokens, Zone* parent)
+void ZoneFileLoader::handleTSIG(const t_tokens& tokens, Zone* parent, std::ostream& log)
 {
 	// $TSIG keyname algorithm secret
 	// Example: $TSIG mykey.example.com. hmac-sha256 K2tf3TRrmE7TJd+m2NPBuw==
 	if (tokens.size() < 4)
 	{
-		std::cerr << "Warning: Invalid $TSIG directive (needs: keyname algorithm secret)" << std::endl;
+		log << "Warning: Invalid $TSIG directive (needs: keyname algorithm secret)" << std::endl;
 		return;
 	}
-	
+
 	if (!parent)
 	{
-		std::cerr << "Warning: $TSIG must come after $ORIGIN" << std::endl;
+		log << "Warning: $TSIG must come after $ORIGIN" << std::endl;
 		return;
 	}
-	
+
 	TSIG::Key* key = new TSIG::Key();
-	key->name = dns_name_tolower(tokens[1]);
-	
+	key->name = dns_name_tolower(tokens[1].str());
+
 	// Ensure key name has trailing dot
 	if (!key->name.empty() && key->name[key->name.length()-1] != '.')
 		key->name += ".";
-	
-	key->algorithm = TSIG::algorithmFromName(tokens[2]);
-	key->secret = tokens[3];
-	key->decoded_secret = TSIG::base64Decode(tokens[3]);
-	
+
+	key->algorithm = TSIG::algorithmFromName(tokens[2].str());
+	key->secret = tokens[3].str();
+	key->decoded_secret = TSIG::base64Decode(key->secret);
+
 	parent->tsig_key = key;
-	
-	std::cerr << "[" << parent->name << "] TSIG key configured: " << key->name 
-	          << " (" << TSIG::algorithmToName(key->algorithm) << ")" << std::endl;
+
+	if (verbosity >= NORMAL)
+		log << "[" << parent->name << "] TSIG key configured: " << key->name
+		    << " (" << TSIG::algorithmToName(key->algorithm) << ")" << std::endl;
 }
 
-void ZoneFileLoader::handleDynamic(const std::vector<std::string>& tokens, Zone* current)
+void ZoneFileLoader::handleDynamic(const t_tokens& tokens, State& state, std::ostream& log)
 {
-	// $DYNAMIC name filepath
+	// $DYNAMIC name filepath [ttl]
 	// Example: $DYNAMIC _acme-challenge.example.com. /var/acme/challenge.txt
 	if (tokens.size() < 3)
 	{
-		std::cerr << "Warning: Invalid $DYNAMIC directive (needs: name filepath)" << std::endl;
+		log << "Warning: Invalid $DYNAMIC directive (needs: name filepath [ttl])" << std::endl;
 		return;
 	}
-	
-	if (!current)
+
+	if (!state.current)
 	{
-		std::cerr << "Warning: $DYNAMIC must come after $ORIGIN" << std::endl;
+		log << "Warning: $DYNAMIC must come after $ORIGIN" << std::endl;
 		return;
 	}
-	
+
 	RRDYNAMIC* rr = new RRDYNAMIC();
-	
+
 	// Process the name with current origin
-	std::string origin = normalize_dns_name(current->name);
-	rr->name = process_domain_name(tokens[1], origin);
-	rr->ttl = 1;  // Short TTL for dynamic records
+	rr->name = process_domain_name(tokens[1].str(), state.origin);
+	// The file can change at any moment, and an ACME validator must see a
+	// new token at once: unless the directive says otherwise, resolvers
+	// may cache the answers for a second only
+	rr->ttl = tokens.size() > 3 ? RR::TTLFromString(tokens[3].data, tokens[3].length) : 1;
 	rr->rrclass = RR::CLASSIN;
 	rr->type = RR::DYNAMIC;
-	rr->filepath = tokens[2];
-	
-	std::cerr << "[" << current->name << "] DYNAMIC " << rr->name << " -> " << rr->filepath << std::endl;
-	current->addRecord(rr);
+	rr->filepath = tokens[2].str();
+
+	if (verbosity >= NORMAL)
+		log << "[" << state.current->name << "] DYNAMIC " << rr->name << " -> " << rr->filepath << std::endl;
+	state.current->addRecord(rr);
 }
 
-void ZoneFileLoader::handleResourceRecord(const std::vector<std::string>& tokens, Zone* current, std::string& previousName)
+void ZoneFileLoader::handleTTL(const t_tokens& tokens, State& state, std::ostream& log)
+{
+	// $TTL <ttl> (RFC 2308 section 4): the TTL of the records that follow
+	// and give none
+	if (tokens.size() < 2)
+	{
+		log << "Warning: $TTL without a TTL" << std::endl;
+		return;
+	}
+	state.default_ttl = RR::TTLFromString(tokens[1].data, tokens[1].length);
+	state.legacy_autosave = false;
+	if (verbosity >= VERBOSE)
+		log << "Default TTL " << state.default_ttl << std::endl;
+}
+
+void ZoneFileLoader::handleResourceRecord(State& state, std::ostream& log)
 {
-	// RR::fromString handles all parsing including TTL
-	// We need to first parse to find the type, then create the appropriate RR
-	
 	// Parse: name [ttl] class type rdata...
+	// This is RR::fromString over token views: only the rdata tokens are
+	// materialized, into a vector reused across records.
+	const t_tokens& tokens = state.tokens;
 	size_t idx = 1;
-	
-	// Skip TTL if present (numeric)
-	if (idx < tokens.size() && !tokens[idx].empty() && isdigit(tokens[idx][0]))
+
+	unsigned long ttl = state.default_ttl;
+	if (idx < tokens.size() && !tokens[idx].empty() && isdigit((unsigned char)tokens[idx].data[0]))
+	{
+		ttl = RR::TTLFromString(tokens[idx].data, tokens[idx].length);
 		idx++;
-	
-	// Skip class
+		if (ttl == 0 && state.legacy_autosave)
+		{
+			if (state.legacy_records++ == 0)
+				log << "Warning: " << state.origin << " was autosaved by an older build; its TTL 0 records get TTL "
+				    << LEGACY_AUTOSAVE_TTL << " until it is saved again" << std::endl;
+			ttl = LEGACY_AUTOSAVE_TTL;
+		}
+	}
+
+	RR::RRClass rrclass = RR::CLASSUNDEF;
 	if (idx < tokens.size())
+	{
+		rrclass = RR::RRClassFromString(tokens[idx].data, tokens[idx].length);
 		idx++;
-	
+	}
+
 	// Get type
 	if (idx >= tokens.size())
 		return;
-	
-	RR::RRType rrtype = RR::RRTypeFromString(tokens[idx]);
+
+	RR::RRType rrtype = RR::RRTypeFromString(tokens[idx].data, tokens[idx].length);
+	idx++;
+
+	state.rdata.resize(tokens.size() - idx);
+	for (size_t i = idx; i < tokens.size(); ++i)
+		state.rdata[i - idx].assign(tokens[i].data, tokens[i].length);
+
 	RR* rr = RR::createByType(rrtype);
-	
-	// Get origin without trailing dot for fromString processing
-	std::string origin = normalize_dns_name(current->name);
-	
-	rr->fromString(tokens, origin, previousName);
-	
+	try
+	{
+		// Handle empty name (use previous name)
+		if (tokens[0].empty() && !state.previousName.empty())
+			rr->name = process_domain_name(state.previousName, state.origin);
+		else
+			rr->name = process_domain_name(tokens[0].str(), state.origin);
+		rr->ttl = ttl;
+		rr->rrclass = rrclass;
+		rr->type = rrtype;
+		rr->fromStringContents(state.rdata, state.origin);
+	}
+	catch (...)
+	{
+		delete rr;
+		throw;
+	}
+
 	if (!tokens[0].empty())
-		previousName = rr->name;
-	
-	std::cerr << "[" << current->name << "] " << *rr << std::endl;
-	current->addRecord(rr);
+		state.previousName = rr->name;
+
+	if (verbosity >= VERBOSE)
+		log << "[" << state.current->name << "] " << *rr << std::endl;
+	state.current->addRecord(rr);
 }
 
-bool ZoneFileLoader::load(const t_data& data, t_zones& zones, const std::string& filename)
+bool ZoneFileLoader::loadLine(const char* begin, const char* end, State& state, t_zones& zones, std::ostream& log)
 {
-	Zone* z = NULL;
-	Zone* parent = NULL;
-	std::string previousName;
-	
-	for (t_data::const_iterator di = data.begin(); di != data.end(); ++di)
+	tokenize(begin, commentStart(begin, end), state.tokens);
+	const t_tokens& tokens = state.tokens;
+
+	if (tokens.size() == 0)
 	{
-		std::string line = stripComments(*di);
-		std::vector<std::string> tokens = tokenize(line);
+		size_t header = sizeof(GENERATED_HEADER) - 1;
+		if (state.current == NULL && (size_t)(end - begin) >= header && memcmp(begin, GENERATED_HEADER, header) == 0)
+			state.legacy_autosave = true;
+		return true;
+	}
 
-		if (tokens.size() == 0)
-			continue;
+	if (tokens[0].equals("$ORIGIN"))
+	{
+		if (tokens.size() >= 2)
+			handleOrigin(tokens, state, zones);
+		return true;
+	}
 
-		if (tokens[0] == "$ORIGIN")
-		{
-			if (tokens.size() < 2)
-				continue;
-			handleOrigin(tokens, parent, z, zones, previousName);
-			continue;
-		}
-		
-		if (tokens[0] == "$ACL")
-		{
-			if (tokens.size() < 2)
-				continue;
-			handleACL(tokens, parent, z);
-			continue;
-		}
-		
-		if (tokens[0] == "$AUTOSAVE")
-		{
-			handleAutoSave(tokens, parent);
-			continue;
-		}
-		
-	if (tokens[0] == "$TSIG")
+	if (tokens[0].equals("$ACL"))
 	{
-		if (tokens.size() < 4)
-		{
-			std::cerr << "Warning: Invalid $TSIG directive (needs: keyname algorithm secret)" << std::endl;
-			continue;
-		}
-		handleTSIG(tokens, parent);
-		continue;
+		if (tokens.size() >= 2)
+			handleACL(tokens, state, log);
+		return true;
 	}
-	
-	if (tokens[0] == "$DYNAMIC")
+
+	if (tokens[0].equals("$AUTOSAVE"))
 	{
-		if (tokens.size() < 3)
-		{
-			std::cerr << "Warning: Invalid $DYNAMIC directive (needs: name filepath)" << std::endl;
-			continue;
-		}
-		handleDynamic(tokens, z);
-		continue;
+		handleAutoSave(tokens, state.parent, log);
+		return true;
 	}
-		
-		if (tokens.size() < 2)
-			continue;
 
-		try
-		{
-			if (z == NULL)
-				return false;
-			
-			handleResourceRecord(tokens, z, previousName);
-		}
-		catch (std::exception& ex)
-		{
-			std::cerr << "error loading rr, line =";
-			for (std::vector<std::string>::const_iterator it = tokens.begin(); it != tokens.end(); ++it)
-				std::cerr << " " << *it;
-			std::cerr << std::endl;
-			throw;
-		}
+	if (tokens[0].equals("$TSIG"))
+	{
+		handleTSIG(tokens, state.parent, log);
+		return true;
+	}
+
+	if (tokens[0].equals("$DYNAMIC"))
+	{
+		handleDynamic(tokens, state, log);
+		return true;
+	}
+
+	if (tokens[0].equals("$TTL"))
+	{
+		handleTTL(tokens, state, log);
+		return true;
 	}
 
+	if (tokens.size() < 2)
+		return true;
+
+	if (state.current == NULL)
+		return false;
+
+	try
+	{
+		handleResourceRecord(state, log);
+	}
+	catch (std::exception& ex)
+	{
+		log << "error loading rr, line =";
+		for (t_tokens::const_iterator it = tokens.begin(); it != tokens.end(); ++it)
+			log << " " << it->str();
+		log << std::endl;
+		throw;
+	}
+	return true;
+}
+
+bool ZoneFileLoader::finish(State& state, t_zones& zones, const std::string& filename)
+{
+	Zone* parent = state.parent;
 	if (parent != NULL)
 	{
 		// Set filename for the zone
@@ -270,15 +351,110 @@ bool ZoneFileLoader::load(const t_data& data, t_zones& zones, const std::string&
 		{
 			parent->filename = filename;
 		}
-		
+
 		// Copy TSIG key to ACL zones (if any)
 		if (parent->tsig_key && parent->acl)
 		{
 			parent->acl->propagateTSIGKey(parent->tsig_key);
 		}
-		
+
 		zones.push_back(parent);
 	}
 
+	for (t_zones::iterator it = zones.begin(); it != zones.end(); ++it)
+		(*it)->shrinkToFit();
+
+	return true;
+}
+
+bool ZoneFileLoader::load(const t_data& data, t_zones& zones, const std::string& filename, std::ostream& log)
+{
+	State state;
+	for (t_data::const_iterator di = data.begin(); di != data.end(); ++di)
+	{
+		if (!loadLine(di->data(), di->data() + di->length(), state, zones, log))
+			return false;
+	}
+	return finish(state, zones, filename);
+}
+
+bool ZoneFileLoader::loadBuffer(const char* data, size_t len, t_zones& zones,
+                                const std::string& filename, std::ostream& log)
+{
+	State state;
+	const char* end = data + len;
+	const char* line = data;
+	while (line < end)
+	{
+		const char* eol = (const char*)memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		if (!loadLine(line, eol, state, zones, log))
+			return false;
+		line = eol + 1;
+	}
+	return finish(state, zones, filename);
+}
+
+bool ZoneFileLoader::loadFile(const std::string& path, t_zones& zones, std::ostream& log)
+{
+	bool ok;
+#ifdef LINUX
+	// Parse straight out of the page cache
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		log << "Error: Cannot open zone file: " << path << std::endl;
+		return false;
+	}
+
+	if (st.st_size == 0)
+	{
+		close(fd);
+		ok = loadBuffer("", 0, zones, path, log);
+	}
+	else
+	{
+		void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+		{
+			log << "Error: Cannot open zone file: " << path << std::endl;
+			return false;
+		}
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+		try
+		{
+			ok = loadBuffer((const char*)p, st.st_size, zones, path, log);
+		}
+		catch (...)
+		{
+			munmap(p, st.st_size);
+			throw;
+		}
+		munmap(p, st.st_size);
+	}
+#else
+	std::ifstream zonefile(path.c_str(), std::ios::binary);
+	if (!zonefile.good())
+	{
+		log << "Error: Cannot open zone file: " << path << std::endl;
+		return false;
+	}
+	std::ostringstream contents;
+	contents << zonefile.rdbuf();
+	std::string buffer = contents.str();
+	ok = loadBuffer(buffer.data(), buffer.length(), zones, path, log);
+#endif
+
+	if (!ok)
+	{
+		log << "Error loading zones from " << path << std::endl;
+		return false;
+	}
+
 	return true;
 }
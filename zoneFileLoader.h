@@ -3,6 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <iostream>
+#include <cstring>
+#include "rr.h"
 
 class Zone;
 
@@ -11,16 +14,65 @@ typedef std::vector<Zone*> t_zones;
 
 struct ZoneFileLoader
 {
-	static bool load(const t_data& data, t_zones& zones, const std::string& filename = "");
-	
+	// How much of a load is echoed to the log. Warnings and errors are
+	// always printed; directives from NORMAL up, every record at VERBOSE.
+	enum Verbosity { QUIET = 0, NORMAL = 1, VERBOSE = 2 };
+	static int verbosity;
+
+	// Builds before records kept their TTLs autosaved every record with
+	// TTL 0 and served 600 whatever the file said. In such files, told by
+	// their generated header and the lack of a $TTL, TTL 0 still means
+	// this; the next autosave writes the real TTLs.
+	static const unsigned long LEGACY_AUTOSAVE_TTL = 600;
+
+	// Diagnostics go to `log` so concurrent loads can keep their output apart
+	static bool load(const t_data& data, t_zones& zones, const std::string& filename = "",
+	                 std::ostream& log = std::cerr);
+	static bool loadFile(const std::string& path, t_zones& zones, std::ostream& log = std::cerr);
+	static bool loadBuffer(const char* data, size_t len, t_zones& zones,
+	                       const std::string& filename = "", std::ostream& log = std::cerr);
+
 private:
-	static std::string stripComments(const std::string& line);
-	static std::vector<std::string> tokenize(const std::string& line);
-	static void handleOrigin(const std::vector<std::string>& tokens, Zone*& parent, Zone*& current, t_zones& zones, std::string& previousName);
-	static void handleACL(const std::vector<std::string>& tokens, Zone* parent, Zone*& current);
-	static void handleAutoSave(const std::vector<std::string>& tokens, Zone* parent);
-	static void handleTSIG(const std::vector<std::string>& tokens, Zone* parent);
-	static void handleDynamic(const std::vector<std::string>& tokens, Zone* current);
-	static void handleResourceRecord(const std::vector<std::string>& tokens, Zone* current, std::string& previousName);
+	// A token is a view into the line being parsed; nothing is copied
+	// until a record's rdata is handed to RR::fromStringContents.
+	struct Token
+	{
+		const char* data;
+		size_t length;
+
+		bool empty() const { return length == 0; }
+		bool equals(const char* s) const { return strlen(s) == length && memcmp(s, data, length) == 0; }
+		std::string str() const { return std::string(data, length); }
+	};
+	typedef std::vector<Token> t_tokens;
+
+	struct State
+	{
+		State() : current(NULL), parent(NULL), default_ttl(RR::DEFAULT_TTL), legacy_autosave(false),
+		          legacy_records(0) {}
+
+		Zone* current;
+		Zone* parent;
+		std::string origin;          // current->name without the trailing dot
+		std::string previousName;
+		unsigned long default_ttl;   // Set by $TTL, for the rest of the file
+		bool legacy_autosave;        // See LEGACY_AUTOSAVE_TTL
+		size_t legacy_records;       // Records given LEGACY_AUTOSAVE_TTL
+		t_tokens tokens;             // Reused for every line
+		std::vector<std::string> rdata;
+	};
+
+	static const char* commentStart(const char* begin, const char* end);
+	static void tokenize(const char* begin, const char* end, t_tokens& tokens);
+	static bool loadLine(const char* begin, const char* end, State& state, t_zones& zones, std::ostream& log);
+	static bool finish(State& state, t_zones& zones, const std::string& filename);
+	static void setCurrent(State& state, Zone* zone);
+	static void handleOrigin(const t_tokens& tokens, State& state, t_zones& zones);
+	static void handleACL(const t_tokens& tokens, State& state, std::ostream& log);
+	static void handleAutoSave(const t_tokens& tokens, Zone* parent, std::ostream& log);
+	static void handleTSIG(const t_tokens& tokens, Zone* parent, std::ostream& log);
+	static void handleDynamic(const t_tokens& tokens, State& state, std::ostream& log);
+	static void handleTTL(const t_tokens& tokens, State& state, std::ostream& log);
+	static void handleResourceRecord(State& state, std::ostream& log);
 };
-#endif
\ No newline at end of file
+#endif
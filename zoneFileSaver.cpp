@@ -88,6 +88,11 @@ void ZoneFileSaver::writeDirectives(ostream& out, const Zone* zone, bool include
 	if (include_origin)
 	{
 		out << "$ORIGIN " << zone->name << endl;
+
+		// The SOA is written without a TTL and takes this one. A $TTL also
+		// tells the loader that the TTLs of the file are real, not those of
+		// builds that wrote 0 for every record.
+		out << "$TTL " << soaTTL(zone) << endl;
 	}
 	
 	// Write $AUTOSAVE if enabled
@@ -107,6 +112,17 @@ void ZoneFileSaver::writeDirectives(ostream& out, const Zone* zone, bool include
 	out << endl;
 }
 
+unsigned long ZoneFileSaver::soaTTL(const Zone* zone)
+{
+	const RecordStore& records = zone->records();
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		if (records.type(i) == RR::SOA)
+			return records.ttl(i);
+	}
+	return RR::DEFAULT_TTL;
+}
+
 void ZoneFileSaver::writeACLs(ostream& out, const Zone* zone)
 {
 	// Write ACL sub-zones with $ACL headers
@@ -117,7 +133,7 @@ void ZoneFileSaver::writeACLs(ostream& out, const Zone* zone)
 		for (vector<Acl::AclEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
 		{
 			// Only write ACL entry if it has records
-			if (it->zone && it->zone->getAllRecords().size() > 0)
+			if (it->zone && !it->zone->records().empty())
 			{
 				out << endl << "$ACL " << it->subnet.toString() << endl;
 				
@@ -130,45 +146,44 @@ void ZoneFileSaver::writeACLs(ostream& out, const Zone* zone)
 
 void ZoneFileSaver::writeRecords(ostream& out, const Zone* zone)
 {
-	const vector<RR*>& records = zone->getAllRecords();
+	const RecordStore& records = zone->records();
 	
 	// First write SOA
-	for (vector<RR*>::const_iterator it = records.begin(); it != records.end(); ++it)
+	for (size_t i = 0; i < records.size(); ++i)
 	{
-		RR* rr = *it;
-		if (rr->type == RR::SOA)
-		{
-			out << rr->toString() << endl;
-		}
+		if (records.type(i) == RR::SOA)
+			writeRecord(out, records, i);
 	}
 	
 	// Then write NS records
-	for (vector<RR*>::const_iterator it = records.begin(); it != records.end(); ++it)
+	for (size_t i = 0; i < records.size(); ++i)
 	{
-		RR* rr = *it;
-		if (rr->type == RR::NS)
-		{
-			out << rr->toString() << endl;
-		}
+		if (records.type(i) == RR::NS)
+			writeRecord(out, records, i);
 	}
 	
 	out << endl;
 	
 	// Then write all other records grouped by name
-	string last_name;
-	for (vector<RR*>::const_iterator it = records.begin(); it != records.end(); ++it)
+	t_name_id last_name = NameTable::UNRESOLVED;
+	for (size_t i = 0; i < records.size(); ++i)
 	{
-		RR* rr = *it;
-		
 		// Skip SOA and NS (already written)
-		if (rr->type == RR::SOA || rr->type == RR::NS)
+		if (records.type(i) == RR::SOA || records.type(i) == RR::NS)
 			continue;
 		
 		// Add blank line between different names
-		if (!last_name.empty() && rr->name != last_name)
+		if (last_name != NameTable::UNRESOLVED && records.nameId(i) != last_name)
 			out << endl;
 		
-		out << rr->toString() << endl;
-		last_name = rr->name;
+		writeRecord(out, records, i);
+		last_name = records.nameId(i);
 	}
 }
+
+void ZoneFileSaver::writeRecord(ostream& out, const RecordStore& records, size_t i)
+{
+	RR* rr = records.materialize(i);
+	out << rr->toString() << endl;
+	delete rr;
+}
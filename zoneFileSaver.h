@@ -5,6 +5,7 @@
 #include <iostream>
 
 class Zone;
+class RecordStore;
 
 class ZoneFileSaver
 {
@@ -19,7 +20,10 @@ private:
 	static void writeHeader(std::ostream& out, const Zone* zone);
 	static void writeDirectives(std::ostream& out, const Zone* zone, bool include_origin);
 	static void writeRecords(std::ostream& out, const Zone* zone);
+	static void writeRecord(std::ostream& out, const RecordStore& records, size_t i);
 	static void writeACLs(std::ostream& out, const Zone* zone);
+	// The TTL of the zone's SOA, for $TTL
+	static unsigned long soaTTL(const Zone* zone);
 };
 
 #endif
@@ -0,0 +1,676 @@
+#include "zoneImage.h"
+
+#include "zone.h"
+#include "acl.h"
+#include "rr.h"
+#include "tsig.h"
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef LINUX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char IMAGE_MAGIC[8] = {'D', 'N', 'S', 'Z', 'I', 'M', 'G', 0};
+static const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+
+// ---------------------------------------------------------------------------
+// Helpers
+
+string ZoneImage::pathFor(const string& zonefile)
+{
+	return zonefile + ".zimg";
+}
+
+string ZoneImage::canonicalKey(const string& name)
+{
+	string key;
+	key.reserve(name.length() + 1);
+
+	string::size_type end = name.length();
+	if (end > 0 && name[end - 1] == '.')
+		end--;
+
+	while (end > 0)
+	{
+		string::size_type dot = name.rfind('.', end - 1);
+		string::size_type start = (dot == string::npos) ? 0 : dot + 1;
+		key.append(name, start, end - start);
+		key += '\0';
+		if (dot == string::npos)
+			break;
+		end = dot;
+	}
+
+	return key;
+}
+
+bool ZoneImage::sourceStamp(const string& source, uint64_t& size,
+                            int64_t& mtime_sec, int64_t& mtime_nsec)
+{
+	struct stat st;
+	if (stat(source.c_str(), &st) != 0)
+		return false;
+
+	size = (uint64_t)st.st_size;
+	mtime_sec = (int64_t)st.st_mtime;
+#ifdef LINUX
+	mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#else
+	mtime_nsec = 0;
+#endif
+	return true;
+}
+
+static ZoneImage::Span appendBlob(string& blob, const char* bytes, size_t length)
+{
+	ZoneImage::Span span;
+	span.offset = (uint32_t)blob.length();
+	span.length = (uint32_t)length;
+	blob.append(bytes, length);
+	return span;
+}
+
+static ZoneImage::Span appendBlob(string& blob, const string& bytes)
+{
+	return appendBlob(blob, bytes.data(), bytes.length());
+}
+
+static void alignTo8(string& out)
+{
+	while (out.length() % 8)
+		out += '\0';
+}
+
+// Steps `offset` over an uncompressed wire name within the `len` bytes at
+// `data`, as RR::appendName writes them
+static bool skipWireName(const char* data, uint32_t len, uint32_t& offset)
+{
+	uint32_t start = offset;
+	while (offset < len)
+	{
+		unsigned char label = (unsigned char)data[offset];
+		if (label > 63)
+			return false;
+		offset += 1 + label;
+		if (offset - start > DNS_WIRE_NAME_MAX - 2)
+			return false;
+		if (label == 0)
+			return true;
+	}
+	return false;
+}
+
+// True if `data` has the layout the packRdata() of `type` writes. Image
+// rdata goes into the zone as is and is unpacked when a query needs it,
+// so a corrupt image must fail here rather than there.
+static bool validRdata(uint16_t type, const char* data, uint32_t len)
+{
+	uint32_t offset = 0;
+	switch (type)
+	{
+		case RR::A:
+			return len == 4;
+		case RR::AAAA:
+			return len == 16;
+		case RR::NS:
+		case RR::CNAME:
+		case RR::PTR:
+			return skipWireName(data, len, offset) && offset == len;
+		case RR::MX:
+			offset = 2;
+			return len > 2 && skipWireName(data, len, offset) && offset == len;
+		case RR::SOA:
+			return skipWireName(data, len, offset) && skipWireName(data, len, offset) &&
+			       offset + 20 == len;
+		case RR::TXT:
+			return len > 0 && (unsigned char)data[0] == len - 1;
+		default:
+			return true;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Compiler
+
+bool ZoneImage::compile(const t_zones& zones, const string& source,
+                        const string& image_path, string& error)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+	header.version = FORMAT_VERSION;
+	header.byte_order = IMAGE_BYTE_ORDER;
+
+	if (!sourceStamp(source, header.source_size, header.source_mtime_sec, header.source_mtime_nsec))
+	{
+		error = "cannot stat source " + source;
+		return false;
+	}
+
+	// Flatten $ORIGIN zones and their ACL sub-zones, parents first
+	vector<const Zone*> flat;
+	vector<int32_t> parents;
+	vector<string> subnets;
+	for (t_zones::const_iterator zi = zones.begin(); zi != zones.end(); ++zi)
+	{
+		const Zone* zone = *zi;
+		int32_t parent_index = (int32_t)flat.size();
+		flat.push_back(zone);
+		parents.push_back(-1);
+		subnets.push_back("");
+
+		if (!zone->acl)
+			continue;
+
+		map<const Zone*, size_t> child_index;
+		const vector<Acl::AclEntry>& entries = zone->acl->getEntries();
+		for (vector<Acl::AclEntry>::const_iterator ai = entries.begin(); ai != entries.end(); ++ai)
+		{
+			if (!ai->zone)
+				continue;
+
+			map<const Zone*, size_t>::iterator ci = child_index.find(ai->zone);
+			if (ci == child_index.end())
+			{
+				ci = child_index.insert(make_pair(ai->zone, flat.size())).first;
+				flat.push_back(ai->zone);
+				parents.push_back(parent_index);
+				subnets.push_back("");
+			}
+
+			string& list = subnets[ci->second];
+			if (!list.empty())
+				list += ' ';
+			list += ai->subnet.toString();
+		}
+	}
+
+	// Name table: every distinct owner name, in canonical order
+	map<string, string> names;   // canonical key -> owner name
+	const NameTable& name_table = NameTable::global();
+	for (size_t i = 0; i < flat.size(); ++i)
+	{
+		const RecordStore& records = flat[i]->records();
+		for (size_t ri = 0; ri < records.size(); ++ri)
+		{
+			const string& name = name_table.name(records.nameId(ri));
+			names.insert(make_pair(canonicalKey(name), name));
+		}
+	}
+
+	string blob;
+	vector<Span> name_spans;
+	map<string, uint32_t> name_index;   // owner name -> index
+	for (map<string, string>::const_iterator ni = names.begin(); ni != names.end(); ++ni)
+	{
+		string wire;
+		RR::appendName(wire, ni->second);
+		name_index[ni->second] = (uint32_t)name_spans.size();
+		name_spans.push_back(appendBlob(blob, wire));
+	}
+
+	// Zones, RRsets and rdata
+	vector<ZoneEntry> zone_entries;
+	vector<RRsetEntry> rrset_entries;
+	vector<RdataEntry> rdata_entries;
+
+	for (size_t i = 0; i < flat.size(); ++i)
+	{
+		const Zone* zone = flat[i];
+
+		ZoneEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.name = appendBlob(blob, zone->name);
+		entry.parent = parents[i];
+		entry.acl_subnets = appendBlob(blob, subnets[i]);
+		if (zone->auto_save)
+			entry.flags |= FLAG_AUTO_SAVE;
+		if (zone->tsig_key)
+		{
+			entry.flags |= FLAG_TSIG;
+			entry.tsig_name = appendBlob(blob, zone->tsig_key->name);
+			entry.tsig_algorithm = appendBlob(blob, TSIG::algorithmToName(zone->tsig_key->algorithm));
+			entry.tsig_secret = appendBlob(blob, zone->tsig_key->secret);
+		}
+
+		// Group records into RRsets, keeping zone order inside each set.
+		// Stored rdata is already in wire form and goes in as is.
+		typedef map<pair<uint32_t, pair<uint16_t, uint16_t> >, vector<size_t> > t_rrsets;
+		t_rrsets rrsets;
+		const RecordStore& records = zone->records();
+		for (size_t ri = 0; ri < records.size(); ++ri)
+		{
+			uint32_t name = name_index[name_table.name(records.nameId(ri))];
+			rrsets[make_pair(name, make_pair((uint16_t)records.type(ri), (uint16_t)records.rrclass(ri)))].push_back(ri);
+		}
+
+		entry.first_rrset = (uint32_t)rrset_entries.size();
+		for (t_rrsets::const_iterator si = rrsets.begin(); si != rrsets.end(); ++si)
+		{
+			RRsetEntry set;
+			set.name = si->first.first;
+			set.type = si->first.second.first;
+			set.rrclass = si->first.second.second;
+			set.first_rdata = (uint32_t)rdata_entries.size();
+			set.rdata_count = (uint32_t)si->second.size();
+
+			for (vector<size_t>::const_iterator ri = si->second.begin(); ri != si->second.end(); ++ri)
+			{
+				RdataEntry rdata;
+				rdata.ttl = records.ttl(*ri);
+				rdata.rdata = appendBlob(blob, records.rdata(*ri), records.rdataLength(*ri));
+				rdata_entries.push_back(rdata);
+			}
+
+			rrset_entries.push_back(set);
+		}
+		entry.rrset_count = (uint32_t)rrset_entries.size() - entry.first_rrset;
+
+		zone_entries.push_back(entry);
+	}
+
+	if (blob.length() > 0xFFFFFFFFUL)
+	{
+		error = "zone data exceeds 4GB image limit";
+		return false;
+	}
+
+	// Lay out the file: header, tables, blob (each 8-byte aligned)
+	string out(sizeof(Header), '\0');
+
+	header.zone_count = (uint32_t)zone_entries.size();
+	header.zones_offset = out.length();
+	if (!zone_entries.empty())
+		out.append((const char*)&zone_entries[0], zone_entries.size() * sizeof(ZoneEntry));
+	alignTo8(out);
+
+	header.name_count = (uint32_t)name_spans.size();
+	header.names_offset = out.length();
+	if (!name_spans.empty())
+		out.append((const char*)&name_spans[0], name_spans.size() * sizeof(Span));
+	alignTo8(out);
+
+	header.rrset_count = (uint32_t)rrset_entries.size();
+	header.rrsets_offset = out.length();
+	if (!rrset_entries.empty())
+		out.append((const char*)&rrset_entries[0], rrset_entries.size() * sizeof(RRsetEntry));
+	alignTo8(out);
+
+	header.rdata_count = (uint32_t)rdata_entries.size();
+	header.rdatas_offset = out.length();
+	if (!rdata_entries.empty())
+		out.append((const char*)&rdata_entries[0], rdata_entries.size() * sizeof(RdataEntry));
+	alignTo8(out);
+
+	header.blob_offset = out.length();
+	header.blob_size = blob.length();
+	out += blob;
+	header.file_size = out.length();
+
+	memcpy(&out[0], &header, sizeof(header));
+
+	// Write to a temporary file and rename so readers never see a partial image
+	string tmp_path = image_path + ".tmp";
+	ofstream file(tmp_path.c_str(), ios::binary | ios::trunc);
+	if (!file.good())
+	{
+		error = "cannot open " + tmp_path + " for writing";
+		return false;
+	}
+	file.write(out.data(), out.length());
+	file.close();
+	if (!file.good())
+	{
+		error = "error writing " + tmp_path;
+		remove(tmp_path.c_str());
+		return false;
+	}
+
+	if (rename(tmp_path.c_str(), image_path.c_str()) != 0)
+	{
+		error = "cannot rename " + tmp_path + " to " + image_path;
+		remove(tmp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Mapping
+
+ZoneImage::Mapping::Mapping()
+	: data_(NULL), size_(0), mapped_(false), header_(NULL), zones_(NULL),
+	  names_(NULL), rrsets_(NULL), rdatas_(NULL), blob_(NULL)
+{
+}
+
+ZoneImage::Mapping::~Mapping()
+{
+	close();
+}
+
+void ZoneImage::Mapping::close()
+{
+	if (data_)
+	{
+#ifdef LINUX
+		if (mapped_)
+			munmap(data_, size_);
+		else
+#endif
+			delete[] data_;
+	}
+	data_ = NULL;
+	size_ = 0;
+	mapped_ = false;
+	header_ = NULL;
+}
+
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t entry_size, uint64_t file_size)
+{
+	if (offset % 8 || offset > file_size)
+		return false;
+	return count <= (file_size - offset) / entry_size;
+}
+
+bool ZoneImage::Mapping::open(const string& path, string& error)
+{
+	close();
+
+#ifdef LINUX
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header))
+	{
+		::close(fd);
+		error = "image too small";
+		return false;
+	}
+
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+	{
+		error = "cannot mmap " + path;
+		return false;
+	}
+	data_ = (char*)p;
+	size_ = st.st_size;
+	mapped_ = true;
+#else
+	ifstream file(path.c_str(), ios::binary | ios::ate);
+	if (!file.good())
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	size_ = (uint64_t)file.tellg();
+	if (size_ < sizeof(Header))
+	{
+		error = "image too small";
+		size_ = 0;
+		return false;
+	}
+	data_ = new char[size_];
+	file.seekg(0);
+	file.read(data_, size_);
+#endif
+
+	header_ = (const Header*)data_;
+	if (memcmp(header_->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+		error = "not a zone image";
+	else if (header_->byte_order != IMAGE_BYTE_ORDER)
+		error = "image was compiled on a host with another byte order";
+	else if (header_->version != FORMAT_VERSION)
+		error = "unsupported image format version";
+	else if (header_->file_size != size_)
+		error = "image is truncated";
+	else if (!sectionFits(header_->zones_offset, header_->zone_count, sizeof(ZoneEntry), size_) ||
+	         !sectionFits(header_->names_offset, header_->name_count, sizeof(Span), size_) ||
+	         !sectionFits(header_->rrsets_offset, header_->rrset_count, sizeof(RRsetEntry), size_) ||
+	         !sectionFits(header_->rdatas_offset, header_->rdata_count, sizeof(RdataEntry), size_) ||
+	         !sectionFits(header_->blob_offset, header_->blob_size, 1, size_))
+		error = "image section out of bounds";
+
+	if (!error.empty())
+	{
+		close();
+		return false;
+	}
+
+	zones_ = (const ZoneEntry*)(data_ + header_->zones_offset);
+	names_ = (const Span*)(data_ + header_->names_offset);
+	rrsets_ = (const RRsetEntry*)(data_ + header_->rrsets_offset);
+	rdatas_ = (const RdataEntry*)(data_ + header_->rdatas_offset);
+	blob_ = data_ + header_->blob_offset;
+	return true;
+}
+
+bool ZoneImage::Mapping::validSpan(const Span& s) const
+{
+	return (uint64_t)s.offset + s.length <= header_->blob_size;
+}
+
+string ZoneImage::Mapping::nameText(uint32_t i) const
+{
+	unsigned int offset = 0;
+	return RR::unpackNameWithDot(const_cast<char*>(bytes(names_[i])), names_[i].length, offset);
+}
+
+bool ZoneImage::Mapping::findName(const string& name, uint32_t& index) const
+{
+	// Names are stored in wire form, so probes compare wire names in place
+	char wire[DNS_WIRE_NAME_MAX];
+	size_t length = dns_name_to_wire(name.data(), name.length(), wire);
+	if (!length)
+		return false;
+
+	uint32_t lo = 0, hi = header_->name_count;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (!validSpan(names_[mid]))
+			return false;
+		int cmp = dns_wire_canonical_compare(bytes(names_[mid]), names_[mid].length,
+		                                     wire, length);
+		if (cmp == 0)
+		{
+			index = mid;
+			return true;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+bool ZoneImage::Mapping::findRRset(uint32_t zone_index, uint32_t name_index, uint16_t type,
+                                   uint16_t rrclass, uint32_t& rrset_index) const
+{
+	if (zone_index >= header_->zone_count)
+		return false;
+
+	const ZoneEntry& z = zones_[zone_index];
+	uint32_t lo = z.first_rrset, hi = z.first_rrset + z.rrset_count;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		const RRsetEntry& s = rrsets_[mid];
+		if (s.name == name_index && s.type == type && s.rrclass == rrclass)
+		{
+			rrset_index = mid;
+			return true;
+		}
+		if (s.name < name_index ||
+		    (s.name == name_index && (s.type < type || (s.type == type && s.rrclass < rrclass))))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+// ---------------------------------------------------------------------------
+// Loader
+
+bool ZoneImage::load(const string& image_path, const string& source,
+                     t_zones& zones, string& error)
+{
+	Mapping image;
+	if (!image.open(image_path, error))
+		return false;
+
+	const Header& header = image.header();
+
+	uint64_t size;
+	int64_t mtime_sec, mtime_nsec;
+	if (!sourceStamp(source, size, mtime_sec, mtime_nsec))
+	{
+		error = "cannot stat source " + source;
+		return false;
+	}
+	if (size != header.source_size || mtime_sec != header.source_mtime_sec ||
+	    mtime_nsec != header.source_mtime_nsec)
+	{
+		error = "image is stale";
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.rrset_count; ++i)
+	{
+		const RRsetEntry& s = image.rrset(i);
+		if (s.name >= header.name_count || s.first_rdata > header.rdata_count ||
+		    s.rdata_count > header.rdata_count - s.first_rdata)
+		{
+			error = "corrupt RRset table";
+			return false;
+		}
+	}
+
+	// Names are interned once each, on first use
+	vector<t_name_id> name_ids(header.name_count, NameTable::NOT_FOUND);
+	vector<Zone*> loaded;
+	try
+	{
+		for (uint32_t zi = 0; zi < header.zone_count; ++zi)
+		{
+			const ZoneEntry& entry = image.zone(zi);
+			if (!image.validSpan(entry.name) || !image.validSpan(entry.acl_subnets) ||
+			    entry.parent >= (int32_t)zi ||
+			    entry.first_rrset > header.rrset_count ||
+			    entry.rrset_count > header.rrset_count - entry.first_rrset)
+				throw runtime_error("corrupt zone table");
+
+			Zone* zone = new Zone();
+			zone->name = image.text(entry.name);
+			zone->auto_save = (entry.flags & FLAG_AUTO_SAVE) != 0;
+			loaded.push_back(zone);
+
+			if (entry.parent < 0)
+			{
+				zone->filename = source;
+			}
+			else
+			{
+				// ACL sub-zone: attach to its $ORIGIN zone under each subnet
+				Zone* parent = loaded[entry.parent];
+				zone->parent = parent;
+				istringstream subnets(image.text(entry.acl_subnets));
+				string subnet;
+				while (subnets >> subnet)
+					parent->acl->addSubnet(subnet, zone);
+			}
+
+			if (entry.flags & FLAG_TSIG)
+			{
+				if (!image.validSpan(entry.tsig_name) || !image.validSpan(entry.tsig_algorithm) ||
+				    !image.validSpan(entry.tsig_secret))
+					throw runtime_error("corrupt TSIG entry");
+
+				TSIG::Key* key = new TSIG::Key();
+				key->name = image.text(entry.tsig_name);
+				key->algorithm = TSIG::algorithmFromName(image.text(entry.tsig_algorithm));
+				key->secret = image.text(entry.tsig_secret);
+				key->decoded_secret = TSIG::base64Decode(key->secret);
+				zone->tsig_key = key;
+			}
+
+			// Rdata is checked up front so the store is sized once
+			uint32_t end_rrset = entry.first_rrset + entry.rrset_count;
+			size_t record_count = 0, rdata_bytes = 0;
+			for (uint32_t si = entry.first_rrset; si < end_rrset; ++si)
+			{
+				const RRsetEntry& set = image.rrset(si);
+				for (uint32_t ri = set.first_rdata; ri < set.first_rdata + set.rdata_count; ++ri)
+				{
+					const RdataEntry& rdata = image.rdata(ri);
+					if (!image.validSpan(rdata.rdata) || rdata.rdata.length > 0xFFFF ||
+					    !validRdata(set.type, image.bytes(rdata.rdata), rdata.rdata.length))
+						throw runtime_error("corrupt rdata table");
+					rdata_bytes += rdata.rdata.length;
+				}
+				record_count += set.rdata_count;
+			}
+			zone->reserveRecords(record_count, rdata_bytes);
+
+			// The rdata was packed by RR::packRdata when the image was
+			// compiled and checked above, and goes in as is
+			for (uint32_t si = entry.first_rrset; si < end_rrset; ++si)
+			{
+				const RRsetEntry& set = image.rrset(si);
+				t_name_id& name_id = name_ids[set.name];
+				if (name_id == NameTable::NOT_FOUND)
+				{
+					if (!image.validSpan(image.name(set.name)))
+						throw runtime_error("corrupt name table");
+					name_id = NameTable::global().intern(image.nameText(set.name));
+				}
+
+				for (uint32_t ri = set.first_rdata; ri < set.first_rdata + set.rdata_count; ++ri)
+				{
+					const RdataEntry& rdata = image.rdata(ri);
+					zone->addRecord(name_id, (RR::RRType)set.type, (RR::RRClass)set.rrclass, rdata.ttl,
+					                image.bytes(rdata.rdata), rdata.rdata.length);
+				}
+			}
+		}
+	}
+	catch (const exception& ex)
+	{
+		// Sub-zones attached to an Acl are owned (and freed) by their parent
+		for (size_t i = 0; i < loaded.size(); ++i)
+			if (image.zone((uint32_t)i).parent < 0)
+				delete loaded[i];
+		error = ex.what();
+		return false;
+	}
+
+	// A $ORIGIN zone's shrinkToFit() builds the indexes of its sub-zones too
+	for (size_t i = 0; i < loaded.size(); ++i)
+	{
+		if (image.zone((uint32_t)i).parent < 0)
+		{
+			loaded[i]->shrinkToFit();
+			zones.push_back(loaded[i]);
+		}
+	}
+
+	return true;
+}
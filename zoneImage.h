@@ -0,0 +1,146 @@
+#ifndef HAVE_ZONEIMAGE_H
+#define HAVE_ZONEIMAGE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class Zone;
+
+typedef std::vector<Zone*> t_zones;
+
+// Compiled zone images (see ZONE_IMAGES.md)
+//
+// An image is a versioned, mmap-able binary form of everything
+// ZoneFileLoader builds from a text zone file: the zone directives, a
+// canonically sorted table of owner names in wire format and, per zone,
+// RRsets whose rdata is already in wire format. The header records the
+// size and mtime of the text file the image was compiled from so the
+// server can detect a stale image and fall back to the text file.
+class ZoneImage
+{
+public:
+	static const uint32_t FORMAT_VERSION = 1;
+
+	enum ZoneFlags { FLAG_AUTO_SAVE = 1, FLAG_TSIG = 2 };
+
+	// On-disk layout. All integers are in host byte order; the header
+	// carries a byte order marker so foreign images are rejected.
+	struct Span
+	{
+		uint32_t offset;   // Into the blob section
+		uint32_t length;
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint64_t file_size;
+		uint64_t source_size;
+		int64_t source_mtime_sec;
+		int64_t source_mtime_nsec;
+		uint32_t zone_count;
+		uint32_t name_count;
+		uint32_t rrset_count;
+		uint32_t rdata_count;
+		uint64_t zones_offset;    // ZoneEntry[zone_count]
+		uint64_t names_offset;    // Span[name_count], wire names in canonical order
+		uint64_t rrsets_offset;   // RRsetEntry[rrset_count]
+		uint64_t rdatas_offset;   // RdataEntry[rdata_count]
+		uint64_t blob_offset;
+		uint64_t blob_size;
+	};
+
+	struct ZoneEntry
+	{
+		Span name;
+		Span tsig_name;
+		Span tsig_algorithm;
+		Span tsig_secret;
+		Span acl_subnets;     // Space separated, ACL sub-zones only
+		int32_t parent;       // Index of the owning zone, -1 for $ORIGIN zones
+		uint32_t flags;
+		uint32_t first_rrset; // RRsets sorted by (name, type, class)
+		uint32_t rrset_count;
+	};
+
+	struct RRsetEntry
+	{
+		uint32_t name;        // Index into the name table
+		uint16_t type;
+		uint16_t rrclass;
+		uint32_t first_rdata;
+		uint32_t rdata_count;
+	};
+
+	struct RdataEntry
+	{
+		uint32_t ttl;
+		Span rdata;
+	};
+
+	// Read-only view of an image file (mmap'd where available)
+	class Mapping
+	{
+	public:
+		Mapping();
+		~Mapping();
+
+		bool open(const std::string& path, std::string& error);
+		void close();
+
+		const Header& header() const { return *header_; }
+		const ZoneEntry& zone(uint32_t i) const { return zones_[i]; }
+		const RRsetEntry& rrset(uint32_t i) const { return rrsets_[i]; }
+		const RdataEntry& rdata(uint32_t i) const { return rdatas_[i]; }
+		const Span& name(uint32_t i) const { return names_[i]; }
+
+		bool validSpan(const Span& s) const;
+		const char* bytes(const Span& s) const { return blob_ + s.offset; }
+		std::string text(const Span& s) const { return std::string(bytes(s), s.length); }
+		std::string nameText(uint32_t i) const;
+
+		// Index lookups: name table binary search, then RRset binary
+		// search within the zone. Return false if not present.
+		bool findName(const std::string& name, uint32_t& index) const;
+		bool findRRset(uint32_t zone_index, uint32_t name_index, uint16_t type,
+		               uint16_t rrclass, uint32_t& rrset_index) const;
+
+	private:
+		Mapping(const Mapping&);
+		Mapping& operator=(const Mapping&);
+
+		char* data_;
+		uint64_t size_;
+		bool mapped_;
+		const Header* header_;
+		const ZoneEntry* zones_;
+		const Span* names_;
+		const RRsetEntry* rrsets_;
+		const RdataEntry* rdatas_;
+		const char* blob_;
+	};
+
+	// Conventional image path for a text zone file ("<zonefile>.zimg")
+	static std::string pathFor(const std::string& zonefile);
+
+	// Write zones loaded from `source` to an image file (atomically)
+	static bool compile(const t_zones& zones, const std::string& source,
+	                    const std::string& image_path, std::string& error);
+
+	// Load zones from an image. Fails with `error` set if the image is
+	// corrupt, has another format version or is stale relative to source.
+	static bool load(const std::string& image_path, const std::string& source,
+	                 t_zones& zones, std::string& error);
+
+	// Canonical (RFC 4034 6.1) sort key: labels reversed, NUL separated
+	static std::string canonicalKey(const std::string& name);
+
+private:
+	static bool sourceStamp(const std::string& source, uint64_t& size,
+	                        int64_t& mtime_sec, int64_t& mtime_nsec);
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "zoneLoadPool.h"
+
+#include "mutex_guard.h"
+#include "zone.h"
+#include <sstream>
+#include <stdexcept>
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct LoadJob
+{
+	const vector<string>* files;
+	ZoneLoadPool::t_loader loader;
+	vector<ZoneLoadPool::Result>* results;
+	size_t next;
+	pthread_mutex_t mutex;
+};
+
+void loadOne(LoadJob* job, size_t i)
+{
+	ZoneLoadPool::Result& result = (*job->results)[i];
+	ostringstream log;
+	try
+	{
+		result.ok = job->loader((*job->files)[i], result.zones, log);
+	}
+	catch (std::exception& ex)
+	{
+		// A worker must not let a parse error escape its thread
+		log << "Error: exception loading " << (*job->files)[i] << ": " << ex.what() << endl;
+		result.ok = false;
+	}
+	if (!result.ok)
+	{
+		for (t_zones::iterator it = result.zones.begin(); it != result.zones.end(); ++it)
+			delete *it;
+		result.zones.clear();
+	}
+	result.log = log.str();
+}
+
+void* loadWorker(void* arg)
+{
+	LoadJob* job = static_cast<LoadJob*>(arg);
+	for (;;)
+	{
+		size_t i;
+		{
+			MutexGuard<pthread_mutex_t> lock(&job->mutex);
+			if (job->next >= job->files->size())
+				break;
+			i = job->next++;
+		}
+		loadOne(job, i);
+	}
+	return NULL;
+}
+
+} // namespace
+
+unsigned int ZoneLoadPool::defaultThreadCount()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (unsigned int)cpus : 1;
+}
+
+void ZoneLoadPool::loadAll(const vector<string>& files, t_loader loader,
+                           vector<Result>& results, unsigned int threads)
+{
+	results.clear();
+	results.resize(files.size());
+
+	LoadJob job;
+	job.files = &files;
+	job.loader = loader;
+	job.results = &results;
+	job.next = 0;
+	pthread_mutex_init(&job.mutex, NULL);
+
+	if (threads == 0)
+		threads = defaultThreadCount();
+	if (threads > files.size())
+		threads = (unsigned int)files.size();
+
+	// The calling thread works too; extra workers are best effort
+	vector<pthread_t> workers;
+	for (unsigned int t = 1; t < threads; ++t)
+	{
+		pthread_t worker;
+		if (pthread_create(&worker, NULL, loadWorker, &job) != 0)
+			break;
+		workers.push_back(worker);
+	}
+	loadWorker(&job);
+
+	for (size_t t = 0; t < workers.size(); ++t)
+		pthread_join(workers[t], NULL);
+	pthread_mutex_destroy(&job.mutex);
+}
@@ -0,0 +1,41 @@
+#ifndef HAVE_ZONELOADPOOL_H
+#define HAVE_ZONELOADPOOL_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+class Zone;
+
+typedef std::vector<Zone*> t_zones;
+
+// Loads independent zone files concurrently on a small pthread pool.
+//
+// Each file is parsed into its own result slot together with the
+// diagnostics it produced, so callers can merge zones and print output in
+// zone file order regardless of which worker finished first.
+class ZoneLoadPool
+{
+public:
+	// Loads one zone file, writing diagnostics to `log`. Must be safe to
+	// call concurrently for different files.
+	typedef bool (*t_loader)(const std::string& path, t_zones& zones, std::ostream& log);
+
+	struct Result
+	{
+		Result() : ok(false) {}
+
+		bool ok;
+		t_zones zones;
+		std::string log;
+	};
+
+	// Fills results[i] for files[i]. `threads` of 0 picks one worker per
+	// online CPU; the pool never has more workers than files.
+	static void loadAll(const std::vector<std::string>& files, t_loader loader,
+	                    std::vector<Result>& results, unsigned int threads = 0);
+
+	static unsigned int defaultThreadCount();
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "rr.h"
 #include "rrsoa.h"
 #include "acl.h"
+#include "dns_name.h"
 #include <iostream>
 
 using namespace std;
@@ -11,45 +12,33 @@ ZoneAuthority::ZoneAuthority(const vector<Zone*>& zones) : zones_(zones)
 }
 
 ZoneLookupResult ZoneAuthority::findZoneForName(const string& zone_name, 
-                                                 unsigned long client_addr) const
+                                                 unsigned long client_addr,
+                                                 unsigned int source_prefix) const
 {
     ZoneLookupResult result;
     Zone* best_match = NULL;
     size_t best_match_length = 0;
     
+    // Compare wire names label by label; nothing is allocated. Zone names
+    // keep their case and are compared with the case-insensitive kernel.
+    char query_wire[DNS_WIRE_NAME_MAX];
+    size_t query_length = dns_name_to_wire(zone_name.data(), zone_name.length(), query_wire);
+    
     // Find the longest matching zone (most specific)
-    for (vector<Zone*>::const_iterator ziter = zones_.begin(); ziter != zones_.end(); ++ziter)
+    for (vector<Zone*>::const_iterator ziter = zones_.begin();
+         query_length && ziter != zones_.end(); ++ziter)
     {
         Zone *z = *ziter;
         
-        // Normalize both names - ensure they end with dot for comparison
-        string query_normalized = zone_name;
-        if (query_normalized.empty() || query_normalized[query_normalized.length()-1] != '.')
-            query_normalized += '.';
-            
-        string zone_normalized = z->name;
-        if (zone_normalized.empty() || zone_normalized[zone_normalized.length()-1] != '.')
-            zone_normalized += '.';
-        
-        // Check if zone matches (exact match or suffix match)
-        bool matches = (query_normalized == zone_normalized);
-        if (!matches && query_normalized.length() >= zone_normalized.length())
-        {
-            // Check if query_normalized ends with zone_normalized
-            size_t pos = query_normalized.length() - zone_normalized.length();
-            if (query_normalized.substr(pos) == zone_normalized)
-            {
-                // Make sure there's a dot separator (or it's at the beginning)
-                if (pos == 0 || query_normalized[pos - 1] == '.')
-                    matches = true;
-            }
-        }
+        char zone_wire[DNS_WIRE_NAME_MAX];
+        size_t zone_length = dns_name_to_wire(z->name.data(), z->name.length(), zone_wire, false);
         
-        // Keep track of the longest (most specific) matching zone
-        if (matches && zone_normalized.length() > best_match_length)
+        // Exact match or a subdomain, split at a label boundary
+        if (zone_length > best_match_length &&
+            dns_wire_is_subdomain_nocase(query_wire, query_length, zone_wire, zone_length))
         {
             best_match = z;
-            best_match_length = zone_normalized.length();
+            best_match_length = zone_length;
         }
     }
     
@@ -60,7 +49,8 @@ ZoneLookupResult ZoneAuthority::findZoneForName(const string& zone_name,
         // Check ACL if present - use longest match
         if (best_match->acl && best_match->acl->size() > 0)
         {
-            Zone* acl_zone = best_match->acl->findMostSpecificMatch(client_addr);
+            Zone* acl_zone = best_match->acl->findMostSpecificMatch(client_addr, source_prefix,
+                                                                    &result.scope_prefix);
             if (acl_zone)
             {
                 // Found matching ACL entry - use its zone
@@ -10,9 +10,12 @@ struct ZoneLookupResult {
     Zone* zone;
     bool found;
     bool authorized;
+    // Leading bits of the client address the answer depends on: 0 without
+    // an ACL, else see Acl::findMostSpecificMatch
+    unsigned int scope_prefix;
     std::string error_message;
     
-    ZoneLookupResult() : zone(NULL), found(false), authorized(false) {}
+    ZoneLookupResult() : zone(NULL), found(false), authorized(false), scope_prefix(0) {}
 };
 
 // Manages a collection of zones and their access control
@@ -21,9 +24,11 @@ class ZoneAuthority {
 public:
     explicit ZoneAuthority(const std::vector<Zone*>& zones);
     
-    // Find zone by name, checking ACL if present
+    // Find zone by name, checking ACL if present. Of `client_addr` only the
+    // first `source_prefix` bits may be known, as with EDNS Client Subnet.
     ZoneLookupResult findZoneForName(const std::string& zone_name, 
-                                     unsigned long client_addr) const;
+                                     unsigned long client_addr,
+                                     unsigned int source_prefix = 32) const;
     
 private:
     const std::vector<Zone*>& zones_;